@@ -1,6 +1,28 @@
 #include "MSSpeech.h"
+#include "TSBrowserApplication.h"
+#include "TSRouteEngine.h"
+#include "TSSpeechNormalizer.h"
+#include "TSRouteTracker.h"
+#include "TSGeofence.h"
+#include "TSVocabulary.h"
+#include "TSIsochrone.h"
+#include "TSTourPlanner.h"
+#include "TSAlternativeRoutes.h"
+#include "TSNetworkAccessManager.h"
+#include "TSTilePrefetcher.h"
+#include <QSettings>
+#include <QDateTime>
 #include "comutil.h"
 
+#define WHERE_AM_I_METERS   2000   //farther buildings are not worth naming
+#define AT_BUILDING_METERS  20
+#define FIX_MAX_AGE_SECS    30     //older positions are asked again to the page
+#define GRAMMAR_PROP_POS    3      //PROPID of the positions rule in speech.xml
+#define FACILITY_COUNT      3      //buildings shown on the page for "nearest ..."
+
+//categories of poi_catalog.xml by VAL of the facilities rule in speech.xml
+static const char* facilityCategories[]={"", "restroom", "cafe", "library", "atm", "printer"};
+
 
 typedef struct{
 	TSWebProxyObject* adapter;
@@ -13,7 +35,29 @@ CComPtr<ISpRecoResult> RecoResult;
 TSWebProxyObject::TSWebProxyObject(QObject *parent) :
 QObject(parent)
 {
+	srcPoi=dstPoi=pendingPoi=0;
 	loadAddressbook();
+	autocompleteMax=8;
+	autocompleteRequest=0;
+	autocompleteTimer.setSingleShot(true);
+	autocompleteTimer.setInterval(TSBrowserApplication::routeEngine()->autocompleteDelay());
+	connect(&autocompleteTimer, SIGNAL(timeout()), this, SLOT(runAutocomplete()));
+	tracker=new TSRouteTracker(TSBrowserApplication::routeEngine(), this);
+	connect(tracker, SIGNAL(maneuverReached(int, const QString&)), this, SLOT(announceStep(int, const QString&)));
+	connect(tracker, SIGNAL(positionMatched(double, double, float)), this, SLOT(onPositionMatched(double, double, float)));
+	connect(tracker, SIGNAL(arrived()), this, SIGNAL(Arrived()));
+	connect(tracker, SIGNAL(rerouted()), this, SLOT(onRerouted()));
+	replay=new TSFixReplay(this);
+	connect(replay, SIGNAL(fixReceived(const TSFix&)), this, SLOT(onFix(const TSFix&)));
+	fences=new TSGeofenceMonitor(&TSBrowserApplication::routeEngine()->geofences(), this);
+	connect(fences, SIGNAL(entered(int)), this, SLOT(onFenceEntered(int)));
+	connect(fences, SIGNAL(exited(int)), this, SLOT(onFenceExited(int)));
+	vocabulary=new TSVocabulary(&TSBrowserApplication::routeEngine()->geocoder());
+	isochrone=new TSIsochrone(TSBrowserApplication::routeEngine());
+	tours=new TSTourPlanner(TSBrowserApplication::routeEngine());
+	alternatives=new TSAlternativeRoutes(TSBrowserApplication::routeEngine());
+	alternativeIndex=0;
+	profile=TSRouteProfile::DEFAULT;
 	isDic=false;
 	system_state=WAIT_DESTINATION;
 	m_Window=static_cast<QWidget*>(parent);
@@ -21,6 +65,15 @@ QObject(parent)
 }
 
 void TSWebProxyObject::loadAddressbook(){
+	// The catalog is the reference, the table below is kept for installs without poi_catalog.xml
+	const TSPoiCatalog& catalog = TSBrowserApplication::routeEngine()->catalog();
+	if(catalog.count()>0){
+		for(int i=0;i<catalog.pois().count();i++){
+			const TSPoi& poi=catalog.pois().at(i);
+			addressbook.insert(std::pair<ULONG,QString>(poi.id, poi.address));
+		}
+		return;
+	}
 	addressbook.insert(std::pair<ULONG,QString>(1, "3941 O'Hara Street, Pittsburgh, PA 15260"));
 	addressbook.insert(std::pair<ULONG,QString>(2, "159 Riverview Avenue, Pittsburgh, PA 15214"));
 	addressbook.insert(std::pair<ULONG,QString>(3, "4227 Fifth Avenue, Pittsburgh, PA 15260"));
@@ -68,6 +121,8 @@ void TSWebProxyObject::loadAddressbook(){
 	addressbook.insert(std::pair<ULONG,QString>(45, "230 S. Bouquet Street, Pittsburgh, PA 15260"));
 }
 
+//called on the listening thread: the commands reading the walker's position or the routing state are
+//queued to the thread of the page, which owns them
 void TSWebProxyObject::ExecuteCommand( const ULONG ulRuleID, const ULONG ulVal, const QString& command/* = QString("")*/ ){
 	switch(ulRuleID){
 	case 1:
@@ -91,6 +146,8 @@ void TSWebProxyObject::ExecuteCommand( const ULONG ulRuleID, const ULONG ulVal,
 		case 1:
 			if(system_state==WAIT_GET_PATH||system_state==WAIT_START_ROUTE){
 			    emit GetPath();
+				QMetaObject::invokeMethod(this, "clearAlternatives", Qt::QueuedConnection);
+				speakRouteSummary();
 				system_state=WAIT_START_ROUTE;
 			}
 			break;
@@ -102,15 +159,45 @@ void TSWebProxyObject::ExecuteCommand( const ULONG ulRuleID, const ULONG ulVal,
 		case 3:
 			speak("Thank you for using our system");
 			emit RouteStop();
+			srcPoi=dstPoi=0;
 			system_state=WAIT_DESTINATION;
 			break;
+		case 4:
+			QMetaObject::invokeMethod(this, "whereAmI", Qt::QueuedConnection);
+			break;
+		case 5:
+			QMetaObject::invokeMethod(this, "whatCanIReach", Qt::QueuedConnection);
+			break;
+		case 6:
+			if(system_state==WAIT_START_ROUTE){
+				QMetaObject::invokeMethod(this, "nextRoute", Qt::QueuedConnection);
+			}
+			break;
 		}
 		break;
 	case 3:
 		std::map<ULONG, QString>::iterator iter;
 		iter = addressbook.find(ulVal);
 		if(iter!=addressbook.end()){
+			pendingPoi=ulVal;
 			phraseCommand(command, iter->second);
+			pendingPoi=0;
+		}
+		else if(const TSPoi* poi=TSBrowserApplication::routeEngine()->catalog().poi(ulVal)){
+			//buildings added to the positions rule from the catalog
+			pendingPoi=ulVal;
+			phraseCommand(poi->name, poi->address);
+			pendingPoi=0;
+		}
+		break;
+	case 4:
+		if(ulVal<sizeof(facilityCategories)/sizeof(facilityCategories[0])){
+			QMetaObject::invokeMethod(this, "findFacility", Qt::QueuedConnection, Q_ARG(QString, QString(facilityCategories[ulVal])));
+		}
+		break;
+	case 5:
+		if(ulVal>0){
+			QMetaObject::invokeMethod(this, "setProfile", Qt::QueuedConnection, Q_ARG(QString, TSRouteProfile::name(ulVal-1)));
 		}
 		break;
 	}
@@ -186,13 +273,30 @@ void listenProcess(LPARAM lpParam){
 }
 
 void TSWebProxyObject::phraseCommand(const QString& command, const QString& value /*= QString("")*/){
+	//coordinates come from the catalog, the page only falls back to Google when they are NaN
+	double lat=qQNaN(), lng=qQNaN();
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	const TSPoi* poi=engine->catalog().poi(pendingPoi);
+	if(poi){
+		lat=poi->lat;
+		lng=poi->lng;
+	}
+	else{
+		TSGeocodeResult found;
+		if(engine->geocoder().resolve(value, &found)){
+			lat=found.lat;
+			lng=found.lng;
+		}
+	}
 	if(system_state==WAIT_DESTINATION){
-		emit SetDestination(command, value);
+		dstPoi=pendingPoi;
+		emit SetDestination(command, value, lat, lng);
 		system_state=WAIT_SOURCE;
 		return;
 	}
 	if(system_state==WAIT_SOURCE){
-		emit SetSource(command, value);
+		srcPoi=pendingPoi;
+		emit SetSource(command, value, lat, lng);
 		system_state=WAIT_GET_PATH;
 		return;
 	}
@@ -243,6 +347,12 @@ void TSWebProxyObject::init(HWND dlg){
 	{
 		return;
 	}
+	//a kiosk knows where it stands before any fix
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	QStringList kiosk=settings.value("grammar/KioskPosition").toString().split(',');
+	if(kiosk.count()==2&&vocabulary->update(kiosk[0].toDouble(), kiosk[1].toDouble())){
+		refreshPositionsRule();
+	}
 }
 
 void TSWebProxyObject::speak(QString content){
@@ -250,6 +360,7 @@ void TSWebProxyObject::speak(QString content){
 	if(!pSpVoice){
 		return;
 	}
+	content=TSSpeechNormalizer::standard().normalize(content);//abbreviations, ZIP codes and house numbers
 	// required size
 	WCHAR* str = new WCHAR[content.length() + 1];
 	content.toWCharArray(str);
@@ -353,3 +464,667 @@ void TSWebProxyObject::endListening(){
 
 }
 
+//walking distance, time and first instruction, from the precomputed building table unless paths are closed
+QVariantMap TSWebProxyObject::routeSummary(int srcPoi, int dstPoi){
+	QVariantMap summary;
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	TSRouteTable::Cell cell;
+	bool found=engine->summary(srcPoi, dstPoi, &cell);
+	summary["found"]=found;
+	if(!found){
+		return summary;
+	}
+	summary["meters"]=cell.meters;
+	summary["seconds"]=cell.seconds;
+	summary["instruction"]=cell.instruction;
+	return summary;
+}
+
+void TSWebProxyObject::speakRouteSummary(){
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	const TSPoi* src=engine->catalog().poi(srcPoi);
+	const TSPoi* dst=engine->catalog().poi(dstPoi);
+	TSRouteTable::Cell cell;
+	if(!src||!dst||!engine->summary(srcPoi, dstPoi, &cell)){
+		return;
+	}
+	int minutes=qMax(1, qRound(cell.seconds/60));
+	QString text=QString("%1 is %2 meters from %3, about %4 minutes walk.")
+		.arg(dst->name).arg(qRound(cell.meters)).arg(src->name).arg(minutes);
+	if(!cell.instruction.isEmpty()){
+		text+=" "+cell.instruction+".";
+	}
+	speak(text);
+}
+
+static QVariantMap geocodeResultMap(const TSPoiCatalog& catalog, const TSGeocodeResult& r){
+	QVariantMap map;
+	const TSPoi* poi=catalog.poi(r.poiId);
+	map["id"]=r.poiId;
+	map["name"]=poi->name;
+	map["address"]=poi->address;
+	map["lat"]=r.lat;
+	map["lng"]=r.lng;
+	map["match"]=TSGeocoder::matchName(r.match);
+	return map;
+}
+
+QVariantMap TSWebProxyObject::geocode(const QString& address){
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	QList<TSGeocodeResult> found=engine->geocoder().geocode(address, 1);
+	if(found.isEmpty()){
+		return QVariantMap();
+	}
+	return geocodeResultMap(engine->catalog(), found.first());
+}
+
+QVariantList TSWebProxyObject::reverseGeocode(double lat, double lng, int count){
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	QList<TSGeocodeResult> found=engine->geocoder().reverse(lat, lng, count);
+	QVariantList list;
+	for(int i=0;i<found.count();i++){
+		list.append(geocodeResultMap(engine->catalog(), found[i]));
+	}
+	return list;
+}
+
+QVariantList TSWebProxyObject::poisInBounds(double south, double west, double north, double east){
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	QList<TSGeocodeResult> found=engine->geocoder().withinBox(south, west, north, east);
+	QVariantList list;
+	for(int i=0;i<found.count();i++){
+		list.append(geocodeResultMap(engine->catalog(), found[i]));
+	}
+	return list;
+}
+
+QVariantList TSWebProxyObject::routeSteps(const QString& source, const QString& destination){
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	QVariantList steps;
+	TSGeocodeResult src, dst;
+	if(!engine->geocoder().resolve(source, &src)||!engine->geocoder().resolve(destination, &dst)){
+		return steps;
+	}
+	//the default walk leaves now and only crosses open buildings, repeated asks come from the cache
+	TSCachedRoute walk=engine->walk(src.poiId, dst.poiId, profile, QDateTime::currentDateTime());
+	TSBrowserApplication::networkAccessManager()->prefetcher()->prefetch(walk.shape);
+	for(int i=0;i<walk.route.maneuvers.count();i++){
+		const TSManeuver& m=walk.route.maneuvers[i];
+		QVariantMap step;
+		step["type"]=m.type;
+		step["angle"]=m.angle;
+		step["street"]=m.street;
+		step["lat"]=m.lat;
+		step["lng"]=m.lng;
+		step["meters"]=m.meters;
+		step["seconds"]=m.seconds;
+		step["landmark"]=m.landmark;
+		step["text"]=m.text;
+		step["speech"]=walk.speech[i];
+		steps.append(step);
+	}
+	return steps;
+}
+
+//every keystroke restarts the timer, only the last term of a burst is looked up
+int TSWebProxyObject::autocomplete(const QString& term, int maxResults){
+	autocompleteTerm=term;
+	autocompleteMax=maxResults;
+	autocompleteTimer.start();
+	return ++autocompleteRequest;
+}
+
+void TSWebProxyObject::cancelAutocomplete(){
+	autocompleteTimer.stop();
+	++autocompleteRequest;
+}
+
+void TSWebProxyObject::runAutocomplete(){
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	QList<TSAutocompleteHit> hits=engine->autocomplete().complete(autocompleteTerm, autocompleteMax);
+	QVariantList items;
+	for(int i=0;i<hits.count();i++){
+		const TSPoi* poi=engine->catalog().poi(hits[i].poiId);
+		QVariantMap item;
+		item["id"]=poi->id;
+		item["label"]=poi->name+" - "+poi->address;
+		item["value"]=poi->address;
+		item["lat"]=poi->lat;
+		item["lng"]=poi->lng;
+		items.append(item);
+	}
+	emit AutocompleteReady(autocompleteRequest, items);
+}
+
+//the walker is followed natively when both ends are catalog buildings on the walking graph
+bool TSWebProxyObject::startGuidance(const QString& source, const QString& destination){
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	TSGeocodeResult src, dst;
+	if(!engine->geocoder().resolve(source, &src)||!engine->geocoder().resolve(destination, &dst)){
+		return false;
+	}
+	//the walk picked by "next route" if any, alternatives are default walks
+	TSRoute route;
+	int walkProfile=profile;
+	if(alternatives->isActive(src.poiId, dst.poiId)){
+		route=alternatives->routes()[alternativeIndex];
+		walkProfile=TSRouteProfile::DEFAULT;
+	}
+	else{
+		route=engine->walk(src.poiId, dst.poiId, profile, QDateTime::currentDateTime()).route;
+	}
+	if(route.isEmpty()){
+		return false;
+	}
+	tracker->start(route, walkProfile);
+	if(route.wait>=60){
+		speak(QString("A building on the way is closed, the walk waits about %1 minutes for it to open.").arg(qRound(route.wait/60)));
+	}
+
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	QString replayFile=settings.value("tracking/ReplayFile").toString();
+	if(!replayFile.isEmpty()){
+		replay->start(replayFile, settings.value("tracking/ReplaySpeed", 1.0).toDouble());
+	}
+	return true;
+}
+
+void TSWebProxyObject::stopGuidance(){
+	replay->stop();
+	tracker->stop();
+	fences->reset();
+}
+
+bool TSWebProxyObject::isGuiding(){
+	return tracker->isActive();
+}
+
+void TSWebProxyObject::updatePosition(double lat, double lng, double accuracy){
+	TSFix fix;
+	QDateTime now=QDateTime::currentDateTime().toUTC();
+	fix.time=(qint64)now.toTime_t()*1000+now.time().msec();
+	fix.lat=lat;
+	fix.lng=lng;
+	fix.accuracy=(float)accuracy;
+	fix.speed=-1;
+	fix.heading=-1;
+	onFix(fix);
+}
+
+void TSWebProxyObject::onFix(const TSFix& fix){
+	lastFix=fix;
+	lastFixAt=QDateTime::currentDateTime();
+	if(vocabulary->update(fix.lat, fix.lng)){
+		refreshPositionsRule();
+	}
+	fences->update(fix.lat, fix.lng);
+	tracker->processFix(fix);
+}
+
+static QString fenceKind(TSGeofence::Kind kind){
+	switch(kind){
+	case TSGeofence::APPROACH:
+		return "approach";
+	case TSGeofence::ENTRANCE:
+		return "entrance";
+	default:
+		return "footprint";
+	}
+}
+
+//only the approach of the destination is spoken among the approach circles, the campus is dense
+void TSWebProxyObject::onFenceEntered(int fence){
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	const TSGeofence& f=engine->geofences().fence(fence);
+	const TSPoi* poi=engine->catalog().poi(f.poiId);
+	if(!poi){
+		return;
+	}
+	emit GeofenceEntered(f.poiId, fenceKind(f.kind), poi->name);
+
+	switch(f.kind){
+	case TSGeofence::APPROACH:
+		if(tracker->isActive()&&tracker->route().dstPoi==f.poiId){
+			speak(QString("You are arriving at %1.").arg(poi->name));
+		}
+		break;
+	case TSGeofence::ENTRANCE:
+		speak(QString("You are at the entrance of %1.").arg(poi->name));
+		break;
+	default:
+		speak(QString("You are at %1.").arg(poi->name));
+		break;
+	}
+}
+
+void TSWebProxyObject::onFenceExited(int fence){
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	const TSGeofence& f=engine->geofences().fence(fence);
+	const TSPoi* poi=engine->catalog().poi(f.poiId);
+	if(poi){
+		emit GeofenceExited(f.poiId, fenceKind(f.kind), poi->name);
+	}
+}
+
+void TSWebProxyObject::announceStep(int index, const QString& text){
+	emit StepReached(index, text);
+	speak(text);
+}
+
+//the first step of the new route follows at once
+void TSWebProxyObject::onRerouted(){
+	emit Rerouted();
+	speak("You left the route. New route.");
+}
+
+void TSWebProxyObject::onPositionMatched(double lat, double lng, float routeOffset){
+	Q_UNUSED(routeOffset);
+	emit PositionUpdated(lat, lng);
+}
+
+QVariantList TSWebProxyObject::nearestBuildings(double lat, double lng, int count){
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	QList<TSNearbyPoi> near=engine->geocoder().nearby(lat, lng, count);
+	QVariantList list;
+	for(int i=0;i<near.count();i++){
+		const TSPoi* poi=engine->catalog().poi(near[i].poiId);
+		QVariantMap map;
+		map["id"]=poi->id;
+		map["name"]=poi->name;
+		map["meters"]=near[i].meters;
+		map["bearing"]=near[i].bearing;
+		map["direction"]=TSManeuverBuilder::compassPoint(near[i].bearing);
+		list.append(map);
+	}
+	return list;
+}
+
+//"You are 40 meters south of Cathedral of Learning. Also near: Alumni Hall and Clapp Hall."
+QString TSWebProxyObject::describePosition(double lat, double lng){
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	QList<TSNearbyPoi> near=engine->geocoder().nearby(lat, lng, 3, WHERE_AM_I_METERS);
+	QString text;
+	if(near.isEmpty()){
+		text="No building of the campus is near you.";
+	}
+	else{
+		QString name=engine->catalog().poi(near[0].poiId)->name;
+		if(near[0].meters<AT_BUILDING_METERS){
+			text=QString("You are at %1.").arg(name);
+		}
+		else{
+			//the side of the building the walker is on, hence the reversed bearing
+			text=QString("You are %1 %2 of %3.").arg(TSManeuverBuilder::spokenDistance(near[0].meters))
+				.arg(TSManeuverBuilder::compassPoint(near[0].bearing+180)).arg(name);
+		}
+		QStringList others;
+		for(int i=1;i<near.count();i++){
+			others.append(engine->catalog().poi(near[i].poiId)->name);
+		}
+		if(others.count()==1){
+			text+=QString(" Also near: %1.").arg(others[0]);
+		}
+		else if(others.count()==2){
+			text+=QString(" Also near: %1 and %2.").arg(others[0]).arg(others[1]);
+		}
+	}
+	speak(text);
+	return text;
+}
+
+void TSWebProxyObject::whereAmI(){
+	if(lastFixAt.isValid()&&lastFixAt.secsTo(QDateTime::currentDateTime())<FIX_MAX_AGE_SECS){
+		describePosition(lastFix.lat, lastFix.lng);
+	}
+	else{
+		emit WhereAmI();
+	}
+}
+
+//[{seconds, pois:[{id, name, seconds}], outlines:[[[lat, lng], ...], ...]}, ...], closest buildings first
+QVariantList TSWebProxyObject::reachable(double lat, double lng, const QVariantList& minutes){
+	QList<int> seconds;
+	for(int i=0;i<minutes.count();i++){
+		if(minutes[i].toDouble()>0){
+			seconds.append((int)(minutes[i].toDouble()*60));
+		}
+	}
+	if(seconds.isEmpty()){
+		seconds=isochrone->defaultBands();
+	}
+	const TSPoiCatalog& catalog=TSBrowserApplication::routeEngine()->catalog();
+	QList<TSIsochroneBand> bands=isochrone->compute(lat, lng, seconds);
+	QVariantList list;
+	for(int b=0;b<bands.count();b++){
+		QVariantList pois;
+		for(int i=0;i<bands[b].poiIds.count();i++){
+			QVariantMap poi;
+			poi["id"]=bands[b].poiIds[i];
+			poi["name"]=catalog.poi(bands[b].poiIds[i])->name;
+			poi["seconds"]=bands[b].poiSeconds[i];
+			pois.append(poi);
+		}
+		QVariantList outlines;
+		for(int k=0;k<bands[b].outlines.count();k++){
+			QVariantList ring;
+			const QVector<QPointF>& outline=bands[b].outlines[k];
+			for(int i=0;i<outline.count();i++){
+				QVariantList point;
+				point.append(outline[i].y());
+				point.append(outline[i].x());
+				ring.append(QVariant(point));
+			}
+			outlines.append(QVariant(ring));
+		}
+		QVariantMap band;
+		band["seconds"]=bands[b].seconds;
+		band["pois"]=pois;
+		band["outlines"]=outlines;
+		list.append(band);
+	}
+	return list;
+}
+
+//"In 5 minutes you can reach 3 buildings, the closest is Alumni Hall. In 10 minutes, 12 buildings."
+QVariantList TSWebProxyObject::announceReach(double lat, double lng){
+	QVariantList bands=reachable(lat, lng);
+	QString text;
+	for(int b=0;b<bands.count();b++){
+		QVariantMap band=bands[b].toMap();
+		QVariantList pois=band["pois"].toList();
+		int minutes=band["seconds"].toInt()/60;
+		if(b==0){
+			text=QString("In %1 minutes you can reach %2 buildings").arg(minutes).arg(pois.count());
+			if(!pois.isEmpty()){
+				text+=QString(", the closest is %1").arg(pois[0].toMap()["name"].toString());
+			}
+			text+=".";
+		}
+		else{
+			text+=QString(" In %1 minutes, %2 buildings.").arg(minutes).arg(pois.count());
+		}
+	}
+	if(bands.isEmpty()){
+		text="You are too far from the campus paths.";
+	}
+	speak(text);
+	emit ReachableReady(bands);
+	return bands;
+}
+
+void TSWebProxyObject::whatCanIReach(){
+	if(lastFixAt.isValid()&&lastFixAt.secsTo(QDateTime::currentDateTime())<FIX_MAX_AGE_SECS){
+		announceReach(lastFix.lat, lastFix.lng);
+	}
+	else{
+		emit ReachRequested();
+	}
+}
+
+//[{id, name, address, lat, lng, seconds, meters, steps:[text, ...]}, ...]
+QVariantList TSWebProxyObject::nearestFacilities(double lat, double lng, const QString& category, int count){
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	QList<TSFacility> found=engine->nearestFacilities(lat, lng, category, count);
+	QVariantList list;
+	for(int i=0;i<found.count();i++){
+		const TSPoi* poi=engine->catalog().poi(found[i].poiId);
+		QVariantList steps;
+		for(int k=0;k<found[i].route.maneuvers.count();k++){
+			steps.append(found[i].route.maneuvers[k].text);
+		}
+		QVariantMap map;
+		map["id"]=poi->id;
+		map["name"]=poi->name;
+		map["address"]=poi->address;
+		map["lat"]=poi->lat;
+		map["lng"]=poi->lng;
+		map["seconds"]=found[i].seconds;
+		map["meters"]=found[i].meters;
+		map["steps"]=steps;
+		list.append(map);
+	}
+	return list;
+}
+
+//"The nearest restroom is in Sennott Square, 200 meters, about 3 minutes walk. Head north on ..."
+QVariantList TSWebProxyObject::announceFacility(double lat, double lng, const QString& category){
+	QVariantList list=nearestFacilities(lat, lng, category, FACILITY_COUNT);
+	if(list.isEmpty()){
+		speak(QString("No %1 is known near you.").arg(category));
+		return list;
+	}
+	QVariantMap first=list[0].toMap();
+	QString text;
+	if(first["steps"].toList().isEmpty()){
+		text=QString("The nearest %1 is in %2, where you are.").arg(category).arg(first["name"].toString());
+	}
+	else{
+		int minutes=qMax(1, qRound(first["seconds"].toDouble()/60));
+		text=QString("The nearest %1 is in %2, %3 meters, about %4 minutes walk. %5.").arg(category)
+			.arg(first["name"].toString()).arg(qRound(first["meters"].toDouble())).arg(minutes)
+			.arg(first["steps"].toList()[0].toString());
+	}
+	speak(text);
+
+	//the walker's position stands for the source, the building becomes the destination
+	dstPoi=first["id"].toInt();
+	srcPoi=0;
+	emit SetDestination(first["name"].toString(), first["address"].toString(), first["lat"].toDouble(), first["lng"].toDouble());
+	system_state=WAIT_GET_PATH;
+	emit FacilityFound(list);
+	return list;
+}
+
+void TSWebProxyObject::findFacility(const QString& category){
+	if(lastFixAt.isValid()&&lastFixAt.secsTo(QDateTime::currentDateTime())<FIX_MAX_AGE_SECS){
+		announceFacility(lastFix.lat, lastFix.lng, category);
+	}
+	else{
+		emit FacilityRequested(category);
+	}
+}
+
+//{points, levels} of a walk, encoded polyline and the zoom each point shows from, see TSPolyline;
+//passages through buildings follow their corridors, the map tiles along the walk are prefetched
+static QVariantMap routePath(const TSRouteEngine* engine, const TSRoute& route){
+	QVector<QPointF> shape=engine->shape(route);
+	TSBrowserApplication::networkAccessManager()->prefetcher()->prefetch(shape);
+	return engine->polyline().toVariant(shape);
+}
+
+//{stops:[{id, name, lat, lng}], seconds, meters, legs:[{seconds, meters, path:{points, levels}, steps:[text, ...]}]},
+//empty when a stop is unknown or cannot be walked to
+QVariantMap TSWebProxyObject::planTour(const QVariantList& stops, bool roundTrip){
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	QList<int> ids;
+	for(int i=0;i<stops.count();i++){
+		bool isId=false;
+		int id=stops[i].toInt(&isId);
+		if(!isId||!engine->catalog().poi(id)){
+			TSGeocodeResult found;
+			if(!engine->geocoder().resolve(stops[i].toString(), &found)){
+				return QVariantMap();
+			}
+			id=found.poiId;
+		}
+		ids.append(id);
+	}
+
+	TSTour tour=tours->plan(ids, roundTrip);
+	if(tour.isEmpty()){
+		speak("These buildings cannot be visited on foot.");
+		return QVariantMap();
+	}
+
+	QVariantList stopList;
+	QStringList names;
+	for(int i=0;i<tour.stops.count();i++){
+		const TSPoi* poi=engine->catalog().poi(tour.stops[i]);
+		QVariantMap stop;
+		stop["id"]=poi->id;
+		stop["name"]=poi->name;
+		stop["lat"]=poi->lat;
+		stop["lng"]=poi->lng;
+		stopList.append(stop);
+		names.append(poi->name);
+	}
+	QVariantList legs;
+	for(int i=0;i<tour.legs.count();i++){
+		const TSRoute& route=tour.legs[i];
+		QVariantList steps;
+		for(int k=0;k<route.maneuvers.count();k++){
+			steps.append(route.maneuvers[k].text);
+		}
+		float seconds=0;
+		for(int k=0;k<route.maneuvers.count();k++){
+			seconds+=route.maneuvers[k].seconds;
+		}
+		QVariantMap leg;
+		leg["seconds"]=seconds;
+		leg["meters"]=route.meters();
+		leg["path"]=routePath(engine, route);
+		leg["steps"]=steps;
+		legs.append(leg);
+	}
+
+	//"Visit Allen Hall, then Benedum Hall, then Thaw Hall, and back. About 12 minutes walk."
+	QString text=QString("Visit %1%2. About %3 minutes walk.").arg(names.join(", then "))
+		.arg(roundTrip?", and back":"").arg(qMax(1, qRound(tour.seconds/60)));
+	speak(text);
+
+	QVariantMap map;
+	map["stops"]=stopList;
+	map["seconds"]=tour.seconds;
+	map["meters"]=tour.meters;
+	map["legs"]=legs;
+	return map;
+}
+
+//{index, count, meters, seconds, path:{points, levels}, steps:[text, ...]}, empty when the buildings are not both known
+QVariantMap TSWebProxyObject::nextRoute(){
+	const TSRouteEngine* engine=TSBrowserApplication::routeEngine();
+	QVariantMap map;
+	if(!alternatives->isActive(srcPoi, dstPoi)){
+		alternativeIndex=0;
+		if(alternatives->start(srcPoi, dstPoi).isEmpty()){
+			speak("No other route is known for this walk.");
+			return map;
+		}
+	}
+
+	const QList<TSRoute>& routes=alternatives->routes();
+	QString text;
+	if(alternativeIndex+1<routes.count()||!alternatives->next().isEmpty()){
+		alternativeIndex++;
+	}
+	else{
+		alternativeIndex=0;
+		text=routes.count()>1?"No other route. Back to the shortest route. ":"No other route. ";
+	}
+
+	const TSRoute& route=routes[alternativeIndex];
+	float seconds=0;
+	QVariantList steps;
+	for(int k=0;k<route.maneuvers.count();k++){
+		seconds+=route.maneuvers[k].seconds;
+		steps.append(route.maneuvers[k].text);
+	}
+	float shortest=0;
+	for(int k=0;k<routes[0].maneuvers.count();k++){
+		shortest+=routes[0].maneuvers[k].seconds;
+	}
+
+	//"Route 2: 850 meters, about 11 minutes, 2 minutes longer. Head east on Fifth Avenue."
+	text+=QString("Route %1: %2 meters, about %3 minutes").arg(alternativeIndex+1).arg(qRound(route.meters()))
+		.arg(qMax(1, qRound(seconds/60)));
+	if(alternativeIndex>0){
+		text+=QString(", %1 minutes longer").arg(qMax(1, qRound((seconds-shortest)/60)));
+	}
+	text+=".";
+	if(!steps.isEmpty()){
+		text+=" "+steps[0].toString()+".";
+	}
+	speak(text);
+
+	map["index"]=alternativeIndex;
+	map["count"]=routes.count();
+	map["meters"]=route.meters();
+	map["seconds"]=seconds;
+	map["path"]=routePath(engine, route);
+	map["steps"]=steps;
+	emit AlternativeRoute(map);
+	return map;
+}
+
+//native walks of the page and of the guidance follow the profile, the page is told to route again
+bool TSWebProxyObject::setProfile(const QString& name){
+	int p=TSRouteProfile::fromName(name);
+	if(p<0){
+		speak("Unknown route profile.");
+		return false;
+	}
+	profile=p;
+	if(p==TSRouteProfile::DEFAULT){
+		speak("Using the shortest route.");
+	}
+	else{
+		speak(QString("Using the %1 route.").arg(TSRouteProfile::name(p)));
+	}
+	emit ProfileChanged(TSRouteProfile::name(p));
+	return true;
+}
+
+//the alternatives are only searched and walked through on the thread of the page
+void TSWebProxyObject::clearAlternatives(){
+	alternatives->clear();
+}
+
+QStringList TSWebProxyObject::profiles(){
+	QStringList names;
+	for(int p=0;p<TSRouteProfile::COUNT;p++){
+		names.append(TSRouteProfile::name(p));
+	}
+	return names;
+}
+
+//the positions rule holds the names and aliases of the buildings around the walker,
+//it is only rebuilt when the vocabulary changes
+void TSWebProxyObject::refreshPositionsRule(){
+	if(!cpRecoGrammar||!vocabulary->isBiased()){
+		return;
+	}
+	SPSTATEHANDLE hRule;
+	HRESULT hr=cpRecoGrammar->GetRule(L"positions", 0, SPRAF_TopLevel|SPRAF_Active|SPRAF_Dynamic, FALSE, &hRule);
+	if(FAILED(hr)){
+		return;
+	}
+	hr=cpRecoGrammar->ClearRule(hRule);
+	if(FAILED(hr)){
+		return;
+	}
+
+	const TSPoiCatalog& catalog=TSBrowserApplication::routeEngine()->catalog();
+	const QList<int>& ids=vocabulary->active();
+	for(int i=0;i<ids.count();i++){
+		const TSPoi* poi=catalog.poi(ids[i]);
+		if(!poi){
+			continue;
+		}
+		SPPROPERTYINFO prop;
+		memset(&prop, 0, sizeof(prop));
+		prop.pszName=L"POSITIONS";
+		prop.ulId=GRAMMAR_PROP_POS;
+		prop.vValue.vt=VT_UI4;
+		prop.vValue.ulVal=poi->id;
+
+		QStringList phrases=QStringList(poi->name)+poi->aliases;
+		for(int k=0;k<phrases.count();k++){
+			WCHAR* str=new WCHAR[phrases[k].length()+1];
+			phrases[k].toWCharArray(str);
+			str[phrases[k].length()]=L'\0';
+			cpRecoGrammar->AddWordTransition(hRule, NULL, str, L" ", SPWT_LEXICAL, 1.0f, &prop);
+			delete[] str;
+		}
+	}
+	cpRecoGrammar->Commit(0);
+}
@@ -2,6 +2,7 @@
 #define _MS_SPEECH_DX
 
 #include "TSWebApp.h"
+#include "TSPositionSource.h"
 
 #include <sapi.h>
 #include <sphelper.h>
@@ -13,6 +14,8 @@
 #include <QMap>
 #include <QStringList>
 #include <QVariant>
+#include <QTimer>
+#include <QDateTime>
 #include <map>
 
 #pragma comment(lib,"ole32.lib")   //CoInitialize CoCreateInstanceҪole32.dll
@@ -39,11 +42,18 @@
 #define WAIT_STOP_ROUTE 4
 
 
+class TSRouteTracker;
+class TSGeofenceMonitor;
+class TSVocabulary;
+class TSIsochrone;
+class TSTourPlanner;
+class TSAlternativeRoutes;
+
 class TSWebProxyObject:public QObject{
 	Q_OBJECT
 public:
 	explicit TSWebProxyObject(QObject *parent = 0);
-	virtual ~TSWebProxyObject(){};
+	virtual ~TSWebProxyObject(){delete vocabulary;delete isochrone;delete tours;delete alternatives;};
 	void init(HWND dlg);//set callback function for receiving what the machine has heard & init the MSSpeach
 
 	HWND m_hWnd;
@@ -58,14 +68,46 @@ public:
 	QWidget*                    m_Window;
 	int                         system_state;
 	std::map<ULONG,QString>        addressbook;
+	ULONG                       srcPoi;        // catalog id of the spoken source building, 0 if none
+	ULONG                       dstPoi;
+	ULONG                       pendingPoi;
+	QTimer                      autocompleteTimer;   // debounces the keystrokes of the address boxes
+	QString                     autocompleteTerm;
+	int                         autocompleteMax;
+	int                         autocompleteRequest; // id of the latest request, older ones are dropped
+	TSRouteTracker*             tracker;             // follows the walker once the route is started
+	TSFixReplay*                replay;              // recorded walk standing in for a receiver
+	TSGeofenceMonitor*          fences;              // buildings the walker is near or in
+	TSFix                       lastFix;
+	QDateTime                   lastFixAt;           // when lastFix came in, invalid until the first fix
+	TSVocabulary*               vocabulary;          // buildings of the positions rule around the walker
+	TSIsochrone*                isochrone;           // what can be reached on foot from a position
+	TSTourPlanner*              tours;               // visiting order of several buildings
+	TSAlternativeRoutes*        alternatives;        // other walks between srcPoi and dstPoi, for "next route"
+	int                         alternativeIndex;    // walk shown among alternatives->routes()
+	int                         profile;             // TSRouteProfile of the native walks
 
 signals:
 	void                        RouteStart();
 	void                        RouteStop();
 	void                        GetPath();
-	void                        SetDestination(QString des, QString bldgName);
-	void                        SetSource(QString source, QString bldgName);
+	void                        SetDestination(QString des, QString bldgName, double lat, double lng);//lat/lng are NaN when the address is not in the catalog
+	void                        SetSource(QString source, QString bldgName, double lat, double lng);
 	void                        UNRECOGNIZED(QString content);
+	void                        AutocompleteReady(int requestId, QVariantList items);
+	void                        StepReached(int index, QString text);
+	void                        PositionUpdated(double lat, double lng);
+	void                        Arrived();
+	void                        Rerouted();
+	void                        GeofenceEntered(int poiId, QString kind, QString name);
+	void                        GeofenceExited(int poiId, QString kind, QString name);
+	void                        WhereAmI();//no recent fix, the page is asked for a position
+	void                        ReachRequested();//same for "what can I reach", answered by announceReach
+	void                        ReachableReady(QVariantList bands);
+	void                        FacilityRequested(QString category);//same for "nearest restroom", answered by announceFacility
+	void                        FacilityFound(QVariantList facilities);
+	void                        AlternativeRoute(QVariantMap route);
+	void                        ProfileChanged(QString name);
 
 public slots:
 		void                        speak(QString) ;
@@ -78,6 +120,42 @@ public slots:
 		void                        switchToDic();
 		void                        switchToReco();
 		void                        loadAddressbook();
+		QVariantMap                 routeSummary(int srcPoi, int dstPoi);//precomputed walk between two buildings
+		void                        speakRouteSummary();
+		QVariantMap                 geocode(const QString& address);//native geocoding, empty map when unknown; match "street" is only a suggestion
+		QVariantList                reverseGeocode(double lat, double lng, int count = 1);
+		QVariantList                poisInBounds(double south, double west, double north, double east);
+		QVariantList                routeSteps(const QString& source, const QString& destination);//native turn-by-turn, empty if not a catalog walk
+		int                         autocomplete(const QString& term, int maxResults = 8);//answered by AutocompleteReady
+		void                        cancelAutocomplete();
+		bool                        startGuidance(const QString& source, const QString& destination);//false if the walk is not native
+		void                        stopGuidance();
+		bool                        isGuiding();
+		void                        updatePosition(double lat, double lng, double accuracy);//live fix from the page
+		QVariantList                nearestBuildings(double lat, double lng, int count = 3);
+		QString                     describePosition(double lat, double lng);//spoken as well
+		void                        whereAmI();
+		QVariantList                reachable(double lat, double lng, const QVariantList& minutes = QVariantList());//bands of isochrone, default minutes of app_config.ini
+		QVariantList                announceReach(double lat, double lng);//spoken as well
+		void                        whatCanIReach();
+		QVariantList                nearestFacilities(double lat, double lng, const QString& category, int count = 3);//closest first
+		QVariantList                announceFacility(double lat, double lng, const QString& category);//spoken and set as destination
+		void                        findFacility(const QString& category);
+		QVariantMap                 planTour(const QVariantList& stops, bool roundTrip = true);//poi ids or names, the first one starts the tour; spoken as well
+		QVariantMap                 nextRoute();//next alternative between the spoken buildings, back to the shortest after the last; spoken as well
+		bool                        setProfile(const QString& name);//"default", "step free", "least climb" or "sheltered"; spoken as well
+		QStringList                 profiles();
+		void                        refreshPositionsRule();
+
+private slots:
+		void                        runAutocomplete();
+		void                        clearAlternatives();
+		void                        announceStep(int index, const QString& text);
+		void                        onPositionMatched(double lat, double lng, float routeOffset);
+		void                        onFix(const TSFix& fix);
+		void                        onRerouted();
+		void                        onFenceEntered(int fence);
+		void                        onFenceExited(int fence);
 };
 
 void listenProcess(LPARAM lpParam);//the listening thread
@@ -0,0 +1,164 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSAlternativeRoutes.cpp
+// Author : Zhan
+//
+
+#include "TSAlternativeRoutes.h"
+#include "TSRouteEngine.h"
+
+#include <QtCore/QSettings>
+#include <QtAlgorithms>
+
+TSAlternativeRoutes::TSAlternativeRoutes(const TSRouteEngine* engine)
+: m_engine(engine)
+, m_forward(&engine->graph())
+, m_backward(&engine->graph())
+, m_maxRoutes(3)
+, m_maxStretch(0.25)
+, m_maxOverlap(0.6)
+, m_srcPoi(0)
+, m_dstPoi(0)
+, m_nextCandidate(0)
+, m_tried(0)
+, m_stamp(0)
+{
+	loadSettings();
+}
+
+void TSAlternativeRoutes::loadSettings()
+{
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	settings.beginGroup(QLatin1String("alternatives"));
+	m_maxRoutes = qMax(1, settings.value(QLatin1String("MaxRoutes"), 3).toInt());
+	m_maxStretch = settings.value(QLatin1String("MaxStretch"), 0.25).toDouble();
+	m_maxOverlap = settings.value(QLatin1String("MaxOverlap"), 0.6).toDouble();
+	settings.endGroup();
+}
+
+void TSAlternativeRoutes::clear()
+{
+	m_srcPoi = m_dstPoi = 0;
+	m_routes.clear();
+	m_candidates.clear();
+	m_nextCandidate = 0;
+	m_tried = 0;
+}
+
+/*!
+  \brief Shortest walk, then both searches grown to the longest walk allowed.
+
+  The via nodes are listed and sorted once here, next() only walks the list.
+*/
+TSRoute TSAlternativeRoutes::start(int srcPoi, int dstPoi)
+{
+	clear();
+	quint32 source = m_engine->poiNode(srcPoi);
+	quint32 target = m_engine->poiNode(dstPoi);
+	if( source == TS_INVALID || target == TS_INVALID || source == target )
+		return m_engine->route(QVector<quint32>(), srcPoi, dstPoi);
+
+	QVector<float> weights = m_engine->weights(TSRouteProfile::DEFAULT);
+	m_forward.setWeights(weights);
+	m_backward.setWeights(weights);
+	m_forward.runTo(source, target);
+	if( !m_forward.reached(target) )
+		return m_engine->route(QVector<quint32>(), srcPoi, dstPoi);
+
+	m_srcPoi = srcPoi;
+	m_dstPoi = dstPoi;
+	const float bound = (float)(m_forward.seconds(target) * (1 + m_maxStretch));
+	m_forward.growWithin(bound);
+	m_backward.runWithin(target, bound, TSRouteSearch::Backward);
+
+	const int n = m_engine->graph().nodeCount();
+	for( int u = 0; u < n; u++ )
+	{
+		if( (quint32)u == source || (quint32)u == target || !m_forward.isSettled(u) || !m_backward.isSettled(u) )
+			continue;
+		float seconds = m_forward.seconds(u) + m_backward.seconds(u);
+		if( seconds <= bound )
+			m_candidates.append(qMakePair(seconds, (quint32)u));
+	}
+	qSort(m_candidates);
+
+	m_onRoute.fill(false, n);
+	m_usedEdge.fill(false, m_engine->graph().edgeCount());
+	m_visit.fill(0, n);
+	m_stamp = 0;
+
+	QVector<quint32> edges = m_forward.path(target);
+	keep(edges);
+	m_routes.append(m_engine->route(edges, srcPoi, dstPoi));
+	return m_routes.last();
+}
+
+TSRoute TSAlternativeRoutes::next()
+{
+	while( !m_routes.isEmpty() && m_routes.count() < m_maxRoutes && m_nextCandidate < m_candidates.count() )
+	{
+		quint32 via = m_candidates[m_nextCandidate++].second;
+		if( m_onRoute[via] )
+			continue;
+
+		m_tried++;
+		QVector<quint32> edges;
+		if( !accept(via, &edges) )
+			continue;
+
+		keep(edges);
+		m_routes.append(m_engine->route(edges, m_srcPoi, m_dstPoi));
+		return m_routes.last();
+	}
+	return m_engine->route(QVector<quint32>(), m_srcPoi, m_dstPoi);
+}
+
+/*!
+  \brief Walk through a via node, if it is a real alternative.
+
+  A walk passing a node twice turns back somewhere, typically at the end of a
+  dead end, and is dropped. So is a walk sharing too much with the kept ones.
+*/
+bool TSAlternativeRoutes::accept(quint32 via, QVector<quint32>* edges)
+{
+	const TSRouteGraph& graph = m_engine->graph();
+	*edges = m_forward.path(via);
+	*edges += m_backward.path(via);
+
+	// Stamps spare clearing the marks between candidates
+	if( ++m_stamp == 0 )
+	{
+		m_visit.fill(0);
+		m_stamp = 1;
+	}
+	m_visit[m_forward.source()] = m_stamp;
+
+	float meters = 0, shared = 0;
+	for( int i = 0; i < edges->count(); i++ )
+	{
+		const TSRouteGraph::Edge& edge = graph.edge((*edges)[i]);
+		if( m_visit[edge.target] == m_stamp )
+			return false;
+		m_visit[edge.target] = m_stamp;
+
+		meters += edge.meters;
+		if( m_usedEdge[(*edges)[i]] )
+			shared += edge.meters;
+	}
+	return meters > 0 && shared <= m_maxOverlap * meters;
+}
+
+void TSAlternativeRoutes::keep(const QVector<quint32>& edges)
+{
+	const TSRouteGraph& graph = m_engine->graph();
+	for( int i = 0; i < edges.count(); i++ )
+	{
+		const TSRouteGraph::Edge& edge = graph.edge(edges[i]);
+		m_usedEdge[edges[i]] = true;
+		m_usedEdge[edge.reverse] = true;
+		m_onRoute[graph.edgeSource(edges[i])] = true;
+		m_onRoute[edge.target] = true;
+	}
+}
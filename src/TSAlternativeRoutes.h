@@ -0,0 +1,83 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSAlternativeRoutes.h
+// Author : Zhan
+//
+#ifndef TSALTERNATIVEROUTES_H
+#define TSALTERNATIVEROUTES_H
+
+#include "TSWebApp.h"
+#include "TSManeuver.h"
+#include "TSRouteSearch.h"
+
+#include <QList>
+#include <QVector>
+#include <QPair>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class TSRouteEngine;
+
+// Alternative walks between two buildings, handed out one at a time.
+//
+// A session keeps a search from the source and a search to the destination,
+// both grown up to maxStretch beyond the shortest walk. Every node settled by
+// both is a via node: the walk source -> via -> destination is read from the two
+// trees. Via nodes are tried by increasing length; a walk is kept if it does not
+// pass a node twice and shares at most maxOverlap of its length with the walks
+// already kept. Nodes on a kept walk are skipped, as they only give that walk
+// again, so next() usually answers after a handful of candidates.
+//
+// Configured by the [alternatives] group of app_config.ini.
+class TSWEBAPP_EXPORTS TSAlternativeRoutes
+{
+public:
+	explicit TSAlternativeRoutes(const TSRouteEngine* engine);
+
+	void						loadSettings();
+	void						setMaxRoutes(int count) { m_maxRoutes = count; }
+	void						setMaxStretch(double stretch) { m_maxStretch = stretch; }
+	void						setMaxOverlap(double overlap) { m_maxOverlap = overlap; }
+
+	// Starts a session and returns the shortest walk, empty if there is none
+	TSRoute						start(int srcPoi, int dstPoi);
+	// Next alternative of the session, empty once maxRoutes are found or the via nodes run out
+	TSRoute						next();
+	void						clear();
+
+	bool						isActive(int srcPoi, int dstPoi) const { return !m_routes.isEmpty() && srcPoi == m_srcPoi && dstPoi == m_dstPoi; }
+	const QList<TSRoute>&		routes() const { return m_routes; }		// shortest first
+	int							candidatesTried() const { return m_tried; }
+
+private:
+	bool						accept(quint32 via, QVector<quint32>* edges);
+	void						keep(const QVector<quint32>& edges);
+
+	const TSRouteEngine			*m_engine;
+	TSRouteSearch				m_forward;
+	TSRouteSearch				m_backward;
+	int							m_maxRoutes;
+	double						m_maxStretch;	// fraction of the shortest walk
+	double						m_maxOverlap;	// fraction of the alternative
+
+	int							m_srcPoi;
+	int							m_dstPoi;
+	QList<TSRoute>				m_routes;
+	QVector< QPair<float, quint32> > m_candidates;	// via nodes by walk length
+	int							m_nextCandidate;
+	int							m_tried;
+	QVector<bool>				m_onRoute;		// nodes of the kept walks
+	QVector<bool>				m_usedEdge;		// edges of the kept walks, both ways
+	QVector<int>				m_visit;		// node stamps of the walk being tested
+	int							m_stamp;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSALTERNATIVEROUTES_H
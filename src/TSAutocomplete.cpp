@@ -0,0 +1,272 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSAutocomplete.cpp
+// Author : Zhan
+//
+
+#include "TSAutocomplete.h"
+#include "TSPoiCatalog.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QRegExp>
+#include <QtCore/QtAlgorithms>
+
+#include <algorithm>
+
+struct TSAutocompleteEntry
+{
+	QString						word;
+	int							poiId;
+	int							weight;
+
+	bool operator<(const TSAutocompleteEntry& other) const
+	{
+		if( word != other.word )
+			return word < other.word;
+		return poiId < other.poiId;
+	}
+};
+
+struct TSAutocompleteRank
+{
+	const QVector<int>*			nameLength;
+
+	bool operator()(const TSAutocompleteHit& a, const TSAutocompleteHit& b) const
+	{
+		if( a.score != b.score )
+			return a.score > b.score;
+		int la = nameLength->value(a.poiId), lb = nameLength->value(b.poiId);
+		if( la != lb )
+			return la < lb;
+		return a.poiId < b.poiId;
+	}
+};
+
+TSAutocomplete::TSAutocomplete()
+{
+	clear();
+}
+
+void TSAutocomplete::clear()
+{
+	m_nodes.clear();
+	m_postings.clear();
+	m_nameLength.clear();
+
+	Node root = { QString(), 0, 0, 0, 0 };
+	m_nodes.append(root);
+}
+
+QStringList TSAutocomplete::words(const QString& text)
+{
+	QString s = text.toLower();
+	s.remove(QLatin1Char('\''));
+	s.replace(QRegExp("[^a-z0-9]+"), QLatin1String(" "));
+	return s.split(QLatin1Char(' '), QString::SkipEmptyParts);
+}
+
+void TSAutocomplete::build(const TSPoiCatalog* catalog)
+{
+	clear();
+
+	// One entry per (word, building), keeping the best weight
+	QVector<TSAutocompleteEntry> entries;
+	const QList<TSPoi>& pois = catalog->pois();
+	for( int i = 0; i < pois.count(); i++ )
+	{
+		const TSPoi& poi = pois[i];
+		if( poi.id >= m_nameLength.count() )
+			m_nameLength.resize(poi.id + 1);
+		m_nameLength[poi.id] = poi.name.length();
+
+		QList<QPair<QString, int> > fields;
+		fields.append(qMakePair(poi.name, (int)WEIGHT_NAME));
+		for( int j = 0; j < poi.aliases.count(); j++ )
+			fields.append(qMakePair(poi.aliases[j], (int)WEIGHT_ALIAS));
+		fields.append(qMakePair(poi.address, (int)WEIGHT_ADDRESS));
+
+		for( int f = 0; f < fields.count(); f++ )
+		{
+			QStringList list = words(fields[f].first);
+			for( int w = 0; w < list.count(); w++ )
+			{
+				TSAutocompleteEntry entry = { list[w], poi.id, fields[f].second };
+				if( w == 0 && fields[f].second != WEIGHT_ADDRESS )
+					entry.weight += WEIGHT_LEADING;
+				entries.append(entry);
+			}
+		}
+	}
+	std::sort(entries.begin(), entries.end());
+
+	m_words.clear();
+	m_wordPostings.clear();
+	for( int i = 0; i < entries.count(); i++ )
+	{
+		const TSAutocompleteEntry& e = entries[i];
+		if( m_words.isEmpty() || m_words.last() != e.word )
+		{
+			m_words.append(e.word);
+			m_wordPostings.append(m_postings.count());
+		}
+		else if( m_postings.last().poiId == e.poiId )
+		{
+			m_postings.last().weight = qMax(m_postings.last().weight, e.weight);
+			continue;
+		}
+		Posting p = { e.poiId, e.weight };
+		m_postings.append(p);
+	}
+	m_wordPostings.append(m_postings.count());
+
+	if( !m_words.isEmpty() )
+		buildNode(0, 0, m_words.count(), 0);
+
+	QLOG_INFO() << QString("Autocomplete: %1 words, %2 trie nodes, %3 postings.")
+					.arg(m_words.count()).arg(m_nodes.count()).arg(m_postings.count());
+
+	m_words.clear();
+	m_wordPostings.clear();
+}
+
+// Fill m_nodes[node] with the words [lo, hi), which share their first depth characters
+int TSAutocomplete::buildNode(int node, int lo, int hi, int depth)
+{
+	// Sorted words: the common prefix of the range is the one of its first and last word
+	const QString& first = m_words.at(lo);
+	const QString& last = m_words.at(hi - 1);
+	int common = depth;
+	while( common < first.length() && common < last.length() && first[common] == last[common] )
+		common++;
+
+	m_nodes[node].label = first.mid(depth, common - depth);
+	m_nodes[node].postingBegin = m_wordPostings[lo];
+	m_nodes[node].postingEnd = m_wordPostings[hi];
+
+	int i = lo;
+	if( m_words.at(i).length() == common )
+		i++;			// the word ending here, it sorts first
+
+	// Group the remaining words by their next character
+	QList<QPair<int, int> > groups;
+	while( i < hi )
+	{
+		int j = i + 1;
+		while( j < hi && m_words.at(j).at(common) == m_words.at(i).at(common) )
+			j++;
+		groups.append(qMakePair(i, j));
+		i = j;
+	}
+
+	m_nodes[node].firstChild = m_nodes.count();
+	m_nodes[node].childCount = groups.count();
+	Node empty = { QString(), 0, 0, 0, 0 };
+	for( int g = 0; g < groups.count(); g++ )
+		m_nodes.append(empty);
+
+	int firstChild = m_nodes[node].firstChild;
+	for( int g = 0; g < groups.count(); g++ )
+		buildNode(firstChild + g, groups[g].first, groups[g].second, common);
+	return node;
+}
+
+// Node whose subtree holds exactly the words starting with prefix, -1 if none
+int TSAutocomplete::find(const QString& prefix) const
+{
+	int node = 0;
+	int pos = 0;
+	for( ;; )
+	{
+		const QString& label = m_nodes[node].label;
+		int n = qMin(label.length(), prefix.length() - pos);
+		for( int k = 0; k < n; k++ )
+		{
+			if( label[k] != prefix[pos + k] )
+				return -1;
+		}
+		pos += n;
+		if( pos == prefix.length() )
+			return node;
+
+		// Binary search on the first character of the children
+		int lo = m_nodes[node].firstChild;
+		int hi = lo + m_nodes[node].childCount;
+		QChar c = prefix[pos];
+		while( lo < hi )
+		{
+			int mid = (lo + hi) / 2;
+			if( m_nodes[mid].label[0] < c )
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if( lo == m_nodes[node].firstChild + m_nodes[node].childCount || m_nodes[lo].label[0] != c )
+			return -1;
+		node = lo;
+	}
+}
+
+/*!
+  \brief Rank the buildings matching a partial query.
+
+  Every query word is a prefix of some word of the building. A building scores
+  the best weight of each query word; ties go to the shorter name.
+*/
+QList<TSAutocompleteHit> TSAutocomplete::complete(const QString& query, int maxResults) const
+{
+	QList<TSAutocompleteHit> hits;
+	QStringList list = words(query);
+	if( list.isEmpty() || maxResults <= 0 || m_postings.isEmpty() )
+		return hits;
+
+	// Fewest postings first, so that the candidate set shrinks early
+	QMap<int, int> order;
+	QVector<int> nodes(list.count());
+	for( int i = 0; i < list.count(); i++ )
+	{
+		nodes[i] = find(list[i]);
+		if( nodes[i] < 0 )
+			return hits;
+		order.insertMulti(m_nodes[nodes[i]].postingEnd - m_nodes[nodes[i]].postingBegin, i);
+	}
+
+	QHash<int, int> scores;		// poi id -> score, for the buildings matching every word so far
+	bool firstWord = true;
+	for( QMap<int, int>::const_iterator it = order.constBegin(); it != order.constEnd(); ++it )
+	{
+		const Node& node = m_nodes[nodes[it.value()]];
+		QHash<int, int> best;
+		for( int p = node.postingBegin; p < node.postingEnd; p++ )
+		{
+			const Posting& posting = m_postings[p];
+			if( !firstWord && !scores.contains(posting.poiId) )
+				continue;
+			int& weight = best[posting.poiId];
+			weight = qMax(weight, posting.weight);
+		}
+
+		QHash<int, int> next;
+		for( QHash<int, int>::const_iterator b = best.constBegin(); b != best.constEnd(); ++b )
+			next.insert(b.key(), scores.value(b.key()) + b.value());
+		scores = next;
+		firstWord = false;
+		if( scores.isEmpty() )
+			return hits;
+	}
+
+	for( QHash<int, int>::const_iterator s = scores.constBegin(); s != scores.constEnd(); ++s )
+	{
+		TSAutocompleteHit hit = { s.key(), s.value() };
+		hits.append(hit);
+	}
+
+	TSAutocompleteRank rank = { &m_nameLength };
+	int n = qMin(maxResults, hits.count());
+	std::partial_sort(hits.begin(), hits.begin() + n, hits.end(), rank);
+	return hits.mid(0, n);
+}
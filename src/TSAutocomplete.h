@@ -0,0 +1,90 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSAutocomplete.h
+// Author : Zhan
+//
+#ifndef TSAUTOCOMPLETE_H
+#define TSAUTOCOMPLETE_H
+
+#include "TSWebApp.h"
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QList>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class TSPoiCatalog;
+
+struct TSAutocompleteHit
+{
+	int							poiId;
+	int							score;
+};
+
+// Type-ahead over building names, aliases and address words.
+//
+// Every word is stored once in a compressed (radix) trie. Words are inserted in
+// sorted order, so the postings of all the words below a trie node are one
+// contiguous range: a prefix lookup costs the length of the prefix, and the
+// ranking only touches the postings of the matching words.
+class TSWEBAPP_EXPORTS TSAutocomplete
+{
+public:
+	TSAutocomplete();
+
+	void						build(const TSPoiCatalog* catalog);
+	void						clear();
+
+	// Buildings matching every word of the query as a word prefix, best first
+	QList<TSAutocompleteHit>	complete(const QString& query, int maxResults = 8) const;
+
+	// Lower case alphanumeric words of a text
+	static QStringList			words(const QString& text);
+
+private:
+	enum Weight
+	{
+		WEIGHT_ADDRESS = 1,
+		WEIGHT_ALIAS = 3,
+		WEIGHT_NAME = 4,
+		WEIGHT_LEADING = 2			// bonus when the word starts the name or alias
+	};
+
+	struct Node
+	{
+		QString					label;			// characters on the edge from the parent
+		int						firstChild;		// children are contiguous, sorted by first character
+		int						childCount;
+		int						postingBegin;	// postings of every word of the subtree
+		int						postingEnd;
+	};
+
+	struct Posting
+	{
+		int						poiId;
+		int						weight;
+	};
+
+	int							buildNode(int node, int lo, int hi, int depth);
+	int							find(const QString& prefix) const;
+
+	QVector<Node>				m_nodes;		// m_nodes[0] is the root
+	QVector<Posting>			m_postings;
+
+	// Build time only
+	QStringList					m_words;		// sorted, unique
+	QVector<int>				m_wordPostings;	// first posting of m_words[i], one extra entry at the end
+	QVector<int>				m_nameLength;	// poi id -> name length, ties go to the shorter name
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSAUTOCOMPLETE_H
@@ -0,0 +1,1838 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSBenchmark.cpp
+// Author : Zhan
+//
+
+#include "TSBenchmark.h"
+#include "TSPoiCatalog.h"
+#include "TSSpeechNormalizer.h"
+#include "TSRouteEngine.h"
+#include "TSRouteTracker.h"
+#include "TSGeofence.h"
+#include "TSGeocoder.h"
+#include "TSGeoIndex.h"
+#include "TSVocabulary.h"
+#include "TSIsochrone.h"
+#include "TSTourPlanner.h"
+#include "TSAlternativeRoutes.h"
+#include "TSRouteSearch.h"
+#include "TSRouteHierarchy.h"
+#include "TSElevation.h"
+#include "TSIndoorMap.h"
+#include "TSOpeningHours.h"
+#include "TSRouteServer.h"
+#include "TSPolyline.h"
+#include "TSTileStore.h"
+#include "TSTilePrefetcher.h"
+#include "TSVectorTiles.h"
+
+#include <serializer.h>
+
+#include <QtCore/QFile>
+#include <QtCore/QTextStream>
+#include <QtCore/QTime>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSettings>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QtConcurrentMap>
+#include <QtCore/QUrl>
+#include <QtCore/QSet>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+#define WALK_SPEED			1.4			// meters per second
+#define METERS_PER_DEGREE	111320.0
+
+bool TSBenchmark::run(const QStringList& args, int* exitCode)
+{
+	int pos = args.indexOf(QLatin1String("--benchmark"));
+	if( pos < 0 || pos + 1 >= args.count() )
+		return false;
+
+	QString name = args[pos + 1];
+	QStringList rest = args.mid(pos + 2);
+	if( name == QLatin1String("normalizer") )
+		*exitCode = normalizer(rest);
+	else if( name == QLatin1String("tracker") )
+		*exitCode = tracker(rest);
+	else if( name == QLatin1String("reroute") )
+		*exitCode = reroute(rest);
+	else if( name == QLatin1String("geofence") )
+		*exitCode = geofence(rest);
+	else if( name == QLatin1String("nearest") )
+		*exitCode = nearest(rest);
+	else if( name == QLatin1String("vocabulary") )
+		*exitCode = vocabulary(rest);
+	else if( name == QLatin1String("isochrone") )
+		*exitCode = isochrone(rest);
+	else if( name == QLatin1String("facility") )
+		*exitCode = facility(rest);
+	else if( name == QLatin1String("tour") )
+		*exitCode = tour(rest);
+	else if( name == QLatin1String("alternatives") )
+		*exitCode = alternatives(rest);
+	else if( name == QLatin1String("profiles") )
+		*exitCode = profiles(rest);
+	else if( name == QLatin1String("elevation") )
+		*exitCode = elevation(rest);
+	else if( name == QLatin1String("indoor") )
+		*exitCode = indoor(rest);
+	else if( name == QLatin1String("hours") )
+		*exitCode = hours(rest);
+	else if( name == QLatin1String("cache") )
+		*exitCode = cache(rest);
+	else if( name == QLatin1String("server") )
+		*exitCode = server(rest);
+	else if( name == QLatin1String("scratch") )
+		*exitCode = scratch(rest);
+	else if( name == QLatin1String("polyline") )
+		*exitCode = polyline(rest);
+	else if( name == QLatin1String("tiles") )
+		*exitCode = tiles(rest);
+	else if( name == QLatin1String("prefetch") )
+		*exitCode = prefetch(rest);
+	else if( name == QLatin1String("vectortiles") )
+		*exitCode = vectortiles(rest);
+	else
+	{
+		fprintf(stderr, "Unknown benchmark %s\n", qPrintable(name));
+		*exitCode = 1;
+	}
+	return true;
+}
+
+void TSBenchmark::report(const QString& name, int items, qint64 chars, int ms)
+{
+	double seconds = qMax(ms, 1) / 1000.0;
+	printf("%-24s %8d items %8d ms %12.0f items/s %8.2f MB/s\n", qPrintable(name), items, ms,
+		   items / seconds, chars * sizeof(QChar) / seconds / (1024.0 * 1024.0));
+	fflush(stdout);
+}
+
+// Addresses of the catalog and directions built on its streets and buildings
+QStringList TSBenchmark::directionCorpus(int count)
+{
+	// %1 street, %2 building name, %3 house number or distance; a template uses any of them
+	static const char* templates[] = {
+		"Head north on %1 and walk 120 meters.",
+		"Turn left onto %1 near %2 and walk 350 meters.",
+		"Bear right onto %1, take the stairs and walk 40 meters.",
+		"Continue onto %1 and walk 1.2 km.",
+		"Arrive at %2, on your left.",
+		"%2 is %3 meters from %1, about 4 minutes walk.",
+		"%3 %1, Pittsburgh, PA 15213",
+		0
+	};
+	static const char* streets[] = { "S Bouquet St", "Forbes Ave", "Fifth & Ruskin Aves", "N. Bellefield Ave",
+									 "O'Hara St", "University Dr", "Roberto Clemente Dr", "Terrace St",
+									 "S. Dithridge St", "Centre Ave", 0 };
+
+	QStringList names, addresses;
+	TSPoiCatalog catalog;
+	if( catalog.load(QLatin1String("poi_catalog.xml")) )
+	{
+		for( int i = 0; i < catalog.pois().count(); i++ )
+		{
+			names.append(catalog.pois()[i].name);
+			addresses.append(catalog.pois()[i].address);
+		}
+	}
+	if( names.isEmpty() )
+		names << "Sennott Square" << "Cathedral of Learning" << "Hillman Library";
+
+	int templateCount = 0, streetCount = 0;
+	while( templates[templateCount] )
+		templateCount++;
+	while( streets[streetCount] )
+		streetCount++;
+
+	QStringList corpus;
+	srand(1);
+	for( int i = 0; i < count; i++ )
+	{
+		if( !addresses.isEmpty() && i % 4 == 0 )
+			corpus.append(addresses[rand() % addresses.count()]);
+		else
+		{
+			// Replaced by name, QString::arg() would fill the lowest placeholders and warn about the others
+			QString text = QLatin1String(templates[rand() % templateCount]);
+			text.replace(QLatin1String("%1"), QLatin1String(streets[rand() % streetCount]));
+			text.replace(QLatin1String("%2"), names[rand() % names.count()]);
+			text.replace(QLatin1String("%3"), QString::number(100 + rand() % 4900));
+			corpus.append(text);
+		}
+	}
+	return corpus;
+}
+
+/*!
+  \brief Normalize a corpus of direction strings.
+
+  The corpus is read from a text file, one string per line, or generated from
+  the catalog. The first normalized strings are printed to check the output.
+*/
+int TSBenchmark::normalizer(const QStringList& args)
+{
+	int count = 200000;
+	QStringList corpus;
+	if( !args.isEmpty() && QFile::exists(args[0]) )
+	{
+		QFile file(args[0]);
+		file.open(QIODevice::ReadOnly | QIODevice::Text);
+		QTextStream in(&file);
+		while( !in.atEnd() )
+			corpus.append(in.readLine());
+	}
+	else
+	{
+		if( !args.isEmpty() )
+			count = qMax(1, args.last().toInt());
+		corpus = directionCorpus(count);
+	}
+
+	qint64 chars = 0;
+	for( int i = 0; i < corpus.count(); i++ )
+		chars += corpus[i].length();
+
+	QTime timer;
+	timer.start();
+	TSSpeechNormalizer normalizer;
+	int buildMs = timer.elapsed();
+	printf("normalizer: %d rules compiled in %d ms\n", normalizer.ruleCount(), buildMs);
+
+	// Keep the results alive so that the work cannot be optimized away
+	qint64 outChars = 0;
+	timer.restart();
+	for( int i = 0; i < corpus.count(); i++ )
+		outChars += normalizer.normalize(corpus[i]).length();
+	report(QLatin1String("normalize"), corpus.count(), chars, timer.elapsed());
+
+	printf("output/input size %.2f\n", chars ? (double)outChars / chars : 0.0);
+	for( int i = 0; i < qMin(5, corpus.count()); i++ )
+		printf("  %s\n    -> %s\n", qPrintable(corpus[i]), qPrintable(normalizer.normalize(corpus[i])));
+	return 0;
+}
+
+// Walks between random pairs of buildings, at least 50 meters long
+QList<TSRoute> TSBenchmark::randomRoutes(const TSRouteEngine& engine, int count)
+{
+	QList<int> pois;
+	for( int i = 0; i < engine.catalog().pois().count(); i++ )
+		pois.append(engine.catalog().pois()[i].id);
+
+	QList<TSRoute> routes;
+	srand(1);
+	for( int attempts = 0; pois.count() >= 2 && routes.count() < count && attempts < count * 10; attempts++ )
+	{
+		TSRoute route = engine.route(pois[rand() % pois.count()], pois[rand() % pois.count()]);
+		if( !route.isEmpty() && route.meters() >= 50 )
+			routes.append(route);
+	}
+	return routes;
+}
+
+// Standard normal deviate, Box-Muller
+static double gaussian()
+{
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2 * log(u)) * cos(2 * 3.14159265358979 * v);
+}
+
+// One fix per second of a walker following the route, with a gaussian error of noise meters
+QList<TSFix> TSBenchmark::walk(const TSRouteGraph& graph, const TSRoute& route, double noise, int maxFixes)
+{
+	QList<TSFix> fixes;
+	double total = route.meters();
+	int i = 0;
+	for( int k = 0; k < maxFixes; k++ )
+	{
+		double along = qMin(k * WALK_SPEED, total);
+		while( i + 1 < route.edges.count() && route.offsets[i + 1] < along )
+			i++;
+
+		quint32 e = route.edges[i];
+		quint32 from = graph.edgeSource(e), to = graph.edge(e).target;
+		float length = route.offsets[i + 1] - route.offsets[i];
+		double t = length > 0 ? (along - route.offsets[i]) / length : 0;
+
+		TSFix fix;
+		fix.time = k * 1000;
+		fix.lat = graph.lat(from) + t * (graph.lat(to) - graph.lat(from));
+		fix.lng = graph.lng(from) + t * (graph.lng(to) - graph.lng(from));
+		fix.lat += noise * gaussian() / METERS_PER_DEGREE;
+		fix.lng += noise * gaussian() / (METERS_PER_DEGREE * cos(fix.lat * 3.14159265358979 / 180));
+		fix.accuracy = (float)noise;
+		fix.speed = (float)WALK_SPEED;
+		fix.heading = -1;
+		fixes.append(fix);
+
+		if( along >= total )
+			break;
+	}
+	return fixes;
+}
+
+/*!
+  \brief Follow many simulated walkers at once.
+
+  Each walker walks between two random buildings of the catalog with a noisy
+  receiver. The fixes of all walkers are interleaved, as a server tracking
+  them would receive them, and fed to one tracker per walker.
+*/
+int TSBenchmark::tracker(const QStringList& args)
+{
+	int walkers = args.count() > 0 ? qMax(1, args[0].toInt()) : 100;
+	int maxFixes = args.count() > 1 ? qMax(1, args[1].toInt()) : 600;
+
+	TSRouteEngine engine;
+	engine.init();
+	if( !engine.isReady() )
+	{
+		fprintf(stderr, "tracker: no walking graph\n");
+		return 1;
+	}
+	const TSRouteGraph& graph = engine.graph();
+	QList<TSRoute> routes = randomRoutes(engine, walkers);
+	if( routes.isEmpty() )
+	{
+		fprintf(stderr, "tracker: no route between the buildings of the catalog\n");
+		return 1;
+	}
+
+	QList<TSRouteTracker*> trackers;
+	QList< QList<TSFix> > walks;
+	int maneuvers = 0, fixCount = 0;
+	for( int w = 0; w < routes.count(); w++ )
+	{
+		TSRouteTracker* t = new TSRouteTracker(&engine);
+		t->start(routes[w]);
+		trackers.append(t);
+		walks.append(walk(graph, routes[w], 6.0, maxFixes));
+		maneuvers += routes[w].maneuvers.count();
+		fixCount += walks.last().count();
+	}
+	printf("tracker: %d walkers, %d fixes, %d maneuvers\n", trackers.count(), fixCount, maneuvers);
+
+	QTime timer;
+	timer.start();
+	for( int k = 0; k < maxFixes; k++ )
+	{
+		for( int w = 0; w < trackers.count(); w++ )
+		{
+			if( k < walks[w].count() )
+				trackers[w]->processFix(walks[w][k]);
+		}
+	}
+	report(QLatin1String("track"), fixCount, 0, timer.elapsed());
+
+	// A walker that arrived has its tracker stopped
+	int arrived = 0, reroutes = 0;
+	for( int w = 0; w < trackers.count(); w++ )
+	{
+		if( !trackers[w]->isActive() )
+			arrived++;
+		reroutes += trackers[w]->rerouteCount();
+	}
+	printf("arrived %d/%d, %d reroutes\n", arrived, trackers.count(), reroutes);
+
+	qDeleteAll(trackers);
+	return 0;
+}
+
+/*!
+  \brief Reroute walkers that left their route.
+
+  Detours start on random edges within 150 meters of the route. Each one is
+  answered by the tracker, which resumes the tree of the destination, and by
+  a search from scratch for comparison. Both build the spoken maneuvers.
+*/
+int TSBenchmark::reroute(const QStringList& args)
+{
+	int count = args.count() > 0 ? qMax(1, args[0].toInt()) : 50;
+	int detours = args.count() > 1 ? qMax(1, args[1].toInt()) : 20;
+
+	TSRouteEngine engine;
+	engine.init();
+	if( !engine.isReady() )
+	{
+		fprintf(stderr, "reroute: no walking graph\n");
+		return 1;
+	}
+	const TSRouteGraph& graph = engine.graph();
+	QList<TSRoute> routes = randomRoutes(engine, count);
+
+	int startMs = 0, rerouteMs = 0, scratchMs = 0, done = 0, mismatches = 0;
+	qint64 settled = 0;
+	QTime timer;
+	for( int r = 0; r < routes.count(); r++ )
+	{
+		const TSRoute& route = routes[r];
+		quint32 destination = engine.poiNode(route.dstPoi);
+
+		TSRouteTracker tracker(&engine);
+		timer.start();
+		tracker.start(route);
+		startMs += timer.elapsed();
+
+		for( int d = 0; d < detours; d++ )
+		{
+			quint32 node = graph.edgeSource(route.edges[rand() % route.edges.count()]);
+			QVector<quint32> near = graph.edgesNear(graph.lat(node), graph.lng(node), 150, 16);
+			if( near.isEmpty() )
+				continue;
+			quint32 edge = near[rand() % near.count()];
+
+			timer.restart();
+			if( !tracker.reroute(edge, 0.5) )
+				continue;
+			rerouteMs += timer.elapsed();
+
+			timer.restart();
+			TSRouteSearch search(&graph);
+			search.runTo(graph.edge(edge).target, destination);
+			QVector<quint32> edges;
+			edges.append(edge);
+			edges += search.path(destination);
+			TSRoute scratch = engine.route(edges, -1, route.dstPoi);
+			scratchMs += timer.elapsed();
+			settled += search.settledCount();
+			done++;
+
+			// Both must agree when the tracker walks on along the edge
+			if( tracker.route().edges.first() == edge && fabs(tracker.route().meters() - scratch.meters()) > 0.5 )
+				mismatches++;
+		}
+	}
+
+	printf("reroute: %d routes, %d detours, %d mismatches\n", routes.count(), done, mismatches);
+	printf("%-24s %10.3f ms per route\n", "tree up to the start", (double)startMs / qMax(1, routes.count()));
+	printf("%-24s %10.3f ms per detour\n", "resumed tree", (double)rerouteMs / qMax(1, done));
+	printf("%-24s %10.3f ms per detour, %lld nodes settled\n", "from scratch", (double)scratchMs / qMax(1, done), settled / qMax(1, done));
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Evaluate a walker against many fences.
+
+  Fences are random polygons of 10 to 60 meters spread over a square of 3 km
+  around the campus, the walker wanders across the square one meter at a time.
+  The brute force test of every fence is timed on the same positions.
+*/
+int TSBenchmark::geofence(const QStringList& args)
+{
+	int count = args.count() > 0 ? qMax(1, args[0].toInt()) : 5000;
+	int updates = args.count() > 1 ? qMax(1, args[1].toInt()) : 200000;
+
+	const double lat0 = 40.4443, lng0 = -79.9533, half = 1500;
+	const double kx = METERS_PER_DEGREE * cos(lat0 * 3.14159265358979 / 180);
+
+	srand(1);
+	QList<TSGeofence> fences;
+	for( int i = 0; i < count; i++ )
+	{
+		TSGeofence fence;
+		fence.poiId = i;
+		fence.kind = TSGeofence::FOOTPRINT;
+		double lat = lat0 + (rand() % 3000 - half) / METERS_PER_DEGREE;
+		double lng = lng0 + (rand() % 3000 - half) / kx;
+		fence.polygon = TSGeofenceIndex::circle(lat, lng, 10 + rand() % 50, 4 + rand() % 12);
+		fences.append(fence);
+	}
+
+	QTime timer;
+	timer.start();
+	TSGeofenceIndex index;
+	index.build(fences);
+	printf("geofence: %d fences indexed in %d ms\n", count, timer.elapsed());
+
+	QVector<double> lats(updates), lngs(updates);
+	double x = 0, y = 0, heading = 0;
+	for( int i = 0; i < updates; i++ )
+	{
+		heading += gaussian() * 0.2;
+		x = qBound(-half, x + sin(heading), half);
+		y = qBound(-half, y + cos(heading), half);
+		lats[i] = lat0 + y / METERS_PER_DEGREE;
+		lngs[i] = lng0 + x / kx;
+	}
+
+	int changes = 0;
+	TSGeofenceMonitor monitor(&index);
+	timer.restart();
+	for( int i = 0; i < updates; i++ )
+	{
+		int before = monitor.inside().count();
+		monitor.update(lats[i], lngs[i]);
+		changes += monitor.inside().count() != before;
+	}
+	int ms = timer.elapsed();
+	report(QLatin1String("monitor update"), updates, 0, ms);
+	printf("%.3f us per update, %d changes of state\n", ms * 1000.0 / updates, changes);
+
+	// Every fence for every position, a tenth of the positions is enough to compare
+	int bruteUpdates = qMax(1, updates / 10), inside = 0;
+	timer.restart();
+	for( int i = 0; i < bruteUpdates; i++ )
+	{
+		for( int f = 0; f < index.count(); f++ )
+			inside += index.contains(f, lats[i], lngs[i]);
+	}
+	ms = timer.elapsed();
+	report(QLatin1String("brute force"), bruteUpdates, 0, ms);
+	printf("%.3f us per update, %d hits\n", ms * 1000.0 / bruteUpdates, inside);
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Answer "where am I" queries.
+
+  The three closest buildings of the catalog are looked up for random points
+  of the campus, then the 2-d tree is timed alone on a synthetic set of points
+  against a linear scan.
+*/
+int TSBenchmark::nearest(const QStringList& args)
+{
+	int points = args.count() > 0 ? qMax(1, args[0].toInt()) : 100000;
+	int queries = args.count() > 1 ? qMax(1, args[1].toInt()) : 100000;
+
+	const double lat0 = 40.4443, lng0 = -79.9533, half = 1500;
+	const double kx = METERS_PER_DEGREE * cos(lat0 * 3.14159265358979 / 180);
+
+	srand(1);
+	QVector<double> qLat(queries), qLng(queries);
+	for( int i = 0; i < queries; i++ )
+	{
+		qLat[i] = lat0 + (rand() % 3000 - half) / METERS_PER_DEGREE;
+		qLng[i] = lng0 + (rand() % 3000 - half) / kx;
+	}
+
+	QTime timer;
+	TSPoiCatalog catalog;
+	if( catalog.load(QLatin1String("poi_catalog.xml")) )
+	{
+		TSGeocoder geocoder;
+		geocoder.build(&catalog);
+		double meters = 0;
+		timer.start();
+		for( int i = 0; i < queries; i++ )
+		{
+			QList<TSNearbyPoi> near = geocoder.nearby(qLat[i], qLng[i], 3);
+			meters += near.isEmpty() ? 0 : near.first().meters;
+		}
+		int ms = timer.elapsed();
+		report(QLatin1String("catalog nearby"), queries, 0, ms);
+		printf("%.3f us per query over %d buildings, closest at %.0f m on average\n",
+			   ms * 1000.0 / queries, catalog.count(), meters / queries);
+	}
+
+	QVector<double> lat(points), lng(points);
+	for( int i = 0; i < points; i++ )
+	{
+		lat[i] = lat0 + (rand() % 3000 - half) / METERS_PER_DEGREE;
+		lng[i] = lng0 + (rand() % 3000 - half) / kx;
+	}
+	timer.start();
+	TSGeoIndex index;
+	index.build(lat, lng);
+	printf("nearest: %d points indexed in %d ms\n", points, timer.elapsed());
+
+	qint64 checksum = 0;
+	timer.restart();
+	for( int i = 0; i < queries; i++ )
+		checksum += index.nearest(qLat[i], qLng[i], 3).first();
+	int ms = timer.elapsed();
+	report(QLatin1String("tree nearest 3"), queries, 0, ms);
+	printf("%.3f us per query\n", ms * 1000.0 / queries);
+
+	// The scan ranks on the same projection as the tree, a hundredth of the queries will do
+	int scanQueries = qMax(1, queries / 100), mismatches = 0;
+	timer.restart();
+	for( int i = 0; i < scanQueries; i++ )
+	{
+		int best = 0;
+		double bestD2 = -1;
+		for( int p = 0; p < points; p++ )
+		{
+			double dx = (lng[p] - qLng[i]) * kx, dy = (lat[p] - qLat[i]) * METERS_PER_DEGREE;
+			double d2 = dx * dx + dy * dy;
+			if( bestD2 < 0 || d2 < bestD2 )
+			{
+				best = p;
+				bestD2 = d2;
+			}
+		}
+		mismatches += index.nearestOne(qLat[i], qLng[i]) != best;
+	}
+	ms = timer.elapsed();
+	report(QLatin1String("linear scan"), scanQueries, 0, ms);
+	printf("%.3f us per query, %d mismatches, checksum %lld\n", ms * 1000.0 / scanQueries, mismatches, checksum);
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Keep the recognizer vocabulary around a walker crossing a city.
+
+  A catalog of random buildings over 20 km is written to a temporary file.
+  The walker crosses it at walking pace with one fix per second; the number of
+  grammar rebuilds and the size of their differences are reported with the
+  cost of an update.
+*/
+int TSBenchmark::vocabulary(const QStringList& args)
+{
+	int buildings = args.count() > 0 ? qMax(1, args[0].toInt()) : 20000;
+	int updates = args.count() > 1 ? qMax(1, args[1].toInt()) : 100000;
+
+	const double lat0 = 40.4443, lng0 = -79.9533, half = 10000;
+	const double kx = METERS_PER_DEGREE * cos(lat0 * 3.14159265358979 / 180);
+
+	QString fileName = QDir::temp().filePath(QLatin1String("speechnav_city_catalog.xml"));
+	QFile file(fileName);
+	if( !file.open(QIODevice::WriteOnly | QIODevice::Text) )
+	{
+		fprintf(stderr, "vocabulary: %s cannot be written\n", qPrintable(fileName));
+		return 1;
+	}
+	srand(1);
+	QTextStream out(&file);
+	out << "<catalog version=\"1\">\n";
+	for( int i = 1; i <= buildings; i++ )
+	{
+		double lat = lat0 + (rand() % 20000 - half) / METERS_PER_DEGREE;
+		double lng = lng0 + (rand() % 20000 - half) / kx;
+		out << QString("<poi id=\"%1\" name=\"Building %1\" lat=\"%2\" lng=\"%3\" address=\"%1 Main Street\"/>\n")
+				.arg(i).arg(lat, 0, 'f', 6).arg(lng, 0, 'f', 6);
+	}
+	out << "</catalog>\n";
+	out.flush();
+	file.close();
+
+	TSPoiCatalog catalog;
+	catalog.load(fileName);
+	QFile::remove(fileName);
+	TSGeocoder geocoder;
+	geocoder.build(&catalog);
+
+	TSVocabulary vocabulary(&geocoder);
+	vocabulary.setFavourites(QList<int>() << 1 << 2 << 3);
+
+	QVector<double> lats(updates), lngs(updates);
+	double x = -half, y = 0, heading = 90;
+	for( int i = 0; i < updates; i++ )
+	{
+		heading += gaussian() * 5;
+		x = qBound(-half, x + WALK_SPEED * sin(heading * 3.14159265358979 / 180), half);
+		y = qBound(-half, y + WALK_SPEED * cos(heading * 3.14159265358979 / 180), half);
+		lats[i] = lat0 + y / METERS_PER_DEGREE;
+		lngs[i] = lng0 + x / kx;
+	}
+
+	int changes = 0;
+	qint64 churn = 0;
+	QTime timer;
+	timer.start();
+	for( int i = 0; i < updates; i++ )
+	{
+		if( vocabulary.update(lats[i], lngs[i]) )
+		{
+			changes++;
+			churn += vocabulary.added().count() + vocabulary.removed().count();
+		}
+	}
+	int ms = timer.elapsed();
+	report(QLatin1String("vocabulary update"), updates, 0, ms);
+	printf("%.3f us per update, %d of %d buildings active, %d grammar rebuilds, %.1f buildings changed per rebuild\n",
+		   ms * 1000.0 / updates, vocabulary.active().count(), catalog.count(), changes, changes ? (double)churn / changes : 0.0);
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Compute the default bands from the buildings of the catalog.
+
+  Each query starts a few meters away from a random building. The searches
+  alone, one per band as they would run without the shared bounded search,
+  are timed on the same positions.
+*/
+int TSBenchmark::isochrone(const QStringList& args)
+{
+	int queries = args.count() > 0 ? qMax(1, args[0].toInt()) : 100;
+
+	TSRouteEngine engine;
+	engine.init();
+	const QList<TSPoi>& pois = engine.catalog().pois();
+	if( !engine.isReady() || pois.isEmpty() )
+	{
+		fprintf(stderr, "isochrone: no walking graph\n");
+		return 1;
+	}
+	const TSRouteGraph& graph = engine.graph();
+	TSIsochrone isochrone(&engine);
+	const QList<int>& bands = isochrone.defaultBands();
+	if( bands.isEmpty() )
+	{
+		fprintf(stderr, "isochrone: no band configured\n");
+		return 1;
+	}
+
+	int computeMs = 0, searchMs = 0, answered = 0;
+	qint64 reached = 0, rings = 0, corners = 0;
+	QTime timer;
+	for( int q = 0; q < queries; q++ )
+	{
+		const TSPoi& poi = pois[rand() % pois.count()];
+		double lat = poi.lat + gaussian() * 10 / METERS_PER_DEGREE;
+		double lng = poi.lng + gaussian() * 10 / (METERS_PER_DEGREE * cos(poi.lat * 3.14159265358979323846 / 180.0));
+
+		timer.start();
+		QList<TSIsochroneBand> result = isochrone.compute(lat, lng, bands);
+		computeMs += timer.elapsed();
+		if( result.isEmpty() )
+			continue;
+		answered++;
+		reached += result.last().poiIds.count();
+		for( int b = 0; b < result.count(); b++ )
+		{
+			rings += result[b].outlines.count();
+			for( int k = 0; k < result[b].outlines.count(); k++ )
+				corners += result[b].outlines[k].count();
+		}
+
+		quint32 source = graph.nearestNode(lat, lng);
+		timer.restart();
+		for( int b = 0; b < bands.count(); b++ )
+		{
+			TSRouteSearch search(&graph);
+			search.runWithin(source, (float)bands[b]);
+		}
+		searchMs += timer.elapsed();
+	}
+
+	printf("isochrone: %d queries, %d answered, %d bands up to %d min\n", queries, answered, bands.count(), bands.last() / 60);
+	printf("%-24s %10.3f ms per query\n", "bands", (double)computeMs / qMax(1, answered));
+	printf("%-24s %10.3f ms per query\n", "one search per band", (double)searchMs / qMax(1, answered));
+	printf("%-24s %10.1f buildings, %.1f rings, %.1f corners per query\n", "widest band",
+		   (double)reached / qMax(1, answered), (double)rings / qMax(1, answered), (double)corners / qMax(1, answered));
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Find the closest building of every category from random positions.
+
+  Positions are drawn around the buildings of the catalog. The search stopping
+  at the first building met is timed against a search settling every building
+  of the category, which must agree on the closest one.
+*/
+int TSBenchmark::facility(const QStringList& args)
+{
+	int queries = args.count() > 0 ? qMax(1, args[0].toInt()) : 200;
+
+	TSRouteEngine engine;
+	engine.init();
+	const QList<TSPoi>& pois = engine.catalog().pois();
+	QStringList categories = engine.catalog().categories();
+	if( !engine.isReady() || pois.isEmpty() || categories.isEmpty() )
+	{
+		fprintf(stderr, "facility: no walking graph or no category in the catalog\n");
+		return 1;
+	}
+	const TSRouteGraph& graph = engine.graph();
+
+	int nearestMs = 0, allMs = 0, answered = 0, mismatches = 0;
+	QTime timer;
+	for( int q = 0; q < queries; q++ )
+	{
+		const TSPoi& poi = pois[rand() % pois.count()];
+		QString category = categories[q % categories.count()];
+		double lat = poi.lat + gaussian() * 200 / METERS_PER_DEGREE;
+		double lng = poi.lng + gaussian() * 200 / (METERS_PER_DEGREE * cos(poi.lat * 3.14159265358979323846 / 180.0));
+
+		timer.start();
+		QList<TSFacility> found = engine.nearestFacilities(lat, lng, category, 1);
+		nearestMs += timer.elapsed();
+		if( found.isEmpty() )
+			continue;
+		answered++;
+
+		QVector<quint32> targets;
+		QList<int> ids = engine.catalog().withCategory(category);
+		for( int i = 0; i < ids.count(); i++ )
+		{
+			if( engine.poiNode(ids[i]) != TS_INVALID )
+				targets.append(engine.poiNode(ids[i]));
+		}
+		timer.restart();
+		TSRouteSearch search(&graph);
+		search.run(graph.nearestNode(lat, lng), targets);
+		float best = TSRouteSearch::INFINITE_TIME;
+		for( int i = 0; i < targets.count(); i++ )
+			best = qMin(best, search.seconds(targets[i]));
+		allMs += timer.elapsed();
+
+		if( fabs(search.seconds(engine.poiNode(found.first().poiId)) - best) > 0.01 )
+			mismatches++;
+	}
+
+	printf("facility: %d queries over %d categories, %d answered, %d mismatches\n", queries, categories.count(), answered, mismatches);
+	printf("%-24s %10.3f ms per query, route included\n", "first building met", (double)nearestMs / qMax(1, answered));
+	printf("%-24s %10.3f ms per query\n", "every building", (double)allMs / qMax(1, answered));
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Plan tours through random buildings of the catalog.
+
+  The solver is then timed alone on random points, where the catalog is too
+  small, with a single restart and with the configured restarts.
+*/
+int TSBenchmark::tour(const QStringList& args)
+{
+	int stops = args.count() > 0 ? qMax(3, args[0].toInt()) : 50;
+	int tours = args.count() > 1 ? qMax(1, args[1].toInt()) : 20;
+
+	TSRouteEngine engine;
+	engine.init();
+	TSTourPlanner planner(&engine);
+	srand(1);
+
+	QList<int> inGraph;
+	for( int i = 0; i < engine.catalog().pois().count(); i++ )
+	{
+		int id = engine.catalog().pois()[i].id;
+		if( engine.poiNode(id) != TS_INVALID )
+			inGraph.append(id);
+	}
+	if( engine.isReady() && inGraph.count() >= 3 )
+	{
+		int count = qMin(stops, inGraph.count()), planned = 0, ms = 0;
+		double seconds = 0;
+		QTime timer;
+		for( int t = 0; t < tours; t++ )
+		{
+			QList<int> ids = inGraph;
+			for( int i = ids.count() - 1; i > 0; i-- )
+				ids.swap(i, rand() % (i + 1));
+			timer.start();
+			TSTour tour = planner.plan(ids.mid(0, count));
+			ms += timer.elapsed();
+			if( tour.isEmpty() )
+				continue;
+			planned++;
+			seconds += tour.seconds;
+		}
+		printf("tour: %d tours of %d buildings, %d planned, %.1f min on average\n", tours, count, planned, seconds / 60 / qMax(1, planned));
+		printf("%-24s %10.3f ms per tour, legs included\n", "catalog tours", (double)ms / tours);
+	}
+
+	// Points on a square of 2 km walked at a constant pace
+	QVector<float> cost(stops * stops);
+	double single = 0, restarted = 0;
+	int singleMs = 0, restartedMs = 0;
+	QTime timer;
+	for( int t = 0; t < tours; t++ )
+	{
+		QVector<double> x(stops), y(stops);
+		for( int i = 0; i < stops; i++ )
+		{
+			x[i] = rand() % 2000;
+			y[i] = rand() % 2000;
+		}
+		for( int i = 0; i < stops; i++ )
+		{
+			for( int j = 0; j < stops; j++ )
+				cost[i * stops + j] = (float)(sqrt((x[i] - x[j]) * (x[i] - x[j]) + (y[i] - y[j]) * (y[i] - y[j])) / WALK_SPEED);
+		}
+
+		timer.start();
+		single += TSTourPlanner::length(cost, stops, TSTourPlanner::solve(cost, stops, 1));
+		singleMs += timer.elapsed();
+		timer.restart();
+		restarted += TSTourPlanner::length(cost, stops, TSTourPlanner::solve(cost, stops, 8));
+		restartedMs += timer.elapsed();
+	}
+	printf("%-24s %10.3f ms per tour, %.1f min\n", "solver, 1 restart", (double)singleMs / tours, single / 60 / tours);
+	printf("%-24s %10.3f ms per tour, %.1f min\n", "solver, 8 restarts", (double)restartedMs / tours, restarted / 60 / tours);
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Ask every alternative between random pairs of buildings.
+
+  The session start pays for both searches; each "next route" is timed on its
+  own, with the via nodes it had to try.
+*/
+int TSBenchmark::alternatives(const QStringList& args)
+{
+	int pairs = args.count() > 0 ? qMax(1, args[0].toInt()) : 100;
+
+	TSRouteEngine engine;
+	engine.init();
+	if( !engine.isReady() )
+	{
+		fprintf(stderr, "alternatives: no walking graph\n");
+		return 1;
+	}
+	QList<TSRoute> routes = randomRoutes(engine, pairs);
+
+	TSAlternativeRoutes session(&engine);
+	int startMs = 0, nextMs = 0, nexts = 0, found = 0;
+	double stretch = 0;
+	qint64 tried = 0;
+	QTime timer;
+	for( int r = 0; r < routes.count(); r++ )
+	{
+		timer.start();
+		TSRoute shortest = session.start(routes[r].srcPoi, routes[r].dstPoi);
+		startMs += timer.elapsed();
+		if( shortest.isEmpty() )
+			continue;
+
+		for( ;; )
+		{
+			timer.restart();
+			TSRoute next = session.next();
+			nextMs += timer.elapsed();
+			nexts++;
+			if( next.isEmpty() )
+				break;
+			found++;
+			stretch += next.meters() / qMax(1.0f, shortest.meters());
+		}
+		tried += session.candidatesTried();
+	}
+
+	printf("alternatives: %d pairs, %d alternatives found, %.2f times the shortest on average\n",
+		   routes.count(), found, stretch / qMax(1, found));
+	printf("%-24s %10.3f ms per pair\n", "session start", (double)startMs / qMax(1, routes.count()));
+	printf("%-24s %10.3f ms per call, %.1f via nodes tried per pair\n", "next route", (double)nextMs / qMax(1, nexts),
+		   (double)tried / qMax(1, routes.count()));
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Build the hierarchy, customize every profile and compare its queries
+  with the plain search.
+
+  The default profile must give the walking time of the search exactly; the
+  other ones are reported by how much longer their walks are.
+*/
+int TSBenchmark::profiles(const QStringList& args)
+{
+	int pairs = args.count() > 0 ? qMax(1, args[0].toInt()) : 1000;
+
+	TSRouteEngine engine;
+	engine.init();
+	if( !engine.isReady() )
+	{
+		fprintf(stderr, "profiles: no walking graph\n");
+		return 1;
+	}
+	const TSRouteGraph& graph = engine.graph();
+
+	QTime timer;
+	timer.start();
+	TSRouteHierarchy hierarchy;
+	hierarchy.build(&graph);
+	printf("hierarchy: %d nodes, %d edges, %d arcs, %d triangles, built in %d ms\n", graph.nodeCount(), graph.edgeCount(),
+		   hierarchy.arcCount(), hierarchy.triangleCount(), timer.elapsed());
+
+	// Defaults of the [profiles] group
+	QVector<TSRouteMetric> metrics(TSRouteProfile::COUNT);
+	for( int p = 0; p < TSRouteProfile::COUNT; p++ )
+	{
+		timer.restart();
+		metrics[p].customize(&hierarchy, TSRouteProfile::weights(graph, p, QVector<bool>(), 8, 1.5));
+		printf("%-24s %10d ms customize\n", qPrintable(TSRouteProfile::name(p)), timer.elapsed());
+	}
+	printf("%-24s %10d ms customize\n", "all profiles, parallel", engine.customize());
+
+	srand(1);
+	QVector<quint32> sources, targets;
+	for( int i = 0; i < pairs; i++ )
+	{
+		sources.append((quint32)(rand() % graph.nodeCount()));
+		targets.append((quint32)(rand() % graph.nodeCount()));
+	}
+
+	TSRouteSearch search(&graph);
+	QVector<float> expected(pairs);
+	timer.restart();
+	for( int i = 0; i < pairs; i++ )
+	{
+		search.runTo(sources[i], targets[i]);
+		expected[i] = search.reached(targets[i]) ? search.seconds(targets[i]) : TSRouteSearch::INFINITE_TIME;
+	}
+	printf("%-24s %10.1f us per query\n", "search", timer.elapsed() * 1000.0 / pairs);
+
+	TSHierarchyQuery query(&hierarchy);
+	for( int p = 0; p < TSRouteProfile::COUNT; p++ )
+	{
+		int mismatches = 0, found = 0;
+		double longer = 0;
+		timer.restart();
+		for( int i = 0; i < pairs; i++ )
+		{
+			QVector<quint32> edges = query.run(metrics[p], sources[i], targets[i]);
+			if( query.seconds() >= TSRouteSearch::INFINITE_TIME || expected[i] >= TSRouteSearch::INFINITE_TIME )
+				continue;
+
+			float seconds = 0;
+			for( int k = 0; k < edges.count(); k++ )
+				seconds += graph.edge(edges[k]).seconds;
+			if( p == TSRouteProfile::DEFAULT && fabs(query.seconds() - expected[i]) > 0.01 + expected[i] * 1e-4 )
+				mismatches++;
+			found++;
+			longer += seconds / qMax(1.0f, expected[i]);
+		}
+		printf("%-24s %10.1f us per query, %d walks %.2f times the shortest, %d mismatches\n",
+			   qPrintable(TSRouteProfile::name(p)), timer.elapsed() * 1000.0 / pairs, found, longer / qMax(1, found), mismatches);
+	}
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Sample a synthetic hilly tile one point at a time and in batches, then
+  the slopes of the whole walking graph on it.
+*/
+int TSBenchmark::elevation(const QStringList& args)
+{
+	int points = args.count() > 0 ? qMax(4, args[0].toInt()) : 4000000;
+
+	TSRouteEngine engine;
+	engine.init();
+	if( !engine.isReady() )
+	{
+		fprintf(stderr, "elevation: no walking graph\n");
+		return 1;
+	}
+	TSRouteGraph graph = engine.graph();
+
+	// One arc second tile under the graph, hills a few hundred meters wide
+	const int size = 3601;
+	const int south = (int)floor(graph.lat(0)), west = (int)floor(graph.lng(0));
+	QVector<qint16> heights(size * size);
+	for( int row = 0; row < size; row++ )
+	{
+		for( int col = 0; col < size; col++ )
+			heights[row * size + col] = (qint16)(250 + 60 * sin(col / 50.0) + 40 * cos(row / 70.0));
+	}
+	TSElevation dem;
+	dem.addTile(south, west, size, heights);
+
+	srand(1);
+	QVector<double> lat(points), lng(points);
+	for( int i = 0; i < points; i++ )
+	{
+		lat[i] = south + (double)rand() / RAND_MAX;
+		lng[i] = west + (double)rand() / RAND_MAX;
+	}
+
+	QVector<float> single(points), batch(points);
+	QTime timer;
+	timer.start();
+	for( int i = 0; i < points; i++ )
+		single[i] = dem.height(lat[i], lng[i]);
+	report(QLatin1String("height"), points, 0, timer.elapsed());
+
+	timer.restart();
+	dem.heights(lat.constData(), lng.constData(), points, batch.data());
+	report(dem.hasSimd() ? QLatin1String("heights, sse2") : QLatin1String("heights, scalar"), points, 0, timer.elapsed());
+
+	float maxError = 0;
+	for( int i = 0; i < points; i++ )
+		maxError = qMax(maxError, (float)fabs(single[i] - batch[i]));
+	printf("largest difference between both %.6f m\n", maxError);
+
+	timer.restart();
+	int covered = graph.applyElevation(dem, 10);
+	int ms = timer.elapsed();
+
+	double ascent = 0, meters = 0;
+	for( int e = 0; e < graph.edgeCount(); e++ )
+	{
+		ascent += graph.edge(e).ascent;
+		meters += graph.edge(e).meters;
+	}
+	report(QLatin1String("edge pairs"), covered, 0, ms);
+	printf("%.1f m climbed per km walked\n", meters > 0 ? ascent / meters * 1000 : 0.0);
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Search between random pairs of buildings on the outdoor graph, then
+  on the same graph with the passages through the buildings.
+*/
+int TSBenchmark::indoor(const QStringList& args)
+{
+	int pairs = args.count() > 0 ? qMax(1, args[0].toInt()) : 1000;
+
+	TSRouteEngine engine;
+	engine.init();
+	if( !engine.isReady() )
+	{
+		fprintf(stderr, "indoor: no walking graph\n");
+		return 1;
+	}
+
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	TSRouteGraph outdoor;
+	TSIndoorMap map;
+	if( !outdoor.importOsm(settings.value("routing/GraphFile", "campus.osm").toString())
+		|| !map.load(settings.value("routing/IndoorFile", "indoor.xml").toString()) )
+	{
+		fprintf(stderr, "indoor: no OSM extract or no indoor map\n");
+		return 1;
+	}
+	TSRouteGraph linked = outdoor;
+	map.link(linked, settings.value("routing/MaxSnapMeters", 500).toDouble());
+	linked.addLinks(map.links());
+	printf("indoor: %d complexes, %d passages, %d edges outdoors, %d with the passages\n", map.complexCount(),
+		   map.passages().count(), outdoor.edgeCount(), linked.edgeCount());
+
+	QList<TSRoute> routes = randomRoutes(engine, pairs);
+	const TSRouteGraph* graphs[2] = { &outdoor, &linked };
+	const char* names[2] = { "outdoor", "with passages" };
+	QVector<float> seconds[2];
+	for( int g = 0; g < 2; g++ )
+	{
+		TSRouteSearch search(graphs[g]);
+		qint64 settled = 0;
+		int inside = 0;
+		QTime timer;
+		timer.start();
+		for( int r = 0; r < routes.count(); r++ )
+		{
+			quint32 source = engine.poiNode(routes[r].srcPoi), target = engine.poiNode(routes[r].dstPoi);
+			search.runTo(source, target);
+			settled += search.settledCount();
+			seconds[g].append(search.seconds(target));
+
+			QVector<quint32> path = search.path(target);
+			for( int k = 0; k < path.count(); k++ )
+			{
+				if( graphs[g]->edge(path[k]).flags & TSRouteGraph::EDGE_INDOOR )
+				{
+					inside++;
+					break;
+				}
+			}
+		}
+		printf("%-24s %10.3f ms per search, %8.0f nodes settled, %d walks through buildings\n", names[g],
+			   (double)timer.elapsed() / qMax(1, routes.count()), (double)settled / qMax(1, routes.count()), inside);
+	}
+
+	double saved = 0;
+	int shorter = 0;
+	for( int r = 0; r < routes.count(); r++ )
+	{
+		if( seconds[1][r] < seconds[0][r] - 0.5f )
+		{
+			saved += seconds[0][r] - seconds[1][r];
+			shorter++;
+		}
+	}
+	printf("%d walks shorter through buildings, by %.0f s on average\n", shorter, saved / qMax(1, shorter));
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Search between random nodes with and without departure times, on a
+  copy of the graph where every fifth edge pair keeps office hours.
+*/
+int TSBenchmark::hours(const QStringList& args)
+{
+	int pairs = args.count() > 0 ? qMax(1, args[0].toInt()) : 1000;
+
+	TSRouteEngine engine;
+	engine.init();
+	if( !engine.isReady() )
+	{
+		fprintf(stderr, "hours: no walking graph\n");
+		return 1;
+	}
+
+	static const char* samples[] = { "24/7", "Mo-Fr 08:00-18:00", "Mo-Fr 07:00-22:00; Sa,Su 10:00-18:00",
+									 "Mo-Th 08:00-12:00,13:00-17:00; Fr 08:00-12:00; Su off", "Fr-Sa 20:00-02:00", 0 };
+	QTime timer;
+	timer.start();
+	int parsed = 0;
+	for( int i = 0; i < 100000; i++ )
+	{
+		for( int k = 0; samples[k]; k++, parsed++ )
+			TSOpeningHours::parse(QLatin1String(samples[k]));
+	}
+	report(QLatin1String("parse"), parsed, 0, timer.elapsed());
+
+	TSRouteGraph graph = engine.graph();
+	TSOpeningHours office = TSOpeningHours::parse(QLatin1String("Mo-Fr 08:00-18:00"));
+	int scheduled = 0;
+	for( int e = 0; e < graph.edgeCount(); e++ )
+	{
+		if( graph.edge(e).reverse > (quint32)e && e % 5 == 0 )
+		{
+			graph.setEdgeHours(e, office);
+			scheduled++;
+		}
+	}
+	printf("hours: %d of %d edge pairs open Mo-Fr 08:00-18:00\n", scheduled, graph.edgeCount() / 2);
+
+	srand(1);
+	QVector<quint32> sources, targets;
+	for( int i = 0; i < pairs; i++ )
+	{
+		sources.append((quint32)(rand() % graph.nodeCount()));
+		targets.append((quint32)(rand() % graph.nodeCount()));
+	}
+
+	// Monday 10:00, Friday 17:55, Sunday 03:00
+	const int departures[3] = { 10 * 3600, 4 * 86400 + 17 * 3600 + 55 * 60, 6 * 86400 + 3 * 3600 };
+	const char* names[3] = { "monday 10:00", "friday 17:55", "sunday 03:00" };
+
+	TSRouteSearch search(&graph);
+	QVector<float> plain(pairs);
+	timer.restart();
+	for( int i = 0; i < pairs; i++ )
+	{
+		search.runTo(sources[i], targets[i]);
+		plain[i] = search.seconds(targets[i]);
+	}
+	printf("%-24s %10.1f us per query\n", "no departure", timer.elapsed() * 1000.0 / pairs);
+
+	for( int d = 0; d < 3; d++ )
+	{
+		search.setDeparture(departures[d]);
+		int later = 0, unreachable = 0;
+		double delay = 0;
+		timer.restart();
+		for( int i = 0; i < pairs; i++ )
+		{
+			search.runTo(sources[i], targets[i]);
+			if( plain[i] >= TSRouteSearch::INFINITE_TIME )
+				continue;
+			if( !search.reached(targets[i]) )
+				unreachable++;
+			else if( search.seconds(targets[i]) > plain[i] + 0.5f )
+			{
+				later++;
+				delay += search.seconds(targets[i]) - plain[i];
+			}
+		}
+		printf("%-24s %10.1f us per query, %d walks later by %.0f s on average, %d never possible\n", names[d],
+			   timer.elapsed() * 1000.0 / pairs, later, delay / qMax(1, later), unreachable);
+	}
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Ask for walks between buildings, most of them among a few popular
+  ones, without and then through the route cache.
+*/
+int TSBenchmark::cache(const QStringList& args)
+{
+	int queries = args.count() > 0 ? qMax(1, args[0].toInt()) : 20000;
+
+	TSRouteEngine engine;
+	engine.init();
+	if( !engine.isReady() )
+	{
+		fprintf(stderr, "cache: no walking graph\n");
+		return 1;
+	}
+	QList<TSRoute> routes = randomRoutes(engine, 200);
+	if( routes.isEmpty() )
+	{
+		fprintf(stderr, "cache: no route between the buildings of the catalog\n");
+		return 1;
+	}
+
+	// Four queries out of five go to the first twenty walks
+	srand(2);
+	QVector<int> asked(queries);
+	for( int i = 0; i < queries; i++ )
+		asked[i] = rand() % 5 ? rand() % qMin(20, routes.count()) : rand() % routes.count();
+
+	const TSSpeechNormalizer& normalizer = TSSpeechNormalizer::standard();
+	QTime timer;
+	timer.start();
+	int points = 0;
+	for( int i = 0; i < queries; i++ )
+	{
+		const TSRoute& r = routes[asked[i]];
+		TSRoute route = engine.route(r.srcPoi, r.dstPoi, TSRouteProfile::DEFAULT);
+		points += engine.shape(route).count();
+		for( int k = 0; k < route.maneuvers.count(); k++ )
+			normalizer.normalize(route.maneuvers[k].text);
+	}
+	report(QLatin1String("without cache"), queries, 0, timer.elapsed());
+
+	timer.restart();
+	for( int i = 0; i < queries; i++ )
+	{
+		const TSRoute& r = routes[asked[i]];
+		points += engine.walk(r.srcPoi, r.dstPoi, TSRouteProfile::DEFAULT).shape.count();
+	}
+	report(QLatin1String("through the cache"), queries, 0, timer.elapsed());
+
+	const TSRouteCache& cache = engine.cache();
+	printf("%d hits, %d misses, %d walks held in %d KB, %d points drawn\n", cache.hits(), cache.misses(), cache.count(),
+		   cache.bytes() / 1024, points);
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Answer batches of route, geocode and autocomplete requests on one to
+  all the cores, as the route server does without the socket.
+*/
+int TSBenchmark::server(const QStringList& args)
+{
+	int requests = args.count() > 0 ? qMax(1, args[0].toInt()) : 20000;
+	int batchSize = args.count() > 1 ? qMax(1, args[1].toInt()) : 64;
+
+	TSRouteEngine engine;
+	engine.init();
+	if( !engine.isReady() || engine.catalog().count() < 2 )
+	{
+		fprintf(stderr, "server: no walking graph\n");
+		return 1;
+	}
+	TSRouteServer routeServer(&engine);
+
+	// Eight routes out of ten, the rest geocoding and typing ahead
+	const QList<TSPoi>& pois = engine.catalog().pois();
+	QList<QVariantList> batches;
+	srand(1);
+	for( int i = 0; i < requests; i++ )
+	{
+		if( i % batchSize == 0 )
+			batches.append(QVariantList());
+		const TSPoi& a = pois[rand() % pois.count()];
+		const TSPoi& b = pois[rand() % pois.count()];
+		QVariantMap request;
+		int kind = rand() % 10;
+		if( kind < 8 )
+		{
+			request["op"] = QLatin1String("route");
+			request["from"] = a.id;
+			request["to"] = b.name;
+			request["profile"] = TSRouteProfile::name(kind % TSRouteProfile::COUNT);
+		}
+		else if( kind == 8 )
+		{
+			request["op"] = QLatin1String("geocode");
+			request["q"] = a.address;
+		}
+		else
+		{
+			request["op"] = QLatin1String("autocomplete");
+			request["q"] = b.name.left(3);
+		}
+		batches.last().append(request);
+	}
+
+	QList<int> threads;
+	for( int t = 1; t < QThread::idealThreadCount(); t *= 2 )
+		threads.append(t);
+	threads.append(QThread::idealThreadCount());
+
+	double single = 0;
+	for( int k = 0; k < threads.count(); k++ )
+	{
+		QThreadPool::globalInstance()->setMaxThreadCount(threads[k]);
+		engine.clearCache();
+
+		QVector<int> latencies;
+		QTime timer, batchTimer;
+		timer.start();
+		for( int b = 0; b < batches.count(); b++ )
+		{
+			batchTimer.start();
+			routeServer.answerAll(batches[b]);
+			latencies.append(batchTimer.elapsed());
+		}
+		int ms = qMax(1, timer.elapsed());
+		qSort(latencies);
+		double perSecond = requests * 1000.0 / ms;
+		if( k == 0 )
+			single = perSecond;
+		printf("%2d threads %10.0f requests/s, x%.2f, batch of %d p50 %d ms, p99 %d ms\n", threads[k], perSecond,
+			   perSecond / qMax(1.0, single), batchSize, latencies[latencies.count() / 2],
+			   latencies[qMin(latencies.count() - 1, latencies.count() * 99 / 100)]);
+		fflush(stdout);
+	}
+	printf("last run: %d cache hits, %d misses\n", engine.cache().hits(), engine.cache().misses());
+	fflush(stdout);
+	return 0;
+}
+
+// Queries of one thread, searched with a new search each or with the one of the thread
+struct TSScratchJob
+{
+	typedef void result_type;
+
+	const TSRouteGraph			*graph;
+	const QVector<quint32>		*sources;
+	const QVector<quint32>		*targets;
+	int							chunkSize;
+	bool						reuse;
+	double						*seconds;		// sum of the walks of each chunk
+
+	void operator()(const int& chunk) const
+	{
+		int begin = chunk * chunkSize;
+		int end = qMin(begin + chunkSize, sources->count());
+		TSRouteSearch shared(graph);
+		double sum = 0;
+		for( int i = begin; i < end; i++ )
+		{
+			if( reuse )
+			{
+				shared.runTo((*sources)[i], (*targets)[i]);
+				sum += shared.reached((*targets)[i]) ? shared.seconds((*targets)[i]) : 0;
+			}
+			else
+			{
+				TSRouteSearch search(graph);
+				search.runTo((*sources)[i], (*targets)[i]);
+				sum += search.reached((*targets)[i]) ? search.seconds((*targets)[i]) : 0;
+			}
+		}
+		seconds[chunk] = sum;
+	}
+};
+
+/*!
+  \brief Route random pairs with a new search per query, which sizes and clears
+  its arrays every time, and with one warm search per thread, which only bumps
+  its search counter, on one thread and then on every core.
+*/
+int TSBenchmark::scratch(const QStringList& args)
+{
+	int queries = args.count() > 0 ? qMax(1, args[0].toInt()) : 5000;
+
+	TSRouteEngine engine;
+	engine.init();
+	if( !engine.isReady() )
+	{
+		fprintf(stderr, "scratch: no walking graph\n");
+		return 1;
+	}
+	const TSRouteGraph& graph = engine.graph();
+
+	srand(1);
+	QVector<quint32> sources, targets;
+	for( int i = 0; i < queries; i++ )
+	{
+		sources.append((quint32)(rand() % graph.nodeCount()));
+		targets.append((quint32)(rand() % graph.nodeCount()));
+	}
+	printf("scratch: %d nodes, %d queries\n", graph.nodeCount(), queries);
+
+	QList<int> threads;
+	threads << 1;
+	if( QThread::idealThreadCount() > 1 )
+		threads << QThread::idealThreadCount();
+
+	for( int k = 0; k < threads.count(); k++ )
+	{
+		QThreadPool::globalInstance()->setMaxThreadCount(threads[k]);
+		QList<int> chunks;
+		for( int c = 0; c < threads[k]; c++ )
+			chunks.append(c);
+		QVector<double> sums[2];
+
+		double perQuery[2];
+		for( int r = 0; r < 2; r++ )
+		{
+			sums[r].fill(0, threads[k]);
+			TSScratchJob job;
+			job.graph = &graph;
+			job.sources = &sources;
+			job.targets = &targets;
+			job.chunkSize = (queries + threads[k] - 1) / threads[k];
+			job.reuse = (r == 1);
+			job.seconds = sums[r].data();
+
+			QTime timer;
+			timer.start();
+			QtConcurrent::blockingMap(chunks, job);
+			perQuery[r] = timer.elapsed() * 1000.0 / queries;
+		}
+
+		double fresh = 0, reused = 0;
+		for( int c = 0; c < threads[k]; c++ )
+		{
+			fresh += sums[0][c];
+			reused += sums[1][c];
+		}
+		printf("%2d threads %10.1f us per query new search, %10.1f us reused, x%.2f%s\n", threads[k], perQuery[0],
+			   perQuery[1], perQuery[0] / qMax(0.001, perQuery[1]), fabs(fresh - reused) > 1 ? ", RESULTS DIFFER" : "");
+	}
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Hand random walks to the page as lists of points and as encoded
+  polylines with levels, and compare the JSON sizes, the time and the points
+  each zoom draws.
+*/
+int TSBenchmark::polyline(const QStringList& args)
+{
+	int count = args.count() > 0 ? qMax(1, args[0].toInt()) : 200;
+
+	TSRouteEngine engine;
+	engine.init();
+	if( !engine.isReady() )
+	{
+		fprintf(stderr, "polyline: no walking graph\n");
+		return 1;
+	}
+	QList<TSRoute> routes = randomRoutes(engine, count);
+	if( routes.isEmpty() )
+	{
+		fprintf(stderr, "polyline: no route between the buildings of the catalog\n");
+		return 1;
+	}
+	QList< QVector<QPointF> > shapes;
+	int points = 0;
+	for( int i = 0; i < routes.count(); i++ )
+	{
+		shapes.append(engine.shape(routes[i]));
+		points += shapes.last().count();
+	}
+	printf("polyline: %d walks, %d points\n", shapes.count(), points);
+
+	const TSPolyline& polyline = engine.polyline();
+	QJson::Serializer serializer;
+	const int rounds = 20;
+
+	qint64 listBytes = 0;
+	QTime timer;
+	timer.start();
+	for( int r = 0; r < rounds; r++ )
+	{
+		for( int i = 0; i < shapes.count(); i++ )
+		{
+			QVariantList path;
+			for( int k = 0; k < shapes[i].count(); k++ )
+				path.append(QVariant(QVariantList() << shapes[i][k].y() << shapes[i][k].x()));
+			listBytes += serializer.serialize(path).size();
+		}
+	}
+	int listMs = timer.elapsed();
+
+	qint64 encodedBytes = 0;
+	timer.restart();
+	for( int r = 0; r < rounds; r++ )
+	{
+		for( int i = 0; i < shapes.count(); i++ )
+			encodedBytes += serializer.serialize(polyline.toVariant(shapes[i])).size();
+	}
+	int encodedMs = timer.elapsed();
+
+	printf("%-24s %10.1f bytes per walk %8.1f us per walk\n", "list of points", (double)listBytes / rounds / shapes.count(),
+		   listMs * 1000.0 / rounds / shapes.count());
+	printf("%-24s %10.1f bytes per walk %8.1f us per walk, x%.1f smaller\n", "polyline and levels",
+		   (double)encodedBytes / rounds / shapes.count(), encodedMs * 1000.0 / rounds / shapes.count(),
+		   (double)listBytes / qMax((qint64)1, encodedBytes));
+
+	// Points drawn per zoom and the error of the encoding
+	const int zooms[4] = { 15, 17, 19, polyline.maxZoom() };
+	int kept[4] = { 0, 0, 0, 0 };
+	double worst = 0;
+	for( int i = 0; i < shapes.count(); i++ )
+	{
+		for( int z = 0; z < 4; z++ )
+			kept[z] += polyline.simplified(shapes[i], zooms[z]).count();
+
+		QVector<QPointF> decoded = TSPolyline::decode(TSPolyline::encode(shapes[i]));
+		for( int k = 0; k < decoded.count() && k < shapes[i].count(); k++ )
+		{
+			worst = qMax(worst, fabs(decoded[k].x() - shapes[i][k].x()));
+			worst = qMax(worst, fabs(decoded[k].y() - shapes[i][k].y()));
+		}
+	}
+	for( int z = 0; z < 4; z++ )
+		printf("zoom %2d %10d points drawn, %.0f%%\n", zooms[z], kept[z], kept[z] * 100.0 / qMax(1, points));
+	printf("largest encoding error %.1f m\n", worst * METERS_PER_DEGREE);
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Write a block of synthetic tiles as separate files, pack them, then
+  read random tiles from the files and from the mapped store.
+*/
+int TSBenchmark::tiles(const QStringList& args)
+{
+	int count = args.count() > 0 ? qMax(1, args[0].toInt()) : 1024;
+	int reads = args.count() > 1 ? qMax(1, args[1].toInt()) : 20000;
+
+	QString root = QDir::temp().filePath(QLatin1String("speechnav_tiles"));
+	int side = (int)ceil(sqrt((double)count));
+	QStringList files;
+	srand(1);
+	for( int i = 0; i < count; i++ )
+	{
+		QString dir = QString("%1/m/17/%2").arg(root).arg(36000 + i / side);
+		QDir().mkpath(dir);
+		QFile file(QString("%1/%2.png").arg(dir).arg(49000 + i % side));
+		if( !file.open(QIODevice::WriteOnly) )
+		{
+			fprintf(stderr, "tiles: cannot write %s\n", qPrintable(file.fileName()));
+			return 1;
+		}
+		QByteArray bytes(8 * 1024 + rand() % (16 * 1024), (char)(i & 0xff));
+		file.write(bytes);
+		files.append(file.fileName());
+	}
+
+	QString storeName = root + QLatin1String(".tiles");
+	QTime timer;
+	timer.start();
+	int packed = TSTileStore::pack(root, storeName);
+	printf("tiles: %d tiles packed in %d ms\n", packed, timer.elapsed());
+
+	TSTileStore store;
+	if( packed != count || !store.open(storeName) )
+	{
+		fprintf(stderr, "tiles: cannot pack %s\n", qPrintable(root));
+		return 1;
+	}
+
+	QVector<int> order(reads);
+	for( int i = 0; i < reads; i++ )
+		order[i] = rand() % count;
+
+	QByteArray buffer(32 * 1024, 0);
+	qint64 fileBytes = 0;
+	timer.restart();
+	for( int i = 0; i < reads; i++ )
+	{
+		QFile file(files[order[i]]);
+		if( file.open(QIODevice::ReadOnly) )
+			fileBytes += file.read(buffer.data(), buffer.size());
+	}
+	int fileMs = timer.elapsed();
+
+	qint64 storeBytes = 0;
+	int missing = 0;
+	timer.restart();
+	for( int i = 0; i < reads; i++ )
+	{
+		QUrl url(QString("http://mt0.googleapis.com/vt?lyrs=m@207000000&x=%1&y=%2&z=17")
+				 .arg(36000 + order[i] / side).arg(49000 + order[i] % side));
+		const uchar* data = 0;
+		qint64 size = 0;
+		if( !store.find(url, &data, &size) )
+		{
+			missing++;
+			continue;
+		}
+		qint64 n = qMin(size, (qint64)buffer.size());
+		memcpy(buffer.data(), data, n);
+		storeBytes += n;
+	}
+	int storeMs = timer.elapsed();
+
+	printf("%-24s %10.1f us per tile %8.1f MB/s\n", "separate files", fileMs * 1000.0 / reads,
+		   fileBytes / (qMax(fileMs, 1) / 1000.0) / (1024.0 * 1024.0));
+	printf("%-24s %10.1f us per tile %8.1f MB/s, %d missing, URL parsing included\n", "mapped store", storeMs * 1000.0 / reads,
+		   storeBytes / (qMax(storeMs, 1) / 1000.0) / (1024.0 * 1024.0), missing);
+	fflush(stdout);
+
+	store.close();
+	QFile::remove(storeName);
+	for( int i = 0; i < files.count(); i++ )
+		QFile::remove(files[i]);
+	for( int c = 0; c * side < count; c++ )
+		QDir().rmdir(QString("%1/m/17/%2").arg(root).arg(36000 + c));
+	QDir().rmdir(root + QLatin1String("/m/17"));
+	QDir().rmdir(root + QLatin1String("/m"));
+	QDir().rmdir(root);
+	return 0;
+}
+
+/*!
+  \brief List the corridor tiles of random walks and count how many of the
+  tiles a 1024x768 map panned along each walk shows were in the corridor.
+*/
+int TSBenchmark::prefetch(const QStringList& args)
+{
+	int count = args.count() > 0 ? qMax(1, args[0].toInt()) : 200;
+	double corridor = args.count() > 1 ? qMax(0.0, args[1].toDouble()) : 150;
+
+	TSRouteEngine engine;
+	engine.init();
+	if( !engine.isReady() )
+	{
+		fprintf(stderr, "prefetch: no walking graph\n");
+		return 1;
+	}
+	QList<TSRoute> routes = randomRoutes(engine, count);
+	if( routes.isEmpty() )
+	{
+		fprintf(stderr, "prefetch: no route between the buildings of the catalog\n");
+		return 1;
+	}
+	QList< QVector<QPointF> > shapes;
+	for( int i = 0; i < routes.count(); i++ )
+		shapes.append(engine.shape(routes[i]));
+
+	printf("prefetch: %d walks, corridor of %.0f m\n", shapes.count(), corridor);
+	for( int zoom = 15; zoom <= 18; zoom++ )
+	{
+		const int n = 1 << zoom;
+		int listed = 0, seen = 0, covered = 0;
+		QTime timer;
+		timer.start();
+		for( int i = 0; i < shapes.count(); i++ )
+			listed += TSTilePrefetcher::corridorTiles(shapes[i], zoom, corridor).count();
+		int ms = timer.elapsed();
+
+		for( int i = 0; i < shapes.count(); i++ )
+		{
+			QStringList tiles = TSTilePrefetcher::corridorTiles(shapes[i], zoom, corridor);
+			QSet<QString> corridorSet = QSet<QString>::fromList(tiles);
+			QSet<QString> viewed;
+			for( int k = 0; k < shapes[i].count(); k++ )
+			{
+				// Map centered on the point, 4 by 3 tiles of 256 pixels
+				double x = (shapes[i][k].x() + 180.0) / 360.0 * n;
+				double phi = shapes[i][k].y() * 3.14159265358979 / 180.0;
+				double y = (1.0 - log(tan(phi) + 1.0 / cos(phi)) / 3.14159265358979) / 2.0 * n;
+				for( int tx = (int)floor(x - 2); tx <= (int)floor(x + 2); tx++ )
+				{
+					for( int ty = (int)floor(y - 1.5); ty <= (int)floor(y + 1.5); ty++ )
+						viewed.insert(QString("%1/%2/%3").arg(zoom).arg(tx).arg(ty));
+				}
+			}
+			seen += viewed.count();
+			covered += viewed.intersect(corridorSet).count();
+		}
+		printf("zoom %2d %8.1f tiles per walk %8.1f us per walk, %5.1f%% of the tiles viewed were prefetched\n", zoom,
+			   (double)listed / shapes.count(), ms * 1000.0 / shapes.count(), covered * 100.0 / qMax(1, seen));
+	}
+	fflush(stdout);
+	return 0;
+}
+
+/*!
+  \brief Cut the vector tiles of the campus on one thread and on all of them,
+  then report their size per zoom against the raster tiles of the offline store.
+*/
+int TSBenchmark::vectortiles(const QStringList& args)
+{
+	Q_UNUSED(args);
+
+	TSRouteEngine engine;
+	engine.init();
+	if( !engine.isReady() )
+	{
+		fprintf(stderr, "vectortiles: no walking graph\n");
+		return 1;
+	}
+	TSVectorTileBuilder builder;
+	QTime timer;
+	timer.start();
+	builder.setSource(engine.graph(), engine.catalog());
+	printf("vectortiles: %d features from %d edges and %d buildings in %d ms\n", builder.featureCount(),
+		   engine.graph().edgeCount(), engine.catalog().count(), timer.elapsed());
+
+	QString fileName = QDir::temp().filePath(QLatin1String("speechnav_bench.vectortiles"));
+	QList<int> threads;
+	threads << 1;
+	if( QThread::idealThreadCount() > 1 )
+		threads << QThread::idealThreadCount();
+	int count = 0;
+	double single = 0;
+	for( int k = 0; k < threads.count(); k++ )
+	{
+		QThreadPool::globalInstance()->setMaxThreadCount(threads[k]);
+		timer.start();
+		count = builder.build(fileName);
+		int ms = timer.elapsed();
+		if( count < 0 )
+		{
+			fprintf(stderr, "vectortiles: cannot write %s\n", qPrintable(fileName));
+			return 1;
+		}
+		if( k == 0 )
+			single = ms;
+		printf("%2d threads %8d ms for %d tiles, x%.2f\n", threads[k], ms, count, single / qMax(1, ms));
+	}
+	QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+
+	QList<TSTileCoord> coverage = builder.coverage();
+	for( int zoom = builder.minZoom(); zoom <= builder.maxZoom(); zoom++ )
+	{
+		int tiles = 0, empty = 0, largest = 0;
+		qint64 bytes = 0;
+		for( int i = 0; i < coverage.count(); i++ )
+		{
+			if( coverage[i].zoom != zoom )
+				continue;
+			int size = builder.tile(zoom, coverage[i].x, coverage[i].y).size();
+			if( size == 0 )
+				empty++;
+			else
+				tiles++;
+			bytes += size;
+			largest = qMax(largest, size);
+		}
+		printf("zoom %2d %6d tiles %6d empty %8.0f bytes per tile, %6d at most\n", zoom, tiles, empty,
+			   (double)bytes / qMax(1, tiles), largest);
+	}
+
+	// Every tile written is found again in the mapped archive
+	TSTileStore store(QLatin1String("vectortiles"));
+	store.open(fileName);
+	int found = 0;
+	for( int i = 0; i < coverage.count(); i++ )
+	{
+		const uchar* data = 0;
+		qint64 size = 0;
+		if( store.find(QLatin1String("v"), coverage[i].zoom, coverage[i].x, coverage[i].y, &data, &size) )
+			found++;
+	}
+	qint64 archive = QFileInfo(fileName).size();
+	printf("archive  %8lld KB, %.0f bytes per tile, %d of %d tiles found%s\n", archive / 1024,
+		   (double)archive / qMax(1, count), found, count, found == count ? "" : ", TILES MISSING");
+
+	QString rasterName = QSettings("app_config.ini", QSettings::IniFormat).value(QLatin1String("tiles/File"), QLatin1String("tiles/campus.tiles")).toString();
+	TSTileStore raster;
+	if( raster.isOpen() && raster.count() > 0 )
+	{
+		qint64 rasterSize = QFileInfo(rasterName).size();
+		printf("raster   %8lld KB, %.0f bytes per tile in %s, vector tiles x%.1f smaller per tile\n", rasterSize / 1024,
+			   (double)rasterSize / raster.count(), qPrintable(rasterName),
+			   ((double)rasterSize / raster.count()) / qMax(1.0, (double)archive / qMax(1, count)));
+	}
+	else
+		printf("raster   no offline tile store to compare with\n");
+	fflush(stdout);
+
+	store.close();
+	QFile::remove(fileName);
+	return 0;
+}
@@ -0,0 +1,81 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSBenchmark.h
+// Author : Zhan
+//
+#ifndef TSBENCHMARK_H
+#define TSBENCHMARK_H
+
+#include "TSWebApp.h"
+
+#include <QStringList>
+#include <QList>
+
+struct TSFix;
+struct TSRoute;
+class TSRouteGraph;
+class TSRouteEngine;
+
+// Command line benchmarks of the native navigation code, run without any window:
+//
+//   SpeechNav.exe --benchmark normalizer [corpus.txt] [strings]
+//   SpeechNav.exe --benchmark tracker [walkers] [fixes]
+//   SpeechNav.exe --benchmark reroute [routes] [detours]
+//   SpeechNav.exe --benchmark geofence [fences] [updates]
+//   SpeechNav.exe --benchmark nearest [points] [queries]
+//   SpeechNav.exe --benchmark vocabulary [buildings] [updates]
+//   SpeechNav.exe --benchmark isochrone [queries]
+//   SpeechNav.exe --benchmark facility [queries]
+//   SpeechNav.exe --benchmark tour [stops] [tours]
+//   SpeechNav.exe --benchmark alternatives [pairs]
+//   SpeechNav.exe --benchmark profiles [pairs]
+//   SpeechNav.exe --benchmark elevation [points]
+//   SpeechNav.exe --benchmark indoor [pairs]
+//   SpeechNav.exe --benchmark hours [pairs]
+//   SpeechNav.exe --benchmark cache [queries]
+//   SpeechNav.exe --benchmark server [requests] [batch]
+//   SpeechNav.exe --benchmark scratch [queries]
+//   SpeechNav.exe --benchmark polyline [routes]
+//   SpeechNav.exe --benchmark tiles [tiles] [reads]
+//   SpeechNav.exe --benchmark prefetch [routes] [corridor meters]
+//   SpeechNav.exe --benchmark vectortiles
+//
+// Results are printed on the standard output.
+class TSWEBAPP_EXPORTS TSBenchmark
+{
+public:
+	// Returns false when the arguments do not ask for a benchmark
+	static bool					run(const QStringList& args, int* exitCode);
+
+private:
+	static int					normalizer(const QStringList& args);
+	static int					tracker(const QStringList& args);
+	static int					reroute(const QStringList& args);
+	static int					geofence(const QStringList& args);
+	static int					nearest(const QStringList& args);
+	static int					vocabulary(const QStringList& args);
+	static int					isochrone(const QStringList& args);
+	static int					facility(const QStringList& args);
+	static int					tour(const QStringList& args);
+	static int					alternatives(const QStringList& args);
+	static int					profiles(const QStringList& args);
+	static int					elevation(const QStringList& args);
+	static int					indoor(const QStringList& args);
+	static int					hours(const QStringList& args);
+	static int					cache(const QStringList& args);
+	static int					server(const QStringList& args);
+	static int					scratch(const QStringList& args);
+	static int					polyline(const QStringList& args);
+	static int					tiles(const QStringList& args);
+	static int					prefetch(const QStringList& args);
+	static int					vectortiles(const QStringList& args);
+
+	static QStringList			directionCorpus(int count);
+	static QList<TSRoute>		randomRoutes(const TSRouteEngine& engine, int count);
+	static QList<TSFix>			walk(const TSRouteGraph& graph, const TSRoute& route, double noise, int maxFixes);
+	static void					report(const QString& name, int items, qint64 chars, int ms);
+};
+
+#endif // TSBENCHMARK_H
@@ -10,6 +10,8 @@
 #include "TSCookieJar.h"
 #include "TSNetworkAccessManager.h"
 #include "TSDownloadManager.h"
+#include "TSRouteEngine.h"
+#include "TSTileStore.h"
 #include "TSMainWindow.h"
 #include "MenuItemMgr.h"
 
@@ -37,6 +39,8 @@
 
 TSDownloadManager	*TSBrowserApplication::s_downloadManager = 0;
 TSNetworkAaccessManager *TSBrowserApplication::s_networkAccessManager = 0;
+TSRouteEngine *TSBrowserApplication::s_routeEngine = 0;
+TSTileStore *TSBrowserApplication::s_vectorTiles = 0;
 
 TSBrowserApplication::TSBrowserApplication(int &argc, char **argv)
     : QApplication(argc, argv)
@@ -118,6 +122,8 @@ TSBrowserApplication::~TSBrowserApplication()
 {
 	delete s_downloadManager;
     delete s_networkAccessManager;
+	delete s_routeEngine;
+	delete s_vectorTiles;
 }
 
 #if defined(Q_WS_MAC)
@@ -219,6 +225,23 @@ TSDownloadManager *TSBrowserApplication::downloadManager()
     return s_downloadManager;
 }
 
+TSRouteEngine *TSBrowserApplication::routeEngine()
+{
+    if (!s_routeEngine) {
+		s_routeEngine = new TSRouteEngine();
+		s_routeEngine->init();
+    }
+    return s_routeEngine;
+}
+
+TSTileStore *TSBrowserApplication::vectorTiles()
+{
+    if (!s_vectorTiles) {
+		s_vectorTiles = new TSTileStore(QLatin1String("vectortiles"), QLatin1String(".speechnav"));
+    }
+    return s_vectorTiles;
+}
+
 TSNetworkAaccessManager *TSBrowserApplication::networkAccessManager()
 {
     if (!s_networkAccessManager) {
@@ -31,6 +31,8 @@ class TSCookieJar;
 class TSDownloadManager;
 class TSNetworkAaccessManager;
 class TSMainWindow;
+class TSRouteEngine;
+class TSTileStore;
 
 
 
@@ -86,6 +88,8 @@ public:
     static TSCookieJar *cookieJar();
     static TSNetworkAaccessManager *networkAccessManager();
 	static TSDownloadManager *downloadManager();
+	static TSRouteEngine *routeEngine();
+	static TSTileStore *vectorTiles();
 	
 
 	TSMainWindow		*newMainWindow(const QString& _url = QString(""), const QList<QVariant>& _menus = QList<QVariant>());
@@ -116,6 +120,8 @@ private:
 private:
 	static TSDownloadManager		*s_downloadManager;
 	static TSNetworkAaccessManager	*s_networkAccessManager;
+	static TSRouteEngine			*s_routeEngine;
+	static TSTileStore				*s_vectorTiles;
 	
 	QList<QPointer<TSMainWindow>>	m_mainWindows;
 
@@ -0,0 +1,212 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSElevation.cpp
+// Author : Zhan
+//
+
+#include "TSElevation.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QRegExp>
+#include <QtCore/QTime>
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TS_ELEVATION_SSE2
+#include <emmintrin.h>
+#endif
+
+#define HGT_VOID			-32768
+
+static inline int tileKey(int south, int west)
+{
+	return (south + 90) * 360 + (west + 180);
+}
+
+static inline float blend(float nw, float ne, float sw, float se, float fx, float fy)
+{
+	float north = nw + fx * (ne - nw);
+	float south = sw + fx * (se - sw);
+	return north + fy * (south - north);
+}
+
+TSElevation::TSElevation()
+{
+}
+
+void TSElevation::clear()
+{
+	m_tiles.clear();
+	m_index.clear();
+}
+
+bool TSElevation::hasSimd()
+{
+#ifdef TS_ELEVATION_SSE2
+	return true;
+#else
+	return false;
+#endif
+}
+
+int TSElevation::load(const QString& dir)
+{
+	QTime timer;
+	timer.start();
+
+	int loaded = 0;
+	QStringList files = QDir(dir).entryList(QStringList() << QLatin1String("*.hgt"));
+	for( int i = 0; i < files.count(); i++ )
+	{
+		if( loadTile(QDir(dir).filePath(files[i])) )
+			loaded++;
+	}
+
+	if( loaded > 0 )
+		QLOG_INFO() << QString("Elevation: loaded %1 tiles from %2 in %3 ms.").arg(loaded).arg(dir).arg(timer.elapsed());
+	return loaded;
+}
+
+/*!
+  \brief Read one SRTM tile, the corner comes from the file name.
+
+  The file is mapped rather than read, its big endian heights are swapped
+  straight from the mapping into the tile.
+*/
+bool TSElevation::loadTile(const QString& fileName)
+{
+	QString name = QFileInfo(fileName).baseName().toUpper();
+	QRegExp pattern(QLatin1String("([NS])(\\d{2})([EW])(\\d{3})"));
+	if( !pattern.exactMatch(name) )
+	{
+		QLOG_WARN() << QString("Elevation: %1 is not named like N40W080.hgt.").arg(fileName);
+		return false;
+	}
+	int south = pattern.cap(2).toInt() * (pattern.cap(1) == QLatin1String("S") ? -1 : 1);
+	int west = pattern.cap(4).toInt() * (pattern.cap(3) == QLatin1String("W") ? -1 : 1);
+
+	QFile file(fileName);
+	if( !file.open(QIODevice::ReadOnly) )
+		return false;
+
+	qint64 bytes = file.size();
+	int size = qRound(sqrt(bytes / 2.0));
+	if( size < 2 || (qint64)size * size * 2 != bytes )
+	{
+		QLOG_WARN() << QString("Elevation: %1 is not a square tile.").arg(fileName);
+		return false;
+	}
+
+	uchar* data = file.map(0, bytes);
+	if( !data )
+	{
+		QLOG_WARN() << QString("Elevation: %1 cannot be mapped.").arg(fileName);
+		return false;
+	}
+
+	QVector<qint16> heights(size * size);
+	const uchar* p = data;
+	for( int i = 0; i < heights.count(); i++, p += 2 )
+		heights[i] = (qint16)((p[0] << 8) | p[1]);
+	file.unmap(data);
+	return addTile(south, west, size, heights);
+}
+
+bool TSElevation::addTile(int south, int west, int size, const QVector<qint16>& heights)
+{
+	if( size < 2 || heights.count() != size * size )
+		return false;
+
+	Tile tile;
+	tile.south = south;
+	tile.west = west;
+	tile.size = size;
+	tile.heights = heights;
+
+	int key = tileKey(south, west);
+	if( m_index.contains(key) )
+		m_tiles[m_index.value(key)] = tile;
+	else
+	{
+		m_index.insert(key, m_tiles.count());
+		m_tiles.append(tile);
+	}
+	return true;
+}
+
+const TSElevation::Tile* TSElevation::tile(double lat, double lng) const
+{
+	QHash<int, int>::const_iterator it = m_index.find(tileKey((int)floor(lat), (int)floor(lng)));
+	return it == m_index.end() ? 0 : &m_tiles[it.value()];
+}
+
+// Heights around the point and where it lies between them
+void TSElevation::cell(double lat, double lng, Batch* b, int lane) const
+{
+	b->fx[lane] = b->fy[lane] = 0;
+	b->ne[lane] = b->sw[lane] = b->se[lane] = 0;
+	b->nw[lane] = (float)qQNaN();
+
+	const Tile* t = tile(lat, lng);
+	if( !t )
+		return;
+
+	const int last = t->size - 1;
+	double y = (t->south + 1 - lat) * last;
+	double x = (lng - t->west) * last;
+	int row = qBound(0, (int)y, last - 1);
+	int col = qBound(0, (int)x, last - 1);
+
+	const qint16* h = t->heights.constData() + row * t->size + col;
+	if( h[0] == HGT_VOID || h[1] == HGT_VOID || h[t->size] == HGT_VOID || h[t->size + 1] == HGT_VOID )
+		return;
+
+	b->nw[lane] = h[0];
+	b->ne[lane] = h[1];
+	b->sw[lane] = h[t->size];
+	b->se[lane] = h[t->size + 1];
+	b->fx[lane] = (float)(x - col);
+	b->fy[lane] = (float)(y - row);
+}
+
+float TSElevation::height(double lat, double lng) const
+{
+	Batch b;
+	cell(lat, lng, &b, 0);
+	return blend(b.nw[0], b.ne[0], b.sw[0], b.se[0], b.fx[0], b.fy[0]);
+}
+
+/*!
+  \brief Heights of many points, four at a time.
+
+  The corners are gathered one point at a time, the interpolation runs on the
+  four lanes together. A NaN corner stays NaN through the arithmetic.
+*/
+void TSElevation::heights(const double* lat, const double* lng, int count, float* out) const
+{
+	int i = 0;
+#ifdef TS_ELEVATION_SSE2
+	Batch b;
+	for( ; i + 4 <= count; i += 4 )
+	{
+		for( int lane = 0; lane < 4; lane++ )
+			cell(lat[i + lane], lng[i + lane], &b, lane);
+
+		__m128 nw = _mm_loadu_ps(b.nw), ne = _mm_loadu_ps(b.ne);
+		__m128 sw = _mm_loadu_ps(b.sw), se = _mm_loadu_ps(b.se);
+		__m128 fx = _mm_loadu_ps(b.fx), fy = _mm_loadu_ps(b.fy);
+		__m128 north = _mm_add_ps(nw, _mm_mul_ps(fx, _mm_sub_ps(ne, nw)));
+		__m128 south = _mm_add_ps(sw, _mm_mul_ps(fx, _mm_sub_ps(se, sw)));
+		_mm_storeu_ps(out + i, _mm_add_ps(north, _mm_mul_ps(fy, _mm_sub_ps(south, north))));
+	}
+#endif
+	for( ; i < count; i++ )
+		out[i] = height(lat[i], lng[i]);
+}
@@ -0,0 +1,81 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSElevation.h
+// Author : Zhan
+//
+#ifndef TSELEVATION_H
+#define TSELEVATION_H
+
+#include "TSWebApp.h"
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+// Ground elevation from SRTM tiles (.hgt), sampled bilinearly.
+//
+// A tile covers one degree square, named after its south west corner, e.g.
+// N40W080.hgt for Pittsburgh. Heights are big endian 16 bit meters, rows from
+// north to south, 1201 or 3601 per side; -32768 marks a void.
+//
+// Batches are interpolated four points at a time with SSE2 when the compiler
+// targets it (x64, or /arch:SSE2 on x86), one at a time otherwise.
+class TSWEBAPP_EXPORTS TSElevation
+{
+public:
+	TSElevation();
+
+	// Loads every tile of the directory, returns the number loaded
+	int							load(const QString& dir);
+	// Adds a tile of size x size heights, rows from north to south
+	bool						addTile(int south, int west, int size, const QVector<qint16>& heights);
+	void						clear();
+
+	bool						isEmpty() const { return m_tiles.isEmpty(); }
+	int							tileCount() const { return m_tiles.count(); }
+	static bool					hasSimd();
+
+	// Meters above sea level, NaN outside the tiles or next to a void
+	float						height(double lat, double lng) const;
+	// Same for count points at once
+	void						heights(const double* lat, const double* lng, int count, float* out) const;
+
+private:
+	struct Tile
+	{
+		int						south;
+		int						west;
+		int						size;
+		QVector<qint16>			heights;
+	};
+
+	// Corners and fractions of four points, one lane per point; nw is NaN when outside
+	struct Batch
+	{
+		float					nw[4];
+		float					ne[4];
+		float					sw[4];
+		float					se[4];
+		float					fx[4];			// 0 on the west corners, 1 on the east ones
+		float					fy[4];			// 0 on the north corners
+	};
+
+	const Tile*					tile(double lat, double lng) const;
+	void						cell(double lat, double lng, Batch* b, int lane) const;
+	bool						loadTile(const QString& fileName);
+
+	QVector<Tile>				m_tiles;
+	QHash<int, int>				m_index;		// degree square -> tile
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSELEVATION_H
@@ -0,0 +1,176 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSGeoIndex.cpp
+// Author : Zhan
+//
+
+#include "TSGeoIndex.h"
+
+#include <algorithm>
+#include <math.h>
+
+#define METERS_PER_DEGREE	111195.0
+#define DEG_TO_RAD			(3.14159265358979323846 / 180.0)
+
+struct TSGeoIndexLessX
+{
+	template <typename T> bool operator()(const T& a, const T& b) const { return a.x < b.x; }
+};
+
+struct TSGeoIndexLessY
+{
+	template <typename T> bool operator()(const T& a, const T& b) const { return a.y < b.y; }
+};
+
+TSGeoIndex::TSGeoIndex()
+: m_scale(1.0)
+{
+}
+
+void TSGeoIndex::clear()
+{
+	m_items.clear();
+	m_scale = 1.0;
+}
+
+void TSGeoIndex::build(const QVector<double>& lat, const QVector<double>& lng)
+{
+	clear();
+	const int n = qMin(lat.count(), lng.count());
+	if( n == 0 )
+		return;
+
+	double meanLat = 0;
+	for( int i = 0; i < n; i++ )
+		meanLat += lat[i];
+	m_scale = cos(meanLat / n * DEG_TO_RAD);
+
+	m_items.resize(n);
+	for( int i = 0; i < n; i++ )
+	{
+		m_items[i].x = projectX(lng[i]);
+		m_items[i].y = lat[i];
+		m_items[i].id = i;
+	}
+	build(0, n, 0);
+}
+
+void TSGeoIndex::build(int lo, int hi, int depth)
+{
+	if( hi - lo <= 1 )
+		return;
+
+	int mid = (lo + hi) / 2;
+	Item* items = m_items.data();
+	if( depth % 2 == 0 )
+		std::nth_element(items + lo, items + mid, items + hi, TSGeoIndexLessX());
+	else
+		std::nth_element(items + lo, items + mid, items + hi, TSGeoIndexLessY());
+
+	build(lo, mid, depth + 1);
+	build(mid + 1, hi, depth + 1);
+}
+
+QVector<int> TSGeoIndex::nearest(double lat, double lng, int k, double maxMeters) const
+{
+	QVector<int> ids;
+	if( k <= 0 || m_items.isEmpty() )
+		return ids;
+
+	double maxD2 = -1;
+	if( maxMeters >= 0 )
+	{
+		double deg = maxMeters / METERS_PER_DEGREE;
+		maxD2 = deg * deg;
+	}
+
+	QVector<Candidate> heap;
+	heap.reserve(k + 1);
+	nearest(0, m_items.count(), 0, projectX(lng), lat, k, maxD2, heap);
+
+	std::sort_heap(heap.begin(), heap.end());
+	ids.reserve(heap.count());
+	for( int i = 0; i < heap.count(); i++ )
+		ids.append(heap[i].id);
+	return ids;
+}
+
+int TSGeoIndex::nearestOne(double lat, double lng) const
+{
+	QVector<int> ids = nearest(lat, lng, 1);
+	return ids.isEmpty() ? -1 : ids.first();
+}
+
+// heap is a max-heap on distance holding the best k candidates so far
+void TSGeoIndex::nearest(int lo, int hi, int depth, double x, double y, int k, double maxD2, QVector<Candidate>& heap) const
+{
+	if( lo >= hi )
+		return;
+
+	int mid = (lo + hi) / 2;
+	const Item& item = m_items[mid];
+	double dx = item.x - x;
+	double dy = item.y - y;
+	double d2 = dx * dx + dy * dy;
+
+	if( maxD2 < 0 || d2 <= maxD2 )
+	{
+		if( heap.count() < k )
+		{
+			Candidate c = { d2, item.id };
+			heap.append(c);
+			std::push_heap(heap.begin(), heap.end());
+		}
+		else if( d2 < heap.first().d2 )
+		{
+			std::pop_heap(heap.begin(), heap.end());
+			heap.last().d2 = d2;
+			heap.last().id = item.id;
+			std::push_heap(heap.begin(), heap.end());
+		}
+	}
+
+	double diff = (depth % 2 == 0) ? (x - item.x) : (y - item.y);
+	int nearLo = diff < 0 ? lo : mid + 1;
+	int nearHi = diff < 0 ? mid : hi;
+	int farLo = diff < 0 ? mid + 1 : lo;
+	int farHi = diff < 0 ? hi : mid;
+
+	nearest(nearLo, nearHi, depth + 1, x, y, k, maxD2, heap);
+
+	// The far side can only help if the splitting plane is closer than the current worst
+	double plane2 = diff * diff;
+	if( maxD2 >= 0 && plane2 > maxD2 )
+		return;
+	if( heap.count() < k || plane2 < heap.first().d2 )
+		nearest(farLo, farHi, depth + 1, x, y, k, maxD2, heap);
+}
+
+QVector<int> TSGeoIndex::withinBox(double south, double west, double north, double east) const
+{
+	QVector<int> ids;
+	if( !m_items.isEmpty() )
+		withinBox(0, m_items.count(), 0, projectX(west), south, projectX(east), north, ids);
+	return ids;
+}
+
+void TSGeoIndex::withinBox(int lo, int hi, int depth, double x0, double y0, double x1, double y1, QVector<int>& out) const
+{
+	if( lo >= hi )
+		return;
+
+	int mid = (lo + hi) / 2;
+	const Item& item = m_items[mid];
+	if( item.x >= x0 && item.x <= x1 && item.y >= y0 && item.y <= y1 )
+		out.append(item.id);
+
+	double v = (depth % 2 == 0) ? item.x : item.y;
+	double min = (depth % 2 == 0) ? x0 : y0;
+	double max = (depth % 2 == 0) ? x1 : y1;
+	if( min <= v )
+		withinBox(lo, mid, depth + 1, x0, y0, x1, y1, out);
+	if( max >= v )
+		withinBox(mid + 1, hi, depth + 1, x0, y0, x1, y1, out);
+}
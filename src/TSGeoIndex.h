@@ -0,0 +1,72 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSGeoIndex.h
+// Author : Zhan
+//
+#ifndef TSGEOINDEX_H
+#define TSGEOINDEX_H
+
+#include "TSWebApp.h"
+
+#include <QVector>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+// Static 2-d tree over WGS84 points.
+//
+// Points are projected with an equirectangular projection around the mean
+// latitude, which ranks distances exactly enough at city scale. The tree is
+// stored implicitly: the median of every range is its root.
+class TSWEBAPP_EXPORTS TSGeoIndex
+{
+public:
+	TSGeoIndex();
+
+	// Point i gets id i
+	void						build(const QVector<double>& lat, const QVector<double>& lng);
+	void						clear();
+
+	int							count() const { return m_items.count(); }
+	bool						isEmpty() const { return m_items.isEmpty(); }
+
+	// Ids of the k closest points, closest first. maxMeters < 0 means unbounded.
+	QVector<int>				nearest(double lat, double lng, int k, double maxMeters = -1) const;
+	int							nearestOne(double lat, double lng) const;
+
+	// Ids of the points inside a latitude / longitude box
+	QVector<int>				withinBox(double south, double west, double north, double east) const;
+
+private:
+	struct Item
+	{
+		double					x;
+		double					y;
+		int						id;
+	};
+
+	struct Candidate
+	{
+		double					d2;
+		int						id;
+		bool operator<(const Candidate& other) const { return d2 < other.d2; }
+	};
+
+	void						build(int lo, int hi, int depth);
+	void						nearest(int lo, int hi, int depth, double x, double y, int k, double maxD2, QVector<Candidate>& heap) const;
+	void						withinBox(int lo, int hi, int depth, double x0, double y0, double x1, double y1, QVector<int>& out) const;
+
+	double						projectX(double lng) const { return lng * m_scale; }
+
+	QVector<Item>				m_items;
+	double						m_scale;		// cos(mean latitude)
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSGEOINDEX_H
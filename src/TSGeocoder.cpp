@@ -0,0 +1,313 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSGeocoder.cpp
+// Author : Zhan
+//
+
+#include "TSGeocoder.h"
+#include "TSPoiCatalog.h"
+#include "TSRouteGraph.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QRegExp>
+#include <QtCore/QSet>
+#include <QtCore/QMap>
+
+// Spelled out forms of the abbreviations used by campus and street addresses
+static const QHash<QString, QString>& abbreviations()
+{
+	static QHash<QString, QString> table;
+	if( table.isEmpty() )
+	{
+		table.insert("st", "street");
+		table.insert("ave", "avenue");
+		table.insert("av", "avenue");
+		table.insert("blvd", "boulevard");
+		table.insert("dr", "drive");
+		table.insert("rd", "road");
+		table.insert("pl", "place");
+		table.insert("ln", "lane");
+		table.insert("ct", "court");
+		table.insert("sq", "square");
+		table.insert("pkwy", "parkway");
+		table.insert("hwy", "highway");
+		table.insert("ctr", "center");
+		table.insert("bldg", "building");
+		table.insert("univ", "university");
+		table.insert("n", "north");
+		table.insert("s", "south");
+		table.insert("e", "east");
+		table.insert("w", "west");
+	}
+	return table;
+}
+
+// "5th" is a street of its own, "5" is a house number
+static int houseNumber(const QString& token)
+{
+	bool ok = false;
+	int number = token.toInt(&ok);
+	return ok ? number : -1;
+}
+
+TSGeocoder::TSGeocoder()
+: m_catalog(0)
+{
+}
+
+void TSGeocoder::build(const TSPoiCatalog* catalog)
+{
+	m_catalog = catalog;
+	m_byName.clear();
+	m_byLine.clear();
+	m_byStreet.clear();
+	m_indexIds.clear();
+
+	const QList<TSPoi>& pois = catalog->pois();
+	QVector<double> lat, lng;
+	lat.reserve(pois.count());
+	lng.reserve(pois.count());
+
+	for( int i = 0; i < pois.count(); i++ )
+	{
+		const TSPoi& poi = pois[i];
+		m_byName.insert(normalize(poi.name), poi.id);
+
+		QStringList lines = streetLines(poi.address);
+		for( int j = 0; j < lines.count(); j++ )
+		{
+			QString line = normalize(lines[j]);
+			if( line.isEmpty() )
+				continue;
+			m_byLine.insert(line, poi.id);
+
+			int number = houseNumber(line.section(' ', 0, 0));
+			QString street = (number >= 0) ? line.section(' ', 1) : line;
+			if( !street.isEmpty() )
+				m_byStreet.insert(street, qMakePair(number, poi.id));
+		}
+
+		lat.append(poi.lat);
+		lng.append(poi.lng);
+		m_indexIds.append(poi.id);
+	}
+
+	// Aliases never shadow the real name of another building
+	for( int i = 0; i < pois.count(); i++ )
+	{
+		for( int j = 0; j < pois[i].aliases.count(); j++ )
+		{
+			QString alias = normalize(pois[i].aliases[j]);
+			if( !m_byName.contains(alias) )
+				m_byName.insert(alias, pois[i].id);
+		}
+	}
+	m_index.build(lat, lng);
+
+	QLOG_INFO() << QString("Geocoder: indexed %1 names and %2 street lines.").arg(m_byName.count()).arg(m_byLine.count());
+}
+
+TSGeocodeResult TSGeocoder::result(int poiId, int match) const
+{
+	const TSPoi* poi = m_catalog->poi(poiId);
+	TSGeocodeResult r = { poiId, poi->lat, poi->lng, match };
+	return r;
+}
+
+/*!
+  \brief Resolve a building name or a street address.
+
+  A building name or a full street line resolves exactly. Otherwise the query is
+  read as "number street" and resolves to the building on that street whose house
+  number is closest.
+*/
+QList<TSGeocodeResult> TSGeocoder::geocode(const QString& query, int maxResults) const
+{
+	QList<TSGeocodeResult> results;
+	if( !m_catalog || maxResults <= 0 )
+		return results;
+
+	QSet<int> seen;
+	QStringList lines = streetLines(query);
+	if( lines.isEmpty() )
+		return results;
+
+	QString name = normalize(query);
+	QHash<QString, int>::const_iterator byName = m_byName.find(name);
+	if( byName == m_byName.end() )
+		byName = m_byName.find(normalize(lines.first()));
+	if( byName != m_byName.end() )
+	{
+		results.append(result(byName.value(), TSGeocodeResult::MATCH_NAME));
+		seen.insert(byName.value());
+	}
+
+	for( int i = 0; i < lines.count() && results.count() < maxResults; i++ )
+	{
+		QString line = normalize(lines[i]);
+		QList<int> ids = m_byLine.values(line);
+		for( int j = 0; j < ids.count() && results.count() < maxResults; j++ )
+		{
+			if( seen.contains(ids[j]) )
+				continue;
+			results.append(result(ids[j], TSGeocodeResult::MATCH_ADDRESS));
+			seen.insert(ids[j]);
+		}
+
+		int number = houseNumber(line.section(' ', 0, 0));
+		QString street = (number >= 0) ? line.section(' ', 1) : line;
+		QList<QPair<int, int> > candidates = m_byStreet.values(street);
+
+		// Closest house number first, buildings without a number last
+		QMap<qint64, int> ranked;
+		for( int j = 0; j < candidates.count(); j++ )
+		{
+			if( seen.contains(candidates[j].second) )
+				continue;
+			qint64 gap = (number < 0 || candidates[j].first < 0) ? 0x7fffffff : qAbs(candidates[j].first - number);
+			ranked.insertMulti(gap * 0x10000 + j, candidates[j].second);
+		}
+		for( QMap<qint64, int>::const_iterator it = ranked.constBegin(); it != ranked.constEnd() && results.count() < maxResults; ++it )
+		{
+			if( seen.contains(it.value()) )
+				continue;
+			results.append(result(it.value(), TSGeocodeResult::MATCH_STREET));
+			seen.insert(it.value());
+		}
+	}
+	return results;
+}
+
+/*!
+  \brief Resolve a query to the building it names, for routing and map placement.
+
+  Only a building name or a full street line counts: a query merely naming a
+  street of the catalog, such as "4000 Fifth Avenue" or an address of another
+  city on a street of the same name, is left to the caller to geocode elsewhere.
+*/
+bool TSGeocoder::resolve(const QString& query, TSGeocodeResult* found) const
+{
+	if( !m_catalog )
+		return false;
+	QStringList lines = streetLines(query);
+	if( lines.isEmpty() )
+		return false;
+
+	QHash<QString, int>::const_iterator byName = m_byName.find(normalize(query));
+	if( byName == m_byName.end() )
+		byName = m_byName.find(normalize(lines.first()));
+	if( byName != m_byName.end() )
+	{
+		*found = result(byName.value(), TSGeocodeResult::MATCH_NAME);
+		return true;
+	}
+
+	for( int i = 0; i < lines.count(); i++ )
+	{
+		QMultiHash<QString, int>::const_iterator byLine = m_byLine.find(normalize(lines[i]));
+		if( byLine != m_byLine.end() )
+		{
+			*found = result(byLine.value(), TSGeocodeResult::MATCH_ADDRESS);
+			return true;
+		}
+	}
+	return false;
+}
+
+QString TSGeocoder::matchName(int match)
+{
+	switch( match )
+	{
+	case TSGeocodeResult::MATCH_STREET:		return QLatin1String("street");
+	case TSGeocodeResult::MATCH_ADDRESS:	return QLatin1String("address");
+	default:								return QLatin1String("name");
+	}
+}
+
+QList<TSGeocodeResult> TSGeocoder::reverse(double lat, double lng, int count, double maxMeters) const
+{
+	QList<TSGeocodeResult> results;
+	QVector<int> ids = m_index.nearest(lat, lng, count, maxMeters);
+	for( int i = 0; i < ids.count(); i++ )
+		results.append(result(m_indexIds[ids[i]], TSGeocodeResult::MATCH_NAME));
+	return results;
+}
+
+// The tree ranks the buildings, exact distances are only computed for the few returned
+QList<TSNearbyPoi> TSGeocoder::nearby(double lat, double lng, int count, double maxMeters) const
+{
+	QList<TSNearbyPoi> results;
+	QVector<int> ids = m_index.nearest(lat, lng, count, maxMeters);
+	for( int i = 0; i < ids.count(); i++ )
+	{
+		const TSPoi* poi = m_catalog->poi(m_indexIds[ids[i]]);
+		TSNearbyPoi near;
+		near.poiId = poi->id;
+		near.meters = TSRouteGraph::distance(lat, lng, poi->lat, poi->lng);
+		near.bearing = TSRouteGraph::bearing(lat, lng, poi->lat, poi->lng);
+		results.append(near);
+	}
+	return results;
+}
+
+QList<TSGeocodeResult> TSGeocoder::withinBox(double south, double west, double north, double east) const
+{
+	QList<TSGeocodeResult> results;
+	QVector<int> ids = m_index.withinBox(south, west, north, east);
+	for( int i = 0; i < ids.count(); i++ )
+		results.append(result(m_indexIds[ids[i]], TSGeocodeResult::MATCH_NAME));
+	return results;
+}
+
+QString TSGeocoder::normalize(const QString& text)
+{
+	QString s = text.toLower();
+	s.replace(QLatin1Char('&'), QLatin1String(" and "));
+	s.remove(QLatin1Char('\''));
+	s.replace(QRegExp("[^a-z0-9]+"), QLatin1String(" "));
+
+	QStringList words = s.split(QLatin1Char(' '), QString::SkipEmptyParts);
+	const QHash<QString, QString>& abbr = abbreviations();
+	for( int i = 0; i < words.count(); i++ )
+	{
+		QHash<QString, QString>::const_iterator it = abbr.find(words[i]);
+		if( it != abbr.end() )
+			words[i] = it.value();
+	}
+	return words.join(QLatin1String(" "));
+}
+
+/*!
+  \brief Split an address into its street lines.
+
+  "Hillman Library, 3960 Forbes Ave, Pittsburgh, PA 15260" gives
+  ("Hillman Library", "3960 Forbes Ave"): the city and the state / zip part are
+  dropped, they are the same for the whole catalog.
+*/
+QStringList TSGeocoder::streetLines(const QString& address)
+{
+	static const QRegExp pattern("^[A-Za-z]{2}(\\s+\\d{5}(-\\d{4})?)?$");
+	QRegExp stateZip(pattern);		// matching keeps state in the object, the route server geocodes on several threads
+
+	QStringList parts = address.split(QLatin1Char(','), QString::SkipEmptyParts);
+	for( int i = 0; i < parts.count(); i++ )
+		parts[i] = parts[i].trimmed();
+
+	if( parts.count() > 1 && stateZip.exactMatch(parts.last()) )
+	{
+		parts.removeLast();
+		if( parts.count() > 1 )
+			parts.removeLast();			// city
+	}
+
+	QStringList lines;
+	for( int i = 0; i < parts.count(); i++ )
+	{
+		if( !parts[i].isEmpty() )
+			lines.append(parts[i]);
+	}
+	return lines;
+}
@@ -0,0 +1,90 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSGeocoder.h
+// Author : Zhan
+//
+#ifndef TSGEOCODER_H
+#define TSGEOCODER_H
+
+#include "TSWebApp.h"
+#include "TSGeoIndex.h"
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QPair>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class TSPoiCatalog;
+
+struct TSGeocodeResult
+{
+	enum Match
+	{
+		MATCH_STREET = 1,		// same street, closest house number
+		MATCH_ADDRESS,			// same normalized street line
+		MATCH_NAME				// building name
+	};
+
+	int							poiId;
+	double						lat;
+	double						lng;
+	int							match;
+};
+
+// Building around a position
+struct TSNearbyPoi
+{
+	int							poiId;
+	double						meters;
+	double						bearing;		// from the position to the building, 0 = north, clockwise
+};
+
+// Resolves building names and street addresses of the catalog to coordinates
+// without any network round trip, and answers reverse and bounding box queries
+// from a 2-d tree.
+class TSWEBAPP_EXPORTS TSGeocoder
+{
+public:
+	TSGeocoder();
+
+	void						build(const TSPoiCatalog* catalog);
+
+	// Best matches first, street matches are only suggestions
+	QList<TSGeocodeResult>		geocode(const QString& query, int maxResults = 5) const;
+	// Building the query names by its name or a full street line, false if none does
+	bool						resolve(const QString& query, TSGeocodeResult* found) const;
+	// Closest buildings first
+	QList<TSGeocodeResult>		reverse(double lat, double lng, int count = 1, double maxMeters = -1) const;
+	QList<TSNearbyPoi>			nearby(double lat, double lng, int count = 3, double maxMeters = -1) const;
+	QList<TSGeocodeResult>		withinBox(double south, double west, double north, double east) const;
+
+	// "210 S. Bouquet St" -> "210 south bouquet street"
+	static QString				normalize(const QString& text);
+	// Street lines of an address, without city, state and zip
+	static QStringList			streetLines(const QString& address);
+	// "street", "address" or "name"
+	static QString				matchName(int match);
+
+private:
+	TSGeocodeResult				result(int poiId, int match) const;
+
+	const TSPoiCatalog			*m_catalog;
+	QHash<QString, int>			m_byName;		// normalized name -> poi id
+	QMultiHash<QString, int>	m_byLine;		// normalized street line -> poi id
+	QMultiHash<QString, QPair<int, int> > m_byStreet;	// normalized street -> (house number or -1, poi id)
+	TSGeoIndex					m_index;
+	QVector<int>				m_indexIds;		// index id -> poi id
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSGEOCODER_H
@@ -0,0 +1,280 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSGeofence.cpp
+// Author : Zhan
+//
+
+#include "TSGeofence.h"
+#include "TSPoiCatalog.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QSettings>
+#include <QtAlgorithms>
+
+#include <math.h>
+
+#define METERS_PER_DEGREE	111195.0
+#define DEG_TO_RAD			(3.14159265358979323846 / 180.0)
+
+TSGeofenceIndex::TSGeofenceIndex()
+: m_cellLat(1)
+, m_cellLng(1)
+{
+}
+
+void TSGeofenceIndex::clear()
+{
+	m_fences.clear();
+	m_cells.clear();
+	m_cellFences.clear();
+}
+
+/*!
+  \brief Index the fences on a grid of cellMeters.
+
+  The fences are first listed as (cell, fence) pairs, sorted, then packed so
+  that the fences of a cell are contiguous and in increasing order.
+*/
+void TSGeofenceIndex::build(const QList<TSGeofence>& fences, double cellMeters)
+{
+	clear();
+	if( fences.isEmpty() )
+		return;
+
+	double latSum = 0;
+	for( int i = 0; i < fences.count(); i++ )
+	{
+		TSGeofence fence = fences[i];
+		double west = fence.polygon[0].x(), east = west, south = fence.polygon[0].y(), north = south;
+		for( int k = 1; k < fence.polygon.count(); k++ )
+		{
+			west = qMin(west, fence.polygon[k].x());
+			east = qMax(east, fence.polygon[k].x());
+			south = qMin(south, fence.polygon[k].y());
+			north = qMax(north, fence.polygon[k].y());
+		}
+		fence.bounds = QRectF(west, south, east - west, north - south);
+		latSum += fence.bounds.center().y();
+		m_fences.append(fence);
+	}
+
+	m_cellLat = cellMeters / METERS_PER_DEGREE;
+	m_cellLng = cellMeters / (METERS_PER_DEGREE * cos(latSum / m_fences.count() * DEG_TO_RAD));
+
+	QVector< QPair<quint64, int> > entries;
+	for( int i = 0; i < m_fences.count(); i++ )
+	{
+		const QRectF& b = m_fences[i].bounds;
+		int row0 = (int)floor(b.top() / m_cellLat), row1 = (int)floor(b.bottom() / m_cellLat);
+		int col0 = (int)floor(b.left() / m_cellLng), col1 = (int)floor(b.right() / m_cellLng);
+		for( int row = row0; row <= row1; row++ )
+		{
+			for( int col = col0; col <= col1; col++ )
+				entries.append(qMakePair(cellKey(row, col), i));
+		}
+	}
+	qSort(entries);
+
+	m_cellFences.resize(entries.count());
+	for( int i = 0; i < entries.count(); i++ )
+	{
+		m_cellFences[i] = entries[i].second;
+		if( i == 0 || entries[i].first != entries[i - 1].first )
+			m_cells.insert(entries[i].first, qMakePair(i, 0));
+		m_cells[entries[i].first].second++;
+	}
+
+	QLOG_INFO() << QString("Geofences: %1 fences in %2 cells of %3 m.").arg(m_fences.count()).arg(m_cells.count()).arg(cellMeters);
+}
+
+void TSGeofenceIndex::build(const TSPoiCatalog& catalog, double radiusMeters, double approachMeters)
+{
+	QList<TSGeofence> fences;
+	for( int i = 0; i < catalog.pois().count(); i++ )
+	{
+		const TSPoi& poi = catalog.pois()[i];
+		TSGeofence fence;
+		fence.poiId = poi.id;
+
+		// The approach circle grows with the footprint so that it always surrounds it
+		double extent = radiusMeters;
+		fence.kind = TSGeofence::FOOTPRINT;
+		if( poi.footprint.count() >= 3 )
+		{
+			fence.polygon = poi.footprint;
+			extent = 0;
+			for( int k = 0; k < poi.footprint.count(); k++ )
+			{
+				double dx = (poi.footprint[k].x() - poi.lng) * METERS_PER_DEGREE * cos(poi.lat * DEG_TO_RAD);
+				double dy = (poi.footprint[k].y() - poi.lat) * METERS_PER_DEGREE;
+				extent = qMax(extent, sqrt(dx * dx + dy * dy));
+			}
+		}
+		else
+			fence.polygon = circle(poi.lat, poi.lng, radiusMeters);
+		fences.append(fence);
+
+		fence.kind = TSGeofence::ENTRANCE;
+		for( int k = 0; k < poi.entrances.count(); k++ )
+		{
+			fence.polygon = poi.entrances[k];
+			fences.append(fence);
+		}
+
+		fence.kind = TSGeofence::APPROACH;
+		fence.polygon = circle(poi.lat, poi.lng, extent + approachMeters);
+		fences.append(fence);
+	}
+	build(fences);
+}
+
+quint64 TSGeofenceIndex::cellKey(double lat, double lng) const
+{
+	return cellKey((int)floor(lat / m_cellLat), (int)floor(lng / m_cellLng));
+}
+
+void TSGeofenceIndex::containing(double lat, double lng, QVector<int>* out) const
+{
+	QHash<quint64, QPair<int, int> >::const_iterator it = m_cells.find(cellKey(lat, lng));
+	if( it == m_cells.end() )
+		return;
+
+	int end = it.value().first + it.value().second;
+	for( int i = it.value().first; i < end; i++ )
+	{
+		int f = m_cellFences[i];
+		const QRectF& b = m_fences[f].bounds;
+		if( lng < b.left() || lng > b.right() || lat < b.top() || lat > b.bottom() )
+			continue;
+		if( insidePolygon(m_fences[f].polygon, lng, lat) )
+			out->append(f);
+	}
+}
+
+bool TSGeofenceIndex::contains(int fence, double lat, double lng, double marginMeters) const
+{
+	const TSGeofence& f = m_fences[fence];
+	double marginLat = marginMeters / METERS_PER_DEGREE;
+	double marginLng = marginMeters / (METERS_PER_DEGREE * cos(lat * DEG_TO_RAD));
+	const QRectF& b = f.bounds;
+	if( lng < b.left() - marginLng || lng > b.right() + marginLng || lat < b.top() - marginLat || lat > b.bottom() + marginLat )
+		return false;
+
+	if( insidePolygon(f.polygon, lng, lat) )
+		return true;
+	return marginMeters > 0 && outlineMeters(f.polygon, lat, lng) <= marginMeters;
+}
+
+// Crossing number: a ray toward +x crosses the outline an odd number of times from inside
+bool TSGeofenceIndex::insidePolygon(const QVector<QPointF>& polygon, double x, double y)
+{
+	bool inside = false;
+	const QPointF* p = polygon.constData();
+	for( int i = 0, j = polygon.count() - 1; i < polygon.count(); j = i++ )
+	{
+		if( (p[i].y() > y) != (p[j].y() > y)
+			&& x < (p[j].x() - p[i].x()) * (y - p[i].y()) / (p[j].y() - p[i].y()) + p[i].x() )
+			inside = !inside;
+	}
+	return inside;
+}
+
+// Distance to the closest side, in a local plane around the point
+double TSGeofenceIndex::outlineMeters(const QVector<QPointF>& polygon, double lat, double lng)
+{
+	double kx = METERS_PER_DEGREE * cos(lat * DEG_TO_RAD);
+	double ky = METERS_PER_DEGREE;
+	double best = -1;
+	for( int i = 0, j = polygon.count() - 1; i < polygon.count(); j = i++ )
+	{
+		double ax = (polygon[j].x() - lng) * kx, ay = (polygon[j].y() - lat) * ky;
+		double bx = (polygon[i].x() - lng) * kx, by = (polygon[i].y() - lat) * ky;
+		double dx = bx - ax, dy = by - ay;
+		double len2 = dx * dx + dy * dy;
+		double t = len2 > 0 ? qBound(0.0, -(ax * dx + ay * dy) / len2, 1.0) : 0;
+		double px = ax + t * dx, py = ay + t * dy;
+		double d = sqrt(px * px + py * py);
+		if( best < 0 || d < best )
+			best = d;
+	}
+	return best;
+}
+
+QVector<QPointF> TSGeofenceIndex::circle(double lat, double lng, double meters, int sides)
+{
+	QVector<QPointF> polygon(sides);
+	double kx = METERS_PER_DEGREE * cos(lat * DEG_TO_RAD);
+	for( int k = 0; k < sides; k++ )
+	{
+		double a = 2 * 3.14159265358979323846 * k / sides;
+		polygon[k] = QPointF(lng + meters * sin(a) / kx, lat + meters * cos(a) / METERS_PER_DEGREE);
+	}
+	return polygon;
+}
+
+TSGeofenceMonitor::TSGeofenceMonitor(const TSGeofenceIndex* index, QObject *parent)
+: QObject(parent)
+, m_index(index)
+, m_exitMeters(10)
+{
+	// Reserved vectors keep their memory when resized to 0
+	m_inside.reserve(16);
+	m_hits.reserve(16);
+	m_next.reserve(16);
+	loadSettings();
+}
+
+void TSGeofenceMonitor::loadSettings()
+{
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	settings.beginGroup(QLatin1String("geofence"));
+	m_exitMeters = settings.value(QLatin1String("ExitMeters"), 10.0).toDouble();
+	settings.endGroup();
+}
+
+/*!
+  \brief Compare the fences at the position with the fences the walker was in.
+
+  Both lists are sorted, a single merge finds the fences entered, kept and
+  left. Fences being left are tested again with the exit margin. Signals are
+  emitted once the new state is stored, exits first.
+*/
+void TSGeofenceMonitor::update(double lat, double lng)
+{
+	m_hits.resize(0);
+	m_index->containing(lat, lng, &m_hits);
+
+	m_next.resize(0);
+	QVector<int> exits, entries;
+	int i = 0, j = 0;
+	while( i < m_inside.count() || j < m_hits.count() )
+	{
+		if( j >= m_hits.count() || (i < m_inside.count() && m_inside[i] < m_hits[j]) )
+		{
+			int f = m_inside[i++];
+			if( m_index->contains(f, lat, lng, m_exitMeters) )
+				m_next.append(f);
+			else
+				exits.append(f);
+		}
+		else if( i >= m_inside.count() || m_hits[j] < m_inside[i] )
+		{
+			entries.append(m_hits[j]);
+			m_next.append(m_hits[j++]);
+		}
+		else
+		{
+			m_next.append(m_hits[j++]);
+			i++;
+		}
+	}
+	qSwap(m_inside, m_next);
+
+	for( int k = 0; k < exits.count(); k++ )
+		emit exited(exits[k]);
+	for( int k = 0; k < entries.count(); k++ )
+		emit entered(entries[k]);
+}
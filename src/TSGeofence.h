@@ -0,0 +1,121 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSGeofence.h
+// Author : Zhan
+//
+#ifndef TSGEOFENCE_H
+#define TSGEOFENCE_H
+
+#include "TSWebApp.h"
+
+#include <QObject>
+#include <QVector>
+#include <QList>
+#include <QHash>
+#include <QPair>
+#include <QPointF>
+#include <QRectF>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class TSPoiCatalog;
+
+// Area around or inside a building of the catalog
+struct TSGeofence
+{
+	enum Kind
+	{
+		APPROACH,		// circle around the building, the walker is getting close
+		FOOTPRINT,		// outline of the building
+		ENTRANCE		// door area
+	};
+
+	int							poiId;
+	Kind						kind;
+	QVector<QPointF>			polygon;		// x = lng, y = lat
+	QRectF						bounds;			// of the polygon, same convention
+};
+
+// Static index of geofences on a sparse uniform grid.
+//
+// Each fence is listed in every grid cell its bounding box overlaps, so a point
+// query reads one cell and runs the point-in-polygon test on the few fences of
+// that cell only. Cells are hashed rather than stored in a dense array because
+// the catalog spans buildings tens of kilometers away from the campus.
+class TSWEBAPP_EXPORTS TSGeofenceIndex
+{
+public:
+	TSGeofenceIndex();
+
+	void						build(const QList<TSGeofence>& fences, double cellMeters = 50);
+	// Footprint, entrances and approach circle of every building. A circle of
+	// radiusMeters stands in for a missing footprint.
+	void						build(const TSPoiCatalog& catalog, double radiusMeters, double approachMeters);
+	void						clear();
+
+	int							count() const { return m_fences.count(); }
+	const TSGeofence&			fence(int i) const { return m_fences[i]; }
+
+	// Appends the fences containing the point to out, in increasing order
+	void						containing(double lat, double lng, QVector<int>* out) const;
+	// True if the point is inside the fence or within marginMeters of its outline
+	bool						contains(int fence, double lat, double lng, double marginMeters = 0) const;
+
+	static QVector<QPointF>		circle(double lat, double lng, double meters, int sides = 16);
+
+private:
+	static bool					insidePolygon(const QVector<QPointF>& polygon, double x, double y);
+	static double				outlineMeters(const QVector<QPointF>& polygon, double lat, double lng);
+
+	quint64						cellKey(double lat, double lng) const;
+	quint64						cellKey(int row, int col) const { return ((quint64)(quint32)row << 32) | (quint32)col; }
+
+	QVector<TSGeofence>			m_fences;
+	QHash<quint64, QPair<int, int> > m_cells;	// cell -> first position and count in m_cellFences
+	QVector<int>				m_cellFences;
+	double						m_cellLat;		// cell size in degrees
+	double						m_cellLng;
+};
+
+// Enter / exit state of one walker over a geofence index.
+//
+// A fence is entered as soon as a position falls inside it, but left only once
+// the walker is exitMeters away from its outline, so that GPS noise along the
+// border does not make it flicker.
+class TSWEBAPP_EXPORTS TSGeofenceMonitor : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit TSGeofenceMonitor(const TSGeofenceIndex* index, QObject *parent = 0);
+
+	void						loadSettings();
+	void						setExitMeters(double meters) { m_exitMeters = meters; }
+
+	void						update(double lat, double lng);
+	// Forgets the fences the walker is in, without signals
+	void						reset() { m_inside.clear(); }
+
+	const QVector<int>&			inside() const { return m_inside; }
+
+signals:
+	void						entered(int fence);
+	void						exited(int fence);
+
+private:
+	const TSGeofenceIndex		*m_index;
+	QVector<int>				m_inside;		// sorted
+	QVector<int>				m_hits;			// reused between updates
+	QVector<int>				m_next;
+	double						m_exitMeters;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSGEOFENCE_H
@@ -0,0 +1,332 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSIndoorMap.cpp
+// Author : Zhan
+//
+
+#include "TSIndoorMap.h"
+#include "TSRouteSearch.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QSettings>
+#include <QtCore/QXmlStreamReader>
+
+#include <math.h>
+
+#include <vector>
+#include <queue>
+#include <functional>
+
+TSIndoorMap::TSIndoorMap()
+: m_levelMeters(4)
+, m_elevatorSeconds(30)
+, m_levelSeconds(3)
+{
+	loadSettings();
+}
+
+void TSIndoorMap::loadSettings()
+{
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	settings.beginGroup(QLatin1String("indoor"));
+	m_levelMeters = settings.value(QLatin1String("LevelMeters"), 4).toDouble();
+	m_elevatorSeconds = settings.value(QLatin1String("ElevatorSeconds"), 30).toDouble();
+	m_levelSeconds = settings.value(QLatin1String("LevelSeconds"), 3).toDouble();
+	settings.endGroup();
+}
+
+void TSIndoorMap::clear()
+{
+	m_complexes.clear();
+	m_passages.clear();
+	m_byEnds.clear();
+}
+
+/*!
+  \brief Load the indoor graphs from an xml file.
+
+  Format:  <indoor><complex name="...">
+             <node id="a" lat="40.44" lng="-79.95" level="1" [poi="41"] [entrance="yes"]/>...
+             <way from="a" to="b" [kind="corridor|stairs|elevator"]/>...
+           </complex>...</indoor>
+  \return true if at least one complex has been loaded
+*/
+bool TSIndoorMap::load(const QString& fileName)
+{
+	clear();
+
+	QFile file(fileName);
+	if( !file.open(QIODevice::ReadOnly) )
+		return false;
+
+	QHash<QString, int> ids;		// node ids of the current complex
+	QXmlStreamReader xml(&file);
+	while( !xml.atEnd() )
+	{
+		xml.readNext();
+		if( !xml.isStartElement() )
+			continue;
+
+		QXmlStreamAttributes attrs = xml.attributes();
+		if( xml.name() == "complex" )
+		{
+			Complex c;
+			c.name = attrs.value("name").toString().simplified();
+			m_complexes.append(c);
+			ids.clear();
+		}
+		else if( xml.name() == "node" && !m_complexes.isEmpty() )
+		{
+			Node node;
+			bool okLat, okLng;
+			QString id = attrs.value("id").toString();
+			node.lat = attrs.value("lat").toString().toDouble(&okLat);
+			node.lng = attrs.value("lng").toString().toDouble(&okLng);
+			node.level = attrs.value("level").toString().toInt();
+			node.poiId = attrs.value("poi").toString().toInt();
+			node.entrance = attrs.value("entrance") == "yes";
+			if( !okLat || !okLng || id.isEmpty() || ids.contains(id) )
+			{
+				QLOG_WARN() << QString("Indoor map %1: invalid or duplicated node at line %2.").arg(fileName).arg(xml.lineNumber());
+				continue;
+			}
+			ids.insert(id, m_complexes.last().nodes.count());
+			m_complexes.last().nodes.append(node);
+		}
+		else if( xml.name() == "way" && !m_complexes.isEmpty() )
+		{
+			Way way;
+			QString from = attrs.value("from").toString(), to = attrs.value("to").toString();
+			QString kind = attrs.value("kind").toString();
+			way.a = ids.value(from, -1);
+			way.b = ids.value(to, -1);
+			way.kind = kind == "stairs" ? STAIRS : (kind == "elevator" ? ELEVATOR : CORRIDOR);
+			if( way.a < 0 || way.b < 0 || way.a == way.b )
+			{
+				QLOG_WARN() << QString("Indoor map %1: way between unknown nodes at line %2.").arg(fileName).arg(xml.lineNumber());
+				continue;
+			}
+			m_complexes.last().ways.append(way);
+		}
+	}
+
+	if( xml.hasError() )
+		QLOG_ERROR() << QString("Indoor map %1: %2").arg(fileName).arg(xml.errorString());
+
+	QLOG_INFO() << QString("Indoor map %1: %2 complexes loaded.").arg(fileName).arg(m_complexes.count());
+	return !m_complexes.isEmpty();
+}
+
+/*!
+  \brief Walking time along an indoor way.
+
+  A corridor between levels is a ramp. Stairs are walked at the stairs pace
+  over about twice their rise; an elevator costs the wait plus the ride.
+*/
+float TSIndoorMap::waySeconds(const Complex& c, const Way& way, float* meters) const
+{
+	const Node& a = c.nodes[way.a];
+	const Node& b = c.nodes[way.b];
+	double flat = TSRouteGraph::distance(a.lat, a.lng, b.lat, b.lng);
+	double rise = qAbs(a.level - b.level) * m_levelMeters;
+
+	if( way.kind == ELEVATOR )
+	{
+		*meters = (float)flat;
+		return (float)(m_elevatorSeconds + qAbs(a.level - b.level) * m_levelSeconds + flat / TSRouteGraph::WALK_SPEED);
+	}
+	if( way.kind == STAIRS )
+	{
+		*meters = (float)qMax(flat, 2 * rise);
+		return (float)(*meters / TSRouteGraph::WALK_SPEED * TSRouteGraph::STEPS_FACTOR);
+	}
+	*meters = (float)sqrt(flat * flat + rise * rise);
+	return (float)(*meters / TSRouteGraph::WALK_SPEED);
+}
+
+// Dijkstra on one complex; via holds the way each node was reached by, -1 for none
+void TSIndoorMap::search(const Complex& c, int source, bool stepFree, QVector<float>* seconds, QVector<int>* via) const
+{
+	const int n = c.nodes.count();
+	seconds->fill(TSRouteSearch::INFINITE_TIME, n);
+	via->fill(-1, n);
+
+	QVector< QList<int> > ways(n);
+	for( int w = 0; w < c.ways.count(); w++ )
+	{
+		ways[c.ways[w].a].append(w);
+		ways[c.ways[w].b].append(w);
+	}
+
+	typedef std::pair<float, int> Entry;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > queue;
+	(*seconds)[source] = 0;
+	queue.push(Entry(0.0f, source));
+	while( !queue.empty() )
+	{
+		Entry top = queue.top();
+		queue.pop();
+		int u = top.second;
+		if( top.first > (*seconds)[u] )
+			continue;
+
+		for( int i = 0; i < ways[u].count(); i++ )
+		{
+			const Way& way = c.ways[ways[u][i]];
+			if( stepFree && way.kind == STAIRS )
+				continue;
+			float meters;
+			float t = (*seconds)[u] + waySeconds(c, way, &meters);
+			int v = way.a == u ? way.b : way.a;
+			if( t < (*seconds)[v] )
+			{
+				(*seconds)[v] = t;
+				(*via)[v] = ways[u][i];
+				queue.push(Entry(t, v));
+			}
+		}
+	}
+}
+
+/*!
+  \brief Passages between every two entrances of each complex.
+
+  The fastest walk comes first; when it takes stairs, the fastest step free
+  walk is kept as well so the step free profile can still cut through.
+  Walking from the entrance to its outdoor node is part of the passage.
+*/
+int TSIndoorMap::link(const TSRouteGraph& graph, double maxSnapMeters)
+{
+	m_passages.clear();
+	m_byEnds.clear();
+	if( graph.isEmpty() )
+		return 0;
+
+	for( int k = 0; k < m_complexes.count(); k++ )
+	{
+		const Complex& c = m_complexes[k];
+		QVector<int> entrances;
+		QVector<quint32> outdoor;
+		QVector<double> snap;
+		for( int i = 0; i < c.nodes.count(); i++ )
+		{
+			if( !c.nodes[i].entrance )
+				continue;
+			double meters = 0;
+			quint32 node = graph.nearestNode(c.nodes[i].lat, c.nodes[i].lng, &meters);
+			if( node == TS_INVALID || meters > maxSnapMeters )
+			{
+				QLOG_DEBUG() << QString("Indoor map: an entrance of %1 is off the walking graph.").arg(c.name);
+				continue;
+			}
+			entrances.append(i);
+			outdoor.append(node);
+			snap.append(meters);
+		}
+
+		QVector<float> seconds;
+		QVector<int> via;
+		for( int stepFree = 0; stepFree < 2; stepFree++ )
+		{
+			for( int s = 0; s < entrances.count(); s++ )
+			{
+				search(c, entrances[s], stepFree != 0, &seconds, &via);
+				for( int t = 0; t < entrances.count(); t++ )
+				{
+					if( outdoor[t] == outdoor[s] || seconds[entrances[t]] >= TSRouteSearch::INFINITE_TIME )
+						continue;
+
+					TSPassage p;
+					p.from = outdoor[s];
+					p.to = outdoor[t];
+					p.complex = c.name;
+					p.fromPoi = c.nodes[entrances[s]].poiId;
+					p.toPoi = c.nodes[entrances[t]].poiId;
+					p.fromLevel = c.nodes[entrances[s]].level;
+					p.toLevel = c.nodes[entrances[t]].level;
+					p.meters = (float)(snap[s] + snap[t]);
+					p.seconds = seconds[entrances[t]] + (float)((snap[s] + snap[t]) / TSRouteGraph::WALK_SPEED);
+					p.steps = p.elevator = false;
+
+					// Back from the exit, then reversed
+					for( int x = entrances[t]; x != entrances[s]; )
+					{
+						const Way& way = c.ways[via[x]];
+						float meters;
+						waySeconds(c, way, &meters);
+						p.meters += meters;
+						p.steps = p.steps || way.kind == STAIRS;
+						p.elevator = p.elevator || way.kind == ELEVATOR;
+						p.lat.prepend(c.nodes[x].lat);
+						p.lng.prepend(c.nodes[x].lng);
+						if( c.nodes[x].poiId > 0 && (p.pois.isEmpty() || p.pois.first() != c.nodes[x].poiId) )
+							p.pois.prepend(c.nodes[x].poiId);
+						x = way.a == x ? way.b : way.a;
+					}
+					p.lat.prepend(c.nodes[entrances[s]].lat);
+					p.lng.prepend(c.nodes[entrances[s]].lng);
+					if( p.fromPoi > 0 && (p.pois.isEmpty() || p.pois.first() != p.fromPoi) )
+						p.pois.prepend(p.fromPoi);
+
+					// The step free walk only matters when the fastest one climbs stairs
+					QPair<quint32, quint32> ends(p.from, p.to);
+					QList<int>& same = m_byEnds[ends];
+					bool keep = true;
+					for( int i = 0; i < same.count() && keep; i++ )
+					{
+						TSPassage& other = m_passages[same[i]];
+						if( stepFree ? !other.steps : other.steps == p.steps )
+						{
+							if( !stepFree && p.seconds < other.seconds )
+								other = p;		// two entrances on the same outdoor nodes
+							keep = false;
+						}
+					}
+					if( keep && (!stepFree || !same.isEmpty()) )
+					{
+						same.append(m_passages.count());
+						m_passages.append(p);
+					}
+				}
+			}
+		}
+	}
+
+	QLOG_INFO() << QString("Indoor map: %1 passages through %2 complexes.").arg(m_passages.count()).arg(m_complexes.count());
+	return m_passages.count();
+}
+
+const TSPassage* TSIndoorMap::passage(quint32 from, quint32 to, bool steps) const
+{
+	QHash<QPair<quint32, quint32>, QList<int> >::const_iterator it = m_byEnds.find(qMakePair(from, to));
+	if( it == m_byEnds.end() || it.value().isEmpty() )
+		return 0;
+	for( int i = 0; i < it.value().count(); i++ )
+	{
+		if( m_passages[it.value()[i]].steps == steps )
+			return &m_passages[it.value()[i]];
+	}
+	return &m_passages[it.value().first()];
+}
+
+QList<TSRouteGraph::Link> TSIndoorMap::links() const
+{
+	QList<TSRouteGraph::Link> links;
+	for( int i = 0; i < m_passages.count(); i++ )
+	{
+		const TSPassage& p = m_passages[i];
+		TSRouteGraph::Link link;
+		link.from = p.from;
+		link.to = p.to;
+		link.meters = p.meters;
+		link.seconds = p.seconds;
+		link.name = p.complex;
+		link.flags = (quint16)(TSRouteGraph::EDGE_INDOOR | TSRouteGraph::EDGE_COVERED | (p.steps ? TSRouteGraph::EDGE_STEPS : 0));
+		links.append(link);
+	}
+	return links;
+}
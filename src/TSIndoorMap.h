@@ -0,0 +1,122 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSIndoorMap.h
+// Author : Zhan
+//
+#ifndef TSINDOORMAP_H
+#define TSINDOORMAP_H
+
+#include "TSWebApp.h"
+#include "TSRouteGraph.h"
+
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QPair>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+// Best walk inside a complex from one entrance to another
+struct TSPassage
+{
+	quint32						from;			// outdoor graph nodes of the entrances
+	quint32						to;
+	int							fromPoi;		// building of each entrance, 0 if unknown
+	int							toPoi;
+	int							fromLevel;
+	int							toLevel;
+	float						meters;
+	float						seconds;
+	QString						complex;		// name of the connected buildings
+	QList<int>					pois;			// buildings walked through, in order
+	bool						steps;			// climbs stairs; without it the walk is step free
+	bool						elevator;
+	QVector<double>				lat;			// indoor path, entrances included
+	QVector<double>				lng;
+};
+
+// Multi-level indoor graphs of connected buildings.
+//
+// Each complex is a small graph of corridors, stairs and elevators. It is not
+// merged with the outdoor graph: the best walk between every two of its
+// entrances is computed once, and only those passages join the outdoor graph,
+// as edges between the outdoor nodes of the entrances. A complex with k
+// entrances adds k(k-1) edges, twice that when the fastest walk takes stairs
+// and a step free one exists, so the outdoor searches barely grow while still
+// cutting through the buildings. The indoor path of a passage is kept here for
+// the directions and the map.
+//
+// Configured by the [indoor] group of app_config.ini.
+class TSWEBAPP_EXPORTS TSIndoorMap
+{
+public:
+	TSIndoorMap();
+
+	void						loadSettings();
+	bool						load(const QString& fileName);
+	void						clear();
+
+	bool						isEmpty() const { return m_complexes.isEmpty(); }
+	int							complexCount() const { return m_complexes.count(); }
+
+	// Snaps the entrances to the graph and computes the passages, returns their count
+	int							link(const TSRouteGraph& graph, double maxSnapMeters);
+	const QList<TSPassage>&		passages() const { return m_passages; }
+	// One graph edge per passage, for TSRouteGraph::addLinks()
+	QList<TSRouteGraph::Link>	links() const;
+	// Passage walked by a graph edge from -> to, 0 if the edge is outdoors
+	const TSPassage*			passage(quint32 from, quint32 to, bool steps) const;
+
+private:
+	enum Kind
+	{
+		CORRIDOR = 0,
+		STAIRS,
+		ELEVATOR
+	};
+
+	struct Node
+	{
+		double					lat;
+		double					lng;
+		int						level;
+		int						poiId;
+		bool					entrance;
+	};
+
+	struct Way
+	{
+		int						a;
+		int						b;
+		int						kind;
+	};
+
+	struct Complex
+	{
+		QString					name;
+		QVector<Node>			nodes;
+		QVector<Way>			ways;
+	};
+
+	void						search(const Complex& c, int source, bool stepFree, QVector<float>* seconds, QVector<int>* via) const;
+	float						waySeconds(const Complex& c, const Way& way, float* meters) const;
+
+	QList<Complex>				m_complexes;
+	QList<TSPassage>			m_passages;
+	QHash<QPair<quint32, quint32>, QList<int> > m_byEnds;	// entrances -> passages
+
+	double						m_levelMeters;		// floor to floor
+	double						m_elevatorSeconds;	// waiting for the car
+	double						m_levelSeconds;		// riding one level
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSINDOORMAP_H
@@ -0,0 +1,371 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSIsochrone.cpp
+// Author : Zhan
+//
+
+#include "TSIsochrone.h"
+#include "TSRouteEngine.h"
+#include "TSRouteSearch.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QSettings>
+#include <QtCore/QStringList>
+#include <QtCore/QPair>
+#include <QtCore/QtConcurrentMap>
+#include <QtAlgorithms>
+
+#include <math.h>
+
+#define METERS_PER_DEGREE	111195.0
+#define DEG_TO_RAD			(3.14159265358979323846 / 180.0)
+#define MAX_GRID_CELLS		(2048 * 2048)
+
+// Side of a marked cell facing an empty one, the marked cell on its left
+struct TSIsochroneBorder
+{
+	enum Direction { EAST, NORTH, WEST, SOUTH };
+
+	int							from;			// vertex y * (width + 1) + x
+	int							to;
+	int							dir;
+};
+
+typedef QPair<qint64, QVector<QPointF> > TSIsochroneRing;		// minus twice the area, ring
+
+static bool largerRing(const TSIsochroneRing& a, const TSIsochroneRing& b)
+{
+	return a.first < b.first;
+}
+
+// Occupancy grid of the raster hull; x grows east, y grows north
+struct TSIsochroneGrid
+{
+	double						west;			// corner of cell (0, 0)
+	double						south;
+	double						cellLng;		// cell size in degrees
+	double						cellLat;
+	int							width;
+	int							height;
+	QVector<quint8>				cells;
+
+	bool at(int x, int y) const
+	{
+		return x >= 0 && y >= 0 && x < width && y < height && cells[y * width + x];
+	}
+
+	void mark(double lat, double lng)
+	{
+		int x = (int)((lng - west) / cellLng);
+		int y = (int)((lat - south) / cellLat);
+		if( x >= 0 && y >= 0 && x < width && y < height )
+			cells[y * width + x] = 1;
+	}
+
+	// Samples twice per cell so that no cell crossed by the segment is skipped
+	void markSegment(double lat0, double lng0, double lat1, double lng1)
+	{
+		double span = qMax(fabs(lng1 - lng0) / cellLng, fabs(lat1 - lat0) / cellLat);
+		int steps = (int)ceil(span * 2) + 1;
+		for( int i = 0; i <= steps; i++ )
+		{
+			double f = (double)i / steps;
+			mark(lat0 + f * (lat1 - lat0), lng0 + f * (lng1 - lng0));
+		}
+	}
+
+	void dilate()
+	{
+		QVector<quint8> grown(cells.count(), 0);
+		for( int y = 0; y < height; y++ )
+		{
+			for( int x = 0; x < width; x++ )
+			{
+				if( !cells[y * width + x] )
+					continue;
+				for( int dy = qMax(0, y - 1); dy <= qMin(height - 1, y + 1); dy++ )
+				{
+					for( int dx = qMax(0, x - 1); dx <= qMin(width - 1, x + 1); dx++ )
+						grown[dy * width + dx] = 1;
+				}
+			}
+		}
+		cells = grown;
+	}
+
+	QList< QVector<QPointF> > outlines() const;
+};
+
+/*!
+  \brief Trace the outer borders of the marked cells.
+
+  Every side between a marked and an empty cell becomes a directed edge with
+  the marked cell on its left, so outer rings run counter-clockwise and holes
+  clockwise. Edges are chained vertex to vertex; where two cells touch by a
+  corner only, the left turn is taken. Straight runs are merged and the rings
+  are returned largest first.
+*/
+QList< QVector<QPointF> > TSIsochroneGrid::outlines() const
+{
+	typedef TSIsochroneBorder Border;
+
+	const int stride = width + 1;
+	QVector<Border> borders;
+	QVector<int> out0((width + 1) * (height + 1), -1), out1((width + 1) * (height + 1), -1);
+	for( int y = 0; y < height; y++ )
+	{
+		for( int x = 0; x < width; x++ )
+		{
+			if( !at(x, y) )
+				continue;
+
+			Border sides[4];
+			int n = 0;
+			if( !at(x, y - 1) )
+			{
+				Border b = { y * stride + x, y * stride + x + 1, Border::EAST };
+				sides[n++] = b;
+			}
+			if( !at(x + 1, y) )
+			{
+				Border b = { y * stride + x + 1, (y + 1) * stride + x + 1, Border::NORTH };
+				sides[n++] = b;
+			}
+			if( !at(x, y + 1) )
+			{
+				Border b = { (y + 1) * stride + x + 1, (y + 1) * stride + x, Border::WEST };
+				sides[n++] = b;
+			}
+			if( !at(x - 1, y) )
+			{
+				Border b = { (y + 1) * stride + x, y * stride + x, Border::SOUTH };
+				sides[n++] = b;
+			}
+			for( int k = 0; k < n; k++ )
+			{
+				int& slot = out0[sides[k].from] < 0 ? out0[sides[k].from] : out1[sides[k].from];
+				slot = borders.count();
+				borders.append(sides[k]);
+			}
+		}
+	}
+
+	QList<TSIsochroneRing> rings;
+	QVector<bool> used(borders.count(), false);
+	for( int first = 0; first < borders.count(); first++ )
+	{
+		if( used[first] )
+			continue;
+
+		QVector<int> chain;
+		int cur = first;
+		do
+		{
+			used[cur] = true;
+			chain.append(cur);
+
+			int v = borders[cur].to;
+			int a = out0[v], b = out1[v];
+			bool okA = a >= 0 && (!used[a] || a == first);
+			bool okB = b >= 0 && (!used[b] || b == first);
+			if( okA && okB )
+				cur = ((borders[a].dir - borders[cur].dir + 4) % 4 == 1) ? a : b;
+			else
+				cur = okA ? a : b;
+		}
+		while( cur != first && cur >= 0 );
+
+		// Corners only, with the signed area on the vertex grid
+		QVector<QPointF> ring;
+		qint64 area2 = 0;
+		for( int k = 0; k < chain.count(); k++ )
+		{
+			const Border& e = borders[chain[k]];
+			int x0 = e.from % stride, y0 = e.from / stride;
+			int x1 = e.to % stride, y1 = e.to / stride;
+			area2 += (qint64)x0 * y1 - (qint64)x1 * y0;
+			if( borders[chain[(k + chain.count() - 1) % chain.count()]].dir != e.dir )
+				ring.append(QPointF(west + x0 * cellLng, south + y0 * cellLat));
+		}
+		if( area2 > 0 && ring.count() >= 4 )
+			rings.append(qMakePair(-area2, ring));
+	}
+
+	qSort(rings.begin(), rings.end(), largerRing);
+	QList< QVector<QPointF> > result;
+	for( int i = 0; i < rings.count(); i++ )
+		result.append(rings[i].second);
+	return result;
+}
+
+// Shapes one band, run by QtConcurrent on every band
+struct TSIsochroneJob
+{
+	typedef void result_type;
+
+	const TSRouteEngine			*engine;
+	const TSRouteSearch			*search;
+	const QVector< QPair<float, quint32> > *reached;	// by increasing time
+	const QList<int>			*bands;
+	TSIsochroneBand				*results;
+	double						startSeconds;
+	double						cellMeters;
+
+	void operator()(const int& b) const
+	{
+		const TSRouteGraph& graph = engine->graph();
+		TSIsochroneBand& band = results[b];
+		band.seconds = (*bands)[b];
+		float limit = (float)(band.seconds - startSeconds);
+
+		int count = 0;
+		while( count < reached->count() && (*reached)[count].first <= limit )
+			count++;
+		if( count == 0 )
+			return;
+
+		const QList<TSPoi>& pois = engine->catalog().pois();
+		QList< QPair<float, int> > found;
+		for( int i = 0; i < pois.count(); i++ )
+		{
+			quint32 node = engine->poiNode(pois[i].id);
+			if( node != TS_INVALID && search->isSettled(node) && search->seconds(node) <= limit )
+				found.append(qMakePair(search->seconds(node), pois[i].id));
+		}
+		qSort(found);
+		for( int i = 0; i < found.count(); i++ )
+		{
+			band.poiIds.append(found[i].second);
+			band.poiSeconds.append((float)(found[i].first + startSeconds));
+		}
+
+		// Paths leaving a reached node are drawn as far as the time allows
+		double south = 90, north = -90, west = 180, east = -180;
+		for( int i = 0; i < count; i++ )
+		{
+			quint32 u = (*reached)[i].second;
+			south = qMin(south, graph.lat(u));
+			north = qMax(north, graph.lat(u));
+			west = qMin(west, graph.lng(u));
+			east = qMax(east, graph.lng(u));
+			for( quint32 e = graph.firstEdge(u); e < graph.lastEdge(u); e++ )
+			{
+				quint32 v = graph.edge(e).target;
+				south = qMin(south, graph.lat(v));
+				north = qMax(north, graph.lat(v));
+				west = qMin(west, graph.lng(v));
+				east = qMax(east, graph.lng(v));
+			}
+		}
+
+		TSIsochroneGrid grid;
+		double meters = cellMeters;
+		double kx = METERS_PER_DEGREE * cos((south + north) / 2 * DEG_TO_RAD);
+		while( ((east - west) * kx / meters + 5) * ((north - south) * METERS_PER_DEGREE / meters + 5) > MAX_GRID_CELLS )
+			meters *= 2;
+		grid.cellLng = meters / kx;
+		grid.cellLat = meters / METERS_PER_DEGREE;
+		grid.west = west - 2 * grid.cellLng;
+		grid.south = south - 2 * grid.cellLat;
+		grid.width = (int)((east - grid.west) / grid.cellLng) + 3;
+		grid.height = (int)((north - grid.south) / grid.cellLat) + 3;
+		grid.cells.fill(0, grid.width * grid.height);
+
+		for( int i = 0; i < count; i++ )
+		{
+			quint32 u = (*reached)[i].second;
+			float su = (*reached)[i].first;
+			grid.mark(graph.lat(u), graph.lng(u));
+			for( quint32 e = graph.firstEdge(u); e < graph.lastEdge(u); e++ )
+			{
+				const TSRouteGraph::Edge& edge = graph.edge(e);
+				double f = edge.seconds > 0 ? qMin(1.0, (double)(limit - su) / edge.seconds) : 1.0;
+				quint32 v = edge.target;
+				grid.markSegment(graph.lat(u), graph.lng(u),
+								 graph.lat(u) + f * (graph.lat(v) - graph.lat(u)),
+								 graph.lng(u) + f * (graph.lng(v) - graph.lng(u)));
+			}
+		}
+		grid.dilate();
+		band.outlines = grid.outlines();
+	}
+};
+
+TSIsochrone::TSIsochrone(const TSRouteEngine* engine)
+: m_engine(engine)
+, m_cellMeters(25)
+, m_maxSnapMeters(200)
+{
+	loadSettings();
+}
+
+void TSIsochrone::loadSettings()
+{
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	settings.beginGroup(QLatin1String("isochrone"));
+	m_cellMeters = settings.value(QLatin1String("CellMeters"), 25.0).toDouble();
+	m_maxSnapMeters = settings.value(QLatin1String("MaxSnapMeters"), 200.0).toDouble();
+
+	m_bands.clear();
+	QStringList minutes = settings.value(QLatin1String("Minutes"), QLatin1String("5;10;15")).toString().split(QLatin1Char(';'), QString::SkipEmptyParts);
+	for( int i = 0; i < minutes.count(); i++ )
+	{
+		int m = minutes[i].trimmed().toInt();
+		if( m > 0 )
+			m_bands.append(m * 60);
+	}
+	qSort(m_bands);
+	settings.endGroup();
+}
+
+/*!
+  \brief Reachable buildings and outlines for every band.
+
+  The walk from the position to the closest node counts against every band.
+*/
+QList<TSIsochroneBand> TSIsochrone::compute(double lat, double lng, const QList<int>& bandSeconds) const
+{
+	QList<TSIsochroneBand> bands;
+	const TSRouteGraph& graph = m_engine->graph();
+	double snapMeters = 0;
+	quint32 source = graph.nearestNode(lat, lng, &snapMeters);
+	if( source == TS_INVALID || snapMeters > m_maxSnapMeters || bandSeconds.isEmpty() )
+		return bands;
+
+	QList<int> sorted = bandSeconds;
+	qSort(sorted);
+	double startSeconds = snapMeters / TSRouteGraph::WALK_SPEED;
+
+	TSRouteSearch search(&graph);
+	search.runWithin(source, (float)(sorted.last() - startSeconds));
+
+	QVector< QPair<float, quint32> > reached;
+	for( int u = 0; u < graph.nodeCount(); u++ )
+	{
+		if( search.isSettled(u) )
+			reached.append(qMakePair(search.seconds(u), (quint32)u));
+	}
+	qSort(reached);
+
+	QVector<TSIsochroneBand> results(sorted.count());
+	QList<int> indexes;
+	for( int i = 0; i < sorted.count(); i++ )
+		indexes.append(i);
+
+	TSIsochroneJob job;
+	job.engine = m_engine;
+	job.search = &search;
+	job.reached = &reached;
+	job.bands = &sorted;
+	job.results = results.data();
+	job.startSeconds = startSeconds;
+	job.cellMeters = m_cellMeters;
+	QtConcurrent::blockingMap(indexes, job);
+
+	for( int i = 0; i < results.count(); i++ )
+		bands.append(results[i]);
+	return bands;
+}
@@ -0,0 +1,67 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSIsochrone.h
+// Author : Zhan
+//
+#ifndef TSISOCHRONE_H
+#define TSISOCHRONE_H
+
+#include "TSWebApp.h"
+
+#include <QList>
+#include <QVector>
+#include <QPointF>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class TSRouteEngine;
+
+// What can be reached on foot within a time band
+struct TSIsochroneBand
+{
+	int							seconds;
+	QList<int>					poiIds;			// closest first
+	QList<float>				poiSeconds;
+	QList< QVector<QPointF> >	outlines;		// outer rings, counter-clockwise, x = lng and y = lat
+};
+
+// Isochrones from a position over the walking graph.
+//
+// A single search bounded by the widest band settles every node once; the
+// bands are then shaped in parallel, as they only read the search. The shape
+// of a band is a concave hull obtained on a raster: the reached paths, cut
+// where the time runs out, are drawn on a grid of cellMeters, grown by one
+// cell to close the gaps between neighbouring paths, and the border of the
+// drawn cells is traced. Holes are dropped, separate islands are kept.
+//
+// Configured by the [isochrone] group of app_config.ini.
+class TSWEBAPP_EXPORTS TSIsochrone
+{
+public:
+	explicit TSIsochrone(const TSRouteEngine* engine);
+
+	void						loadSettings();
+	void						setCellMeters(double meters) { m_cellMeters = meters; }
+
+	// Bands in increasing order, empty when the position is off the graph
+	QList<TSIsochroneBand>		compute(double lat, double lng, const QList<int>& bandSeconds) const;
+
+	// Default bands of the configuration
+	const QList<int>&			defaultBands() const { return m_bands; }
+
+private:
+	const TSRouteEngine			*m_engine;
+	double						m_cellMeters;
+	double						m_maxSnapMeters;
+	QList<int>					m_bands;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSISOCHRONE_H
@@ -43,11 +43,38 @@
 #include <QFileInfo>
 
 #include "TSBrowserApplication.h"
+#include "TSBenchmark.h"
+#include "TSRouteServer.h"
+#include "TSTileStore.h"
+#include "TSVectorTiles.h"
 
 int main(int argc, char *argv[])
 {
     Q_INIT_RESOURCE(speechnav);
 
+	// Benchmarks run from the command line, without any window
+	QStringList args;
+	for (int i = 0; i < argc; i++)
+		args.append(QString::fromLocal8Bit(argv[i]));
+	int benchmarkResult = 0;
+	if (TSBenchmark::run(args, &benchmarkResult))
+		return benchmarkResult;
+
+	// Headless route server shared by kiosks and web front ends
+	int serverResult = 0;
+	if (TSRouteServer::run(args, argc, argv, &serverResult))
+		return serverResult;
+
+	// Map tiles packed for offline use
+	int packResult = 0;
+	if (TSTileStore::run(args, &packResult))
+		return packResult;
+
+	// Vector tiles of the campus cut from the graph and the catalog
+	int buildResult = 0;
+	if (TSVectorTileBuilder::run(args, &buildResult))
+		return buildResult;
+
 	// Set QTWEBKIT_PLUGIN_PATH env to exe's path/plugin
 	QFileInfo fi (argv[0]);
     QString appPath = fi.absolutePath();
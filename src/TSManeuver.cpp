@@ -0,0 +1,284 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSManeuver.cpp
+// Author : Zhan
+//
+
+#include "TSManeuver.h"
+#include "TSRouteGraph.h"
+#include "TSPoiCatalog.h"
+#include "TSGeocoder.h"
+#include "TSIndoorMap.h"
+#include "TSSpeechNormalizer.h"
+
+#include <math.h>
+
+const double TSManeuverBuilder::STRAIGHT_ANGLE = 30.0;
+const double TSManeuverBuilder::LANDMARK_METERS = 40.0;
+
+static const char* turnVerb(int type)
+{
+	switch( type )
+	{
+	case TSManeuver::SLIGHT_LEFT:	return "Bear left";
+	case TSManeuver::LEFT:			return "Turn left";
+	case TSManeuver::SHARP_LEFT:	return "Turn sharp left";
+	case TSManeuver::SLIGHT_RIGHT:	return "Bear right";
+	case TSManeuver::RIGHT:			return "Turn right";
+	case TSManeuver::SHARP_RIGHT:	return "Turn sharp right";
+	case TSManeuver::UTURN:			return "Turn around";
+	default:						return "Continue";
+	}
+}
+
+// Angle in (-180, 180], positive clockwise
+static double normalizeAngle(double deg)
+{
+	while( deg > 180.0 )
+		deg -= 360.0;
+	while( deg <= -180.0 )
+		deg += 360.0;
+	return deg;
+}
+
+TSManeuverBuilder::TSManeuverBuilder(const TSRouteGraph* graph, const TSPoiCatalog* catalog, const TSGeocoder* geocoder,
+									 const TSIndoorMap* indoor)
+: m_graph(graph)
+, m_catalog(catalog)
+, m_geocoder(geocoder)
+, m_indoor(indoor)
+{
+}
+
+// Buildings and levels of the passage starting the maneuver, if the edge is one
+void TSManeuverBuilder::enter(TSManeuver& m, quint32 edge) const
+{
+	m.indoor = m.elevator = false;
+	m.exitPoi = m.fromLevel = m.toLevel = 0;
+
+	const TSRouteGraph::Edge& e = m_graph->edge(edge);
+	if( !(e.flags & TSRouteGraph::EDGE_INDOOR) )
+		return;
+	m.indoor = true;
+	const TSPassage* passage = m_indoor ? m_indoor->passage(m_graph->edgeSource(edge), e.target, (e.flags & TSRouteGraph::EDGE_STEPS) != 0) : 0;
+	if( passage )
+	{
+		m.landmark = passage->fromPoi;
+		m.exitPoi = passage->toPoi;
+		m.fromLevel = passage->fromLevel;
+		m.toLevel = passage->toLevel;
+		m.elevator = passage->elevator;
+	}
+}
+
+double TSManeuverBuilder::edgeBearing(quint32 edge) const
+{
+	quint32 from = m_graph->edgeSource(edge);
+	quint32 to = m_graph->edge(edge).target;
+	return TSRouteGraph::bearing(m_graph->lat(from), m_graph->lng(from), m_graph->lat(to), m_graph->lng(to));
+}
+
+int TSManeuverBuilder::turnType(double angle) const
+{
+	double a = fabs(angle);
+	if( a < STRAIGHT_ANGLE )
+		return TSManeuver::CONTINUE;
+	if( a > 170.0 )
+		return TSManeuver::UTURN;
+	if( angle < 0 )
+		return a < 60.0 ? TSManeuver::SLIGHT_LEFT : (a < 135.0 ? TSManeuver::LEFT : TSManeuver::SHARP_LEFT);
+	return a < 60.0 ? TSManeuver::SLIGHT_RIGHT : (a < 135.0 ? TSManeuver::RIGHT : TSManeuver::SHARP_RIGHT);
+}
+
+/*!
+  \brief Build the maneuvers of a walk.
+
+  A new maneuver starts where the street name changes, or at a junction where
+  the walker has to turn by STRAIGHT_ANGLE or more. Bends of a single way are
+  never announced.
+*/
+QList<TSManeuver> TSManeuverBuilder::build(const QVector<quint32>& path, int dstPoi) const
+{
+	QList<TSManeuver> maneuvers;
+	if( path.isEmpty() )
+		return maneuvers;
+
+	TSManeuver current;
+	current.type = TSManeuver::DEPART;
+	current.angle = 0;
+	current.node = m_graph->edgeSource(path[0]);
+	current.lat = m_graph->lat(current.node);
+	current.lng = m_graph->lng(current.node);
+	current.bearing = qRound(edgeBearing(path[0])) % 360;
+	current.street = m_graph->edgeName(path[0]);
+	current.steps = false;
+	current.landmark = 0;
+	current.offset = 0;
+	current.meters = 0;
+	current.seconds = 0;
+	enter(current, path[0]);
+
+	float offset = 0;
+	for( int i = 0; i < path.count(); i++ )
+	{
+		const TSRouteGraph::Edge& edge = m_graph->edge(path[i]);
+		if( i > 0 )
+		{
+			quint32 u = m_graph->edgeSource(path[i]);
+			double heading = edgeBearing(path[i]);
+			double angle = normalizeAngle(heading - edgeBearing(path[i - 1]));
+			QString street = m_graph->edgeName(path[i]);
+			bool junction = (m_graph->lastEdge(u) - m_graph->firstEdge(u)) > 2;
+
+			bool indoor = (edge.flags & TSRouteGraph::EDGE_INDOOR) != 0;
+			if( street != current.street || indoor || current.indoor || (junction && fabs(angle) >= STRAIGHT_ANGLE) )
+			{
+				maneuvers.append(current);
+
+				current.type = turnType(angle);
+				current.angle = qRound(angle);
+				current.bearing = qRound(heading) % 360;
+				current.street = street;
+				current.steps = false;
+				current.node = u;
+				current.lat = m_graph->lat(u);
+				current.lng = m_graph->lng(u);
+				current.landmark = 0;
+				current.offset = offset;
+				current.meters = 0;
+				current.seconds = 0;
+				enter(current, path[i]);
+			}
+		}
+		offset += edge.meters;
+		current.meters += edge.meters;
+		current.seconds += edge.seconds;
+		if( edge.flags & TSRouteGraph::EDGE_STEPS )
+			current.steps = true;
+	}
+	maneuvers.append(current);
+
+	// Arrival, with the side of the destination building
+	quint32 last = m_graph->edge(path.last()).target;
+	TSManeuver arrive;
+	arrive.type = TSManeuver::ARRIVE;
+	arrive.angle = 0;
+	arrive.bearing = current.bearing;
+	arrive.street = current.street;
+	arrive.steps = false;
+	arrive.node = last;
+	arrive.lat = m_graph->lat(last);
+	arrive.lng = m_graph->lng(last);
+	arrive.landmark = dstPoi;
+	arrive.offset = offset;
+	arrive.meters = 0;
+	arrive.seconds = 0;
+	arrive.indoor = arrive.elevator = false;
+	arrive.exitPoi = arrive.fromLevel = arrive.toLevel = 0;
+	const TSPoi* dst = m_catalog ? m_catalog->poi(dstPoi) : 0;
+	if( dst && TSRouteGraph::distance(arrive.lat, arrive.lng, dst->lat, dst->lng) > 10.0 )
+	{
+		double side = normalizeAngle(TSRouteGraph::bearing(arrive.lat, arrive.lng, dst->lat, dst->lng) - edgeBearing(path.last()));
+		arrive.angle = qRound(side);
+	}
+	maneuvers.append(arrive);
+
+	// Landmarks at the turns, the departure and the arrival speak of their own building
+	if( m_geocoder )
+	{
+		for( int i = 1; i < maneuvers.count() - 1; i++ )
+		{
+			if( maneuvers[i].indoor )
+				continue;
+			QList<TSGeocodeResult> near = m_geocoder->reverse(maneuvers[i].lat, maneuvers[i].lng, 1, LANDMARK_METERS);
+			if( !near.isEmpty() && near.first().poiId != dstPoi )
+				maneuvers[i].landmark = near.first().poiId;
+		}
+	}
+
+	for( int i = 0; i < maneuvers.count(); i++ )
+		describe(maneuvers[i]);
+	return maneuvers;
+}
+
+QString TSManeuverBuilder::compassPoint(double bearing)
+{
+	static const char* compass[] = { "north", "northeast", "east", "southeast",
+									 "south", "southwest", "west", "northwest" };
+	int b = qRound(bearing) % 360;
+	if( b < 0 )
+		b += 360;
+	return QLatin1String(compass[((b + 22) / 45) % 8]);
+}
+
+void TSManeuverBuilder::describe(TSManeuver& m) const
+{
+	const TSPoi* landmark = m_catalog ? m_catalog->poi(m.landmark) : 0;
+
+	if( m.type == TSManeuver::ARRIVE )
+	{
+		QString place = landmark ? landmark->name : QString("your destination");
+		if( qAbs(m.angle) < 30 || qAbs(m.angle) > 150 )
+			m.text = QString("Arrive at %1.").arg(place);
+		else
+			m.text = QString("Arrive at %1, on your %2.").arg(place).arg(m.angle < 0 ? "left" : "right");
+		return;
+	}
+
+	// "Enter Thaw Hall, take the elevator to level 3 and leave by Allen Hall after 150 meters."
+	if( m.indoor )
+	{
+		const TSPoi* exit = m_catalog ? m_catalog->poi(m.exitPoi) : 0;
+		QString text = landmark ? QString("Enter %1").arg(landmark->name) : QString("Go inside");
+		if( m.toLevel != m.fromLevel )
+			text += QString(", take the %1 to level %2").arg(m.steps ? "stairs" : (m.elevator ? "elevator" : "ramp")).arg(m.toLevel);
+		if( exit && exit != landmark )
+			text += QString(" and leave by %1 after %2").arg(exit->name).arg(spokenDistance(m.meters));
+		else
+			text += QString(" and walk %1 inside").arg(spokenDistance(m.meters));
+		m.text = text + ".";
+		return;
+	}
+
+	QString onto = m.street.isEmpty() ? QString() : spokenName(m.street);
+	QString text;
+	if( m.type == TSManeuver::DEPART )
+	{
+		text = QString("Head %1").arg(compassPoint(m.bearing));
+		if( !onto.isEmpty() )
+			text += QString(" on %1").arg(onto);
+	}
+	else
+	{
+		text = turnVerb(m.type);
+		if( !onto.isEmpty() )
+			text += QString(" onto %1").arg(onto);
+		if( landmark )
+			text += QString(" near %1").arg(landmark->name);
+	}
+
+	if( m.steps )
+		text += QString(", take the stairs");
+	text += QString(" and walk %1").arg(spokenDistance(m.meters));
+	m.text = text + ".";
+}
+
+QString TSManeuverBuilder::spokenName(const QString& name)
+{
+	return TSSpeechNormalizer::standard().normalize(name);
+}
+
+QString TSManeuverBuilder::spokenDistance(double meters)
+{
+	if( meters >= 950.0 )
+	{
+		double km = qRound(meters / 100.0) / 10.0;
+		if( km == floor(km) )
+			return QString("%1 %2").arg((int)km).arg(km == 1.0 ? "kilometer" : "kilometers");
+		return QString("%1 kilometers").arg(km, 0, 'f', 1);
+	}
+	int rounded = (meters < 100.0) ? qMax(10, qRound(meters / 10.0) * 10) : qRound(meters / 50.0) * 50;
+	return QString("%1 meters").arg(rounded);
+}
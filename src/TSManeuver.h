@@ -0,0 +1,117 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSManeuver.h
+// Author : Zhan
+//
+#ifndef TSMANEUVER_H
+#define TSMANEUVER_H
+
+#include "TSWebApp.h"
+
+#include <QString>
+#include <QList>
+#include <QVector>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class TSRouteGraph;
+class TSPoiCatalog;
+class TSGeocoder;
+class TSIndoorMap;
+
+// One step of a walk: what to do at a point, then how far to walk
+struct TSManeuver
+{
+	enum Type
+	{
+		DEPART = 0,
+		CONTINUE,			// street name changes, no turn
+		SLIGHT_LEFT,
+		LEFT,
+		SHARP_LEFT,
+		SLIGHT_RIGHT,
+		RIGHT,
+		SHARP_RIGHT,
+		UTURN,
+		ARRIVE
+	};
+
+	int							type;
+	int							angle;			// turn in degrees, positive to the right
+	int							bearing;		// heading after the maneuver, 0 = north
+	QString						street;			// empty for unnamed walkways
+	bool						steps;			// the walk after the maneuver takes stairs
+	bool						indoor;			// the walk after the maneuver goes through a building, entered at landmark
+	bool						elevator;		// indoor: takes an elevator
+	int							exitPoi;		// indoor: building left by, 0 if unknown
+	int							fromLevel;		// indoor: levels of the entrance and of the exit
+	int							toLevel;
+	double						lat;			// maneuver point
+	double						lng;
+	quint32						node;
+	int							landmark;		// poi id of a building next to the point, 0 if none
+	float						offset;			// meters from the start of the walk
+	float						meters;			// walk until the next maneuver
+	float						seconds;
+	QString						text;			// ready to be spoken
+};
+
+// A walk on the graph with its maneuvers
+struct TSRoute
+{
+	int							srcPoi;
+	int							dstPoi;
+	QVector<quint32>			edges;
+	QVector<float>				offsets;		// meters from the start to the source of each edge, plus the total
+	QList<TSManeuver>			maneuvers;
+	float						wait;			// seconds spent before closed doors, walks planned for a departure time
+
+	bool						isEmpty() const { return edges.isEmpty(); }
+	float						meters() const { return offsets.isEmpty() ? 0 : offsets.last(); }
+};
+
+// Turns a path of graph edges into spoken maneuvers.
+//
+// Consecutive edges are merged while the walker keeps going straight on the same
+// street; a maneuver is emitted where the street changes or where the turn is
+// sharp enough to be noticed. Landmarks are the closest catalog buildings.
+class TSWEBAPP_EXPORTS TSManeuverBuilder
+{
+public:
+	TSManeuverBuilder(const TSRouteGraph* graph, const TSPoiCatalog* catalog, const TSGeocoder* geocoder,
+					  const TSIndoorMap* indoor = 0);
+
+	// path: edges from the source to the destination building, dstPoi may be 0
+	QList<TSManeuver>			build(const QVector<quint32>& path, int dstPoi = 0) const;
+
+	// "S Bouquet St" -> "South Bouquet Street"
+	static QString				spokenName(const QString& name);
+	// 37 -> "40 meters", 1260 -> "1.3 kilometers"
+	static QString				spokenDistance(double meters);
+	// 0 -> "north", 90 -> "east"; eight points
+	static QString				compassPoint(double bearing);
+
+	static const double			STRAIGHT_ANGLE;		// below, a bend is not announced
+	static const double			LANDMARK_METERS;	// farthest building used as a landmark
+
+private:
+	int							turnType(double angle) const;
+	double						edgeBearing(quint32 edge) const;
+	void						describe(TSManeuver& m) const;
+	void						enter(TSManeuver& m, quint32 edge) const;
+
+	const TSRouteGraph			*m_graph;
+	const TSPoiCatalog			*m_catalog;
+	const TSGeocoder			*m_geocoder;
+	const TSIndoorMap			*m_indoor;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSMANEUVER_H
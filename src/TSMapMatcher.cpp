@@ -0,0 +1,165 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSMapMatcher.cpp
+// Author : Zhan
+//
+
+#include "TSMapMatcher.h"
+#include "TSRouteGraph.h"
+#include "TSManeuver.h"
+
+#include <math.h>
+
+#define MAX_GAP_MS		30000		// a longer silence breaks the chain
+#define MAX_MISSES		3
+
+TSMapMatcher::TSMapMatcher(const TSRouteGraph* graph)
+: m_graph(graph)
+, m_route(0)
+, m_sigma(8.0)
+, m_beta(10.0)
+, m_searchRadius(40.0)
+, m_maxCandidates(8)
+, m_offRoutePenalty(1.0)
+, m_misses(0)
+{
+	m_lastFix.time = 0;
+}
+
+void TSMapMatcher::setRoute(const TSRoute* route)
+{
+	m_route = route;
+	m_routeIndex.clear();
+	if( route )
+	{
+		for( int i = 0; i < route->edges.count(); i++ )
+		{
+			quint32 e = route->edges[i];
+			quint32 key = qMin(e, m_graph->edge(e).reverse);
+			if( !m_routeIndex.contains(key) )
+				m_routeIndex.insert(key, i);
+		}
+	}
+	reset();
+}
+
+void TSMapMatcher::reset()
+{
+	m_column.clear();
+	m_misses = 0;
+}
+
+float TSMapMatcher::routeOffset(quint32 edge, double t) const
+{
+	QHash<quint32, int>::const_iterator it = m_routeIndex.find(edge);
+	if( it == m_routeIndex.end() )
+		return -1;
+
+	int i = it.value();
+	quint32 routeEdge = m_route->edges[i];
+	float length = m_route->offsets[i + 1] - m_route->offsets[i];
+	// The route may walk the pair either way
+	double along = (routeEdge == edge) ? t : 1.0 - t;
+	return m_route->offsets[i] + (float)(along * length);
+}
+
+double TSMapMatcher::walkedDistance(const State& from, const State& to, double straight) const
+{
+	// Along the route, walking back is allowed but costs twice
+	if( from.routeOffset >= 0 && to.routeOffset >= 0 )
+	{
+		double d = to.routeOffset - from.routeOffset;
+		return d >= 0 ? d : -2 * d;
+	}
+
+	const TSRouteGraph::Edge& a = m_graph->edge(from.edge);
+	if( from.edge == to.edge )
+		return fabs(to.t - from.t) * a.meters;
+
+	// Adjacent edges: through the shared node
+	const TSRouteGraph::Edge& b = m_graph->edge(to.edge);
+	quint32 a0 = m_graph->edgeSource(from.edge), a1 = a.target;
+	quint32 b0 = m_graph->edgeSource(to.edge), b1 = b.target;
+	if( a0 == b0 )
+		return from.t * a.meters + to.t * b.meters;
+	if( a0 == b1 )
+		return from.t * a.meters + (1 - to.t) * b.meters;
+	if( a1 == b0 )
+		return (1 - from.t) * a.meters + to.t * b.meters;
+	if( a1 == b1 )
+		return (1 - from.t) * a.meters + (1 - to.t) * b.meters;
+
+	// Farther: assume a detour, the transition is then unlikely but possible
+	return straight * 1.5 + m_beta;
+}
+
+bool TSMapMatcher::update(const TSFix& fix, TSMatch* match)
+{
+	if( !m_column.isEmpty() && (fix.time - m_lastFix.time > MAX_GAP_MS || fix.time < m_lastFix.time) )
+		reset();
+
+	double s = fix.accuracy > 0 ? qMax((double)fix.accuracy, m_sigma / 2) : m_sigma;
+	QVector<quint32> edges = m_graph->edgesNear(fix.lat, fix.lng, qMax(m_searchRadius, 3 * s), m_maxCandidates);
+	if( edges.isEmpty() )
+	{
+		if( ++m_misses >= MAX_MISSES )
+			reset();
+		return false;
+	}
+	m_misses = 0;
+
+	QVector<State> column(edges.count());
+	for( int j = 0; j < edges.count(); j++ )
+	{
+		State& st = column[j];
+		st.edge = edges[j];
+		st.distance = m_graph->projectOnEdge(st.edge, fix.lat, fix.lng, &st.t);
+		st.routeOffset = m_route ? routeOffset(st.edge, st.t) : -1;
+
+		double emission = -0.5 * (st.distance / s) * (st.distance / s);
+		double prior = (m_route && st.routeOffset < 0) ? -m_offRoutePenalty : 0;
+		st.score = emission + prior;
+	}
+
+	if( !m_column.isEmpty() )
+	{
+		double straight = TSRouteGraph::distance(m_lastFix.lat, m_lastFix.lng, fix.lat, fix.lng);
+		for( int j = 0; j < column.count(); j++ )
+		{
+			double best = -1e300;
+			for( int i = 0; i < m_column.count(); i++ )
+			{
+				double transition = -fabs(walkedDistance(m_column[i], column[j], straight) - straight) / m_beta;
+				best = qMax(best, m_column[i].score + transition);
+			}
+			column[j].score += best;
+		}
+	}
+
+	// Keep the scores near zero, only their differences matter
+	int bestIndex = 0;
+	for( int j = 1; j < column.count(); j++ )
+	{
+		if( column[j].score > column[bestIndex].score )
+			bestIndex = j;
+	}
+	double top = column[bestIndex].score;
+	for( int j = 0; j < column.count(); j++ )
+		column[j].score -= top;
+
+	m_column = column;
+	m_lastFix = fix;
+
+	const State& st = column[bestIndex];
+	quint32 from = m_graph->edgeSource(st.edge);
+	quint32 to = m_graph->edge(st.edge).target;
+	match->edge = st.edge;
+	match->t = st.t;
+	match->lat = m_graph->lat(from) + st.t * (m_graph->lat(to) - m_graph->lat(from));
+	match->lng = m_graph->lng(from) + st.t * (m_graph->lng(to) - m_graph->lng(from));
+	match->distance = st.distance;
+	match->routeOffset = st.routeOffset;
+	return true;
+}
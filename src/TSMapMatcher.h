@@ -0,0 +1,90 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSMapMatcher.h
+// Author : Zhan
+//
+#ifndef TSMAPMATCHER_H
+#define TSMAPMATCHER_H
+
+#include "TSWebApp.h"
+#include "TSPositionSource.h"
+
+#include <QVector>
+#include <QHash>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class TSRouteGraph;
+struct TSRoute;
+
+// Position of a fix snapped on the graph
+struct TSMatch
+{
+	quint32						edge;			// lower index edge of a twin pair
+	double						t;				// 0 at the edge source, 1 at its target
+	double						lat;
+	double						lng;
+	double						distance;		// meters between the fix and the snapped point
+	float						routeOffset;	// meters along the route, negative when off the route
+};
+
+// Online map matching with a hidden Markov model.
+//
+// The hidden states of a fix are the graph edges close to it. Emission follows
+// the GPS error (gaussian on the distance to the edge), transition prefers
+// moves whose walked distance matches the distance between the fixes, as in
+// Newson and Krumm. Along the active route the walked distance is exact and
+// cheap; elsewhere it is taken through a shared node or estimated. The Viterbi
+// recursion is run one column per fix and the best state of the last column is
+// reported, so the cost of a fix is O(candidates^2).
+class TSWEBAPP_EXPORTS TSMapMatcher
+{
+public:
+	explicit TSMapMatcher(const TSRouteGraph* graph);
+
+	// Route the walker is expected to follow, 0 for none. Resets the model.
+	void						setRoute(const TSRoute* route);
+	void						reset();
+
+	// Returns false when no edge lies within the search radius of the fix
+	bool						update(const TSFix& fix, TSMatch* match);
+
+	// GPS error in meters, used when the fix has no accuracy
+	void						setSigma(double meters) { m_sigma = meters; }
+	void						setSearchRadius(double meters) { m_searchRadius = meters; }
+
+private:
+	struct State
+	{
+		quint32					edge;
+		double					t;
+		double					distance;
+		float					routeOffset;
+		double					score;			// log-probability of the best sequence ending here
+	};
+
+	float						routeOffset(quint32 edge, double t) const;
+	double						walkedDistance(const State& from, const State& to, double straight) const;
+
+	const TSRouteGraph			*m_graph;
+	const TSRoute				*m_route;
+	double						m_sigma;
+	double						m_beta;			// meters, tolerance on walked vs straight distance
+	double						m_searchRadius;
+	int							m_maxCandidates;
+	double						m_offRoutePenalty;	// log-probability cost of leaving the route
+	QHash<quint32, int>			m_routeIndex;	// edge of a twin pair -> position in the route
+	QVector<State>				m_column;
+	TSFix						m_lastFix;
+	int							m_misses;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSMAPMATCHER_H
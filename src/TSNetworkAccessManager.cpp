@@ -9,6 +9,7 @@
 #include "TSNetworkAccessManager.h"
 
 #include "TSBrowserApplication.h"
+#include "TSTilePrefetcher.h"
 #include "ui_passworddialog.h"
 #include "ui_proxy.h"
 
@@ -30,7 +31,7 @@
 TSNetworkAaccessManager::TSNetworkAaccessManager(QObject *parent)
     : QNetworkAccessManager(parent),
     requestFinishedCount(0), requestFinishedFromCacheCount(0), requestFinishedPipelinedCount(0),
-    requestFinishedSecureCount(0)
+    requestFinishedSecureCount(0), requestFinishedFromTilesCount(0), tilePrefetcher(0)
 {
     connect(this, SIGNAL(authenticationRequired(QNetworkReply*,QAuthenticator*)),
             SLOT(authenticationRequired(QNetworkReply*,QAuthenticator*)));
@@ -48,10 +49,31 @@ TSNetworkAaccessManager::TSNetworkAaccessManager(QObject *parent)
     QString location = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
     diskCache->setCacheDirectory(location);
     setCache(diskCache);
+
+    tilePrefetcher = new TSTilePrefetcher(this, &tileStore, this);
 }
 
 QNetworkReply* TSNetworkAaccessManager::createRequest(Operation op, const QNetworkRequest & req, QIODevice * outgoingData)
 {
+    // map tiles of the offline store never reach the network
+    const uchar *tile = 0;
+    qint64 tileSize = 0;
+    TSTileStore::Type tileType = TSTileStore::Png;
+    if (op == GetOperation && tileStore.find(req.url(), &tile, &tileSize, &tileType))
+        return new TSTileReply(req, tile, tileSize, tileType, this);
+
+    // vector tiles of the campus map have no server at all, a missing one is an empty tile
+    QString layer;
+    int zoom, x, y;
+    const TSTileStore *vectorTiles = TSBrowserApplication::vectorTiles();
+    if (op == GetOperation && vectorTiles->tileOf(req.url(), &layer, &zoom, &x, &y)) {
+        if (!vectorTiles->find(layer, zoom, x, y, &tile, &tileSize))
+            tileSize = 0;
+        return new TSTileReply(req, tile, tileSize, TSTileStore::Vector, this);
+    }
+    if (op == GetOperation && tilePrefetcher)
+        tilePrefetcher->noteRequest(req);
+
     QNetworkRequest request = req; // copy so we can modify
     // this is a temporary hack until we properly use the pipelining flags from QtWebkit
     // pipeline everything! :)
@@ -72,14 +94,18 @@ void TSNetworkAaccessManager::requestFinished(QNetworkReply *reply)
     if (reply->attribute(QNetworkRequest::ConnectionEncryptedAttribute).toBool() == true)
         requestFinishedSecureCount++;
 
+    if (qobject_cast<TSTileReply*>(reply))
+        requestFinishedFromTilesCount++;
+
     if (requestFinishedCount % 10)
         return;
 
     double pctCached = (double(requestFinishedFromCacheCount) * 100.0/ double(requestFinishedCount));
     double pctPipelined = (double(requestFinishedPipelinedCount) * 100.0/ double(requestFinishedCount));
     double pctSecure = (double(requestFinishedSecureCount) * 100.0/ double(requestFinishedCount));
+    double pctTiles = (double(requestFinishedFromTilesCount) * 100.0/ double(requestFinishedCount));
 #ifdef QT_DEBUG
-    qDebug("STATS [%lli requests total] [%3.2f%% from cache] [%3.2f%% pipelined] [%3.2f%% SSL/TLS]", requestFinishedCount, pctCached, pctPipelined, pctSecure);
+    qDebug("STATS [%lli requests total] [%3.2f%% from cache] [%3.2f%% pipelined] [%3.2f%% SSL/TLS] [%3.2f%% offline tiles]", requestFinishedCount, pctCached, pctPipelined, pctSecure, pctTiles);
 #endif
 }
 
@@ -13,6 +13,10 @@
 #include <QtNetwork/QNetworkAccessManager>
 #include <QtNetwork/QNetworkRequest>
 
+#include "TSTileStore.h"
+
+class TSTilePrefetcher;
+
 class TSNetworkAaccessManager : public QNetworkAccessManager
 {
     Q_OBJECT
@@ -22,12 +26,17 @@ public:
 
     virtual QNetworkReply* createRequest ( Operation op, const QNetworkRequest & req, QIODevice * outgoingData = 0 );
 
+    TSTilePrefetcher *prefetcher() const { return tilePrefetcher; }
+
 private:
     QList<QString> sslTrustedHostList;
     qint64 requestFinishedCount;
     qint64 requestFinishedFromCacheCount;
     qint64 requestFinishedPipelinedCount;
     qint64 requestFinishedSecureCount;
+    qint64 requestFinishedFromTilesCount;
+    TSTileStore tileStore;
+    TSTilePrefetcher *tilePrefetcher;
 
 public slots:
     void loadSettings();
@@ -0,0 +1,248 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSOpeningHours.cpp
+// Author : Zhan
+//
+
+#include "TSOpeningHours.h"
+
+#include <QtCore/QStringList>
+#include <QtCore/QtAlgorithms>
+
+#include <math.h>
+
+#define DAY_SECONDS			86400
+
+static const char* dayNames[7] = { "mo", "tu", "we", "th", "fr", "sa", "su" };
+
+static int dayIndex(const QString& name)
+{
+	for( int d = 0; d < 7; d++ )
+	{
+		if( name == QLatin1String(dayNames[d]) )
+			return d;
+	}
+	return -1;
+}
+
+// "Mo-Fr,Su" -> days[0..6], false if it is not a list of days
+static bool parseDays(const QString& text, bool days[7])
+{
+	for( int d = 0; d < 7; d++ )
+		days[d] = false;
+
+	QStringList parts = text.toLower().split(QLatin1Char(','), QString::SkipEmptyParts);
+	for( int i = 0; i < parts.count(); i++ )
+	{
+		QStringList range = parts[i].split(QLatin1Char('-'));
+		int first = dayIndex(range[0]);
+		int last = range.count() == 2 ? dayIndex(range[1]) : first;
+		if( first < 0 || last < 0 || range.count() > 2 )
+			return false;
+		for( int d = first; ; d = (d + 1) % 7 )		// Sa-Mo wraps
+		{
+			days[d] = true;
+			if( d == last )
+				break;
+		}
+	}
+	return !parts.isEmpty();
+}
+
+// "08:30" -> seconds of the day, -1 if malformed; 24:00 is the end of the day
+static int parseClock(const QString& text)
+{
+	QStringList hm = text.split(QLatin1Char(':'));
+	bool okH = false, okM = false;
+	int h = hm.count() == 2 ? hm[0].toInt(&okH) : -1;
+	int m = hm.count() == 2 ? hm[1].toInt(&okM) : -1;
+	if( !okH || !okM || h < 0 || h > 24 || m < 0 || m > 59 || (h == 24 && m > 0) )
+		return -1;
+	return h * 3600 + m * 60;
+}
+
+// "08:00-18:00,22:00-02:00" -> begin, end pairs in seconds of the day, an end before its begin is the next day
+static bool parseTimes(const QString& text, QVector<qint32>* spans)
+{
+	spans->clear();
+	QStringList parts = text.split(QLatin1Char(','), QString::SkipEmptyParts);
+	for( int i = 0; i < parts.count(); i++ )
+	{
+		QStringList range = parts[i].trimmed().split(QLatin1Char('-'));
+		int begin = range.count() == 2 ? parseClock(range[0].trimmed()) : -1;
+		int end = range.count() == 2 ? parseClock(range[1].trimmed()) : -1;
+		if( begin < 0 || end < 0 )
+			return false;
+		if( end <= begin )
+			end += DAY_SECONDS;
+		spans->append(begin);
+		spans->append(end);
+	}
+	return !parts.isEmpty();
+}
+
+TSOpeningHours::TSOpeningHours()
+: m_always(true)
+{
+}
+
+/*!
+  \brief Parse opening hours, lenient on what cannot be understood.
+
+  A rule that cannot be parsed leaves the hours always open, so an unknown
+  syntax never locks a building.
+*/
+TSOpeningHours TSOpeningHours::parse(const QString& text, bool* ok)
+{
+	if( ok )
+		*ok = true;
+
+	TSOpeningHours hours;
+	QString trimmed = text.simplified();
+	if( trimmed.isEmpty() || trimmed == QLatin1String("24/7") )
+		return hours;
+
+	QVector<qint32> week[7];
+	QStringList rules = trimmed.split(QLatin1Char(';'), QString::SkipEmptyParts);
+	for( int r = 0; r < rules.count(); r++ )
+	{
+		QString rule = rules[r].trimmed();
+		bool days[7];
+		QString times = rule;
+		int space = rule.indexOf(QLatin1Char(' '));
+		if( parseDays(space < 0 ? rule : rule.left(space), days) )
+			times = space < 0 ? QString() : rule.mid(space + 1).trimmed();
+		else
+		{
+			for( int d = 0; d < 7; d++ )
+				days[d] = true;
+		}
+
+		QVector<qint32> spans;
+		if( times == QLatin1String("24/7") || times.isEmpty() )
+			spans << 0 << DAY_SECONDS;
+		else if( times != QLatin1String("off") && times != QLatin1String("closed") && !parseTimes(times, &spans) )
+		{
+			if( ok )
+				*ok = false;
+			return TSOpeningHours();
+		}
+
+		for( int d = 0; d < 7; d++ )
+		{
+			if( days[d] )
+				week[d] = spans;
+		}
+	}
+
+	hours.m_always = false;
+	for( int d = 0; d < 7; d++ )
+	{
+		for( int i = 0; i < week[d].count(); i += 2 )
+		{
+			qint32 begin = d * DAY_SECONDS + week[d][i];
+			qint32 end = d * DAY_SECONDS + week[d][i + 1];
+			if( end > WEEK_SECONDS )
+			{
+				hours.m_open << begin << WEEK_SECONDS << 0 << end - WEEK_SECONDS;		// Sunday night into Monday
+			}
+			else
+				hours.m_open << begin << end;
+		}
+	}
+	hours.normalize();
+	return hours;
+}
+
+// Sort and merge the intervals; open all week is always open
+void TSOpeningHours::normalize()
+{
+	QVector< QPair<qint32, qint32> > spans;
+	for( int i = 0; i + 1 < m_open.count(); i += 2 )
+		spans.append(qMakePair(m_open[i], m_open[i + 1]));
+	qSort(spans);
+
+	m_open.clear();
+	for( int i = 0; i < spans.count(); i++ )
+	{
+		if( !m_open.isEmpty() && spans[i].first <= m_open.last() )
+			m_open.last() = qMax(m_open.last(), spans[i].second);
+		else
+			m_open << spans[i].first << spans[i].second;
+	}
+
+	if( m_open.count() == 2 && m_open[0] <= 0 && m_open[1] >= WEEK_SECONDS )
+	{
+		m_always = true;
+		m_open.clear();
+	}
+}
+
+int TSOpeningHours::weekSecond(const QDateTime& time)
+{
+	return (time.date().dayOfWeek() - 1) * DAY_SECONDS + time.time().hour() * 3600 + time.time().minute() * 60 + time.time().second();
+}
+
+double TSOpeningHours::wait(double weekSecond) const
+{
+	if( m_always )
+		return 0;
+	if( m_open.isEmpty() )
+		return -1;
+
+	double s = fmod(weekSecond, (double)WEEK_SECONDS);
+	if( s < 0 )
+		s += WEEK_SECONDS;
+
+	// First interval ending after s
+	int lo = 0, hi = m_open.count() / 2;
+	while( lo < hi )
+	{
+		int mid = (lo + hi) / 2;
+		if( m_open[2 * mid + 1] > s )
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	if( lo < m_open.count() / 2 )
+		return m_open[2 * lo] <= s ? 0 : m_open[2 * lo] - s;
+	return m_open[0] + WEEK_SECONDS - s;
+}
+
+TSOpeningHours TSOpeningHours::intersected(const TSOpeningHours& other) const
+{
+	if( m_always )
+		return other;
+	if( other.m_always )
+		return *this;
+
+	TSOpeningHours hours;
+	hours.m_always = false;
+	int i = 0, j = 0;
+	while( i < m_open.count() && j < other.m_open.count() )
+	{
+		qint32 begin = qMax(m_open[i], other.m_open[j]);
+		qint32 end = qMin(m_open[i + 1], other.m_open[j + 1]);
+		if( begin < end )
+			hours.m_open << begin << end;
+		if( m_open[i + 1] < other.m_open[j + 1] )
+			i += 2;
+		else
+			j += 2;
+	}
+	return hours;
+}
+
+QDataStream& operator<<(QDataStream& out, const TSOpeningHours& hours)
+{
+	out << hours.m_always << hours.m_open;
+	return out;
+}
+
+QDataStream& operator>>(QDataStream& in, TSOpeningHours& hours)
+{
+	in >> hours.m_always >> hours.m_open;
+	return in;
+}
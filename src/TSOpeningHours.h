@@ -0,0 +1,67 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSOpeningHours.h
+// Author : Zhan
+//
+#ifndef TSOPENINGHOURS_H
+#define TSOPENINGHOURS_H
+
+#include "TSWebApp.h"
+
+#include <QString>
+#include <QVector>
+#include <QDateTime>
+#include <QDataStream>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+// Weekly opening hours of a building or a gated path.
+//
+// Parsed from the common subset of the OSM opening_hours syntax:
+// "24/7", "Mo-Fr 07:00-22:00; Sa,Su 10:00-18:00", "Su off", "Fr 20:00-02:00".
+// A rule replaces the hours of the days it names. The week is kept as sorted
+// open intervals in seconds from Monday 00:00, so the wait before a door opens
+// is one binary search.
+class TSWEBAPP_EXPORTS TSOpeningHours
+{
+public:
+	TSOpeningHours();		// always open
+
+	// Always open when the text is empty; *ok is false on a syntax error
+	static TSOpeningHours		parse(const QString& text, bool* ok = 0);
+	static int					weekSecond(const QDateTime& time);
+
+	bool						isAlwaysOpen() const { return m_always; }
+	bool						isOpen(double weekSecond) const { return wait(weekSecond) == 0; }
+	// Seconds from weekSecond until open, 0 when open, -1 when never open
+	double						wait(double weekSecond) const;
+	// Open when both are
+	TSOpeningHours				intersected(const TSOpeningHours& other) const;
+
+	bool						operator==(const TSOpeningHours& other) const { return m_always == other.m_always && m_open == other.m_open; }
+	bool						operator!=(const TSOpeningHours& other) const { return !(*this == other); }
+
+	static const int			WEEK_SECONDS = 7 * 24 * 3600;
+
+private:
+	friend QDataStream&			operator<<(QDataStream& out, const TSOpeningHours& hours);
+	friend QDataStream&			operator>>(QDataStream& in, TSOpeningHours& hours);
+
+	void						normalize();
+
+	bool						m_always;
+	QVector<qint32>				m_open;			// begin, end, begin, end... sorted and disjoint
+};
+
+TSWEBAPP_EXPORTS QDataStream&	operator<<(QDataStream& out, const TSOpeningHours& hours);
+TSWEBAPP_EXPORTS QDataStream&	operator>>(QDataStream& in, TSOpeningHours& hours);
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSOPENINGHOURS_H
@@ -0,0 +1,150 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSPoiCatalog.cpp
+// Author : Zhan
+//
+
+#include "TSPoiCatalog.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QXmlStreamReader>
+#include <QtCore/QCryptographicHash>
+
+TSPoiCatalog::TSPoiCatalog()
+{
+}
+
+/*!
+  \brief Load the catalog from an xml file.
+
+  Format:  <catalog><poi id="1" name="Allen Hall" lat="40.44" lng="-79.95" address="..." [aliases="a;b"] [categories="a;b"]
+                    [opening_hours="Mo-Fr 07:00-22:00; Sa,Su 10:00-18:00"]/>...</catalog>
+  \return true if at least one poi has been loaded
+*/
+bool TSPoiCatalog::load(const QString& fileName)
+{
+	m_pois.clear();
+	m_index.clear();
+	m_categories.clear();
+	m_fingerprint.clear();
+
+	QFile file(fileName);
+	if( !file.open(QIODevice::ReadOnly) )
+	{
+		QLOG_WARN() << QString("POI catalog %1 cannot be opened.").arg(fileName);
+		return false;
+	}
+
+	QCryptographicHash hash(QCryptographicHash::Md5);
+	QXmlStreamReader xml(&file);
+	bool inPoi = false;
+	while( !xml.atEnd() )
+	{
+		xml.readNext();
+		if( xml.isEndElement() && xml.name() == "poi" )
+			inPoi = false;
+		if( !xml.isStartElement() )
+			continue;
+
+		// Outlines of the last poi, they do not move it so they stay out of the fingerprint
+		if( inPoi && (xml.name() == "footprint" || xml.name() == "entrance") )
+		{
+			QVector<QPointF> polygon = parsePolygon(xml.attributes().value("points").toString());
+			if( polygon.count() < 3 )
+				QLOG_WARN() << QString("POI catalog %1: polygon of less than 3 points at line %2.").arg(fileName).arg(xml.lineNumber());
+			else if( xml.name() == "footprint" )
+				m_pois.last().footprint = polygon;
+			else
+				m_pois.last().entrances.append(polygon);
+			continue;
+		}
+		if( xml.name() != "poi" )
+			continue;
+
+		QXmlStreamAttributes attrs = xml.attributes();
+		TSPoi poi;
+		bool okId, okLat, okLng;
+		poi.id = attrs.value("id").toString().toInt(&okId);
+		poi.lat = attrs.value("lat").toString().toDouble(&okLat);
+		poi.lng = attrs.value("lng").toString().toDouble(&okLng);
+		poi.name = attrs.value("name").toString().simplified();
+		poi.address = attrs.value("address").toString().simplified();
+		QStringList aliases = attrs.value("aliases").toString().split(QLatin1Char(';'), QString::SkipEmptyParts);
+		for( int i = 0; i < aliases.count(); i++ )
+		{
+			QString alias = aliases[i].simplified();
+			if( !alias.isEmpty() )
+				poi.aliases.append(alias);
+		}
+		QStringList categories = attrs.value("categories").toString().split(QLatin1Char(';'), QString::SkipEmptyParts);
+		for( int i = 0; i < categories.count(); i++ )
+		{
+			QString category = categories[i].simplified().toLower();
+			if( !category.isEmpty() && !poi.categories.contains(category) )
+				poi.categories.append(category);
+		}
+		bool okHours;
+		poi.hours = TSOpeningHours::parse(attrs.value("opening_hours").toString(), &okHours);
+		if( !okHours )
+			QLOG_WARN() << QString("POI catalog %1: opening hours not understood at line %2, the building stays open.").arg(fileName).arg(xml.lineNumber());
+
+		if( !okId || !okLat || !okLng || m_index.contains(poi.id) )
+		{
+			QLOG_WARN() << QString("POI catalog %1: invalid or duplicated poi at line %2.").arg(fileName).arg(xml.lineNumber());
+			continue;
+		}
+
+		m_index.insert(poi.id, m_pois.count());
+		m_pois.append(poi);
+		for( int i = 0; i < poi.categories.count(); i++ )
+			m_categories[poi.categories[i]].append(poi.id);
+		inPoi = true;
+
+		hash.addData(QString("%1|%2|%3|%4|%5\n").arg(poi.id).arg(poi.name).arg(poi.address)
+			.arg(poi.lat, 0, 'f', 7).arg(poi.lng, 0, 'f', 7).toUtf8());
+	}
+
+	if( xml.hasError() )
+		QLOG_ERROR() << QString("POI catalog %1: %2").arg(fileName).arg(xml.errorString());
+
+	m_fingerprint = hash.result();
+
+	QLOG_INFO() << QString("POI catalog %1: %2 buildings loaded.").arg(fileName).arg(m_pois.count());
+	return !m_pois.isEmpty();
+}
+
+const TSPoi* TSPoiCatalog::poi(int id) const
+{
+	QHash<int, int>::const_iterator it = m_index.find(id);
+	if( it == m_index.end() )
+		return 0;
+	return &m_pois.at(it.value());
+}
+
+// "lat,lng lat,lng ..." -> x = lng, y = lat; a closing point equal to the first is dropped
+QVector<QPointF> TSPoiCatalog::parsePolygon(const QString& points)
+{
+	QVector<QPointF> polygon;
+	QStringList pairs = points.split(QLatin1Char(' '), QString::SkipEmptyParts);
+	for( int i = 0; i < pairs.count(); i++ )
+	{
+		QStringList latLng = pairs[i].split(QLatin1Char(','));
+		bool okLat = false, okLng = false;
+		if( latLng.count() == 2 )
+		{
+			double lat = latLng[0].toDouble(&okLat);
+			double lng = latLng[1].toDouble(&okLng);
+			if( okLat && okLng )
+				polygon.append(QPointF(lng, lat));
+		}
+		if( !okLat || !okLng )
+			return QVector<QPointF>();
+	}
+	if( polygon.count() > 1 && polygon.first() == polygon.last() )
+		polygon.remove(polygon.count() - 1);
+	return polygon;
+}
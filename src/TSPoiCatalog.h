@@ -0,0 +1,73 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSPoiCatalog.h
+// Author : Zhan
+//
+#ifndef TSPOICATALOG_H
+#define TSPOICATALOG_H
+
+#include "TSWebApp.h"
+#include "TSOpeningHours.h"
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QByteArray>
+#include <QVector>
+#include <QPointF>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+// One building of the campus catalog
+struct TSPoi
+{
+	int							id;			// VAL of the phrase in speech.xml
+	QString						name;
+	QStringList					aliases;	// other names, e.g. "Cathedral" for "Cathedral of Learning"
+	QStringList					categories;	// facilities inside, lower case, e.g. "restroom"
+	QString						address;
+	double						lat;
+	double						lng;
+	QVector<QPointF>			footprint;	// outline, x = lng and y = lat, empty if unknown
+	QList< QVector<QPointF> >	entrances;	// door areas, same convention
+	TSOpeningHours				hours;		// always open if unknown
+};
+
+// Buildings known to the navigation system, loaded from poi_catalog.xml
+class TSWEBAPP_EXPORTS TSPoiCatalog
+{
+public:
+	TSPoiCatalog();
+
+	bool						load(const QString& fileName);
+
+	int							count() const { return m_pois.count(); }
+	const QList<TSPoi>&			pois() const { return m_pois; }
+	const TSPoi*				poi(int id) const;
+
+	// Buildings holding a facility, in catalog order
+	QList<int>					withCategory(const QString& category) const { return m_categories.value(category.toLower()); }
+	QStringList					categories() const { return m_categories.keys(); }
+
+	// Digest of the catalog content, changes whenever a poi is added, removed or moved
+	QByteArray					fingerprint() const { return m_fingerprint; }
+
+private:
+	static QVector<QPointF>		parsePolygon(const QString& points);
+
+	QList<TSPoi>				m_pois;
+	QHash<int, int>				m_index;		// poi id -> position in m_pois
+	QHash<QString, QList<int> >	m_categories;	// category -> poi ids
+	QByteArray					m_fingerprint;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSPOICATALOG_H
@@ -0,0 +1,217 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSPolyline.cpp
+// Author : Zhan
+//
+
+#include "TSPolyline.h"
+
+#include <QtCore/QSettings>
+
+#include <math.h>
+
+#define METERS_PER_DEGREE	111320.0
+#define ZOOM0_METERS		156543.03392		// meters per pixel of the equator at zoom 0
+#define DEG_TO_RAD			0.017453292519943295
+
+// Distance in meters from p to the segment a-b, on a plane tangent at a
+static double segmentDistance(const QPointF& p, const QPointF& a, const QPointF& b, double cosLat)
+{
+	double bx = (b.x() - a.x()) * cosLat * METERS_PER_DEGREE;
+	double by = (b.y() - a.y()) * METERS_PER_DEGREE;
+	double px = (p.x() - a.x()) * cosLat * METERS_PER_DEGREE;
+	double py = (p.y() - a.y()) * METERS_PER_DEGREE;
+
+	double length2 = bx * bx + by * by;
+	double t = length2 > 0 ? (px * bx + py * by) / length2 : 0;
+	t = qBound(0.0, t, 1.0);
+	double dx = px - t * bx;
+	double dy = py - t * by;
+	return sqrt(dx * dx + dy * dy);
+}
+
+// Points first..last of a line, inside a span of significance bound
+struct TSSpan
+{
+	int							first;
+	int							last;
+	double						bound;
+};
+
+static void encodeValue(int value, QString* text)
+{
+	uint v = value < 0 ? ~((uint)value << 1) : ((uint)value << 1);
+	while( v >= 0x20 )
+	{
+		text->append(QLatin1Char((char)((0x20 | (v & 0x1f)) + 63)));
+		v >>= 5;
+	}
+	text->append(QLatin1Char((char)(v + 63)));
+}
+
+// Next value of the text from *pos, false once the text is exhausted or truncated
+static bool decodeValue(const QString& text, int* pos, int* value)
+{
+	uint v = 0;
+	int shift = 0;
+	while( *pos < text.size() )
+	{
+		uint chunk = (uint)(text[(*pos)++].unicode() - 63);
+		v |= (chunk & 0x1f) << shift;
+		shift += 5;
+		if( chunk < 0x20 )
+		{
+			*value = (v & 1) ? (int)~(v >> 1) : (int)(v >> 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+TSPolyline::TSPolyline()
+: m_tolerancePixels(0.5)
+, m_maxZoom(21)
+{
+	loadSettings();
+}
+
+void TSPolyline::loadSettings()
+{
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	settings.beginGroup(QLatin1String("polyline"));
+	m_tolerancePixels = qMax(0.01, settings.value(QLatin1String("TolerancePixels"), 0.5).toDouble());
+	m_maxZoom = qBound(0, settings.value(QLatin1String("MaxZoom"), 21).toInt(), 30);
+	settings.endGroup();
+}
+
+double TSPolyline::baseTolerance(double lat) const
+{
+	return ZOOM0_METERS * cos(lat * DEG_TO_RAD) * m_tolerancePixels;
+}
+
+/*!
+  \brief Lowest zoom each point is needed at, by a single Douglas-Peucker pass.
+
+  The farthest point of a span splits it; its significance is its distance to
+  the span, capped by the significance of the point that made the span, since
+  a simplification coarser than that never looks inside it. A point shows at
+  every zoom whose tolerance its significance reaches, so filtering by level
+  gives exactly the Douglas-Peucker line of each zoom.
+*/
+QVector<int> TSPolyline::levels(const QVector<QPointF>& points) const
+{
+	const int n = points.count();
+	QVector<int> result(n, -1);
+	if( n == 0 )
+		return result;
+	result[0] = result[n - 1] = 0;
+
+	double cosLat = cos(points[0].y() * DEG_TO_RAD);
+	double base = baseTolerance(points[0].y());
+	double finest = base / pow(2.0, m_maxZoom);
+
+	QVector<TSSpan> stack;
+	TSSpan whole = { 0, n - 1, base };
+	stack.append(whole);
+	while( !stack.isEmpty() )
+	{
+		TSSpan span = stack.last();
+		stack.pop_back();
+
+		int farthest = -1;
+		double distance = 0;
+		for( int i = span.first + 1; i < span.last; i++ )
+		{
+			double d = segmentDistance(points[i], points[span.first], points[span.last], cosLat);
+			if( d > distance )
+			{
+				distance = d;
+				farthest = i;
+			}
+		}
+
+		double significance = qMin(distance, span.bound);
+		if( farthest < 0 || significance < finest )
+			continue;		// nothing in the span shows at any zoom
+
+		result[farthest] = qBound(0, (int)ceil(log(base / significance) / log(2.0)), m_maxZoom);
+		TSSpan left = { span.first, farthest, significance };
+		TSSpan right = { farthest, span.last, significance };
+		stack.append(left);
+		stack.append(right);
+	}
+	return result;
+}
+
+QVector<QPointF> TSPolyline::simplified(const QVector<QPointF>& points, int zoom) const
+{
+	QVector<int> level = levels(points);
+	QVector<QPointF> kept;
+	for( int i = 0; i < points.count(); i++ )
+	{
+		if( level[i] >= 0 && level[i] <= zoom )
+			kept.append(points[i]);
+	}
+	return kept;
+}
+
+QVariantMap TSPolyline::toVariant(const QVector<QPointF>& points) const
+{
+	QVector<int> level = levels(points);
+	QVector<QPointF> kept;
+	QVector<int> keptLevels;
+	for( int i = 0; i < points.count(); i++ )
+	{
+		if( level[i] >= 0 )
+		{
+			kept.append(points[i]);
+			keptLevels.append(level[i]);
+		}
+	}
+
+	QVariantMap map;
+	map["points"] = encode(kept);
+	map["levels"] = encodeLevels(keptLevels);
+	return map;
+}
+
+QString TSPolyline::encode(const QVector<QPointF>& points)
+{
+	QString text;
+	text.reserve(points.count() * 8);
+	int lastLat = 0, lastLng = 0;
+	for( int i = 0; i < points.count(); i++ )
+	{
+		int lat = qRound(points[i].y() * 1e5);
+		int lng = qRound(points[i].x() * 1e5);
+		encodeValue(lat - lastLat, &text);
+		encodeValue(lng - lastLng, &text);
+		lastLat = lat;
+		lastLng = lng;
+	}
+	return text;
+}
+
+QVector<QPointF> TSPolyline::decode(const QString& text)
+{
+	QVector<QPointF> points;
+	int pos = 0, lat = 0, lng = 0, dLat, dLng;
+	while( decodeValue(text, &pos, &dLat) && decodeValue(text, &pos, &dLng) )
+	{
+		lat += dLat;
+		lng += dLng;
+		points.append(QPointF(lng * 1e-5, lat * 1e-5));
+	}
+	return points;
+}
+
+QString TSPolyline::encodeLevels(const QVector<int>& levels)
+{
+	QString text;
+	text.reserve(levels.count());
+	for( int i = 0; i < levels.count(); i++ )
+		text.append(QLatin1Char((char)('?' + qMax(0, levels[i]))));
+	return text;
+}
@@ -0,0 +1,67 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSPolyline.h
+// Author : Zhan
+//
+#ifndef TSPOLYLINE_H
+#define TSPOLYLINE_H
+
+#include "TSWebApp.h"
+
+#include <QString>
+#include <QVector>
+#include <QPointF>
+#include <QVariant>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+// Compact geometry of a walk for the page.
+//
+// Each point gets the lowest map zoom it shows at: a Douglas-Peucker pass keeps
+// a point at zoom z when it lies farther than a fraction of a pixel of zoom z
+// from the simplified line, so the levels of all zooms come out of one pass and
+// the page only filters them when the zoom changes. Points no zoom needs are
+// dropped. Coordinates are written as deltas of 1e-5 degrees in the polyline
+// encoding of Google Maps, zigzag varints in printable characters, and the
+// levels as one character each.
+//
+// Configured by the [polyline] group of app_config.ini.
+class TSWEBAPP_EXPORTS TSPolyline
+{
+public:
+	TSPolyline();
+
+	void						loadSettings();
+
+	// Lowest zoom of each point, x = lng and y = lat; -1 for the points dropped at every zoom
+	QVector<int>				levels(const QVector<QPointF>& points) const;
+	// Points shown at a zoom
+	QVector<QPointF>			simplified(const QVector<QPointF>& points, int zoom) const;
+	// {points, levels} of the points kept at the highest zoom, what the page decodes
+	QVariantMap					toVariant(const QVector<QPointF>& points) const;
+
+	int							maxZoom() const { return m_maxZoom; }
+
+	// Polyline encoding at 1e-5 degrees, x = lng and y = lat
+	static QString				encode(const QVector<QPointF>& points);
+	static QVector<QPointF>		decode(const QString& text);
+	// One character per level, '?' is zoom 0
+	static QString				encodeLevels(const QVector<int>& levels);
+
+private:
+	// Meters a fraction of a pixel covers at zoom 0 and a latitude, halved by each zoom
+	double						baseTolerance(double lat) const;
+
+	double						m_tolerancePixels;
+	int							m_maxZoom;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSPOLYLINE_H
@@ -0,0 +1,273 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSPositionSource.cpp
+// Author : Zhan
+//
+
+#include "TSPositionSource.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QTextStream>
+#include <QtCore/QXmlStreamReader>
+#include <QtCore/QDateTime>
+#include <QtCore/QStringList>
+
+#define KNOTS_TO_MPS		0.514444
+#define HDOP_TO_METERS		5.0			// rough user equivalent range error of a consumer receiver
+#define MS_PER_DAY			86400000
+
+static qint64 toMs(const QDateTime& dt)
+{
+	return (qint64)dt.toTime_t() * 1000 + dt.time().msec();
+}
+
+// "4026.6574","N" -> 40.44429
+static bool nmeaDegrees(const QString& value, const QString& hemisphere, double* degrees)
+{
+	bool ok = false;
+	double v = value.toDouble(&ok);
+	if( !ok || value.isEmpty() )
+		return false;
+	int d = (int)(v / 100);
+	*degrees = d + (v - d * 100) / 60.0;
+	if( hemisphere == "S" || hemisphere == "W" )
+		*degrees = -*degrees;
+	return true;
+}
+
+// "123519.50" -> ms since midnight
+static qint64 nmeaTime(const QString& value)
+{
+	QTime t = QTime::fromString(value.left(6), "hhmmss");
+	if( !t.isValid() )
+		return -1;
+	qint64 ms = t.hour() * 3600000 + t.minute() * 60000 + t.second() * 1000;
+	int dot = value.indexOf(QLatin1Char('.'));
+	if( dot > 0 )
+		ms += qRound(value.mid(dot).toDouble() * 1000);
+	return ms;
+}
+
+bool TSFixReader::parseNmea(const QString& sentence, TSFix* fix)
+{
+	QString s = sentence.trimmed();
+	if( !s.startsWith(QLatin1Char('$')) || s.length() < 7 )
+		return false;
+
+	// XOR of the characters between '$' and '*'
+	int star = s.indexOf(QLatin1Char('*'));
+	if( star > 0 )
+	{
+		quint8 sum = 0;
+		for( int i = 1; i < star; i++ )
+			sum ^= (quint8)s[i].toLatin1();
+		bool ok = false;
+		if( s.mid(star + 1, 2).toUInt(&ok, 16) != sum || !ok )
+			return false;
+		s = s.left(star);
+	}
+
+	QStringList f = s.split(QLatin1Char(','));
+	QString type = f[0].mid(3);
+	fix->accuracy = 0;
+	fix->speed = -1;
+	fix->heading = -1;
+
+	if( type == "RMC" && f.count() >= 10 )
+	{
+		if( f[2] != "A" )
+			return false;			// receiver warning, no fix
+		if( !nmeaDegrees(f[3], f[4], &fix->lat) || !nmeaDegrees(f[5], f[6], &fix->lng) )
+			return false;
+		bool ok = false;
+		double knots = f[7].toDouble(&ok);
+		if( ok )
+			fix->speed = (float)(knots * KNOTS_TO_MPS);
+		double course = f[8].toDouble(&ok);
+		if( ok )
+			fix->heading = (float)course;
+
+		qint64 tod = nmeaTime(f[1]);
+		QDate date = QDate::fromString(f[9], "ddMMyy").addYears(100);
+		if( tod < 0 || !date.isValid() )
+			return false;
+		fix->time = toMs(QDateTime(date, QTime(0, 0), Qt::UTC)) + tod;
+		return true;
+	}
+
+	if( type == "GGA" && f.count() >= 9 )
+	{
+		if( f[6].toInt() == 0 )
+			return false;			// fix quality: invalid
+		if( !nmeaDegrees(f[2], f[3], &fix->lat) || !nmeaDegrees(f[4], f[5], &fix->lng) )
+			return false;
+		bool ok = false;
+		double hdop = f[8].toDouble(&ok);
+		if( ok )
+			fix->accuracy = (float)(hdop * HDOP_TO_METERS);
+		fix->time = nmeaTime(f[1]);		// time of day only, the date comes with RMC
+		return fix->time >= 0;
+	}
+	return false;
+}
+
+QList<TSFix> TSFixReader::readNmea(const QString& fileName)
+{
+	QList<TSFix> fixes;
+	QFile file(fileName);
+	if( !file.open(QIODevice::ReadOnly | QIODevice::Text) )
+	{
+		QLOG_WARN() << QString("Position: %1 cannot be opened.").arg(fileName);
+		return fixes;
+	}
+
+	// A GGA of the same second as the previous RMC only adds its accuracy
+	qint64 day = 0;
+	QTextStream in(&file);
+	while( !in.atEnd() )
+	{
+		QString line = in.readLine();
+		TSFix fix;
+		if( !parseNmea(line, &fix) )
+			continue;
+
+		bool gga = line.mid(3, 3) == "GGA";
+		if( gga )
+		{
+			if( !fixes.isEmpty() && fixes.last().time % MS_PER_DAY == fix.time )
+			{
+				fixes.last().accuracy = fix.accuracy;
+				continue;
+			}
+			fix.time += day;
+		}
+		else
+			day = fix.time - fix.time % MS_PER_DAY;
+		fixes.append(fix);
+	}
+	return fixes;
+}
+
+QList<TSFix> TSFixReader::readGpx(const QString& fileName)
+{
+	QList<TSFix> fixes;
+	QFile file(fileName);
+	if( !file.open(QIODevice::ReadOnly) )
+	{
+		QLOG_WARN() << QString("Position: %1 cannot be opened.").arg(fileName);
+		return fixes;
+	}
+
+	TSFix fix;
+	bool inPoint = false;
+	QXmlStreamReader xml(&file);
+	while( !xml.atEnd() )
+	{
+		xml.readNext();
+		if( xml.isStartElement() )
+		{
+			if( xml.name() == "trkpt" )
+			{
+				QXmlStreamAttributes attrs = xml.attributes();
+				fix.lat = attrs.value("lat").toString().toDouble();
+				fix.lng = attrs.value("lon").toString().toDouble();
+				fix.time = -1;
+				fix.accuracy = 0;
+				fix.speed = -1;
+				fix.heading = -1;
+				inPoint = true;
+			}
+			else if( inPoint && xml.name() == "time" )
+			{
+				QDateTime dt = QDateTime::fromString(xml.readElementText().trimmed(), Qt::ISODate);
+				dt.setTimeSpec(Qt::UTC);
+				if( dt.isValid() )
+					fix.time = toMs(dt);
+			}
+			else if( inPoint && xml.name() == "hdop" )
+				fix.accuracy = (float)(xml.readElementText().toDouble() * HDOP_TO_METERS);
+		}
+		else if( xml.isEndElement() && xml.name() == "trkpt" )
+		{
+			// Untimed tracks are played one point per second
+			if( fix.time < 0 )
+				fix.time = fixes.isEmpty() ? 0 : fixes.last().time + 1000;
+			fixes.append(fix);
+			inPoint = false;
+		}
+	}
+
+	if( xml.hasError() )
+		QLOG_WARN() << QString("Position: %1 at line %2 of %3.").arg(xml.errorString()).arg(xml.lineNumber()).arg(fileName);
+	return fixes;
+}
+
+QList<TSFix> TSFixReader::readFile(const QString& fileName)
+{
+	QFile file(fileName);
+	if( !file.open(QIODevice::ReadOnly) )
+	{
+		QLOG_WARN() << QString("Position: %1 cannot be opened.").arg(fileName);
+		return QList<TSFix>();
+	}
+	QByteArray head = file.read(512);
+	file.close();
+
+	QList<TSFix> fixes = head.contains("<gpx") ? readGpx(fileName) : readNmea(fileName);
+	QLOG_INFO() << QString("Position: %1 fixes read from %2.").arg(fixes.count()).arg(fileName);
+	return fixes;
+}
+
+TSFixReplay::TSFixReplay(QObject *parent)
+: QObject(parent)
+, m_next(0)
+, m_speed(1.0)
+{
+	m_timer.setSingleShot(true);
+	connect(&m_timer, SIGNAL(timeout()), this, SLOT(emitNext()));
+}
+
+bool TSFixReplay::start(const QString& fileName, double speed)
+{
+	QList<TSFix> fixes = TSFixReader::readFile(fileName);
+	if( fixes.isEmpty() )
+		return false;
+	start(fixes, speed);
+	return true;
+}
+
+void TSFixReplay::start(const QList<TSFix>& fixes, double speed)
+{
+	m_fixes = fixes;
+	m_next = 0;
+	m_speed = speed > 0 ? speed : 1.0;
+	m_timer.start(0);
+}
+
+void TSFixReplay::stop()
+{
+	m_timer.stop();
+	m_fixes.clear();
+	m_next = 0;
+}
+
+void TSFixReplay::emitNext()
+{
+	if( m_next >= m_fixes.count() )
+		return;
+
+	TSFix fix = m_fixes[m_next++];
+	emit fixReceived(fix);
+
+	if( m_next >= m_fixes.count() )
+	{
+		emit finished();
+		return;
+	}
+	qint64 gap = m_fixes[m_next].time - fix.time;
+	m_timer.start((int)qBound((qint64)0, (qint64)(gap / m_speed), (qint64)60000));
+}
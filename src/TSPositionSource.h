@@ -0,0 +1,80 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSPositionSource.h
+// Author : Zhan
+//
+#ifndef TSPOSITIONSOURCE_H
+#define TSPOSITIONSOURCE_H
+
+#include "TSWebApp.h"
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QTimer>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+// One position fix
+struct TSFix
+{
+	qint64						time;			// ms since the epoch, UTC
+	double						lat;
+	double						lng;
+	float						accuracy;		// meters, 0 if unknown
+	float						speed;			// meters per second, negative if unknown
+	float						heading;		// degrees from north, negative if unknown
+};
+
+// Reads recorded walks: GPX tracks and NMEA 0183 logs ($GPRMC / $GPGGA)
+class TSWEBAPP_EXPORTS TSFixReader
+{
+public:
+	// The format is guessed from the content
+	static QList<TSFix>			readFile(const QString& fileName);
+
+	static QList<TSFix>			readGpx(const QString& fileName);
+	static QList<TSFix>			readNmea(const QString& fileName);
+
+	// One sentence; RMC gives time, speed and course, GGA gives the accuracy.
+	// Returns false for other sentences, bad checksums and fixes flagged invalid.
+	static bool					parseNmea(const QString& sentence, TSFix* fix);
+};
+
+// Plays recorded fixes back in (scaled) real time, stand-in for a live receiver
+class TSWEBAPP_EXPORTS TSFixReplay : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit TSFixReplay(QObject *parent = 0);
+
+	// speed 2.0 plays twice as fast as recorded
+	bool						start(const QString& fileName, double speed = 1.0);
+	void						start(const QList<TSFix>& fixes, double speed = 1.0);
+	void						stop();
+	bool						isActive() const { return m_timer.isActive(); }
+
+signals:
+	void						fixReceived(const TSFix& fix);
+	void						finished();
+
+private slots:
+	void						emitNext();
+
+private:
+	QList<TSFix>				m_fixes;
+	int							m_next;
+	double						m_speed;
+	QTimer						m_timer;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSPOSITIONSOURCE_H
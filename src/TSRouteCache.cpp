@@ -0,0 +1,119 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteCache.cpp
+// Author : Zhan
+//
+
+#include "TSRouteCache.h"
+#include "TSOpeningHours.h"
+
+#include <QtCore/QSettings>
+#include <QtCore/QMutexLocker>
+
+TSRouteCache::TSRouteCache()
+: m_hits(0)
+, m_misses(0)
+, m_maxBytes(2 * 1024 * 1024)
+, m_slotSeconds(300)
+{
+	loadSettings();
+}
+
+void TSRouteCache::loadSettings()
+{
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	settings.beginGroup(QLatin1String("cache"));
+	m_maxBytes = qMax(0, settings.value(QLatin1String("MaxKilobytes"), 2048).toInt()) * 1024;
+	m_slotSeconds = qMax(1, settings.value(QLatin1String("SlotMinutes"), 5).toInt()) * 60;
+	settings.endGroup();
+
+	QMutexLocker locker(&m_mutex);
+	m_cache.setMaxCost(m_maxBytes);
+}
+
+bool TSRouteCache::find(const TSRouteKey& key, TSCachedRoute* walk) const
+{
+	QMutexLocker locker(&m_mutex);
+	const TSCachedRoute* cached = m_cache.object(key);
+	if( !cached )
+	{
+		m_misses++;
+		return false;
+	}
+	m_hits++;
+	*walk = *cached;
+	return true;
+}
+
+void TSRouteCache::insert(const TSRouteKey& key, const TSCachedRoute& walk)
+{
+	if( !isEnabled() )
+		return;
+	QMutexLocker locker(&m_mutex);
+	m_cache.insert(key, new TSCachedRoute(walk), cost(walk));		// dropped at once if larger than the cache
+}
+
+void TSRouteCache::validate(const QByteArray& stamp)
+{
+	QMutexLocker locker(&m_mutex);
+	if( stamp == m_stamp )
+		return;
+	m_cache.clear();
+	m_stamp = stamp;
+}
+
+void TSRouteCache::clear()
+{
+	QMutexLocker locker(&m_mutex);
+	m_cache.clear();
+	m_hits = m_misses = 0;
+}
+
+int TSRouteCache::slot(const QDateTime& departure) const
+{
+	return TSOpeningHours::weekSecond(departure) / m_slotSeconds;
+}
+
+int TSRouteCache::count() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_cache.count();
+}
+
+int TSRouteCache::bytes() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_cache.totalCost();
+}
+
+int TSRouteCache::hits() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_hits;
+}
+
+int TSRouteCache::misses() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_misses;
+}
+
+/*!
+  \brief Bytes held by a walk, containers and strings included.
+*/
+int TSRouteCache::cost(const TSCachedRoute& walk)
+{
+	int bytes = sizeof(TSCachedRoute);
+	bytes += walk.route.edges.count() * sizeof(quint32) + walk.route.offsets.count() * sizeof(float);
+	bytes += walk.shape.count() * sizeof(QPointF);
+	for( int i = 0; i < walk.route.maneuvers.count(); i++ )
+	{
+		const TSManeuver& m = walk.route.maneuvers[i];
+		bytes += sizeof(TSManeuver) + (m.street.size() + m.text.size()) * sizeof(QChar);
+	}
+	for( int i = 0; i < walk.speech.count(); i++ )
+		bytes += sizeof(QString) + walk.speech[i].size() * sizeof(QChar);
+	return bytes;
+}
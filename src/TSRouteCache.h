@@ -0,0 +1,105 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteCache.h
+// Author : Zhan
+//
+#ifndef TSROUTECACHE_H
+#define TSROUTECACHE_H
+
+#include "TSWebApp.h"
+#include "TSManeuver.h"
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QPointF>
+#include <QByteArray>
+#include <QDateTime>
+#include <QCache>
+#include <QMutex>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+// Walk between two buildings with what the page and the voice need of it
+struct TSCachedRoute
+{
+	TSRoute						route;
+	QVector<QPointF>			shape;			// x = lng and y = lat, passages through buildings included
+	QStringList					speech;			// text of each maneuver, normalized for the voice
+};
+
+// Walk asked for: buildings, profile and departure slot or minute
+struct TSRouteKey
+{
+	int							srcPoi;
+	int							dstPoi;
+	int							profile;
+	int							slot;			// departure slot of a walk honouring opening hours, -1 otherwise
+	int							minute;			// departure minute of such a walk through scheduled edges, -1 otherwise
+
+	bool operator==(const TSRouteKey& other) const
+	{
+		return srcPoi == other.srcPoi && dstPoi == other.dstPoi && profile == other.profile && slot == other.slot && minute == other.minute;
+	}
+};
+
+inline uint qHash(const TSRouteKey& key)
+{
+	return ((uint)key.srcPoi * 92821u) ^ ((uint)key.dstPoi * 31u) ^ ((uint)key.profile << 24) ^ ((uint)key.slot * 2654435761u) ^ ((uint)key.minute * 40503u);
+}
+
+// Least recently used walks, bounded by the memory they take.
+//
+// Walkers keep asking for the same few walks between buildings; a hit costs one
+// hash lookup instead of a search, the directions and their normalization. The
+// walks are only valid for the graph and catalog they were computed on: the
+// owner passes a stamp of both and the cache empties itself when it changes.
+// Walks honouring opening hours are shared by the departures of one slot when
+// they go through no scheduled edge, and by those of one minute otherwise.
+//
+// Thread safe. Configured by the [cache] group of app_config.ini.
+class TSWEBAPP_EXPORTS TSRouteCache
+{
+public:
+	TSRouteCache();
+
+	void						loadSettings();
+
+	// Copies the walk out on a hit
+	bool						find(const TSRouteKey& key, TSCachedRoute* walk) const;
+	void						insert(const TSRouteKey& key, const TSCachedRoute& walk);
+	// Empties the cache when the stamp differs from the one of the cached walks
+	void						validate(const QByteArray& stamp);
+	void						clear();
+
+	// Departure slot of a local time, slots cut the week every few minutes
+	int							slot(const QDateTime& departure) const;
+
+	bool						isEnabled() const { return m_maxBytes > 0; }
+	int							count() const;
+	int							bytes() const;
+	int							hits() const;
+	int							misses() const;
+
+	// Approximate memory held by a walk
+	static int					cost(const TSCachedRoute& walk);
+
+private:
+	mutable QMutex				m_mutex;
+	mutable QCache<TSRouteKey, TSCachedRoute> m_cache;		// object() refreshes the order
+	QByteArray					m_stamp;
+	mutable int					m_hits;
+	mutable int					m_misses;
+	int							m_maxBytes;
+	int							m_slotSeconds;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSROUTECACHE_H
@@ -0,0 +1,541 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteEngine.cpp
+// Author : Zhan
+//
+
+#include "TSRouteEngine.h"
+#include "TSRouteSearch.h"
+#include "TSElevation.h"
+#include "TSSpeechNormalizer.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QSettings>
+#include <QtCore/QFileInfo>
+#include <QtCore/QTime>
+#include <QtCore/QtConcurrentMap>
+
+#define CLOSURE_METERS		20			// a closed path passes this close to its point
+
+// Metric of one profile, run by QtConcurrent on every profile
+struct TSCustomizeJob
+{
+	typedef void result_type;
+
+	const TSRouteHierarchy		*hierarchy;
+	const QVector<bool>			*closed;
+	TSRouteMetric				*metrics;
+	QVector<float>				*weights;
+	double						climbSeconds;
+	double						uncoveredFactor;
+
+	void operator()(const int& profile) const
+	{
+		weights[profile] = TSRouteProfile::weights(*hierarchy->graph(), profile, *closed, climbSeconds, uncoveredFactor);
+		metrics[profile].customize(hierarchy, weights[profile]);
+	}
+};
+
+TSRouteEngine::TSRouteEngine(QObject *parent)
+: QObject(parent)
+, m_closedCount(0)
+, m_maxSnapMeters(500)
+, m_autocompleteDelay(80)
+, m_footprintMeters(25)
+, m_approachMeters(60)
+, m_climbSeconds(8)
+, m_uncoveredFactor(1.5)
+, m_sampleMeters(10)
+{
+	loadSettings();
+}
+
+TSRouteEngine::~TSRouteEngine()
+{
+}
+
+void TSRouteEngine::loadSettings()
+{
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	settings.beginGroup(QLatin1String("routing"));
+	m_catalogFile = settings.value(QLatin1String("CatalogFile"), QLatin1String("poi_catalog.xml")).toString();
+	m_graphFile = settings.value(QLatin1String("GraphFile"), QLatin1String("campus.osm")).toString();
+	m_tableFile = settings.value(QLatin1String("TableFile"), QLatin1String("route_table.dat")).toString();
+	m_indoorFile = settings.value(QLatin1String("IndoorFile"), QLatin1String("indoor.xml")).toString();
+	m_maxSnapMeters = settings.value(QLatin1String("MaxSnapMeters"), 500).toDouble();
+	m_closedPaths = settings.value(QLatin1String("ClosedPaths"), QStringList()).toStringList();		// comma separated
+	m_autocompleteDelay = settings.value(QLatin1String("AutocompleteDelay"), 80).toInt();
+	settings.endGroup();
+
+	settings.beginGroup(QLatin1String("geofence"));
+	m_footprintMeters = settings.value(QLatin1String("FootprintMeters"), 25).toDouble();
+	m_approachMeters = settings.value(QLatin1String("ApproachMeters"), 60).toDouble();
+	settings.endGroup();
+
+	settings.beginGroup(QLatin1String("profiles"));
+	m_climbSeconds = settings.value(QLatin1String("ClimbSecondsPerMeter"), 8).toDouble();
+	m_uncoveredFactor = qMax(1.0, settings.value(QLatin1String("UncoveredFactor"), 1.5).toDouble());
+	settings.endGroup();
+
+	settings.beginGroup(QLatin1String("elevation"));
+	m_demDir = settings.value(QLatin1String("TileDir"), QLatin1String("dem")).toString();
+	m_sampleMeters = settings.value(QLatin1String("SampleMeters"), 10).toDouble();
+	settings.endGroup();
+}
+
+/*!
+  \brief Load the catalog and the graph, then bring the route table up to date.
+
+  The geocoder, the autocomplete and the geofences only need the catalog. Without a graph the web page keeps using
+  the Google directions service.
+*/
+void TSRouteEngine::init()
+{
+	m_catalog.load(m_catalogFile);
+	m_geocoder.build(&m_catalog);
+	m_autocomplete.build(&m_catalog);
+	m_geofences.build(m_catalog, m_footprintMeters, m_approachMeters);
+	m_indoor.load(m_indoorFile);
+
+	if( !loadGraph() )
+	{
+		QLOG_WARN() << QString("Route engine: no walking graph, native routing disabled.");
+		return;
+	}
+
+	snapPois();
+	applyHours();
+
+	m_hierarchy.build(&m_graph);
+	setClosedEdges(closedPathEdges());
+
+	m_table.load(m_tableFile);
+	if( m_table.update(&m_graph, m_poiNodes) > 0 || m_table.count() != m_poiNodes.count() )
+		m_table.save(m_tableFile);
+
+	m_cache.validate(m_graph.signature() + m_catalog.fingerprint());
+}
+
+// Use the binary cache next to the OSM extract unless the extract, the elevation tiles or the indoor map are newer
+bool TSRouteEngine::loadGraph()
+{
+	QString cacheFile = m_graphFile + QLatin1String(".graph");
+	QFileInfo osm(m_graphFile), cache(cacheFile), dem(m_demDir), indoor(m_indoorFile);
+
+	if( cache.exists() && (!osm.exists() || cache.lastModified() >= osm.lastModified())
+		&& (!dem.exists() || cache.lastModified() >= dem.lastModified())
+		&& (!indoor.exists() || cache.lastModified() >= indoor.lastModified()) )
+	{
+		if( m_graph.load(cacheFile) )
+		{
+			m_indoor.link(m_graph, m_maxSnapMeters);		// the passages are in, only their paths are needed
+			return true;
+		}
+	}
+
+	if( !osm.exists() || !m_graph.importOsm(m_graphFile) )
+		return false;
+
+	linkIndoor();
+
+	TSElevation elevation;
+	if( dem.exists() && elevation.load(m_demDir) > 0 )
+		m_graph.applyElevation(elevation, m_sampleMeters);
+
+	m_graph.save(cacheFile);
+	return true;
+}
+
+// One edge per passage; the snapped entrances are nodes the rebuild keeps, so the passages stay valid
+void TSRouteEngine::linkIndoor()
+{
+	if( m_indoor.link(m_graph, m_maxSnapMeters) > 0 )
+		m_graph.addLinks(m_indoor.links());
+}
+
+/*!
+  \brief Passages open while every building they cross is.
+
+  Applied on each start rather than cached with the graph, so editing the hours
+  of the catalog needs no import.
+*/
+void TSRouteEngine::applyHours()
+{
+	int closing = 0;
+	for( int e = 0; e < m_graph.edgeCount(); e++ )
+	{
+		const TSRouteGraph::Edge& edge = m_graph.edge(e);
+		if( !(edge.flags & TSRouteGraph::EDGE_INDOOR) || edge.reverse < (quint32)e )
+			continue;
+		const TSPassage* p = m_indoor.passage(m_graph.edgeSource(e), edge.target, (edge.flags & TSRouteGraph::EDGE_STEPS) != 0);
+		if( !p )
+			continue;
+
+		TSOpeningHours hours;
+		for( int i = 0; i < p->pois.count(); i++ )
+		{
+			const TSPoi* poi = m_catalog.poi(p->pois[i]);
+			if( poi )
+				hours = hours.intersected(poi->hours);
+		}
+		if( !hours.isAlwaysOpen() )
+		{
+			m_graph.setEdgeHours(e, hours);
+			closing++;
+		}
+	}
+	if( closing > 0 )
+		QLOG_INFO() << QString("Route engine: %1 indoor passages follow opening hours.").arg(closing);
+}
+
+void TSRouteEngine::snapPois()
+{
+	m_poiNodes.clear();
+
+	const QList<TSPoi>& pois = m_catalog.pois();
+	for( int i = 0; i < pois.count(); i++ )
+	{
+		double meters = 0;
+		quint32 node = m_graph.nearestNode(pois[i].lat, pois[i].lng, &meters);
+		if( node == TS_INVALID || meters > m_maxSnapMeters )
+		{
+			QLOG_DEBUG() << QString("Route engine: %1 is outside the walking graph.").arg(pois[i].name);
+			continue;
+		}
+		m_poiNodes.insert(pois[i].id, node);
+	}
+}
+
+TSRouteSearch* TSRouteEngine::threadSearch() const
+{
+	if( !m_searches.hasLocalData() )
+		m_searches.setLocalData(new TSRouteSearch(&m_graph));
+	return m_searches.localData();
+}
+
+// Sized for the hierarchy, so only asked for once it is built
+TSHierarchyQuery* TSRouteEngine::threadQuery() const
+{
+	if( !m_queries.hasLocalData() )
+		m_queries.setLocalData(new TSHierarchyQuery(&m_hierarchy));
+	return m_queries.localData();
+}
+
+TSRoute TSRouteEngine::route(int srcPoi, int dstPoi) const
+{
+	quint32 source = poiNode(srcPoi);
+	quint32 target = poiNode(dstPoi);
+	if( source == TS_INVALID || target == TS_INVALID )
+		return route(QVector<quint32>(), srcPoi, dstPoi);
+
+	TSRouteSearch* search = threadSearch();
+	search->setWeights(weights(TSRouteProfile::DEFAULT));
+	search->runTo(source, target);
+	return route(search->path(target), srcPoi, dstPoi);
+}
+
+/*!
+  \brief Walk leaving at a given time, waiting at a closed door if need be.
+
+  Only the search from the source knows the time; the route table, the
+  profiles and the reroutes of the tracker ignore the schedules.
+*/
+TSRoute TSRouteEngine::route(int srcPoi, int dstPoi, const QDateTime& departure) const
+{
+	quint32 source = poiNode(srcPoi);
+	quint32 target = poiNode(dstPoi);
+	if( source == TS_INVALID || target == TS_INVALID || !departure.isValid() )
+		return route(srcPoi, dstPoi);
+
+	TSRouteSearch* search = threadSearch();
+	search->setWeights(weights(TSRouteProfile::DEFAULT));
+	search->setDeparture(TSOpeningHours::weekSecond(departure));
+	search->runTo(source, target);
+	search->setDeparture(-1);
+
+	TSRoute walk = route(search->path(target), srcPoi, dstPoi);
+	if( search->reached(target) )
+	{
+		float walking = 0;
+		for( int i = 0; i < walk.edges.count(); i++ )
+			walking += m_graph.edge(walk.edges[i]).seconds;
+		walk.wait = qMax(0.0f, search->seconds(target) - walking);
+	}
+	return walk;
+}
+
+/*!
+  \brief Walk for a profile, read from the metric of that profile.
+
+  The default walk keeps the plain search, which can also honour opening
+  hours; it avoids the closed paths all the same.
+*/
+TSRoute TSRouteEngine::route(int srcPoi, int dstPoi, int profile) const
+{
+	if( profile <= TSRouteProfile::DEFAULT || profile >= TSRouteProfile::COUNT || m_hierarchy.isEmpty() )
+		return route(srcPoi, dstPoi);
+
+	quint32 source = poiNode(srcPoi);
+	quint32 target = poiNode(dstPoi);
+	if( source == TS_INVALID || target == TS_INVALID )
+		return route(QVector<quint32>(), srcPoi, dstPoi);
+
+	QVector<quint32> edges;
+	{
+		QReadLocker locker(&m_metricLock);
+		edges = threadQuery()->run(m_metrics[profile], source, target);
+	}
+	return route(edges, srcPoi, dstPoi);
+}
+
+/*!
+  \brief Close edges to every walk, the default one included.
+
+  Only the weights change: the profiles are customized again, the walks
+  cached are dropped, and the route table, which knows nothing of closures,
+  is left aside until every edge is open again (see summary()).
+*/
+void TSRouteEngine::setClosedEdges(const QVector<quint32>& edges)
+{
+	m_closed.fill(false, m_graph.edgeCount());
+	int closed = 0;
+	for( int i = 0; i < edges.count(); i++ )
+	{
+		if( edges[i] < (quint32)m_closed.count() && !m_closed[edges[i]] )
+		{
+			m_closed[edges[i]] = true;
+			closed++;
+		}
+	}
+	int ms = customize();
+	m_closedCount = closed;
+	m_cache.clear();
+	if( closed > 0 || !edges.isEmpty() )
+		QLOG_INFO() << QString("Route engine: %1 edges closed, profiles customized in %2 ms.").arg(closed).arg(ms);
+}
+
+// Both ways of the path closest to each "lat lng" of ClosedPaths
+QVector<quint32> TSRouteEngine::closedPathEdges() const
+{
+	QVector<quint32> edges;
+	for( int i = 0; i < m_closedPaths.count(); i++ )
+	{
+		QStringList latLng = m_closedPaths[i].trimmed().split(QLatin1Char(' '), QString::SkipEmptyParts);
+		bool okLat = false, okLng = false;
+		double lat = latLng.count() == 2 ? latLng[0].toDouble(&okLat) : 0;
+		double lng = latLng.count() == 2 ? latLng[1].toDouble(&okLng) : 0;
+		QVector<quint32> near = (okLat && okLng) ? m_graph.edgesNear(lat, lng, CLOSURE_METERS, 1) : QVector<quint32>();
+		if( near.isEmpty() )
+		{
+			QLOG_WARN() << QString("Route engine: no path within %1 m of the closure \"%2\".").arg(CLOSURE_METERS).arg(m_closedPaths[i]);
+			continue;
+		}
+		edges.append(near[0]);
+		edges.append(m_graph.edge(near[0]).reverse);
+	}
+	return edges;
+}
+
+QVector<float> TSRouteEngine::weights(int profile) const
+{
+	QReadLocker locker(&m_metricLock);
+	return profile >= 0 && profile < m_weights.count() ? m_weights[profile] : QVector<float>();
+}
+
+/*!
+  \brief Meters, seconds and first instruction of the default walk.
+
+  Read from the route table while every path is open, walked otherwise.
+*/
+bool TSRouteEngine::summary(int srcPoi, int dstPoi, TSRouteTable::Cell* cell) const
+{
+	if( m_closedCount == 0 )
+	{
+		const TSRouteTable::Cell* found = m_table.lookup(srcPoi, dstPoi);
+		if( found )
+			*cell = *found;
+		return found != 0;
+	}
+
+	quint32 source = poiNode(srcPoi);
+	quint32 target = poiNode(dstPoi);
+	if( source == TS_INVALID || target == TS_INVALID )
+		return false;
+	TSRoute walk = route(srcPoi, dstPoi);
+	if( walk.edges.isEmpty() && source != target )
+		return false;		// cut off by the closures
+
+	cell->meters = walk.offsets.last();
+	cell->seconds = 0;
+	QVector<float> w = weights(TSRouteProfile::DEFAULT);
+	for( int i = 0; i < walk.edges.count(); i++ )
+		cell->seconds += w.isEmpty() ? m_graph.edge(walk.edges[i]).seconds : w[walk.edges[i]];
+	cell->instruction = walk.edges.isEmpty() ? QString() : TSRouteTable::departureText(&m_graph, walk.edges.first());
+	return true;
+}
+
+/*!
+  \brief Walk with its shape and spoken text, computed once per key.
+
+  Walks honouring opening hours are keyed by their departure slot as long as
+  they go through no scheduled edge. A walk through one only holds for the
+  minute it was computed for, the door may close or open later in the slot,
+  and is keyed by that minute. Without any schedule in the graph the time
+  makes no difference and is left out.
+*/
+TSCachedRoute TSRouteEngine::walk(int srcPoi, int dstPoi, int profile, const QDateTime& departure) const
+{
+	bool timed = profile == TSRouteProfile::DEFAULT && departure.isValid() && m_graph.scheduleCount() > 1;
+	TSRouteKey key = { srcPoi, dstPoi, profile, timed ? m_cache.slot(departure) : -1, -1 };
+
+	TSCachedRoute walk;
+	if( m_cache.find(key, &walk) )
+		return walk;
+	TSRouteKey exact = key;
+	exact.minute = timed ? TSOpeningHours::weekSecond(departure) / 60 : -1;
+	if( timed && m_cache.find(exact, &walk) )
+		return walk;
+
+	walk.route = timed ? route(srcPoi, dstPoi, departure) : route(srcPoi, dstPoi, profile);
+	walk.shape = shape(walk.route);
+	const TSSpeechNormalizer& normalizer = TSSpeechNormalizer::standard();
+	for( int i = 0; i < walk.route.maneuvers.count(); i++ )
+		walk.speech.append(normalizer.normalize(walk.route.maneuvers[i].text));
+
+	bool scheduled = false;
+	for( int i = 0; timed && i < walk.route.edges.count() && !scheduled; i++ )
+		scheduled = m_graph.edge(walk.route.edges[i]).schedule != 0;
+	m_cache.insert(scheduled ? exact : key, walk);
+	return walk;
+}
+
+QVector<QPointF> TSRouteEngine::shape(const TSRoute& route) const
+{
+	QVector<QPointF> points;
+	for( int k = 0; k < route.edges.count(); k++ )
+	{
+		quint32 node = m_graph.edgeSource(route.edges[k]);
+		const TSRouteGraph::Edge& edge = m_graph.edge(route.edges[k]);
+		points.append(QPointF(m_graph.lng(node), m_graph.lat(node)));
+		if( edge.flags & TSRouteGraph::EDGE_INDOOR )
+		{
+			const TSPassage* passage = m_indoor.passage(node, edge.target, (edge.flags & TSRouteGraph::EDGE_STEPS) != 0);
+			for( int i = 0; passage && i < passage->lat.count(); i++ )
+				points.append(QPointF(passage->lng[i], passage->lat[i]));
+		}
+	}
+	if( !route.edges.isEmpty() )
+	{
+		quint32 last = m_graph.edge(route.edges.last()).target;
+		points.append(QPointF(m_graph.lng(last), m_graph.lat(last)));
+	}
+	return points;
+}
+
+/*!
+  \brief Customize every profile on the hierarchy, one thread per profile.
+
+  The new metrics are built aside, queries keep the old ones until the swap.
+*/
+int TSRouteEngine::customize()
+{
+	if( m_hierarchy.isEmpty() )
+		return 0;
+
+	QTime timer;
+	timer.start();
+
+	QVector<TSRouteMetric> metrics(TSRouteProfile::COUNT);
+	QVector< QVector<float> > weights(TSRouteProfile::COUNT);
+	QList<int> profiles;
+	for( int p = 0; p < TSRouteProfile::COUNT; p++ )
+		profiles.append(p);
+
+	TSCustomizeJob job;
+	job.hierarchy = &m_hierarchy;
+	job.closed = &m_closed;
+	job.metrics = metrics.data();
+	job.weights = weights.data();
+	job.climbSeconds = m_climbSeconds;
+	job.uncoveredFactor = m_uncoveredFactor;
+	QtConcurrent::blockingMap(profiles, job);
+
+	QWriteLocker locker(&m_metricLock);
+	m_metrics = metrics;
+	m_weights = weights;
+	return timer.elapsed();
+}
+
+TSRoute TSRouteEngine::route(const QVector<quint32>& edges, int srcPoi, int dstPoi) const
+{
+	TSRoute route;
+	route.srcPoi = srcPoi;
+	route.dstPoi = dstPoi;
+	route.edges = edges;
+	route.wait = 0;
+
+	float offset = 0;
+	for( int i = 0; i < route.edges.count(); i++ )
+	{
+		route.offsets.append(offset);
+		offset += m_graph.edge(route.edges[i]).meters;
+	}
+	route.offsets.append(offset);
+
+	TSManeuverBuilder builder(&m_graph, &m_catalog, &m_geocoder, &m_indoor);
+	route.maneuvers = builder.build(route.edges, dstPoi);
+	return route;
+}
+
+/*!
+  \brief Closest buildings of a category from a position.
+
+  One search from the node closest to the position stops at the count-th
+  building node met. Buildings sharing a node are all returned, so the list
+  may hold a few more than count.
+*/
+QList<TSFacility> TSRouteEngine::nearestFacilities(double lat, double lng, const QString& category, int count) const
+{
+	QList<TSFacility> facilities;
+	double snapMeters = 0;
+	quint32 source = m_graph.nearestNode(lat, lng, &snapMeters);
+	if( source == TS_INVALID || snapMeters > m_maxSnapMeters )
+		return facilities;
+
+	QMultiHash<quint32, int> nodePois;
+	QVector<quint32> targets;
+	QList<int> ids = m_catalog.withCategory(category);
+	for( int i = 0; i < ids.count(); i++ )
+	{
+		quint32 node = poiNode(ids[i]);
+		if( node == TS_INVALID )
+			continue;
+		if( !nodePois.contains(node) )
+			targets.append(node);
+		nodePois.insert(node, ids[i]);
+	}
+	if( targets.isEmpty() )
+		return facilities;
+
+	TSRouteSearch* search = threadSearch();
+	search->setWeights(weights(TSRouteProfile::DEFAULT));
+	QVector<quint32> found = search->runNearest(source, targets, count);
+	for( int i = 0; i < found.count(); i++ )
+	{
+		QList<int> pois = nodePois.values(found[i]);
+		qSort(pois);
+		for( int k = 0; k < pois.count(); k++ )
+		{
+			TSFacility facility;
+			facility.poiId = pois[k];
+			facility.seconds = search->seconds(found[i]) + (float)(snapMeters / TSRouteGraph::WALK_SPEED);
+			facility.meters = search->meters(found[i]) + (float)snapMeters;
+			facility.route = route(search->path(found[i]), -1, pois[k]);
+			facilities.append(facility);
+		}
+	}
+	return facilities;
+}
@@ -0,0 +1,168 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteEngine.h
+// Author : Zhan
+//
+#ifndef TSROUTEENGINE_H
+#define TSROUTEENGINE_H
+
+#include "TSWebApp.h"
+#include "TSPoiCatalog.h"
+#include "TSRouteGraph.h"
+#include "TSRouteTable.h"
+#include "TSGeocoder.h"
+#include "TSAutocomplete.h"
+#include "TSManeuver.h"
+#include "TSGeofence.h"
+#include "TSRouteHierarchy.h"
+#include "TSIndoorMap.h"
+#include "TSRouteCache.h"
+#include "TSPolyline.h"
+
+#include <QObject>
+#include <QString>
+#include <QMap>
+#include <QVector>
+#include <QReadWriteLock>
+#include <QThreadStorage>
+#include <QDateTime>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class TSRouteSearch;
+
+// Building of a category found by TSRouteEngine::nearestFacilities()
+struct TSFacility
+{
+	int							poiId;
+	float						seconds;		// walk from the position
+	float						meters;
+	TSRoute						route;			// from the node closest to the position, empty when already there
+};
+
+// Native routing backend shared by all web views: building catalog with its geocoder,
+// autocomplete index and geofences, walking graph and the precomputed building-to-building table.
+// Connected buildings join the graph as passages between their entrances, see TSIndoorMap.
+// Walks with a profile other than the default one go through a customizable hierarchy of the graph,
+// with one metric per profile; closing edges customizes them all again.
+// Buildings and gated paths may be closed: walks planned for a departure time
+// only go through them while they are open.
+// The walks asked for by the page and the voice are kept in an LRU cache.
+// Once init() is done the queries are thread safe; each thread keeps its own
+// search buffers, so concurrent queries never allocate them again.
+//
+// Configured by the [routing], [geofence], [profiles], [elevation], [indoor], [cache] and [polyline] groups of app_config.ini.
+class TSWEBAPP_EXPORTS TSRouteEngine : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit TSRouteEngine(QObject *parent = 0);
+	virtual ~TSRouteEngine();
+
+	void						loadSettings();
+	void						init();
+
+	bool						isReady() const { return !m_graph.isEmpty(); }
+
+	const TSPoiCatalog&			catalog() const { return m_catalog; }
+	const TSGeocoder&			geocoder() const { return m_geocoder; }
+	const TSAutocomplete&		autocomplete() const { return m_autocomplete; }
+	const TSGeofenceIndex&		geofences() const { return m_geofences; }
+	const TSRouteGraph&			graph() const { return m_graph; }
+	const TSRouteTable&			table() const { return m_table; }
+	const TSIndoorMap&			indoor() const { return m_indoor; }
+
+	// Graph node of a building, TS_INVALID if the building lies outside the graph
+	quint32						poiNode(int poiId) const { return m_poiNodes.value(poiId, TS_INVALID); }
+
+	// Walk between two buildings, empty if either is outside the graph
+	TSRoute						route(int srcPoi, int dstPoi) const;
+	// Route along a path of edges found elsewhere, srcPoi is -1 when it starts off the catalog
+	TSRoute						route(const QVector<quint32>& edges, int srcPoi, int dstPoi) const;
+	// Walk between two buildings for a TSRouteProfile
+	TSRoute						route(int srcPoi, int dstPoi, int profile) const;
+	// Walk between two buildings leaving at a local time, through open doors only
+	TSRoute						route(int srcPoi, int dstPoi, const QDateTime& departure) const;
+	QList<TSManeuver>			directions(int srcPoi, int dstPoi) const { return route(srcPoi, dstPoi).maneuvers; }
+	// Walk for a profile with its shape and spoken text, through the cache; the default
+	// profile honours opening hours when the departure is valid
+	TSCachedRoute				walk(int srcPoi, int dstPoi, int profile, const QDateTime& departure = QDateTime()) const;
+	const TSRouteCache&			cache() const { return m_cache; }
+	void						clearCache() { m_cache.clear(); }
+	// Points of a walk, x = lng and y = lat; passages through buildings follow their corridors
+	QVector<QPointF>			shape(const TSRoute& route) const;
+	// Simplifies and encodes the shapes handed to the page
+	const TSPolyline&			polyline() const { return m_polyline; }
+
+	// Edges no walk may use, e.g. a path closed for works; replaces the previous closures.
+	// The paths listed by ClosedPaths of [routing] are closed on init().
+	void						setClosedEdges(const QVector<quint32>& edges);
+	bool						hasClosures() const { return m_closedCount > 0; }
+	// Edge weights of a profile with the closures, for TSRouteSearch::setWeights()
+	QVector<float>				weights(int profile) const;
+	// Meters, seconds and first instruction of the default walk, false if there is none
+	bool						summary(int srcPoi, int dstPoi, TSRouteTable::Cell* cell) const;
+	// Customizes the metric of every profile again, returns the milliseconds spent
+	int							customize();
+	const TSRouteHierarchy&		hierarchy() const { return m_hierarchy; }
+
+	// Closest buildings of a category on foot, closest first; empty off the graph or for an unknown category
+	QList<TSFacility>			nearestFacilities(double lat, double lng, const QString& category, int count = 1) const;
+
+	// Quiet time after the last keystroke before the page is answered
+	int							autocompleteDelay() const { return m_autocompleteDelay; }
+
+private:
+	bool						loadGraph();
+	void						linkIndoor();
+	void						applyHours();
+	// Scratch space of the calling thread
+	TSRouteSearch*				threadSearch() const;
+	TSHierarchyQuery*			threadQuery() const;
+	void						snapPois();
+	QVector<quint32>			closedPathEdges() const;
+
+	TSPoiCatalog				m_catalog;
+	TSGeocoder					m_geocoder;
+	TSAutocomplete				m_autocomplete;
+	TSGeofenceIndex				m_geofences;
+	TSRouteGraph				m_graph;
+	TSRouteTable				m_table;
+	TSIndoorMap					m_indoor;
+	QMap<int, quint32>			m_poiNodes;
+	TSRouteHierarchy			m_hierarchy;
+	QVector<TSRouteMetric>		m_metrics;		// by profile
+	QVector<bool>				m_closed;		// by edge
+	QVector< QVector<float> >	m_weights;		// by profile, then by edge
+	int							m_closedCount;
+	mutable QReadWriteLock		m_metricLock;
+	mutable TSRouteCache		m_cache;
+	TSPolyline					m_polyline;
+	mutable QThreadStorage<TSRouteSearch*> m_searches;
+	mutable QThreadStorage<TSHierarchyQuery*> m_queries;
+
+	QString						m_catalogFile;
+	QString						m_graphFile;
+	QString						m_tableFile;
+	QString						m_indoorFile;
+	double						m_maxSnapMeters;
+	QStringList					m_closedPaths;		// "lat lng" on each closed path
+	int							m_autocompleteDelay;
+	double						m_footprintMeters;
+	double						m_approachMeters;
+	double						m_climbSeconds;		// per meter climbed
+	double						m_uncoveredFactor;
+	QString						m_demDir;			// SRTM tiles, slopes come from the incline tags without it
+	double						m_sampleMeters;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSROUTEENGINE_H
@@ -0,0 +1,699 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteGraph.cpp
+// Author : Zhan
+//
+
+#include "TSRouteGraph.h"
+#include "TSElevation.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QMap>
+#include <QtCore/QPair>
+#include <QtCore/QDataStream>
+#include <QtCore/QXmlStreamReader>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QTime>
+#include <QtCore/QtConcurrentMap>
+
+#include <math.h>
+
+#define GRAPH_FILE_MAGIC	0x54534752		// "TSGR"
+#define GRAPH_FILE_VERSION	4
+#define INCLINE_GRADE		8				// percent, for an incline tagged up or down only
+#define EARTH_RADIUS		6371008.8
+#define DEG_TO_RAD			(3.14159265358979323846 / 180.0)
+#define NODES_PER_JOB		4096
+
+const double TSRouteGraph::WALK_SPEED = 1.4;
+const double TSRouteGraph::STEPS_FACTOR = 2.0;
+
+static QDataStream& operator<<(QDataStream& out, const TSRouteGraph::Edge& e)
+{
+	out << e.target << e.reverse << e.meters << e.seconds << e.name << e.flags << e.grade << e.ascent << e.descent << e.schedule;
+	return out;
+}
+
+static QDataStream& operator>>(QDataStream& in, TSRouteGraph::Edge& e)
+{
+	in >> e.target >> e.reverse >> e.meters >> e.seconds >> e.name >> e.flags >> e.grade >> e.ascent >> e.descent >> e.schedule;
+	return in;
+}
+
+// Ways a pedestrian may walk along, keyed by their highway tag
+static bool isWalkable(const QHash<QString, QString>& tags)
+{
+	static QSet<QString> walkable;
+	if( walkable.isEmpty() )
+	{
+		walkable << "footway" << "pedestrian" << "path" << "steps" << "corridor" << "living_street"
+				 << "residential" << "service" << "unclassified" << "tertiary" << "tertiary_link"
+				 << "secondary" << "secondary_link" << "primary" << "primary_link" << "track" << "cycleway";
+	}
+
+	if( !walkable.contains(tags.value("highway")) )
+		return false;
+
+	QString foot = tags.value("foot");
+	if( foot == "no" )
+		return false;
+	QString access = tags.value("access");
+	if( (access == "no" || access == "private") && foot != "yes" && foot != "designated" )
+		return false;
+	return true;
+}
+
+// Roofed ways, walked dry
+static bool isCovered(const QHash<QString, QString>& tags)
+{
+	QString covered = tags.value("covered"), tunnel = tags.value("tunnel");
+	return covered == "yes" || covered == "arcade" || tunnel == "yes" || tunnel == "building_passage"
+		|| tags.value("highway") == "corridor" || tags.value("indoor") == "yes";
+}
+
+// Slope in percent along the node order of a way, from "10%", "-5%", "up" or "down"
+static qint8 inclineGrade(const QString& incline)
+{
+	if( incline == "up" )
+		return INCLINE_GRADE;
+	if( incline == "down" )
+		return -INCLINE_GRADE;
+
+	QString value = incline;
+	value.remove(QLatin1Char('%'));
+	bool ok = false;
+	double grade = value.trimmed().toDouble(&ok);
+	return ok ? (qint8)qBound(-100, qRound(grade), 100) : 0;
+}
+
+// Walking time of a straight stretch; stairs have their own pace whatever the slope
+static double walkSeconds(double meters, double grade, quint16 flags)
+{
+	if( flags & TSRouteGraph::EDGE_STEPS )
+		return meters / TSRouteGraph::WALK_SPEED * TSRouteGraph::STEPS_FACTOR;
+	return meters / (TSRouteGraph::WALK_SPEED * TSRouteGraph::slopeFactor(grade));
+}
+
+// Edges leaving a range of nodes, run by QtConcurrent on every range
+struct TSElevationJob
+{
+	typedef void result_type;
+
+	const TSRouteGraph			*graph;
+	const TSElevation			*dem;
+	TSRouteGraph::Edge			*edges;
+	double						sampleMeters;
+	int							*covered;		// by range
+
+	void operator()(const int& range) const
+	{
+		QVector<double> lat, lng;
+		QVector<float> heights;
+		quint32 first = (quint32)range * NODES_PER_JOB;
+		quint32 last = qMin(first + NODES_PER_JOB, (quint32)graph->nodeCount());
+		for( quint32 u = first; u < last; u++ )
+		{
+			for( quint32 e = graph->firstEdge(u); e < graph->lastEdge(u); e++ )
+			{
+				const quint32 reverse = edges[e].reverse;
+				if( reverse < e || (edges[e].flags & TSRouteGraph::EDGE_COVERED) || edges[e].meters < 0.5f )
+					continue;		// twin done from its side; the ground is not the floor of a tunnel or a corridor
+
+				const quint32 v = edges[e].target;
+				const int k = qMax(1, (int)ceil(edges[e].meters / sampleMeters));
+				lat.resize(k + 1);
+				lng.resize(k + 1);
+				heights.resize(k + 1);
+				for( int i = 0; i <= k; i++ )
+				{
+					lat[i] = graph->lat(u) + (graph->lat(v) - graph->lat(u)) * i / k;
+					lng[i] = graph->lng(u) + (graph->lng(v) - graph->lng(u)) * i / k;
+				}
+				dem->heights(lat.constData(), lng.constData(), k + 1, heights.data());
+
+				double ascent = 0, descent = 0, forward = 0, backward = 0;
+				const double step = edges[e].meters / k;
+				bool ok = true;
+				for( int i = 0; i < k && ok; i++ )
+				{
+					double rise = heights[i + 1] - heights[i];
+					ok = !qIsNaN(rise);
+					ascent += qMax(0.0, rise);
+					descent += qMax(0.0, -rise);
+					forward += walkSeconds(step, rise / step, edges[e].flags);
+					backward += walkSeconds(step, -rise / step, edges[e].flags);
+				}
+				if( !ok )
+					continue;
+
+				qint8 grade = (qint8)qBound(-100, qRound((heights[k] - heights[0]) / edges[e].meters * 100), 100);
+				edges[e].seconds = (float)forward;
+				edges[e].grade = grade;
+				edges[e].ascent = (float)ascent;
+				edges[e].descent = (float)descent;
+				edges[reverse].seconds = (float)backward;
+				edges[reverse].grade = (qint8)-grade;
+				edges[reverse].ascent = (float)descent;
+				edges[reverse].descent = (float)ascent;
+				covered[range]++;
+			}
+		}
+	}
+};
+
+TSRouteGraph::TSRouteGraph()
+: m_maxEdgeMeters(0)
+{
+	m_schedules.append(TSOpeningHours());
+}
+
+void TSRouteGraph::clear()
+{
+	m_lat.clear();
+	m_lng.clear();
+	m_firstEdge.clear();
+	m_edges.clear();
+	m_names.clear();
+	m_schedules.clear();
+	m_schedules.append(TSOpeningHours());
+	m_signature.clear();
+	m_nodeIndex.clear();
+	m_edgeIndex.clear();
+	m_edgeIds.clear();
+	m_maxEdgeMeters = 0;
+}
+
+/*!
+  \brief Import the walkable ways of an OpenStreetMap xml extract.
+
+  Each pair of consecutive way nodes becomes one edge in both directions.
+*/
+bool TSRouteGraph::importOsm(const QString& fileName)
+{
+	clear();
+
+	QFile file(fileName);
+	if( !file.open(QIODevice::ReadOnly) )
+	{
+		QLOG_WARN() << QString("Route graph: OSM file %1 cannot be opened.").arg(fileName);
+		return false;
+	}
+
+	QTime timer;
+	timer.start();
+
+	QHash<qint64, QPair<double, double> > osmNodes;
+	QHash<qint64, quint32> nodeIndex;			// osm id -> graph node
+	QHash<QString, qint32> nameIndex;
+	QVector<double> lat, lng;
+	QVector<RawEdge> raw;
+
+	QList<qint64> wayNodes;
+	QHash<QString, QString> wayTags;
+	bool inWay = false;
+
+	QXmlStreamReader xml(&file);
+	while( !xml.atEnd() )
+	{
+		xml.readNext();
+
+		if( xml.isStartElement() )
+		{
+			QXmlStreamAttributes attrs = xml.attributes();
+			if( xml.name() == "node" )
+			{
+				osmNodes.insert(attrs.value("id").toString().toLongLong(),
+					qMakePair(attrs.value("lat").toString().toDouble(), attrs.value("lon").toString().toDouble()));
+			}
+			else if( xml.name() == "way" )
+			{
+				inWay = true;
+				wayNodes.clear();
+				wayTags.clear();
+			}
+			else if( inWay && xml.name() == "nd" )
+			{
+				wayNodes.append(attrs.value("ref").toString().toLongLong());
+			}
+			else if( inWay && xml.name() == "tag" )
+			{
+				wayTags.insert(attrs.value("k").toString(), attrs.value("v").toString());
+			}
+		}
+		else if( xml.isEndElement() && xml.name() == "way" )
+		{
+			inWay = false;
+			if( !isWalkable(wayTags) )
+				continue;
+
+			qint32 name = -1;
+			QString wayName = wayTags.value("name");
+			if( !wayName.isEmpty() )
+			{
+				if( !nameIndex.contains(wayName) )
+				{
+					nameIndex.insert(wayName, m_names.count());
+					m_names.append(wayName);
+				}
+				name = nameIndex.value(wayName);
+			}
+			quint16 flags = (wayTags.value("highway") == "steps") ? EDGE_STEPS : 0;
+			if( isCovered(wayTags) )
+				flags |= EDGE_COVERED;
+			qint8 grade = inclineGrade(wayTags.value("incline"));
+
+			quint16 schedule = 0;
+			if( wayTags.contains("opening_hours") )
+			{
+				bool ok;
+				schedule = addSchedule(TSOpeningHours::parse(wayTags.value("opening_hours"), &ok));
+				if( !ok )
+					QLOG_WARN() << QString("Route graph: opening hours \"%1\" not understood, the way stays open.").arg(wayTags.value("opening_hours"));
+			}
+
+			quint32 prev = TS_INVALID;
+			for( int i = 0; i < wayNodes.count(); i++ )
+			{
+				QHash<qint64, QPair<double, double> >::const_iterator pos = osmNodes.find(wayNodes[i]);
+				if( pos == osmNodes.end() )
+				{
+					prev = TS_INVALID;		// clipped extract, the way leaves the bounding box
+					continue;
+				}
+
+				quint32 cur;
+				QHash<qint64, quint32>::const_iterator it = nodeIndex.find(wayNodes[i]);
+				if( it == nodeIndex.end() )
+				{
+					cur = lat.count();
+					nodeIndex.insert(wayNodes[i], cur);
+					lat.append(pos.value().first);
+					lng.append(pos.value().second);
+				}
+				else
+					cur = it.value();
+
+				if( prev != TS_INVALID && prev != cur )
+				{
+					RawEdge forward = { prev, cur, name, flags, grade, schedule, -1, -1 };
+					RawEdge backward = { cur, prev, name, flags, (qint8)-grade, schedule, -1, -1 };
+					raw.append(forward);
+					raw.append(backward);
+				}
+				prev = cur;
+			}
+		}
+	}
+
+	if( xml.hasError() )
+	{
+		QLOG_ERROR() << QString("Route graph: %1 at line %2 of %3.").arg(xml.errorString()).arg(xml.lineNumber()).arg(fileName);
+		clear();
+		return false;
+	}
+
+	build(lat, lng, raw);
+
+	QLOG_INFO() << QString("Route graph: imported %1 nodes and %2 edges from %3 in %4 ms.")
+					.arg(nodeCount()).arg(edgeCount()).arg(fileName).arg(timer.elapsed());
+	return !isEmpty();
+}
+
+void TSRouteGraph::build(const QVector<double>& lat, const QVector<double>& lng, QVector<RawEdge>& raw)
+{
+	m_lat = lat;
+	m_lng = lng;
+
+	// An edge without its way back, such as a link added one way, is given one
+	QHash<QPair<quint32, quint32>, int> unmatched;		// edges from -> to less edges to -> from
+	for( int i = 0; i < raw.count(); i++ )
+	{
+		unmatched[qMakePair(raw[i].from, raw[i].to)]++;
+		unmatched[qMakePair(raw[i].to, raw[i].from)]--;
+	}
+	const int imported = raw.count();
+	for( int i = 0; i < imported; i++ )
+	{
+		int& count = unmatched[qMakePair(raw[i].from, raw[i].to)];
+		if( count <= 0 )
+			continue;
+		count--;
+		RawEdge back = raw[i];
+		back.from = raw[i].to;
+		back.to = raw[i].from;
+		back.grade = (qint8)-raw[i].grade;
+		raw.append(back);
+	}
+
+	qStableSort(raw.begin(), raw.end());
+
+	const int n = m_lat.count();
+	m_firstEdge.fill(0, n + 1);
+	m_edges.resize(raw.count());
+
+	for( int i = 0; i < raw.count(); i++ )
+	{
+		const RawEdge& r = raw[i];
+		Edge& e = m_edges[i];
+		e.target = r.to;
+		e.reverse = TS_INVALID;
+		e.meters = r.meters >= 0 ? r.meters : (float)distance(m_lat[r.from], m_lng[r.from], m_lat[r.to], m_lng[r.to]);
+		e.seconds = r.seconds >= 0 ? r.seconds : (float)walkSeconds(e.meters, r.grade / 100.0, r.flags);
+		e.name = r.name;
+		e.flags = r.flags;
+		e.grade = r.grade;
+		e.ascent = (float)qMax(0.0, e.meters * r.grade / 100.0);
+		e.descent = (float)qMax(0.0, -e.meters * r.grade / 100.0);
+		e.schedule = r.schedule;
+		m_firstEdge[r.from + 1]++;
+	}
+	for( int u = 0; u < n; u++ )
+		m_firstEdge[u + 1] += m_firstEdge[u];
+
+	// Pair every edge with its twin
+	for( int u = 0; u < n; u++ )
+	{
+		for( quint32 e = m_firstEdge[u]; e < m_firstEdge[u + 1]; e++ )
+		{
+			if( m_edges[e].reverse != TS_INVALID )
+				continue;
+			quint32 v = m_edges[e].target;
+			for( quint32 f = m_firstEdge[v]; f < m_firstEdge[v + 1]; f++ )
+			{
+				if( m_edges[f].target == (quint32)u && m_edges[f].reverse == TS_INVALID )
+				{
+					m_edges[e].reverse = f;
+					m_edges[f].reverse = e;
+					break;
+				}
+			}
+		}
+	}
+
+	updateSignature();
+	buildIndexes();
+}
+
+/*!
+  \brief Rebuild the graph from its edges and the links.
+
+  The edges keep their length and walking time; link names join the street
+  names.
+*/
+void TSRouteGraph::addLinks(const QList<Link>& links)
+{
+	if( isEmpty() || links.isEmpty() )
+		return;
+
+	QVector<RawEdge> raw;
+	raw.reserve(m_edges.count() + links.count());
+	for( int u = 0; u < nodeCount(); u++ )
+	{
+		for( quint32 e = m_firstEdge[u]; e < m_firstEdge[u + 1]; e++ )
+		{
+			const Edge& edge = m_edges[e];
+			RawEdge r = { (quint32)u, edge.target, edge.name, edge.flags, edge.grade, edge.schedule, edge.meters, edge.seconds };
+			raw.append(r);
+		}
+	}
+
+	for( int i = 0; i < links.count(); i++ )
+	{
+		const Link& link = links[i];
+		if( link.from >= (quint32)nodeCount() || link.to >= (quint32)nodeCount() || link.from == link.to )
+			continue;
+		qint32 name = -1;
+		if( !link.name.isEmpty() )
+		{
+			name = m_names.indexOf(link.name);
+			if( name < 0 )
+			{
+				name = m_names.count();
+				m_names.append(link.name);
+			}
+		}
+		RawEdge r = { link.from, link.to, name, link.flags, 0, 0, link.meters, link.seconds };
+		raw.append(r);
+	}
+
+	QVector<double> lat = m_lat, lng = m_lng;
+	build(lat, lng, raw);
+}
+
+/*!
+  \brief Tobler's hiking function, 1 on flat ground.
+
+  Walking is fastest slightly downhill, at a 5% descent, and slows down on
+  either side of it. Grades beyond 100% are DEM noise at a wall and clamped.
+*/
+double TSRouteGraph::slopeFactor(double grade)
+{
+	grade = qBound(-1.0, grade, 1.0);
+	return exp(-3.5 * (fabs(grade + 0.05) - 0.05));
+}
+
+/*!
+  \brief Climbs and walking times from the ground along every edge.
+
+  Each edge is cut into stretches of about sampleMeters; the climb and the
+  walking time add up over the stretches, so a dip in the middle of a flat
+  edge still costs. Both twins come from the same samples. Ranges of nodes
+  are sampled in parallel.
+*/
+int TSRouteGraph::applyElevation(const TSElevation& dem, double sampleMeters)
+{
+	if( isEmpty() || dem.isEmpty() )
+		return 0;
+
+	QTime timer;
+	timer.start();
+
+	const int ranges = (nodeCount() + NODES_PER_JOB - 1) / NODES_PER_JOB;
+	QVector<int> covered(ranges, 0);
+	QList<int> indexes;
+	for( int r = 0; r < ranges; r++ )
+		indexes.append(r);
+
+	TSElevationJob job;
+	job.graph = this;
+	job.dem = &dem;
+	job.edges = m_edges.data();
+	job.sampleMeters = qMax(1.0, sampleMeters);
+	job.covered = covered.data();
+	QtConcurrent::blockingMap(indexes, job);
+
+	int total = 0;
+	for( int r = 0; r < ranges; r++ )
+		total += covered[r];
+
+	updateSignature();
+	QLOG_INFO() << QString("Route graph: elevation of %1 of %2 edge pairs sampled in %3 ms.")
+					.arg(total).arg(m_edgeIds.count()).arg(timer.elapsed());
+	return total;
+}
+
+void TSRouteGraph::updateSignature()
+{
+	QByteArray buffer;
+	QDataStream out(&buffer, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_4_6);
+	out << m_lat << m_lng << m_firstEdge << m_edges;
+	m_signature = QCryptographicHash::hash(buffer, QCryptographicHash::Md5);
+}
+
+void TSRouteGraph::buildIndexes()
+{
+	m_nodeIndex.build(m_lat, m_lng);
+
+	QVector<double> lat, lng;
+	m_edgeIds.clear();
+	m_maxEdgeMeters = 0;
+	for( int e = 0; e < m_edges.count(); e++ )
+	{
+		if( m_edges[e].reverse < (quint32)e )
+			continue;			// the twin is already in
+		quint32 from = edgeSource(e);
+		quint32 to = m_edges[e].target;
+		lat.append((m_lat[from] + m_lat[to]) / 2);
+		lng.append((m_lng[from] + m_lng[to]) / 2);
+		m_edgeIds.append(e);
+		m_maxEdgeMeters = qMax(m_maxEdgeMeters, (double)m_edges[e].meters);
+	}
+	m_edgeIndex.build(lat, lng);
+}
+
+/*!
+  \brief Load a graph written by save().
+*/
+bool TSRouteGraph::load(const QString& fileName)
+{
+	clear();
+
+	QFile file(fileName);
+	if( !file.open(QIODevice::ReadOnly) )
+		return false;
+
+	QDataStream in(&file);
+	in.setVersion(QDataStream::Qt_4_6);
+
+	quint32 magic, version;
+	in >> magic >> version;
+	if( magic != GRAPH_FILE_MAGIC || version != GRAPH_FILE_VERSION )
+	{
+		QLOG_WARN() << QString("Route graph: %1 is not a graph file of version %2.").arg(fileName).arg(GRAPH_FILE_VERSION);
+		return false;
+	}
+
+	in >> m_lat >> m_lng >> m_firstEdge >> m_edges >> m_names >> m_schedules;
+	bool twinned = true;
+	for( int e = 0; e < m_edges.count() && twinned; e++ )
+		twinned = m_edges[e].reverse < (quint32)m_edges.count();
+	if( in.status() != QDataStream::Ok || m_firstEdge.count() != m_lat.count() + 1 || m_schedules.isEmpty() || !twinned )
+	{
+		QLOG_ERROR() << QString("Route graph: %1 is corrupted.").arg(fileName);
+		clear();
+		return false;
+	}
+
+	updateSignature();
+	buildIndexes();
+	QLOG_INFO() << QString("Route graph: loaded %1 nodes and %2 edges from %3.").arg(nodeCount()).arg(edgeCount()).arg(fileName);
+	return true;
+}
+
+bool TSRouteGraph::save(const QString& fileName) const
+{
+	QFile file(fileName);
+	if( !file.open(QIODevice::WriteOnly) )
+	{
+		QLOG_WARN() << QString("Route graph: %1 cannot be written.").arg(fileName);
+		return false;
+	}
+
+	QDataStream out(&file);
+	out.setVersion(QDataStream::Qt_4_6);
+	out << (quint32)GRAPH_FILE_MAGIC << (quint32)GRAPH_FILE_VERSION;
+	out << m_lat << m_lng << m_firstEdge << m_edges << m_names << m_schedules;
+	return out.status() == QDataStream::Ok;
+}
+
+QString TSRouteGraph::edgeName(quint32 e) const
+{
+	qint32 name = m_edges[e].name;
+	return name < 0 ? QString() : m_names.at(name);
+}
+
+// Index of the schedule, shared with the edges already open at the same hours
+quint16 TSRouteGraph::addSchedule(const TSOpeningHours& hours)
+{
+	int s = m_schedules.indexOf(hours);
+	if( s < 0 )
+	{
+		if( m_schedules.count() > 0xffff )
+			return 0;
+		s = m_schedules.count();
+		m_schedules.append(hours);
+	}
+	return (quint16)s;
+}
+
+/*!
+  \brief Set the opening hours of an edge and its twin.
+
+  Only the schedule changes: the weights, hence the signature and the route
+  table, are left alone.
+*/
+void TSRouteGraph::setEdgeHours(quint32 e, const TSOpeningHours& hours)
+{
+	if( e >= (quint32)m_edges.count() )
+		return;
+	quint16 s = addSchedule(hours);
+	m_edges[e].schedule = s;
+	m_edges[m_edges[e].reverse].schedule = s;
+}
+
+quint32 TSRouteGraph::nearestNode(double lat, double lng, double* meters) const
+{
+	int best = m_nodeIndex.nearestOne(lat, lng);
+	if( best < 0 )
+		return TS_INVALID;
+
+	if( meters )
+		*meters = distance(lat, lng, m_lat[best], m_lng[best]);
+	return best;
+}
+
+/*!
+  \brief Edges close to a coordinate.
+
+  The midpoint index returns every edge whose midpoint lies within meters plus
+  half the longest edge, the exact distance then filters them.
+*/
+QVector<quint32> TSRouteGraph::edgesNear(double lat, double lng, double meters, int maxCount) const
+{
+	QVector<quint32> result;
+	if( m_edgeIds.isEmpty() || maxCount <= 0 )
+		return result;
+
+	QVector<int> ids = m_edgeIndex.nearest(lat, lng, maxCount * 4, meters + m_maxEdgeMeters / 2);
+	QMap<double, quint32> byDistance;
+	for( int i = 0; i < ids.count(); i++ )
+	{
+		quint32 e = m_edgeIds[ids[i]];
+		double d = projectOnEdge(e, lat, lng);
+		if( d <= meters )
+			byDistance.insertMulti(d, e);
+	}
+	for( QMap<double, quint32>::const_iterator it = byDistance.constBegin(); it != byDistance.constEnd() && result.count() < maxCount; ++it )
+		result.append(it.value());
+	return result;
+}
+
+// Local equirectangular projection around the point, exact enough along an edge
+double TSRouteGraph::projectOnEdge(quint32 e, double lat, double lng, double* t) const
+{
+	quint32 from = edgeSource(e);
+	quint32 to = m_edges[e].target;
+	double scale = cos(lat * DEG_TO_RAD);
+	double ax = (m_lng[from] - lng) * scale, ay = m_lat[from] - lat;
+	double bx = (m_lng[to] - lng) * scale, by = m_lat[to] - lat;
+	double dx = bx - ax, dy = by - ay;
+	double len2 = dx * dx + dy * dy;
+
+	double u = len2 > 0 ? -(ax * dx + ay * dy) / len2 : 0;
+	u = qBound(0.0, u, 1.0);
+	if( t )
+		*t = u;
+
+	double px = ax + u * dx, py = ay + u * dy;
+	return sqrt(px * px + py * py) * DEG_TO_RAD * EARTH_RADIUS;
+}
+
+// Great circle distance in meters
+double TSRouteGraph::distance(double lat1, double lng1, double lat2, double lng2)
+{
+	double dLat = (lat2 - lat1) * DEG_TO_RAD;
+	double dLng = (lng2 - lng1) * DEG_TO_RAD;
+	double a = sin(dLat / 2) * sin(dLat / 2)
+			 + cos(lat1 * DEG_TO_RAD) * cos(lat2 * DEG_TO_RAD) * sin(dLng / 2) * sin(dLng / 2);
+	return 2 * EARTH_RADIUS * atan2(sqrt(a), sqrt(1 - a));
+}
+
+// Initial bearing in degrees, 0 = north, clockwise
+double TSRouteGraph::bearing(double lat1, double lng1, double lat2, double lng2)
+{
+	double phi1 = lat1 * DEG_TO_RAD;
+	double phi2 = lat2 * DEG_TO_RAD;
+	double dLng = (lng2 - lng1) * DEG_TO_RAD;
+	double y = sin(dLng) * cos(phi2);
+	double x = cos(phi1) * sin(phi2) - sin(phi1) * cos(phi2) * cos(dLng);
+	double deg = atan2(y, x) / DEG_TO_RAD;
+	return deg < 0 ? deg + 360.0 : deg;
+}
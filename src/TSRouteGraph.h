@@ -0,0 +1,160 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteGraph.h
+// Author : Zhan
+//
+#ifndef TSROUTEGRAPH_H
+#define TSROUTEGRAPH_H
+
+#include "TSWebApp.h"
+#include "TSGeoIndex.h"
+#include "TSOpeningHours.h"
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QByteArray>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class TSElevation;
+
+// Invalid node or edge index
+static const quint32			TS_INVALID = 0xffffffff;
+
+// Pedestrian street network in adjacency array (forward star) form.
+//
+// Every walkable way is imported in both directions, so each edge has a reverse
+// twin; links added one way only are given the other. Backward searches use the
+// twin to relax incoming edges, and the source of an edge is the target of its
+// twin.
+//
+// Gated paths and passages through buildings may hold a schedule, the opening
+// hours their edges can be entered at; schedule 0 is always open.
+class TSWEBAPP_EXPORTS TSRouteGraph
+{
+public:
+	enum EdgeFlag
+	{
+		EDGE_STEPS				= 0x0001,
+		EDGE_COVERED			= 0x0002,		// roofed: arcade, passage, corridor, tunnel
+		EDGE_INDOOR				= 0x0004		// through a building, see TSIndoorMap
+	};
+
+	struct Edge
+	{
+		quint32					target;
+		quint32					reverse;		// index of the twin edge target -> source
+		float					meters;
+		float					seconds;		// walking time at WALK_SPEED, slowed uphill and on steep descents
+		qint32					name;			// index into names(), -1 if unnamed
+		quint16					flags;
+		qint8					grade;			// slope in percent, positive uphill
+		float					ascent;			// meters climbed along the edge
+		float					descent;
+		quint16					schedule;		// index into schedule(), 0 if always open
+	};
+
+	// Edge added to the imported ways
+	struct Link
+	{
+		quint32					from;
+		quint32					to;
+		float					meters;
+		float					seconds;
+		QString					name;
+		quint16					flags;
+	};
+
+	TSRouteGraph();
+
+	bool						importOsm(const QString& fileName);
+	bool						load(const QString& fileName);
+	bool						save(const QString& fileName) const;
+	void						clear();
+	// Adds edges between existing nodes, twins included, and rebuilds the graph;
+	// call before applyElevation(), which the rebuild would undo
+	void						addLinks(const QList<Link>& links);
+	// Slopes and walking times from a DEM sampled every sampleMeters along the edges;
+	// returns the number of edges covered, the others keep the incline of their way
+	int							applyElevation(const TSElevation& dem, double sampleMeters);
+	// Opening hours of an edge and its twin; the schedules are shared between edges
+	void						setEdgeHours(quint32 e, const TSOpeningHours& hours);
+
+	bool						isEmpty() const { return m_lat.isEmpty(); }
+	int							nodeCount() const { return m_lat.count(); }
+	int							edgeCount() const { return m_edges.count(); }
+
+	quint32						firstEdge(quint32 node) const { return m_firstEdge[node]; }
+	quint32						lastEdge(quint32 node) const { return m_firstEdge[node + 1]; }
+	const Edge&					edge(quint32 e) const { return m_edges[e]; }
+	quint32						edgeSource(quint32 e) const { return m_edges[m_edges[e].reverse].target; }
+	QString						edgeName(quint32 e) const;
+	const TSOpeningHours&		schedule(quint16 s) const { return m_schedules[s]; }
+	int							scheduleCount() const { return m_schedules.count(); }
+
+	double						lat(quint32 node) const { return m_lat[node]; }
+	double						lng(quint32 node) const { return m_lng[node]; }
+
+	// Closest node to a coordinate, TS_INVALID if the graph is empty
+	quint32						nearestNode(double lat, double lng, double* meters = 0) const;
+
+	// Edges passing within the given distance, closest first. One edge per twin pair
+	// is returned, the one with the lower index.
+	QVector<quint32>			edgesNear(double lat, double lng, double meters, int maxCount) const;
+	// Distance in meters from a coordinate to an edge; *t is the position of the
+	// closest point along the edge, 0 at the source and 1 at the target
+	double						projectOnEdge(quint32 e, double lat, double lng, double* t = 0) const;
+
+	// Digest of the topology and weights, used to validate derived data (tables, caches)
+	QByteArray					signature() const { return m_signature; }
+
+	static double				distance(double lat1, double lng1, double lat2, double lng2);
+	static double				bearing(double lat1, double lng1, double lat2, double lng2);
+
+	static const double			WALK_SPEED;		// meters per second
+	static const double			STEPS_FACTOR;	// slowdown on stairs
+	// Walking speed on a slope relative to flat ground (Tobler), grade as a fraction
+	static double				slopeFactor(double grade);
+
+private:
+	struct RawEdge
+	{
+		quint32					from;
+		quint32					to;
+		qint32					name;
+		quint16					flags;
+		qint8					grade;
+		quint16					schedule;
+		float					meters;			// < 0: straight line from the coordinates
+		float					seconds;		// < 0: walked at WALK_SPEED on the grade
+		bool operator<(const RawEdge& other) const { return from < other.from; }
+	};
+
+	void						build(const QVector<double>& lat, const QVector<double>& lng, QVector<RawEdge>& raw);
+	void						updateSignature();
+	void						buildIndexes();
+	quint16						addSchedule(const TSOpeningHours& hours);
+
+	QVector<double>				m_lat;
+	QVector<double>				m_lng;
+	QVector<quint32>			m_firstEdge;	// nodeCount()+1 entries
+	QVector<Edge>				m_edges;
+	QStringList					m_names;
+	QList<TSOpeningHours>		m_schedules;	// the first one is always open
+	QByteArray					m_signature;
+	TSGeoIndex					m_nodeIndex;
+	TSGeoIndex					m_edgeIndex;	// edge midpoints
+	QVector<quint32>			m_edgeIds;		// m_edgeIndex id -> edge
+	double						m_maxEdgeMeters;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSROUTEGRAPH_H
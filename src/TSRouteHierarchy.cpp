@@ -0,0 +1,403 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteHierarchy.cpp
+// Author : Zhan
+//
+
+#include "TSRouteHierarchy.h"
+#include "TSRouteSearch.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QTime>
+#include <QtAlgorithms>
+
+#include <vector>
+#include <queue>
+#include <functional>
+
+#define VIA_TRIANGLE		0x80000000		// set on the via of an arc coming from a triangle
+
+static const char* profileNames[TSRouteProfile::COUNT] = { "default", "step free", "least climb", "sheltered" };
+
+QString TSRouteProfile::name(int profile)
+{
+	return (profile >= 0 && profile < COUNT) ? QString(profileNames[profile]) : QString();
+}
+
+int TSRouteProfile::fromName(const QString& name)
+{
+	QString key = name.simplified().toLower().replace(QLatin1Char('-'), QLatin1Char(' '));
+	for( int i = 0; i < COUNT; i++ )
+	{
+		if( key == QLatin1String(profileNames[i]) )
+			return i;
+	}
+	return -1;
+}
+
+QVector<float> TSRouteProfile::weights(const TSRouteGraph& graph, int profile, const QVector<bool>& closed,
+									   double climbSeconds, double uncoveredFactor)
+{
+	const int m = graph.edgeCount();
+	QVector<float> weights(m);
+	for( int e = 0; e < m; e++ )
+	{
+		const TSRouteGraph::Edge& edge = graph.edge(e);
+		float w = edge.seconds;
+		if( profile == STEP_FREE && (edge.flags & TSRouteGraph::EDGE_STEPS) )
+			w = TSRouteSearch::INFINITE_TIME;
+		else if( profile == LEAST_CLIMB )
+			w += (float)(climbSeconds * edge.ascent);
+		else if( profile == SHELTERED && !(edge.flags & TSRouteGraph::EDGE_COVERED) )
+			w *= (float)uncoveredFactor;
+
+		if( !closed.isEmpty() && closed[e] )
+			w = TSRouteSearch::INFINITE_TIME;
+		weights[e] = w;
+	}
+	return weights;
+}
+
+// Sorted union of two sorted lists, without self nor removed
+static QVector<quint32> mergeNeighbours(const QVector<quint32>& a, const QVector<quint32>& b, quint32 self, quint32 removed)
+{
+	QVector<quint32> merged;
+	merged.reserve(a.count() + b.count());
+	int i = 0, j = 0;
+	while( i < a.count() || j < b.count() )
+	{
+		quint32 v;
+		if( j >= b.count() || (i < a.count() && a[i] < b[j]) )
+			v = a[i++];
+		else if( i >= a.count() || b[j] < a[i] )
+			v = b[j++];
+		else
+		{
+			v = a[i++];
+			j++;
+		}
+		if( v != self && v != removed && (merged.isEmpty() || merged.last() != v) )
+			merged.append(v);
+	}
+	return merged;
+}
+
+TSRouteHierarchy::TSRouteHierarchy()
+: m_graph(0)
+{
+}
+
+void TSRouteHierarchy::clear()
+{
+	m_rank.clear();
+	m_firstArc.clear();
+	m_arcHead.clear();
+	m_arcTail.clear();
+	m_parent.clear();
+	m_triangles.clear();
+	m_edgeArc.clear();
+	m_edgeUp.clear();
+}
+
+/*!
+  \brief Rank the nodes, add the upward arcs and list their triangles.
+
+  The node of least degree is eliminated first, its neighbours are linked to
+  each other; degrees are those of the graph left. Stale queue entries are
+  skipped rather than removed.
+*/
+void TSRouteHierarchy::build(const TSRouteGraph* graph)
+{
+	clear();
+	m_graph = graph;
+	const int n = graph->nodeCount();
+	if( n == 0 )
+		return;
+
+	QTime timer;
+	timer.start();
+
+	QVector< QVector<quint32> > adjacent(n);
+	for( int u = 0; u < n; u++ )
+	{
+		for( quint32 e = graph->firstEdge(u); e < graph->lastEdge(u); e++ )
+		{
+			if( graph->edge(e).target != (quint32)u )
+				adjacent[u].append(graph->edge(e).target);
+		}
+		qSort(adjacent[u]);
+		adjacent[u] = mergeNeighbours(adjacent[u], QVector<quint32>(), u, TS_INVALID);
+	}
+
+	typedef std::pair<int, quint32> Entry;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > queue;
+	for( int u = 0; u < n; u++ )
+		queue.push(Entry(adjacent[u].count(), u));
+
+	m_rank.fill(TS_INVALID, n);
+	QVector<quint32> byRank;
+	QVector< QVector<quint32> > upward(n);
+	while( !queue.empty() )
+	{
+		Entry top = queue.top();
+		queue.pop();
+		quint32 x = top.second;
+		if( m_rank[x] != TS_INVALID || top.first != adjacent[x].count() )
+			continue;
+
+		m_rank[x] = byRank.count();
+		byRank.append(x);
+		upward[x] = adjacent[x];
+		for( int i = 0; i < upward[x].count(); i++ )
+		{
+			quint32 u = upward[x][i];
+			adjacent[u] = mergeNeighbours(adjacent[u], upward[x], u, x);
+			queue.push(Entry(adjacent[u].count(), u));
+		}
+		adjacent[x].clear();
+	}
+
+	// Upward arcs, by increasing rank of the head so that the first one leads to the parent
+	m_firstArc.fill(0, n + 1);
+	m_parent.fill(TS_INVALID, n);
+	for( int u = 0; u < n; u++ )
+	{
+		QVector< QPair<quint32, quint32> > heads;
+		for( int i = 0; i < upward[u].count(); i++ )
+			heads.append(qMakePair(m_rank[upward[u][i]], upward[u][i]));
+		qSort(heads);
+		for( int i = 0; i < heads.count(); i++ )
+		{
+			m_arcHead.append(heads[i].second);
+			m_arcTail.append(u);
+		}
+		if( !heads.isEmpty() )
+			m_parent[u] = heads[0].second;
+		m_firstArc[u + 1] = m_arcHead.count();
+	}
+
+	for( int r = 0; r < byRank.count(); r++ )
+	{
+		quint32 w = byRank[r];
+		for( quint32 a = firstArc(w); a < lastArc(w); a++ )
+		{
+			quint32 u = m_arcHead[a];
+			quint32 uv = firstArc(u);
+			for( quint32 b = a + 1; b < lastArc(w); b++ )
+			{
+				// Heads of w and of u are both sorted by rank, so the arc (u, v) is found by walking on
+				quint32 v = m_arcHead[b];
+				while( m_arcHead[uv] != v )
+					uv++;
+				m_triangles.append(a);
+				m_triangles.append(b);
+				m_triangles.append(uv);
+			}
+		}
+	}
+
+	m_edgeArc.fill(TS_INVALID, graph->edgeCount());
+	m_edgeUp.fill(false, graph->edgeCount());
+	for( int u = 0; u < n; u++ )
+	{
+		for( quint32 e = graph->firstEdge(u); e < graph->lastEdge(u); e++ )
+		{
+			quint32 v = graph->edge(e).target;
+			if( v == (quint32)u )
+				continue;
+			bool up = m_rank[u] < m_rank[v];
+			quint32 low = up ? u : v, high = up ? v : u;
+			quint32 a = firstArc(low);
+			while( m_arcHead[a] != high )
+				a++;
+			m_edgeArc[e] = a;
+			m_edgeUp[e] = up;
+		}
+	}
+
+	QLOG_INFO() << QString("Route hierarchy: %1 arcs, %2 triangles for %3 edges in %4 ms.")
+					.arg(arcCount()).arg(triangleCount()).arg(graph->edgeCount()).arg(timer.elapsed());
+}
+
+TSRouteMetric::TSRouteMetric()
+: m_hierarchy(0)
+{
+}
+
+/*!
+  \brief Weigh every arc for the edge weights.
+
+  Arcs start from the edges they stand for, then each triangle offers the
+  arc (u, v) the way through its lowest node w. Triangles come by increasing
+  rank of w, so both arcs from w are final when they are used.
+*/
+void TSRouteMetric::customize(const TSRouteHierarchy* hierarchy, const QVector<float>& edgeWeights)
+{
+	m_hierarchy = hierarchy;
+	const int arcs = hierarchy->arcCount();
+	m_up.fill(TSRouteSearch::INFINITE_TIME, arcs);
+	m_down.fill(TSRouteSearch::INFINITE_TIME, arcs);
+	m_upVia.fill(TS_INVALID, arcs);
+	m_downVia.fill(TS_INVALID, arcs);
+
+	for( int e = 0; e < edgeWeights.count(); e++ )
+	{
+		quint32 a = hierarchy->edgeArc(e);
+		if( a == TS_INVALID )
+			continue;
+		float& weight = hierarchy->isUpward(e) ? m_up[a] : m_down[a];
+		if( edgeWeights[e] < weight )
+		{
+			weight = edgeWeights[e];
+			(hierarchy->isUpward(e) ? m_upVia[a] : m_downVia[a]) = e;
+		}
+	}
+
+	const QVector<quint32>& triangles = hierarchy->triangles();
+	const quint32* t = triangles.constData();
+	for( int i = 0; i < triangles.count(); i += 3 )
+	{
+		quint32 wu = t[i], wv = t[i + 1], uv = t[i + 2];
+		float up = m_down[wu] + m_up[wv];		// u -> w -> v
+		if( up < m_up[uv] )
+		{
+			m_up[uv] = up;
+			m_upVia[uv] = (quint32)(i / 3) | VIA_TRIANGLE;
+		}
+		float down = m_down[wv] + m_up[wu];		// v -> w -> u
+		if( down < m_down[uv] )
+		{
+			m_down[uv] = down;
+			m_downVia[uv] = (quint32)(i / 3) | VIA_TRIANGLE;
+		}
+	}
+}
+
+void TSRouteMetric::unpack(quint32 arc, bool up, QVector<quint32>* edges) const
+{
+	const QVector<quint32>& triangles = m_hierarchy->triangles();
+	QVector< QPair<quint32, bool> > stack;
+	stack.append(qMakePair(arc, up));
+	while( !stack.isEmpty() )
+	{
+		QPair<quint32, bool> top = stack.last();
+		stack.remove(stack.count() - 1);
+
+		quint32 via = top.second ? m_upVia[top.first] : m_downVia[top.first];
+		if( via == TS_INVALID )
+			continue;
+		if( !(via & VIA_TRIANGLE) )
+		{
+			edges->append(via);
+			continue;
+		}
+
+		// The part walked first is pushed last
+		quint32 t = (via & ~VIA_TRIANGLE) * 3;
+		quint32 wu = triangles[t], wv = triangles[t + 1];
+		if( top.second )
+		{
+			stack.append(qMakePair(wv, true));
+			stack.append(qMakePair(wu, false));
+		}
+		else
+		{
+			stack.append(qMakePair(wu, true));
+			stack.append(qMakePair(wv, false));
+		}
+	}
+}
+
+TSHierarchyQuery::TSHierarchyQuery(const TSRouteHierarchy* hierarchy)
+: m_hierarchy(hierarchy)
+, m_best(TSRouteSearch::INFINITE_TIME)
+{
+	const int n = hierarchy->graph() ? hierarchy->graph()->nodeCount() : 0;
+	m_forward.fill(TSRouteSearch::INFINITE_TIME, n);
+	m_backward.fill(TSRouteSearch::INFINITE_TIME, n);
+	m_forwardArc.fill(TS_INVALID, n);
+	m_backwardArc.fill(TS_INVALID, n);
+}
+
+QVector<quint32> TSHierarchyQuery::run(const TSRouteMetric& metric, quint32 source, quint32 target)
+{
+	QVector<quint32> edges;
+	m_best = TSRouteSearch::INFINITE_TIME;
+	const quint32 n = (quint32)m_forward.count();
+	if( source >= n || target >= n )
+		return edges;
+	if( source == target )
+	{
+		m_best = 0;
+		return edges;
+	}
+
+	const TSRouteHierarchy& h = *m_hierarchy;
+	m_forward[source] = 0;
+	for( quint32 x = source; x != TS_INVALID; x = h.parent(x) )
+	{
+		if( m_forward[x] == TSRouteSearch::INFINITE_TIME )
+			continue;
+		for( quint32 a = h.firstArc(x); a < h.lastArc(x); a++ )
+		{
+			float d = m_forward[x] + metric.up(a);
+			if( d < m_forward[h.arcHead(a)] )
+			{
+				m_forward[h.arcHead(a)] = d;
+				m_forwardArc[h.arcHead(a)] = a;
+			}
+		}
+	}
+	m_backward[target] = 0;
+	for( quint32 x = target; x != TS_INVALID; x = h.parent(x) )
+	{
+		if( m_backward[x] == TSRouteSearch::INFINITE_TIME )
+			continue;
+		for( quint32 a = h.firstArc(x); a < h.lastArc(x); a++ )
+		{
+			float d = m_backward[x] + metric.down(a);
+			if( d < m_backward[h.arcHead(a)] )
+			{
+				m_backward[h.arcHead(a)] = d;
+				m_backwardArc[h.arcHead(a)] = a;
+			}
+		}
+	}
+
+	quint32 meet = TS_INVALID;
+	for( quint32 x = source; x != TS_INVALID; x = h.parent(x) )
+	{
+		if( m_forward[x] + m_backward[x] < m_best )
+		{
+			m_best = m_forward[x] + m_backward[x];
+			meet = x;
+		}
+	}
+
+	if( meet != TS_INVALID )
+	{
+		QVector<quint32> arcs;
+		for( quint32 x = meet; x != source; x = h.arcTail(arcs.last()) )
+			arcs.append(m_forwardArc[x]);
+		for( int i = arcs.count() - 1; i >= 0; i-- )
+			metric.unpack(arcs[i], true, &edges);
+		for( quint32 x = meet; x != target; x = h.arcTail(m_backwardArc[x]) )
+			metric.unpack(m_backwardArc[x], false, &edges);
+	}
+
+	// Only ancestors were touched
+	for( quint32 x = source; x != TS_INVALID; x = h.parent(x) )
+	{
+		m_forward[x] = TSRouteSearch::INFINITE_TIME;
+		m_forwardArc[x] = TS_INVALID;
+	}
+	for( quint32 x = target; x != TS_INVALID; x = h.parent(x) )
+	{
+		m_backward[x] = TSRouteSearch::INFINITE_TIME;
+		m_backwardArc[x] = TS_INVALID;
+	}
+	return edges;
+}
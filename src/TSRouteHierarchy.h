@@ -0,0 +1,138 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteHierarchy.h
+// Author : Zhan
+//
+#ifndef TSROUTEHIERARCHY_H
+#define TSROUTEHIERARCHY_H
+
+#include "TSRouteGraph.h"
+
+#include <QString>
+#include <QVector>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+// Edge weights of the walking profiles
+class TSWEBAPP_EXPORTS TSRouteProfile
+{
+public:
+	enum Kind
+	{
+		DEFAULT = 0,		// walking time
+		STEP_FREE,			// no stairs
+		LEAST_CLIMB,		// every meter climbed costs climbSeconds more
+		SHELTERED,			// open air walks cost uncoveredFactor times more
+		COUNT
+	};
+
+	static QString				name(int profile);
+	static int					fromName(const QString& name);		// -1 if unknown
+
+	// Weight of every edge, INFINITE_TIME for a forbidden or closed one
+	static QVector<float>		weights(const TSRouteGraph& graph, int profile, const QVector<bool>& closed,
+										double climbSeconds, double uncoveredFactor);
+};
+
+// Customizable contraction hierarchy of the walking graph.
+//
+// The hierarchy only depends on the topology: nodes are ranked by minimum
+// degree elimination, and eliminating a node links all its remaining
+// neighbours, so every node gets upward arcs to higher ranked nodes. The
+// triangles of those arcs are listed once. A metric is then customized in one
+// pass over the triangles, lowest node first, which is what makes a profile
+// switch or a closure cheap.
+class TSWEBAPP_EXPORTS TSRouteHierarchy
+{
+public:
+	TSRouteHierarchy();
+
+	void						build(const TSRouteGraph* graph);
+	void						clear();
+
+	bool						isEmpty() const { return m_rank.isEmpty(); }
+	const TSRouteGraph*			graph() const { return m_graph; }
+	int							arcCount() const { return m_arcHead.count(); }
+	int							triangleCount() const { return m_triangles.count() / 3; }
+
+	quint32						firstArc(quint32 node) const { return m_firstArc[node]; }
+	quint32						lastArc(quint32 node) const { return m_firstArc[node + 1]; }
+	quint32						arcHead(quint32 arc) const { return m_arcHead[arc]; }		// higher ranked end
+	quint32						arcTail(quint32 arc) const { return m_arcTail[arc]; }
+	// Lowest ranked upward neighbour, TS_INVALID for a root; ancestors are all a search from the node reaches
+	quint32						parent(quint32 node) const { return m_parent[node]; }
+
+	// Arcs (w, u), (w, v) and (u, v) of each triangle, w ranked lowest; by increasing rank of w
+	const QVector<quint32>&		triangles() const { return m_triangles; }
+	// Arc between the ends of each graph edge, and whether the edge goes up that arc
+	quint32						edgeArc(quint32 edge) const { return m_edgeArc[edge]; }
+	bool						isUpward(quint32 edge) const { return m_edgeUp[edge]; }
+
+private:
+	const TSRouteGraph			*m_graph;
+	QVector<quint32>			m_rank;
+	QVector<quint32>			m_firstArc;		// nodeCount()+1 entries
+	QVector<quint32>			m_arcHead;		// by increasing rank of the head
+	QVector<quint32>			m_arcTail;
+	QVector<quint32>			m_parent;
+	QVector<quint32>			m_triangles;
+	QVector<quint32>			m_edgeArc;
+	QVector<bool>				m_edgeUp;
+};
+
+// One metric customized on a hierarchy: the weight of every arc both ways, with
+// the edge or triangle it comes from to unpack paths
+class TSWEBAPP_EXPORTS TSRouteMetric
+{
+public:
+	TSRouteMetric();
+
+	void						customize(const TSRouteHierarchy* hierarchy, const QVector<float>& edgeWeights);
+	bool						isEmpty() const { return m_up.isEmpty(); }
+
+	float						up(quint32 arc) const { return m_up[arc]; }			// tail -> head
+	float						down(quint32 arc) const { return m_down[arc]; }		// head -> tail
+
+	// Graph edges of the arc walked up or down, appended in walking order
+	void						unpack(quint32 arc, bool up, QVector<quint32>* edges) const;
+
+private:
+	const TSRouteHierarchy		*m_hierarchy;
+	QVector<float>				m_up;
+	QVector<float>				m_down;
+	QVector<quint32>			m_upVia;		// graph edge, or triangle | VIA_TRIANGLE
+	QVector<quint32>			m_downVia;
+};
+
+// Shortest path query on a customized metric. One instance per thread.
+//
+// Both ends walk up the elimination tree, relaxing the upward arcs of each
+// ancestor in turn; no priority queue is needed and only the ancestors are
+// touched, so the scratch arrays are reset for the cost of the query.
+class TSWEBAPP_EXPORTS TSHierarchyQuery
+{
+public:
+	explicit TSHierarchyQuery(const TSRouteHierarchy* hierarchy);
+
+	// Graph edges of the best path, empty if unreachable or source == target
+	QVector<quint32>			run(const TSRouteMetric& metric, quint32 source, quint32 target);
+	float						seconds() const { return m_best; }		// of the last run, INFINITE_TIME if unreachable
+
+private:
+	const TSRouteHierarchy		*m_hierarchy;
+	QVector<float>				m_forward;
+	QVector<float>				m_backward;
+	QVector<quint32>			m_forwardArc;	// arc the node was reached by
+	QVector<quint32>			m_backwardArc;
+	float						m_best;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSROUTEHIERARCHY_H
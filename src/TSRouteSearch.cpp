@@ -0,0 +1,248 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteSearch.cpp
+// Author : Zhan
+//
+
+#include "TSRouteSearch.h"
+
+#include <algorithm>
+#include <functional>
+
+#include <float.h>
+
+const float TSRouteSearch::INFINITE_TIME = FLT_MAX;
+
+TSRouteSearch::TSRouteSearch(const TSRouteGraph* graph)
+: m_graph(graph)
+, m_generation(0)
+, m_dir(Forward)
+, m_source(TS_INVALID)
+, m_settled(0)
+, m_departure(-1)
+{
+}
+
+void TSRouteSearch::run(quint32 source, const QVector<quint32>& targets, Direction dir)
+{
+	start(source, dir);
+
+	const int n = m_graph->nodeCount();
+	if( source >= (quint32)n )
+		return;
+
+	// Targets still to settle, duplicates are counted once
+	int pending = 0;
+	for( int i = 0; i < targets.count(); i++ )
+	{
+		if( targets[i] < (quint32)n && m_targetIn[targets[i]] != m_generation )
+		{
+			m_targetIn[targets[i]] = m_generation;
+			pending++;
+		}
+	}
+
+	quint32 u;
+	while( (u = settleNext()) != TS_INVALID )
+	{
+		if( pending > 0 && m_targetIn[u] == m_generation && --pending == 0 )
+			break;
+	}
+}
+
+bool TSRouteSearch::runTo(quint32 source, quint32 target, Direction dir)
+{
+	start(source, dir);
+	return settle(target);
+}
+
+/*!
+  \brief Settle nodes until the count closest targets are settled.
+
+  Nodes are settled by increasing time, so the targets come out closest first
+  and the search stops as soon as the last one wanted is met.
+*/
+QVector<quint32> TSRouteSearch::runNearest(quint32 source, const QVector<quint32>& targets, int count, Direction dir)
+{
+	start(source, dir);
+
+	QVector<quint32> found;
+	const int n = m_graph->nodeCount();
+	if( source >= (quint32)n || count <= 0 )
+		return found;
+
+	for( int i = 0; i < targets.count(); i++ )
+	{
+		if( targets[i] < (quint32)n )
+			m_targetIn[targets[i]] = m_generation;
+	}
+
+	quint32 u;
+	while( (u = settleNext()) != TS_INVALID )
+	{
+		if( m_targetIn[u] == m_generation )
+		{
+			found.append(u);
+			if( found.count() == count )
+				break;
+		}
+	}
+	return found;
+}
+
+void TSRouteSearch::runWithin(quint32 source, float maxSeconds, Direction dir)
+{
+	start(source, dir);
+	growWithin(maxSeconds);
+}
+
+void TSRouteSearch::growWithin(float maxSeconds)
+{
+	while( !m_heap.empty() && m_heap.front().seconds <= maxSeconds )
+		settleNext();
+}
+
+/*!
+  \brief Seed a search in constant time.
+
+  The arrays are only sized and cleared when the graph size changes or the
+  search counter wraps; otherwise every node written by an earlier search is
+  stale because its stamp differs from the new counter.
+*/
+void TSRouteSearch::start(quint32 source, Direction dir)
+{
+	const int n = m_graph->nodeCount();
+	if( m_reachedIn.count() != n || ++m_generation == 0 )
+	{
+		m_seconds.resize(n);
+		m_meters.resize(n);
+		m_parent.resize(n);
+		m_reachedIn.fill(0, n);
+		m_settledIn.fill(0, n);
+		m_targetIn.fill(0, n);
+		m_generation = 1;
+	}
+	m_heap.clear();
+	m_dir = dir;
+	m_source = source;
+	m_settled = 0;
+
+	if( source >= (quint32)n )
+		return;
+
+	m_seconds[source] = 0;
+	m_meters[source] = 0;
+	m_parent[source] = TS_INVALID;
+	m_reachedIn[source] = m_generation;
+	push(0, source);
+}
+
+bool TSRouteSearch::settle(quint32 node)
+{
+	if( node >= (quint32)m_settledIn.count() )
+		return false;
+
+	while( m_settledIn[node] != m_generation )
+	{
+		if( settleNext() == TS_INVALID )
+			return false;
+	}
+	return true;
+}
+
+quint32 TSRouteSearch::settleNext()
+{
+	while( !m_heap.empty() )
+	{
+		std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<QueueItem>());
+		quint32 u = m_heap.back().node;
+		m_heap.pop_back();
+
+		if( m_settledIn[u] == m_generation )
+			continue;
+		m_settledIn[u] = m_generation;
+		m_settled++;
+
+		for( quint32 e = m_graph->firstEdge(u); e < m_graph->lastEdge(u); e++ )
+		{
+			const TSRouteGraph::Edge& out = m_graph->edge(e);
+			quint32 v = out.target;
+
+			// Backward searches walk the twin v -> u
+			quint32 via = (m_dir == Forward) ? e : out.reverse;
+			if( via == TS_INVALID )
+				continue;
+			const TSRouteGraph::Edge& edge = m_graph->edge(via);
+			float w = m_weights.isEmpty() ? edge.seconds : m_weights.at(via);
+			if( w >= INFINITE_TIME )
+				continue;		// closed, or not for this walker
+
+			float t = m_seconds[u] + w;
+			if( edge.schedule != 0 && m_departure >= 0 && m_dir == Forward )
+			{
+				double wait = m_graph->schedule(edge.schedule).wait(m_departure + m_seconds[u]);
+				if( wait < 0 )
+					continue;		// never open
+				t += (float)wait;
+			}
+			if( m_reachedIn[v] != m_generation || t < m_seconds[v] )
+			{
+				m_seconds[v] = t;
+				m_meters[v] = m_meters[u] + edge.meters;
+				m_parent[v] = via;
+				m_reachedIn[v] = m_generation;
+				push(t, v);
+			}
+		}
+		return u;
+	}
+	return TS_INVALID;
+}
+
+// Stale entries stay in the heap and are skipped once their node is settled
+void TSRouteSearch::push(float seconds, quint32 node)
+{
+	QueueItem item = { seconds, node };
+	m_heap.push_back(item);
+	std::push_heap(m_heap.begin(), m_heap.end(), std::greater<QueueItem>());
+}
+
+quint32 TSRouteSearch::firstEdge(quint32 node) const
+{
+	if( node == m_source || !reached(node) )
+		return TS_INVALID;
+
+	quint32 e = m_parent[node];
+	quint32 u = m_graph->edgeSource(e);
+	while( u != m_source )
+	{
+		e = m_parent[u];
+		u = m_graph->edgeSource(e);
+	}
+	return e;
+}
+
+QVector<quint32> TSRouteSearch::path(quint32 node) const
+{
+	QVector<quint32> edges;
+	if( node == m_source || !reached(node) )
+		return edges;
+
+	// Backward parents already point to the source
+	if( m_dir == Backward )
+	{
+		for( quint32 u = node; u != m_source; u = m_graph->edge(edges.last()).target )
+			edges.append(m_parent[u]);
+		return edges;
+	}
+
+	for( quint32 u = node; u != m_source; u = m_graph->edgeSource(edges.last()) )
+		edges.append(m_parent[u]);
+
+	// Collected from the node back to the source
+	for( int i = 0, j = edges.count() - 1; i < j; i++, j-- )
+		qSwap(edges[i], edges[j]);
+	return edges;
+}
@@ -0,0 +1,130 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteSearch.h
+// Author : Zhan
+//
+#ifndef TSROUTESEARCH_H
+#define TSROUTESEARCH_H
+
+#include "TSRouteGraph.h"
+
+#include <QVector>
+
+#include <vector>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+// Dijkstra search on walking time. One instance per thread, results stay valid
+// until the next run() or start().
+//
+// An instance is the scratch memory of its thread: the arrays are sized for the
+// graph once and each node carries the number of the search that last wrote it,
+// so starting a search only bumps that number instead of clearing every node,
+// and the heap keeps its capacity from one search to the next. Once warm, a
+// search allocates nothing but the paths it returns.
+//
+// A search can also be grown on demand: start() only seeds it and settle() goes
+// on from where the previous call stopped, so a tree rooted at a fixed
+// destination is paid for once and then answers from any node it covers.
+//
+// With a departure time, forward searches honour the schedules of the edges:
+// a walker reaching a closed door waits until it opens, so arriving later never
+// helps and the search stays exact. Backward searches ignore the time.
+//
+// The search weighs edges by their walking time unless it is given the weights
+// of a profile (see TSRouteProfile::weights), which is how closed paths and the
+// stairs a step-free walker avoids are left out.
+class TSWEBAPP_EXPORTS TSRouteSearch
+{
+public:
+	enum Direction
+	{
+		Forward,		// shortest paths from the source
+		Backward		// shortest paths to the source
+	};
+
+	explicit TSRouteSearch(const TSRouteGraph* graph);
+
+	// Seconds since Monday 00:00 the forward searches leave at, -1 to ignore the schedules
+	void						setDeparture(int weekSecond) { m_departure = weekSecond; }
+	int							departure() const { return m_departure; }
+	// Seconds of each edge, INFINITE_TIME where it may not be used; empty for the walking times
+	void						setWeights(const QVector<float>& weights) { m_weights = weights; }
+	const QVector<float>&		weights() const { return m_weights; }
+
+	// Settle nodes until every target is settled, or the whole graph if targets is empty
+	void						run(quint32 source, const QVector<quint32>& targets = QVector<quint32>(), Direction dir = Forward);
+	// Settle nodes until the target is settled, false if it cannot be reached
+	bool						runTo(quint32 source, quint32 target, Direction dir = Forward);
+
+	// Settle nodes until count of the targets are settled, returns them closest first
+	QVector<quint32>			runNearest(quint32 source, const QVector<quint32>& targets, int count, Direction dir = Forward);
+
+	// Settle every node reachable within maxSeconds
+	void						runWithin(quint32 source, float maxSeconds, Direction dir = Forward);
+	// Resumes the search until every node within maxSeconds is settled
+	void						growWithin(float maxSeconds);
+
+	// Seeds a search without settling anything
+	void						start(quint32 source, Direction dir = Forward);
+	// Resumes the search until the node is settled, false if it cannot be reached
+	bool						settle(quint32 node);
+	bool						isSettled(quint32 node) const { return node < (quint32)m_settledIn.count() && m_settledIn[node] == m_generation; }
+
+	bool						reached(quint32 node) const { return m_reachedIn[node] == m_generation; }
+	float						seconds(quint32 node) const { return reached(node) ? m_seconds[node] : INFINITE_TIME; }
+	float						meters(quint32 node) const { return reached(node) ? m_meters[node] : INFINITE_TIME; }
+
+	// Forward: edge entering the node on its path from the source.
+	// Backward: edge leaving the node on its path to the source.
+	quint32						parentEdge(quint32 node) const { return reached(node) ? m_parent[node] : TS_INVALID; }
+
+	// First edge of the forward path source -> node, TS_INVALID if node is the source
+	quint32						firstEdge(quint32 node) const;
+	// Forward: edges of the path source -> node. Backward: edges of the path node -> source.
+	// Empty if node is the source or unreached.
+	QVector<quint32>			path(quint32 node) const;
+
+	quint32						source() const { return m_source; }
+	Direction					direction() const { return m_dir; }
+	int							settledCount() const { return m_settled; }
+
+	static const float			INFINITE_TIME;
+
+private:
+	struct QueueItem
+	{
+		float					seconds;
+		quint32					node;
+		bool operator>(const QueueItem& other) const { return seconds > other.seconds; }
+	};
+
+	// Settles the closest node of the queue and relaxes its edges, TS_INVALID once exhausted
+	quint32						settleNext();
+	void						push(float seconds, quint32 node);
+
+	const TSRouteGraph			*m_graph;
+	QVector<float>				m_seconds;		// valid for the nodes reached by the current search
+	QVector<float>				m_meters;
+	QVector<quint32>			m_parent;
+	QVector<quint32>			m_reachedIn;	// search each node was last reached by
+	QVector<quint32>			m_settledIn;	// search each node was last settled by
+	QVector<quint32>			m_targetIn;		// search each node was last a target of
+	quint32						m_generation;	// current search, 0 is none
+	std::vector<QueueItem>		m_heap;			// binary min-heap on seconds, cleared but never shrunk
+	Direction					m_dir;
+	quint32						m_source;
+	int							m_settled;
+	int							m_departure;
+	QVector<float>				m_weights;		// by edge, shared with the engine
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSROUTESEARCH_H
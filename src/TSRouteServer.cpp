@@ -0,0 +1,387 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteServer.cpp
+// Author : Zhan
+//
+
+#include "TSRouteServer.h"
+#include "TSRouteEngine.h"
+#include "TSSpeechNormalizer.h"
+
+#include <parser.h>
+#include <serializer.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QSettings>
+#include <QtCore/QTimer>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QtConcurrentMap>
+#include <QtCore/QtAlgorithms>
+#include <QtNetwork/QLocalServer>
+#include <QtNetwork/QLocalSocket>
+
+#include <stdio.h>
+#include <math.h>
+
+// One request of a batch, run by QtConcurrent on the thread pool
+struct TSAnswerJob
+{
+	typedef QVariant result_type;
+
+	const TSRouteServer			*server;
+
+	QVariant operator()(const QVariant& request) const
+	{
+		return server->answer(request.toMap());
+	}
+};
+
+TSRouteServer::TSRouteServer(const TSRouteEngine* engine, QObject *parent)
+: QObject(parent)
+, m_engine(engine)
+, m_server(new QLocalServer(this))
+, m_statsTimer(new QTimer(this))
+, m_threads(0)
+, m_maxBatch(1000)
+, m_periodRequests(0)
+, m_requests(0)
+, m_batchCount(0)
+, m_errors(0)
+{
+	loadSettings();
+
+	// Shared by the threads, built before they start
+	TSSpeechNormalizer::standard();
+
+	connect(m_server, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+	connect(m_statsTimer, SIGNAL(timeout()), this, SLOT(reportStats()));
+	m_period.start();
+}
+
+TSRouteServer::~TSRouteServer()
+{
+	QThreadPool::globalInstance()->waitForDone();
+}
+
+void TSRouteServer::loadSettings()
+{
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	settings.beginGroup(QLatin1String("server"));
+	m_name = settings.value(QLatin1String("Name"), QLatin1String("speechnav-route")).toString();
+	m_threads = qMax(0, settings.value(QLatin1String("Threads"), 0).toInt());
+	m_maxBatch = qMax(1, settings.value(QLatin1String("MaxBatch"), 1000).toInt());
+	m_statsTimer->setInterval(qMax(1, settings.value(QLatin1String("StatsSeconds"), 10).toInt()) * 1000);
+	settings.endGroup();
+}
+
+/*!
+  \brief Listen on a local socket (a named pipe on Windows).
+
+  The pool threads never expire, so their search buffers are allocated once.
+*/
+bool TSRouteServer::listen(const QString& name)
+{
+	if( !name.isEmpty() )
+		m_name = name;
+
+	QThreadPool* pool = QThreadPool::globalInstance();
+	pool->setMaxThreadCount(m_threads > 0 ? m_threads : QThread::idealThreadCount());
+	pool->setExpiryTimeout(-1);
+
+	QLocalServer::removeServer(m_name);		// left over by a crashed server
+	if( !m_server->listen(m_name) )
+	{
+		fprintf(stderr, "server: cannot listen on %s: %s\n", qPrintable(m_name), qPrintable(m_server->errorString()));
+		return false;
+	}
+	m_statsTimer->start();
+	printf("server: listening on %s with %d threads\n", qPrintable(m_server->serverName()), pool->maxThreadCount());
+	fflush(stdout);
+	return true;
+}
+
+void TSRouteServer::onNewConnection()
+{
+	QLocalSocket* socket;
+	while( (socket = m_server->nextPendingConnection()) != 0 )
+	{
+		connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+		connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+	}
+}
+
+/*!
+  \brief Start every complete line of the client as a batch.
+
+  The batches of a client run side by side, their answers carry the id of the
+  batch since they may come back in another order.
+*/
+void TSRouteServer::onReadyRead()
+{
+	QLocalSocket* socket = qobject_cast<QLocalSocket*>(sender());
+	while( socket && socket->canReadLine() )
+	{
+		QByteArray line = socket->readLine().trimmed();
+		if( line.isEmpty() )
+			continue;
+
+		QJson::Parser parser;
+		bool ok = false;
+		QVariantMap message = parser.parse(line, &ok).toMap();
+		QVariantList requests = message.contains(QLatin1String("requests")) ? message.value(QLatin1String("requests")).toList()
+																			: QVariantList() << message;
+
+		QString error;
+		if( !ok )
+			error = QString("invalid JSON: %1").arg(parser.errorString());
+		else if( requests.count() > m_maxBatch )
+			error = QString("batch of %1 requests, at most %2").arg(requests.count()).arg(m_maxBatch);
+		if( !error.isEmpty() )
+		{
+			QVariantMap reply;
+			reply["id"] = message.value(QLatin1String("id"));
+			reply["error"] = error;
+			QJson::Serializer serializer;
+			socket->write(serializer.serialize(reply) + '\n');
+			QMutexLocker locker(&m_statsMutex);
+			m_errors++;
+			continue;
+		}
+
+		Batch batch;
+		batch.socket = socket;
+		batch.id = message.value(QLatin1String("id"));
+		batch.received.start();
+		batch.size = requests.count();
+
+		TSAnswerJob job;
+		job.server = this;
+		QFutureWatcher<QVariant>* watcher = new QFutureWatcher<QVariant>(this);
+		connect(watcher, SIGNAL(finished()), this, SLOT(onBatchDone()));
+		m_batches.insert(watcher, batch);
+		watcher->setFuture(QtConcurrent::mapped(requests, job));
+	}
+}
+
+void TSRouteServer::onBatchDone()
+{
+	QFutureWatcher<QVariant>* watcher = static_cast<QFutureWatcher<QVariant>*>(sender());
+	Batch batch = m_batches.take(watcher);
+	watcher->deleteLater();
+
+	if( batch.socket )
+	{
+		QVariantMap reply;
+		reply["id"] = batch.id;
+		reply["results"] = QVariantList(watcher->future().results());
+		QJson::Serializer serializer;
+		batch.socket->write(serializer.serialize(reply) + '\n');
+	}
+
+	QMutexLocker locker(&m_statsMutex);
+	m_latencies.append(batch.received.elapsed());
+	m_periodRequests += batch.size;
+	m_requests += batch.size;
+	m_batchCount++;
+}
+
+QVariantList TSRouteServer::answerAll(const QVariantList& requests) const
+{
+	TSAnswerJob job;
+	job.server = this;
+	return QtConcurrent::blockingMapped(requests, job);
+}
+
+QVariantMap TSRouteServer::answer(const QVariantMap& request) const
+{
+	QString op = request.value(QLatin1String("op")).toString();
+	QVariantMap result;
+	if( op == QLatin1String("route") )
+		result = route(request);
+	else if( op == QLatin1String("geocode") || op == QLatin1String("autocomplete") )
+	{
+		QString query = request.value(QLatin1String("q")).toString();
+		QVariantList places;
+		QList<int> ids;
+		QList<int> matches;
+		QList<QPointF> points;
+		if( op == QLatin1String("geocode") )
+		{
+			QList<TSGeocodeResult> found = m_engine->geocoder().geocode(query, qMax(1, request.value(QLatin1String("count"), 1).toInt()));
+			for( int i = 0; i < found.count(); i++ )
+			{
+				ids.append(found[i].poiId);
+				matches.append(found[i].match);
+				points.append(QPointF(found[i].lng, found[i].lat));
+			}
+		}
+		else
+		{
+			QList<TSAutocompleteHit> hits = m_engine->autocomplete().complete(query, qMax(1, request.value(QLatin1String("max"), 8).toInt()));
+			for( int i = 0; i < hits.count(); i++ )
+			{
+				const TSPoi* poi = m_engine->catalog().poi(hits[i].poiId);
+				ids.append(hits[i].poiId);
+				points.append(poi ? QPointF(poi->lng, poi->lat) : QPointF());
+			}
+		}
+		for( int i = 0; i < ids.count(); i++ )
+		{
+			const TSPoi* poi = m_engine->catalog().poi(ids[i]);
+			if( !poi )
+				continue;
+			QVariantMap place;
+			place["id"] = poi->id;
+			place["name"] = poi->name;
+			place["address"] = poi->address;
+			place["lat"] = points[i].y();
+			place["lng"] = points[i].x();
+			if( i < matches.count() )
+				place["match"] = TSGeocoder::matchName(matches[i]);
+			places.append(place);
+		}
+		result["results"] = places;
+	}
+	else if( op == QLatin1String("stats") )
+		result = stats();
+	else
+		result["error"] = QString("unknown op \"%1\"").arg(op);
+
+	if( result.contains(QLatin1String("error")) )
+	{
+		QMutexLocker locker(&m_statsMutex);
+		m_errors++;
+	}
+	return result;
+}
+
+/*!
+  \brief Walk between two places, the default profile leaving now unless told.
+*/
+QVariantMap TSRouteServer::route(const QVariantMap& request) const
+{
+	QVariantMap result;
+	int from = poiId(request.value(QLatin1String("from")));
+	int to = poiId(request.value(QLatin1String("to")));
+	QString profileName = request.value(QLatin1String("profile")).toString();
+	int profile = profileName.isEmpty() ? TSRouteProfile::DEFAULT : TSRouteProfile::fromName(profileName);
+	if( from <= 0 || to <= 0 || profile < 0 )
+	{
+		result["found"] = false;
+		result["error"] = profile < 0 ? QString("unknown profile \"%1\"").arg(profileName) : QString("unknown place");
+		return result;
+	}
+
+	QDateTime departure = request.contains(QLatin1String("depart"))
+		? QDateTime::fromString(request.value(QLatin1String("depart")).toString(), Qt::ISODate) : QDateTime::currentDateTime();
+	TSCachedRoute walk = m_engine->walk(from, to, profile, departure);
+
+	float seconds = walk.route.wait;
+	for( int i = 0; i < walk.route.edges.count(); i++ )
+		seconds += m_engine->graph().edge(walk.route.edges[i]).seconds;
+
+	QVariantList steps;
+	for( int i = 0; i < walk.route.maneuvers.count(); i++ )
+	{
+		const TSManeuver& m = walk.route.maneuvers[i];
+		QVariantMap step;
+		step["type"] = m.type;
+		step["text"] = m.text;
+		step["speech"] = walk.speech[i];
+		step["lat"] = m.lat;
+		step["lng"] = m.lng;
+		step["meters"] = m.meters;
+		step["seconds"] = m.seconds;
+		steps.append(step);
+	}
+
+	result["found"] = !walk.route.isEmpty();
+	result["from"] = from;
+	result["to"] = to;
+	result["meters"] = walk.route.meters();
+	result["seconds"] = seconds;
+	result["wait"] = walk.route.wait;
+	result["path"] = m_engine->polyline().toVariant(walk.shape);
+	result["steps"] = steps;
+	return result;
+}
+
+// Catalog id, or the building the text geocodes to; 0 if unknown
+int TSRouteServer::poiId(const QVariant& place) const
+{
+	bool isId = false;
+	int id = place.toInt(&isId);
+	if( isId && m_engine->catalog().poi(id) )
+		return id;
+
+	// A street match is a guess, never a place to route to
+	TSGeocodeResult found;
+	return m_engine->geocoder().resolve(place.toString(), &found) ? found.poiId : 0;
+}
+
+int TSRouteServer::percentile(QVector<int> values, double p)
+{
+	if( values.isEmpty() )
+		return 0;
+	qSort(values);
+	return values[qBound(0, (int)ceil(p * values.count()) - 1, values.count() - 1)];
+}
+
+QVariantMap TSRouteServer::stats() const
+{
+	QMutexLocker locker(&m_statsMutex);
+	QVariantMap map;
+	map["requests"] = m_requests;
+	map["batches"] = m_batchCount;
+	map["errors"] = m_errors;
+	map["threads"] = QThreadPool::globalInstance()->maxThreadCount();
+	map["cacheHits"] = m_engine->cache().hits();
+	map["cacheMisses"] = m_engine->cache().misses();
+	map["p50"] = percentile(m_latencies, 0.50);
+	map["p95"] = percentile(m_latencies, 0.95);
+	map["p99"] = percentile(m_latencies, 0.99);
+	map["perSecond"] = m_periodRequests * 1000.0 / qMax(1, m_period.elapsed());
+	return map;
+}
+
+void TSRouteServer::reportStats()
+{
+	QMutexLocker locker(&m_statsMutex);
+	if( m_periodRequests > 0 )
+	{
+		printf("server: %8.0f requests/s, batch latency p50 %d ms, p95 %d ms, p99 %d ms, %lld requests in all\n",
+			   m_periodRequests * 1000.0 / qMax(1, m_period.elapsed()), percentile(m_latencies, 0.50),
+			   percentile(m_latencies, 0.95), percentile(m_latencies, 0.99), (long long)m_requests);
+		fflush(stdout);
+	}
+	m_latencies.clear();
+	m_periodRequests = 0;
+	m_period.restart();
+}
+
+bool TSRouteServer::run(const QStringList& args, int& argc, char* argv[], int* exitCode)
+{
+	int pos = args.indexOf(QLatin1String("--server"));
+	if( pos < 0 )
+		return false;
+
+	QCoreApplication app(argc, argv);
+	TSRouteEngine engine;
+	engine.init();
+	if( !engine.isReady() )
+		fprintf(stderr, "server: no walking graph, routes are not found\n");
+
+	TSRouteServer server(&engine);
+	QString name = pos + 1 < args.count() && !args[pos + 1].startsWith(QLatin1String("--")) ? args[pos + 1] : QString();
+	if( !server.listen(name) )
+	{
+		*exitCode = 1;
+		return true;
+	}
+	*exitCode = app.exec();
+	return true;
+}
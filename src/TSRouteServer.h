@@ -0,0 +1,113 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteServer.h
+// Author : Zhan
+//
+#ifndef TSROUTESERVER_H
+#define TSROUTESERVER_H
+
+#include "TSWebApp.h"
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+#include <QHash>
+#include <QPointer>
+#include <QTime>
+#include <QMutex>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class QLocalServer;
+class QLocalSocket;
+class QTimer;
+class TSRouteEngine;
+
+// Headless routing backend shared by kiosks and web front ends over a local socket.
+//
+// Each line a client writes is one JSON batch, {"id": 7, "requests": [...]}, or a
+// single request. Requests are {"op": "route", "from": "Cathedral", "to": 41,
+// "profile": "step-free", "depart": "2026-10-19T10:00:00"}, {"op": "geocode", "q": ...},
+// {"op": "autocomplete", "q": ..., "max": 8} and {"op": "stats"}. Geocoded places
+// carry their "match": "name", "address" or "street", the last only a suggestion;
+// routes only start and end at names and addresses. The answer is one
+// line, {"id": 7, "results": [...]}, results in the order of the requests. Paths
+// are encoded polylines with the zoom of each point, {"points": ..., "levels": ...},
+// see TSPolyline.
+//
+// The requests of every batch are spread on the Qt thread pool, a thread picks the
+// next request as soon as it is done with one, and each thread searches in its own
+// buffers (see TSRouteEngine). Throughput and batch latency percentiles are printed
+// every few seconds.
+//
+// Configured by the [server] group of app_config.ini.
+class TSWEBAPP_EXPORTS TSRouteServer : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit TSRouteServer(const TSRouteEngine* engine, QObject *parent = 0);
+	virtual ~TSRouteServer();
+
+	void						loadSettings();
+	bool						listen(const QString& name = QString());
+
+	// Answer of one request, thread safe
+	QVariantMap					answer(const QVariantMap& request) const;
+	// Answers of a batch, computed on the thread pool
+	QVariantList				answerAll(const QVariantList& requests) const;
+
+	// Counters since the start and latency percentiles of the last period, in ms
+	QVariantMap					stats() const;
+
+	// Serves until killed when the arguments hold --server [name]; false otherwise
+	static bool					run(const QStringList& args, int& argc, char* argv[], int* exitCode);
+
+private slots:
+	void						onNewConnection();
+	void						onReadyRead();
+	void						onBatchDone();
+	void						reportStats();
+
+private:
+	struct Batch
+	{
+		QPointer<QLocalSocket>	socket;
+		QVariant				id;
+		QTime					received;
+		int						size;
+	};
+
+	QVariantMap					route(const QVariantMap& request) const;
+	int							poiId(const QVariant& place) const;
+	static int					percentile(QVector<int> values, double p);
+
+	const TSRouteEngine			*m_engine;
+	QLocalServer				*m_server;
+	QTimer						*m_statsTimer;
+	QHash<QObject*, Batch>		m_batches;			// by future watcher
+
+	QString						m_name;
+	int							m_threads;			// 0: one per core
+	int							m_maxBatch;
+
+	mutable QMutex				m_statsMutex;
+	QTime						m_period;
+	QVector<int>				m_latencies;		// ms, batches of the period
+	int							m_periodRequests;
+	qint64						m_requests;
+	qint64						m_batchCount;
+	mutable qint64				m_errors;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSROUTESERVER_H
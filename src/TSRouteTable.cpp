@@ -0,0 +1,239 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteTable.cpp
+// Author : Zhan
+//
+
+#include "TSRouteTable.h"
+#include "TSRouteGraph.h"
+#include "TSRouteSearch.h"
+#include "TSManeuver.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QDataStream>
+#include <QtCore/QTime>
+#include <QtCore/QtConcurrentMap>
+
+#define TABLE_FILE_MAGIC	0x54535254		// "TSRT"
+#define TABLE_FILE_VERSION	3
+
+static QDataStream& operator<<(QDataStream& out, const TSRouteTable::Cell& c)
+{
+	out << c.meters << c.seconds << c.instruction;
+	return out;
+}
+
+static QDataStream& operator>>(QDataStream& in, TSRouteTable::Cell& c)
+{
+	in >> c.meters >> c.seconds >> c.instruction;
+	return in;
+}
+
+// Fills the row and the column of one building, run by QtConcurrent on every dirty building
+struct TSRouteTableJob
+{
+	typedef void result_type;
+
+	const TSRouteGraph			*graph;
+	const QVector<quint32>		*nodes;
+	const QVector<int>			*oldPos;		// -1 for dirty buildings
+	TSRouteTable::Cell			*cells;
+	int							n;
+
+	void operator()(const int& i) const
+	{
+		TSRouteSearch search(graph);
+		const quint32 src = (*nodes)[i];
+
+		// Row: every building reached from i
+		search.run(src, *nodes, TSRouteSearch::Forward);
+		for( int j = 0; j < n; j++ )
+		{
+			TSRouteTable::Cell& cell = cells[i * n + j];
+			quint32 dst = (*nodes)[j];
+			fill(cell, search, dst, search.firstEdge(dst));
+		}
+
+		// Column: every clean building walking to i. Dirty rows are filled by their own forward search.
+		search.run(src, *nodes, TSRouteSearch::Backward);
+		for( int r = 0; r < n; r++ )
+		{
+			if( (*oldPos)[r] < 0 )
+				continue;
+			TSRouteTable::Cell& cell = cells[r * n + i];
+			quint32 from = (*nodes)[r];
+			fill(cell, search, from, search.parentEdge(from));
+		}
+	}
+
+	void fill(TSRouteTable::Cell& cell, const TSRouteSearch& search, quint32 node, quint32 firstEdge) const
+	{
+		if( !search.reached(node) )
+		{
+			cell.meters = -1;
+			cell.seconds = -1;
+			cell.instruction.clear();
+			return;
+		}
+		cell.meters = search.meters(node);
+		cell.seconds = search.seconds(node);
+		cell.instruction = TSRouteTable::departureText(graph, firstEdge);
+	}
+};
+
+TSRouteTable::TSRouteTable()
+{
+}
+
+void TSRouteTable::clear()
+{
+	m_graphSignature.clear();
+	m_ids.clear();
+	m_nodes.clear();
+	m_index.clear();
+	m_cells.clear();
+}
+
+int TSRouteTable::update(const TSRouteGraph* graph, const QMap<int, quint32>& poiNodes)
+{
+	QTime timer;
+	timer.start();
+
+	const bool sameGraph = (graph->signature() == m_graphSignature);
+	const int oldN = m_ids.count();
+
+	QVector<int> ids;
+	QVector<quint32> nodes;
+	for( QMap<int, quint32>::const_iterator it = poiNodes.begin(); it != poiNodes.end(); ++it )
+	{
+		ids.append(it.key());
+		nodes.append(it.value());
+	}
+	const int n = ids.count();
+
+	// A building keeps its row and column if neither the graph nor its snapped node changed
+	QVector<int> oldPos(n, -1);
+	QVector<int> dirty;
+	for( int i = 0; i < n; i++ )
+	{
+		int o = sameGraph ? m_index.value(ids[i], -1) : -1;
+		if( o >= 0 && m_nodes[o] == nodes[i] )
+			oldPos[i] = o;
+		else
+			dirty.append(i);
+	}
+
+	if( sameGraph && dirty.isEmpty() && n == oldN )
+		return 0;
+
+	QVector<Cell> cells(n * n);
+	for( int i = 0; i < n; i++ )
+	{
+		if( oldPos[i] < 0 )
+			continue;
+		for( int j = 0; j < n; j++ )
+		{
+			if( oldPos[j] >= 0 )
+				cells[i * n + j] = m_cells[oldPos[i] * oldN + oldPos[j]];
+		}
+	}
+
+	TSRouteTableJob job;
+	job.graph = graph;
+	job.nodes = &nodes;
+	job.oldPos = &oldPos;
+	job.cells = cells.data();
+	job.n = n;
+	QtConcurrent::blockingMap(dirty, job);
+
+	m_graphSignature = graph->signature();
+	m_ids = ids;
+	m_nodes = nodes;
+	m_cells = cells;
+	m_index.clear();
+	for( int i = 0; i < n; i++ )
+		m_index.insert(ids[i], i);
+
+	QLOG_INFO() << QString("Route table: %1 of %2 buildings recomputed in %3 ms.").arg(dirty.count()).arg(n).arg(timer.elapsed());
+	return dirty.count();
+}
+
+const TSRouteTable::Cell* TSRouteTable::lookup(int srcPoi, int dstPoi) const
+{
+	QHash<int, int>::const_iterator src = m_index.find(srcPoi);
+	QHash<int, int>::const_iterator dst = m_index.find(dstPoi);
+	if( src == m_index.end() || dst == m_index.end() )
+		return 0;
+
+	const Cell& cell = m_cells.at(src.value() * m_ids.count() + dst.value());
+	return cell.meters < 0 ? 0 : &cell;
+}
+
+bool TSRouteTable::load(const QString& fileName)
+{
+	clear();
+
+	QFile file(fileName);
+	if( !file.open(QIODevice::ReadOnly) )
+		return false;
+
+	QDataStream in(&file);
+	in.setVersion(QDataStream::Qt_4_6);
+
+	quint32 magic, version;
+	in >> magic >> version;
+	if( magic != TABLE_FILE_MAGIC || version != TABLE_FILE_VERSION )
+		return false;
+
+	in >> m_graphSignature >> m_ids >> m_nodes >> m_cells;
+	if( in.status() != QDataStream::Ok || m_ids.count() != m_nodes.count()
+		|| m_cells.count() != m_ids.count() * m_ids.count() )
+	{
+		QLOG_WARN() << QString("Route table: %1 is corrupted, it will be rebuilt.").arg(fileName);
+		clear();
+		return false;
+	}
+
+	for( int i = 0; i < m_ids.count(); i++ )
+		m_index.insert(m_ids[i], i);
+	return true;
+}
+
+bool TSRouteTable::save(const QString& fileName) const
+{
+	QFile file(fileName);
+	if( !file.open(QIODevice::WriteOnly) )
+	{
+		QLOG_WARN() << QString("Route table: %1 cannot be written.").arg(fileName);
+		return false;
+	}
+
+	QDataStream out(&file);
+	out.setVersion(QDataStream::Qt_4_6);
+	out << (quint32)TABLE_FILE_MAGIC << (quint32)TABLE_FILE_VERSION;
+	out << m_graphSignature << m_ids << m_nodes << m_cells;
+	return out.status() == QDataStream::Ok;
+}
+
+/*!
+  \brief Spoken description of the first edge of a walk, e.g. "Head north on Fifth Avenue".
+*/
+QString TSRouteTable::departureText(const TSRouteGraph* graph, quint32 edge)
+{
+	if( edge == TS_INVALID )
+		return QString();
+
+	quint32 from = graph->edgeSource(edge);
+	quint32 to = graph->edge(edge).target;
+	double deg = TSRouteGraph::bearing(graph->lat(from), graph->lng(from), graph->lat(to), graph->lng(to));
+	QString heading = TSManeuverBuilder::compassPoint(deg);
+
+	QString name = graph->edgeName(edge);
+	if( name.isEmpty() )
+		return QString("Head %1").arg(heading);
+	return QString("Head %1 on %2").arg(heading).arg(TSManeuverBuilder::spokenName(name));
+}
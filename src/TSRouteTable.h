@@ -0,0 +1,69 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteTable.h
+// Author : Zhan
+//
+#ifndef TSROUTETABLE_H
+#define TSROUTETABLE_H
+
+#include "TSWebApp.h"
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QMap>
+#include <QByteArray>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class TSRouteGraph;
+
+// Walking distance, time and first instruction between every pair of catalog buildings.
+//
+// A row is filled by one forward search from its building and a column by one
+// backward search to its building, so a catalog change only costs two searches
+// per added or moved building. Searches run in parallel on the global thread pool.
+class TSWEBAPP_EXPORTS TSRouteTable
+{
+public:
+	struct Cell
+	{
+		float					meters;			// negative if unreachable
+		float					seconds;
+		QString					instruction;	// first instruction of the walk
+	};
+
+	TSRouteTable();
+
+	// Bring the table in line with the graph and the snapped buildings (poi id -> node).
+	// Returns the number of buildings whose row and column were recomputed.
+	int							update(const TSRouteGraph* graph, const QMap<int, quint32>& poiNodes);
+
+	bool						load(const QString& fileName);
+	bool						save(const QString& fileName) const;
+
+	int							count() const { return m_ids.count(); }
+	bool						contains(int poiId) const { return m_index.contains(poiId); }
+	const Cell*					lookup(int srcPoi, int dstPoi) const;
+
+	static QString				departureText(const TSRouteGraph* graph, quint32 edge);
+
+private:
+	void						clear();
+
+	QByteArray					m_graphSignature;
+	QVector<int>				m_ids;
+	QVector<quint32>			m_nodes;
+	QHash<int, int>				m_index;		// poi id -> row / column
+	QVector<Cell>				m_cells;		// row-major, count() x count()
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSROUTETABLE_H
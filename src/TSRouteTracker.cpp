@@ -0,0 +1,187 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteTracker.cpp
+// Author : Zhan
+//
+
+#include "TSRouteTracker.h"
+#include "TSRouteEngine.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QSettings>
+#include <QtCore/QTime>
+
+TSRouteTracker::TSRouteTracker(const TSRouteEngine* engine, QObject *parent)
+: QObject(parent)
+, m_engine(engine)
+, m_graph(&engine->graph())
+, m_matcher(m_graph)
+, m_toDestination(m_graph)
+, m_progress(0)
+, m_next(0)
+, m_offRoute(0)
+, m_reroutes(0)
+, m_announceMeters(12)
+, m_offRouteFixes(3)
+{
+	loadSettings();
+}
+
+void TSRouteTracker::loadSettings()
+{
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	settings.beginGroup(QLatin1String("tracking"));
+	m_matcher.setSigma(settings.value(QLatin1String("GpsSigma"), 8.0).toDouble());
+	m_matcher.setSearchRadius(settings.value(QLatin1String("SearchRadius"), 40.0).toDouble());
+	m_announceMeters = settings.value(QLatin1String("AnnounceMeters"), 12.0).toDouble();
+	m_offRouteFixes = qMax(1, settings.value(QLatin1String("OffRouteFixes"), 3).toInt());
+	settings.endGroup();
+}
+
+void TSRouteTracker::start(const TSRoute& route, int profile)
+{
+	m_reroutes = 0;
+	follow(route);
+
+	// A tree grown with other weights cannot be resumed
+	QVector<float> weights = m_engine->weights(profile);
+	bool reweighted = weights != m_weights;
+	m_weights = weights;
+	m_toDestination.setWeights(m_weights);
+
+	// Grow the tree of the destination as far as the start while nothing is walked yet,
+	// detours close to the route are then answered from it
+	if( isActive() )
+	{
+		quint32 destination = destinationNode();
+		if( reweighted || m_toDestination.source() != destination )
+			m_toDestination.start(destination, TSRouteSearch::Backward);
+		m_toDestination.settle(m_graph->edgeSource(m_route.edges.first()));
+	}
+}
+
+quint32 TSRouteTracker::destinationNode() const
+{
+	quint32 node = m_engine->poiNode(m_route.dstPoi);
+	return node != TS_INVALID ? node : m_graph->edge(m_route.edges.last()).target;
+}
+
+float TSRouteTracker::weight(quint32 edge) const
+{
+	return m_weights.isEmpty() ? m_graph->edge(edge).seconds : m_weights.at(edge);
+}
+
+void TSRouteTracker::follow(const TSRoute& route)
+{
+	m_route = route;
+	m_matcher.setRoute(&m_route);
+	m_progress = 0;
+	m_next = 0;
+	m_offRoute = 0;
+
+	if( m_route.maneuvers.isEmpty() )
+		return;
+
+	QLOG_DEBUG() << QString("Route tracker: %1 maneuvers over %2 m.").arg(m_route.maneuvers.count()).arg(m_route.meters());
+	emit maneuverReached(0, m_route.maneuvers[0].text);
+	m_next = 1;
+}
+
+void TSRouteTracker::stop()
+{
+	m_route = TSRoute();
+	m_matcher.setRoute(0);
+	m_progress = 0;
+	m_next = 0;
+	m_offRoute = 0;
+}
+
+/*!
+  \brief Route from a matched position to the destination.
+
+  The walker may head either way along the edge; both ends are looked up in
+  the tree of the destination and the cheaper one wins. The tree is kept as
+  long as the destination does not change and resumed only as far as the two
+  ends require.
+*/
+bool TSRouteTracker::reroute(quint32 edge, double t)
+{
+	if( !isActive() )
+		return false;
+
+	QTime timer;
+	timer.start();
+
+	quint32 destination = destinationNode();
+	if( m_toDestination.source() != destination )
+		m_toDestination.start(destination, TSRouteSearch::Backward);
+
+	// Walking on toward the target of the edge, or back toward its source
+	quint32 ahead = edge, back = m_graph->edge(edge).reverse;
+	quint32 aheadNode = m_graph->edge(ahead).target;
+	double aheadSeconds = TSRouteSearch::INFINITE_TIME, backSeconds = TSRouteSearch::INFINITE_TIME;
+	if( weight(ahead) < TSRouteSearch::INFINITE_TIME && m_toDestination.settle(aheadNode) )
+		aheadSeconds = (1 - t) * weight(ahead) + m_toDestination.seconds(aheadNode);
+	if( weight(back) < TSRouteSearch::INFINITE_TIME && m_toDestination.settle(m_graph->edge(back).target) )
+		backSeconds = t * weight(back) + m_toDestination.seconds(m_graph->edge(back).target);
+
+	if( aheadSeconds >= TSRouteSearch::INFINITE_TIME && backSeconds >= TSRouteSearch::INFINITE_TIME )
+	{
+		QLOG_WARN() << QString("Route tracker: the destination cannot be reached from edge %1.").arg(edge);
+		return false;
+	}
+
+	quint32 first = aheadSeconds <= backSeconds ? ahead : back;
+	QVector<quint32> edges;
+	edges.append(first);
+	edges += m_toDestination.path(m_graph->edge(first).target);
+
+	m_reroutes++;
+	emit rerouted();
+	follow(m_engine->route(edges, -1, m_route.dstPoi));
+
+	QLOG_INFO() << QString("Route tracker: rerouted in %1 ms, %2 nodes settled so far.").arg(timer.elapsed()).arg(m_toDestination.settledCount());
+	return true;
+}
+
+void TSRouteTracker::processFix(const TSFix& fix)
+{
+	if( !isActive() )
+		return;
+
+	TSMatch match;
+	if( !m_matcher.update(fix, &match) )
+		return;
+
+	emit positionMatched(match.lat, match.lng, match.routeOffset);
+
+	// A single stray fix is noise, a few in a row are a detour
+	if( match.routeOffset < 0 )
+	{
+		if( ++m_offRoute >= m_offRouteFixes )
+			reroute(match.edge, match.t);
+		return;
+	}
+	m_offRoute = 0;
+
+	if( match.routeOffset > m_progress )
+		m_progress = match.routeOffset;
+
+	// Several maneuvers may be passed at once after a gap in the fixes, only the last is spoken
+	int reached = m_next;
+	while( reached < m_route.maneuvers.count() && m_route.maneuvers[reached].offset - m_announceMeters <= m_progress )
+		reached++;
+	if( reached == m_next )
+		return;
+
+	m_next = reached;
+	emit maneuverReached(reached - 1, m_route.maneuvers[reached - 1].text);
+	if( m_route.maneuvers[reached - 1].type == TSManeuver::ARRIVE )
+	{
+		emit arrived();
+		stop();
+	}
+}
@@ -0,0 +1,93 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSRouteTracker.h
+// Author : Zhan
+//
+#ifndef TSROUTETRACKER_H
+#define TSROUTETRACKER_H
+
+#include "TSWebApp.h"
+#include "TSManeuver.h"
+#include "TSMapMatcher.h"
+#include "TSPositionSource.h"
+#include "TSRouteSearch.h"
+
+#include <QObject>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class TSRouteEngine;
+
+// Follows one walker along an active route.
+//
+// Every fix is map-matched; the progress along the route only moves forward,
+// and each maneuver is announced once, when the walker comes within
+// announceMeters of it. One tracker per walker: trackers share the engine and
+// nothing else, so many of them can run side by side.
+//
+// After offRouteFixes fixes matched off the route in a row, the walk is rerouted
+// from the matched position. The shortest path tree rooted at the destination is
+// kept between reroutes and only grown when the walker strays outside of it, so
+// a reroute usually costs the length of the new path. Reroutes weigh the edges
+// by the profile the walk was planned with, closed paths included.
+class TSWEBAPP_EXPORTS TSRouteTracker : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit TSRouteTracker(const TSRouteEngine* engine, QObject *parent = 0);
+
+	void						loadSettings();
+
+	// Announces the departure at once; profile is the TSRouteProfile the route was planned with
+	void						start(const TSRoute& route, int profile = 0);
+	void						stop();
+
+	// New route to the destination from a position on the edge, see TSMatch
+	bool						reroute(quint32 edge, double t);
+
+	bool						isActive() const { return !m_route.isEmpty(); }
+	const TSRoute&				route() const { return m_route; }
+	float						progress() const { return m_progress; }
+	int							nextManeuver() const { return m_next; }
+	int							rerouteCount() const { return m_reroutes; }
+
+	TSMapMatcher&				matcher() { return m_matcher; }
+
+public slots:
+	void						processFix(const TSFix& fix);
+
+signals:
+	void						positionMatched(double lat, double lng, float routeOffset);
+	void						maneuverReached(int index, const QString& text);
+	void						arrived();
+	void						rerouted();
+
+private:
+	void						follow(const TSRoute& route);
+	quint32						destinationNode() const;
+	float						weight(quint32 edge) const;
+
+	const TSRouteEngine			*m_engine;
+	const TSRouteGraph			*m_graph;
+	TSRoute						m_route;
+	TSMapMatcher				m_matcher;
+	TSRouteSearch				m_toDestination;	// backward tree, grown across reroutes
+	QVector<float>				m_weights;		// by edge, of the profile of the walk
+	float						m_progress;		// meters along the route, never decreases
+	int							m_next;			// first maneuver not announced yet
+	int							m_offRoute;		// fixes in a row matched off the route
+	int							m_reroutes;
+	double						m_announceMeters;
+	int							m_offRouteFixes;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSROUTETRACKER_H
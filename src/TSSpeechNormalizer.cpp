@@ -0,0 +1,376 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSSpeechNormalizer.cpp
+// Author : Zhan
+//
+
+#include "TSSpeechNormalizer.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QQueue>
+#include <QtCore/QStringList>
+
+static const char* ONES[] = { "zero", "one", "two", "three", "four", "five", "six", "seven", "eight", "nine",
+							  "ten", "eleven", "twelve", "thirteen", "fourteen", "fifteen", "sixteen",
+							  "seventeen", "eighteen", "nineteen" };
+static const char* TENS[] = { "", "", "twenty", "thirty", "forty", "fifty", "sixty", "seventy", "eighty", "ninety" };
+static const char* ORDINAL_ONES[] = { "zeroth", "first", "second", "third", "fourth", "fifth", "sixth", "seventh",
+									  "eighth", "ninth", "tenth", "eleventh", "twelfth", "thirteenth", "fourteenth",
+									  "fifteenth", "sixteenth", "seventeenth", "eighteenth", "nineteenth" };
+static const char* ORDINAL_TENS[] = { "", "", "twentieth", "thirtieth", "fortieth", "fiftieth", "sixtieth",
+									  "seventieth", "eightieth", "ninetieth" };
+
+// Words after which a number is a quantity, not a house number
+static const char* UNITS[] = { "meter", "meters", "kilometer", "kilometers", "minute", "minutes",
+							   "second", "seconds", "hour", "hours", "percent", "degree", "degrees",
+							   "step", "steps", "floor", "floors", 0 };
+
+Q_GLOBAL_STATIC(TSSpeechNormalizer, standardNormalizer)
+
+static bool isWordChar(QChar c)
+{
+	return c.isLetterOrNumber();
+}
+
+// 0 .. 99
+static QString cardinal(int n)
+{
+	if( n < 20 )
+		return ONES[n];
+	if( n % 10 == 0 )
+		return TENS[n / 10];
+	return QString("%1 %2").arg(TENS[n / 10]).arg(ONES[n % 10]);
+}
+
+// 0 .. 99
+static QString ordinal(int n)
+{
+	if( n < 20 )
+		return ORDINAL_ONES[n];
+	if( n % 10 == 0 )
+		return ORDINAL_TENS[n / 10];
+	return QString("%1 %2").arg(TENS[n / 10]).arg(ORDINAL_ONES[n % 10]);
+}
+
+// Second half of a house number: "10" -> "ten", "05" -> "oh five", "00" -> "hundred"
+static QString housePair(int n)
+{
+	if( n == 0 )
+		return "hundred";
+	if( n < 10 )
+		return QString("oh %1").arg(ONES[n]);
+	return cardinal(n);
+}
+
+TSSpeechNormalizer::TSSpeechNormalizer()
+{
+	addStandardRules();
+	compile();
+}
+
+const TSSpeechNormalizer& TSSpeechNormalizer::standard()
+{
+	return *standardNormalizer();
+}
+
+void TSSpeechNormalizer::addStandardRules()
+{
+	// Street types
+	addRule("St", "Street");
+	addRule("St.", "Street");
+	addRule("Sts", "Streets");
+	addRule("Ave", "Avenue");
+	addRule("Ave.", "Avenue");
+	addRule("Av", "Avenue");
+	addRule("Aves", "Avenues");
+	addRule("Blvd", "Boulevard");
+	addRule("Blvd.", "Boulevard");
+	addRule("Dr", "Drive");
+	addRule("Dr.", "Drive");
+	addRule("Rd", "Road");
+	addRule("Rd.", "Road");
+	addRule("Pl", "Place");
+	addRule("Pl.", "Place");
+	addRule("Ln", "Lane");
+	addRule("Ct", "Court");
+	addRule("Sq", "Square");
+	addRule("Pkwy", "Parkway");
+	addRule("Hwy", "Highway");
+	addRule("Ctr", "Center");
+	addRule("Bldg", "Building");
+	addRule("Univ", "University");
+	addRule("Mt", "Mount");
+	addRule("Mt.", "Mount");
+
+	// Directions, single letters only when written in capitals
+	addRule("N", "North", Qt::CaseSensitive);
+	addRule("S", "South", Qt::CaseSensitive);
+	addRule("E", "East", Qt::CaseSensitive);
+	addRule("W", "West", Qt::CaseSensitive);
+	addRule("N.", "North", Qt::CaseSensitive);
+	addRule("S.", "South", Qt::CaseSensitive);
+	addRule("E.", "East", Qt::CaseSensitive);
+	addRule("W.", "West", Qt::CaseSensitive);
+	addRule("NE", "Northeast", Qt::CaseSensitive);
+	addRule("NW", "Northwest", Qt::CaseSensitive);
+	addRule("SE", "Southeast", Qt::CaseSensitive);
+	addRule("SW", "Southwest", Qt::CaseSensitive);
+
+	// State, acronyms spelled out, symbols
+	addRule("PA", "Pennsylvania", Qt::CaseSensitive);
+	addRule("UPMC", "U P M C", Qt::CaseSensitive);
+	addRule("LRDC", "L R D C", Qt::CaseSensitive);
+	addRule("SRCC", "S R C C", Qt::CaseSensitive);
+	addRule("&", "and");
+	addRule("km", "kilometers");
+	addRule("min", "minutes");
+	addRule("approx.", "approximately");
+}
+
+void TSSpeechNormalizer::addRule(const QString& pattern, const QString& replacement, Qt::CaseSensitivity cs)
+{
+	for( int i = 0; i < pattern.length(); i++ )
+	{
+		if( pattern[i].unicode() >= ALPHABET )
+		{
+			QLOG_WARN() << QString("Speech normalizer: pattern %1 is not ASCII.").arg(pattern);
+			return;
+		}
+	}
+	if( pattern.isEmpty() )
+		return;
+
+	Rule rule = { pattern, replacement, cs };
+	m_rules.append(rule);
+}
+
+/*!
+  \brief Build the automaton: a trie of the lower case patterns, completed with
+  the failure transitions so that matching never backtracks.
+*/
+void TSSpeechNormalizer::compile()
+{
+	QVector<qint32> fail;
+	QVector<QList<int> > out;
+
+	m_next.fill(-1, ALPHABET);
+	fail.append(0);
+	out.append(QList<int>());
+
+	for( int r = 0; r < m_rules.count(); r++ )
+	{
+		QString pattern = m_rules[r].pattern.toLower();
+		int state = 0;
+		for( int i = 0; i < pattern.length(); i++ )
+		{
+			int c = pattern[i].unicode();
+			if( m_next[state * ALPHABET + c] < 0 )
+			{
+				m_next[state * ALPHABET + c] = fail.count();
+				m_next.insert(m_next.count(), ALPHABET, -1);
+				fail.append(0);
+				out.append(QList<int>());
+			}
+			state = m_next[state * ALPHABET + c];
+		}
+		out[state].append(r);
+	}
+
+	// Breadth first: the failure state of a node is always known before its children
+	QQueue<int> queue;
+	for( int c = 0; c < ALPHABET; c++ )
+	{
+		int s = m_next[c];
+		if( s < 0 )
+			m_next[c] = 0;
+		else
+		{
+			fail[s] = 0;
+			queue.enqueue(s);
+		}
+	}
+	while( !queue.isEmpty() )
+	{
+		int state = queue.dequeue();
+		out[state] += out[fail[state]];		// suffixes are shorter, longest first is kept
+
+		for( int c = 0; c < ALPHABET; c++ )
+		{
+			int s = m_next[state * ALPHABET + c];
+			if( s < 0 )
+				m_next[state * ALPHABET + c] = m_next[fail[state] * ALPHABET + c];
+			else
+			{
+				fail[s] = m_next[fail[state] * ALPHABET + c];
+				queue.enqueue(s);
+			}
+		}
+	}
+
+	m_outBegin.clear();
+	m_outputs.clear();
+	for( int s = 0; s < out.count(); s++ )
+	{
+		m_outBegin.append(m_outputs.count());
+		for( int i = 0; i < out[s].count(); i++ )
+			m_outputs.append(out[s][i]);
+	}
+	m_outBegin.append(m_outputs.count());
+}
+
+// Case and word boundaries of a rule matched by the automaton at text[start]
+bool TSSpeechNormalizer::matches(const QString& text, int start, int rule) const
+{
+	const QString& pattern = m_rules[rule].pattern;
+	int end = start + pattern.length();
+
+	if( isWordChar(pattern[0]) && start > 0 && isWordChar(text[start - 1]) )
+		return false;
+	if( isWordChar(pattern[pattern.length() - 1]) && end < text.length() && isWordChar(text[end]) )
+		return false;
+
+	if( m_rules[rule].cs == Qt::CaseSensitive )
+	{
+		for( int i = 0; i < pattern.length(); i++ )
+		{
+			if( text[start + i] != pattern[i] )
+				return false;
+		}
+	}
+	return true;
+}
+
+/*!
+  \brief Rewrite a text for the speech synthesizer.
+
+  The automaton records the longest rule starting at every position, then the
+  text is copied once, replacing rules and numbers from left to right.
+*/
+QString TSSpeechNormalizer::normalize(const QString& text) const
+{
+	const int n = text.length();
+	QVector<qint32> bestRule(n, -1);
+
+	int state = 0;
+	for( int i = 0; i < n; i++ )
+	{
+		ushort c = text[i].toLower().unicode();
+		if( c >= ALPHABET )
+		{
+			state = 0;
+			continue;
+		}
+		state = m_next[state * ALPHABET + c];
+		for( int o = m_outBegin[state]; o < m_outBegin[state + 1]; o++ )
+		{
+			int rule = m_outputs[o];
+			int start = i - m_rules[rule].pattern.length() + 1;
+			if( !matches(text, start, rule) )
+				continue;
+			if( bestRule[start] < 0 || m_rules[bestRule[start]].pattern.length() < m_rules[rule].pattern.length() )
+				bestRule[start] = rule;
+		}
+	}
+
+	QString out;
+	out.reserve(n + n / 2);
+	int i = 0;
+	while( i < n )
+	{
+		if( bestRule[i] >= 0 )
+		{
+			out += m_rules[bestRule[i]].replacement;
+			i += m_rules[bestRule[i]].pattern.length();
+		}
+		else if( text[i].isDigit() && (i == 0 || !isWordChar(text[i - 1])) )
+			i = appendNumber(text, i, out);
+		else
+			out += text[i++];
+	}
+	return out;
+}
+
+// Speak the number starting at text[start], return the position after it
+int TSSpeechNormalizer::appendNumber(const QString& text, int start, QString& out) const
+{
+	const int n = text.length();
+	int end = start;
+	while( end < n && text[end].isDigit() )
+		end++;
+	QString digits = text.mid(start, end - start);
+
+	// Ordinal: 5th, 21st
+	QString suffix = text.mid(end, 2).toLower();
+	if( digits.length() <= 2 && (suffix == "st" || suffix == "nd" || suffix == "rd" || suffix == "th")
+		&& (end + 2 == n || !isWordChar(text[end + 2])) )
+	{
+		out += ordinal(digits.toInt());
+		return end + 2;
+	}
+
+	if( end < n && isWordChar(text[end]) )
+	{
+		out += digits;			// 3B and the like are left to the synthesizer
+		return end;
+	}
+
+	// ZIP code, with an optional +4 part
+	if( digits.length() == 5 )
+	{
+		int stop = end;
+		if( end + 5 <= n && text[end] == QLatin1Char('-') )
+		{
+			bool plus4 = true;
+			for( int k = end + 1; k < end + 5; k++ )
+				plus4 = plus4 && text[k].isDigit();
+			if( plus4 && (end + 5 == n || !isWordChar(text[end + 5])) )
+			{
+				digits += text.mid(end + 1, 4);
+				stop = end + 5;
+			}
+		}
+
+		QStringList words;
+		for( int k = 0; k < digits.length(); k++ )
+			words.append(ONES[digits[k].digitValue()]);
+		out += words.join(QLatin1String(" "));
+		return stop;
+	}
+
+	// House number: 3 or 4 digits followed by a word that is not a unit
+	if( (digits.length() == 3 || digits.length() == 4) && digits[0] != QLatin1Char('0') )
+	{
+		int w = end;
+		while( w < n && text[w] == QLatin1Char(' ') )
+			w++;
+		int wEnd = w;
+		while( wEnd < n && text[wEnd].isLetter() )
+			wEnd++;
+
+		bool house = (w > end && wEnd > w);
+		QString word = text.mid(w, wEnd - w).toLower();
+		for( int u = 0; house && UNITS[u]; u++ )
+		{
+			if( word == UNITS[u] )
+				house = false;
+		}
+
+		if( house )
+		{
+			int value = digits.toInt();
+			if( digits.length() == 4 && value % 1000 == 0 )
+				out += QString("%1 thousand").arg(ONES[value / 1000]);
+			else if( digits.length() == 3 )
+				out += QString("%1 %2").arg(ONES[value / 100]).arg(housePair(value % 100));
+			else
+				out += QString("%1 %2").arg(cardinal(value / 100)).arg(housePair(value % 100));
+			return end;
+		}
+	}
+
+	out += digits;
+	return end;
+}
@@ -0,0 +1,70 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSSpeechNormalizer.h
+// Author : Zhan
+//
+#ifndef TSSPEECHNORMALIZER_H
+#define TSSPEECHNORMALIZER_H
+
+#include "TSWebApp.h"
+
+#include <QString>
+#include <QVector>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+// Rewrites addresses and directions into text the speech synthesizer reads well:
+// "210 S. Bouquet St, Pittsburgh, PA 15213" becomes
+// "two ten South Bouquet Street, Pittsburgh, Pennsylvania one five two one three".
+//
+// Abbreviations are found by an Aho-Corasick automaton compiled from the rule
+// table, so the cost of normalize() is linear in the text whatever the number of
+// rules. Numbers are rewritten on the fly: ZIP codes digit by digit, house numbers
+// by pairs and ordinals as words.
+class TSWEBAPP_EXPORTS TSSpeechNormalizer
+{
+public:
+	// Built with the standard abbreviations, ready to use
+	TSSpeechNormalizer();
+
+	// A pattern made of letters or digits only matches whole words.
+	// Rules added after the constructor take effect at the next compile().
+	void						addRule(const QString& pattern, const QString& replacement,
+										Qt::CaseSensitivity cs = Qt::CaseInsensitive);
+	void						compile();
+
+	int							ruleCount() const { return m_rules.count(); }
+	QString						normalize(const QString& text) const;
+
+	// Shared instance with the standard rules
+	static const TSSpeechNormalizer& standard();
+
+private:
+	enum { ALPHABET = 128 };		// patterns are ASCII, other characters reset the automaton
+
+	struct Rule
+	{
+		QString					pattern;
+		QString					replacement;
+		Qt::CaseSensitivity		cs;
+	};
+
+	void						addStandardRules();
+	bool						matches(const QString& text, int start, int rule) const;
+	int							appendNumber(const QString& text, int start, QString& out) const;
+
+	QVector<Rule>				m_rules;
+	QVector<qint32>				m_next;			// state * ALPHABET + character -> state
+	QVector<qint32>				m_outBegin;		// state -> first entry of m_outputs, one extra at the end
+	QVector<qint32>				m_outputs;		// rules ending at each state, longest first
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSSPEECHNORMALIZER_H
@@ -0,0 +1,283 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSTilePrefetcher.cpp
+// Author : Zhan
+//
+
+#include "TSTilePrefetcher.h"
+#include "TSTileStore.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QSettings>
+#include <QtCore/QThread>
+#include <QtCore/QUrl>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+
+#include <math.h>
+
+#define METERS_PER_DEGREE	111320.0
+#define EQUATOR_METERS		40075016.686
+#define DEG_TO_RAD			0.017453292519943295
+#define PI					3.14159265358979
+#define TICK_MS				250
+#define MAX_ERRORS			5				// failures in a row before the queue is dropped
+
+const QNetworkRequest::Attribute TSTilePrefetcher::PrefetchAttribute = (QNetworkRequest::Attribute)(QNetworkRequest::User + 1);
+
+static int tileX(double lng, int n)
+{
+	return qBound(0, (int)floor((lng + 180.0) / 360.0 * n), n - 1);
+}
+
+static int tileY(double lat, int n)
+{
+	double phi = qBound(-85.05, lat, 85.05) * DEG_TO_RAD;
+	return qBound(0, (int)floor((1.0 - log(tan(phi) + 1.0 / cos(phi)) / PI) / 2.0 * n), n - 1);
+}
+
+TSTilePrefetcher::TSTilePrefetcher(QNetworkAccessManager* manager, const TSTileStore* store, QObject *parent)
+: QObject(parent)
+, m_manager(manager)
+, m_store(store)
+, m_budget(0)
+, m_bytes(0)
+, m_errors(0)
+, m_requests(0)
+, m_hits(0)
+, m_late(0)
+, m_enabled(true)
+, m_corridorMeters(150)
+, m_maxConcurrent(2)
+, m_bytesPerTick(64 * 1024)
+, m_maxQueued(1500)
+{
+	qRegisterMetaType< QVector<QPointF> >("QVector<QPointF>");
+	loadSettings();
+	m_tick.setInterval(TICK_MS);
+	connect(&m_tick, SIGNAL(timeout()), this, SLOT(refill()));
+}
+
+void TSTilePrefetcher::loadSettings()
+{
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	settings.beginGroup(QLatin1String("prefetch"));
+	m_enabled = settings.value(QLatin1String("Enabled"), true).toBool();
+	QStringList zooms = settings.value(QLatin1String("Zooms"), QStringList() << QLatin1String("17") << QLatin1String("16")
+									   << QLatin1String("18")).toStringList();		// comma separated
+	m_corridorMeters = qMax(0.0, settings.value(QLatin1String("CorridorMeters"), 150).toDouble());
+	m_maxConcurrent = qMax(1, settings.value(QLatin1String("MaxConcurrent"), 2).toInt());
+	m_bytesPerTick = qMax(0, settings.value(QLatin1String("KilobytesPerSecond"), 256).toInt()) * 1024 / (1000 / TICK_MS);
+	m_maxQueued = qMax(0, settings.value(QLatin1String("MaxQueued"), 1500).toInt());
+	m_urlTemplate = settings.value(QLatin1String("UrlTemplate"),
+		QLatin1String("http://mt%4.googleapis.com/vt?lyrs=m@207000000&src=apiv3&hl=en-US&x=%1&y=%2&z=%3")).toString();
+	settings.endGroup();
+
+	m_zooms.clear();
+	for( int i = 0; i < zooms.count(); i++ )
+	{
+		bool ok = false;
+		int zoom = zooms[i].trimmed().toInt(&ok);
+		if( ok && zoom >= 0 && zoom <= 22 )
+			m_zooms.append(zoom);
+	}
+
+	// Layer of the tiles fetched, to recognize them among the requests of the page
+	int zoom, x, y;
+	if( !m_store->tileOf(QUrl(tileUrl(QLatin1String("0/0/0"))), &m_layer, &zoom, &x, &y) )
+	{
+		QLOG_WARN() << "Tile prefetch: the URL template is not a tile URL of the map, prefetching is off.";
+		m_enabled = false;
+	}
+}
+
+/*!
+  \brief Tiles a walker panning along the walk would see.
+
+  Points are sampled along each segment at most half a tile and half the
+  corridor apart, and every tile within the corridor of a sample is listed
+  the first time it is met.
+*/
+QStringList TSTilePrefetcher::corridorTiles(const QVector<QPointF>& shape, int zoom, double corridorMeters)
+{
+	QStringList tiles;
+	QSet<QString> seen;
+	const int n = 1 << zoom;
+	for( int i = 0; i < shape.count(); i++ )
+	{
+		const QPointF& a = shape[i];
+		const QPointF& b = i + 1 < shape.count() ? shape[i + 1] : shape[i];
+		double cosLat = qMax(0.01, cos(a.y() * DEG_TO_RAD));
+		double dx = (b.x() - a.x()) * cosLat * METERS_PER_DEGREE;
+		double dy = (b.y() - a.y()) * METERS_PER_DEGREE;
+		double length = sqrt(dx * dx + dy * dy);
+		double step = qMax(1.0, qMin(EQUATOR_METERS * cosLat / n, qMax(corridorMeters, 1.0)) / 2);
+		int samples = qMax(1, (int)ceil(length / step));
+		if( i + 1 == shape.count() )
+			samples = 1;		// the last point alone
+
+		double dLat = corridorMeters / METERS_PER_DEGREE;
+		double dLng = corridorMeters / (METERS_PER_DEGREE * cosLat);
+		for( int s = 0; s < samples; s++ )
+		{
+			double t = (double)s / samples;
+			double lat = a.y() + (b.y() - a.y()) * t;
+			double lng = a.x() + (b.x() - a.x()) * t;
+			int x0 = tileX(lng - dLng, n), x1 = tileX(lng + dLng, n);
+			int y0 = tileY(lat + dLat, n), y1 = tileY(lat - dLat, n);
+			for( int x = x0; x <= x1; x++ )
+			{
+				for( int y = y0; y <= y1; y++ )
+				{
+					QString tile = QString("%1/%2/%3").arg(zoom).arg(x).arg(y);
+					if( !seen.contains(tile) )
+					{
+						seen.insert(tile);
+						tiles.append(tile);
+					}
+				}
+			}
+		}
+	}
+	return tiles;
+}
+
+void TSTilePrefetcher::prefetch(const QVector<QPointF>& shape)
+{
+	if( !m_enabled || shape.isEmpty() )
+		return;
+	if( QThread::currentThread() != thread() )
+	{
+		// The timer and the replies belong to the manager's thread
+		QMetaObject::invokeMethod(this, "prefetch", Qt::QueuedConnection, Q_ARG(QVector<QPointF>, shape));
+		return;
+	}
+	if( m_requests > 0 )
+		report();		// how the previous walks did
+
+	QList<QString> fresh;
+	for( int z = 0; z < m_zooms.count(); z++ )
+	{
+		QStringList tiles = corridorTiles(shape, m_zooms[z], m_corridorMeters);
+		for( int i = 0; i < tiles.count(); i++ )
+		{
+			if( m_fetched.contains(tiles[i]) || m_waiting.contains(tiles[i]) )
+				continue;
+			QStringList zxy = tiles[i].split(QLatin1Char('/'));
+			const uchar* data = 0;
+			qint64 size = 0;
+			if( m_store->find(m_layer, zxy[0].toInt(), zxy[1].toInt(), zxy[2].toInt(), &data, &size) )
+				continue;		// offline already
+			fresh.append(tiles[i]);
+			m_waiting.insert(tiles[i]);
+		}
+	}
+
+	// The new walk first, the oldest waiting tiles are dropped
+	m_queue = fresh + m_queue;
+	while( m_queue.count() > m_maxQueued )
+		m_waiting.remove(m_queue.takeLast());
+	QLOG_DEBUG() << QString("Tile prefetch: %1 new tiles along the walk, %2 waiting.").arg(fresh.count()).arg(m_queue.count());
+
+	m_budget = m_bytesPerTick;
+	m_tick.start();
+	fetchNext();
+}
+
+void TSTilePrefetcher::fetchNext()
+{
+	while( !m_queue.isEmpty() && m_inFlight.count() < m_maxConcurrent && (m_bytesPerTick == 0 || m_budget > 0) )
+	{
+		QString tile = m_queue.takeFirst();
+		QNetworkRequest request(QUrl(tileUrl(tile)));
+		request.setAttribute(PrefetchAttribute, true);
+		request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferCache);
+		QNetworkReply* reply = m_manager->get(request);
+		m_inFlight.insert(reply, tile);
+		connect(reply, SIGNAL(finished()), this, SLOT(onFinished()));
+	}
+	if( m_queue.isEmpty() && m_inFlight.isEmpty() )
+		m_tick.stop();
+}
+
+void TSTilePrefetcher::onFinished()
+{
+	QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
+	if( !reply || !m_inFlight.contains(reply) )
+		return;
+	QString tile = m_inFlight.take(reply);
+	m_waiting.remove(tile);
+	qint64 bytes = reply->readAll().size();
+
+	if( reply->error() != QNetworkReply::NoError )
+	{
+		if( ++m_errors >= MAX_ERRORS )
+		{
+			QLOG_INFO() << QString("Tile prefetch: %1 tiles failed in a row, %2 waiting tiles dropped.").arg(m_errors).arg(m_queue.count());
+			for( int i = 0; i < m_queue.count(); i++ )
+				m_waiting.remove(m_queue[i]);
+			m_queue.clear();
+			m_errors = 0;
+		}
+	}
+	else
+	{
+		m_errors = 0;
+		m_fetched.insert(tile);
+		if( !reply->attribute(QNetworkRequest::SourceIsFromCacheAttribute).toBool() )
+		{
+			m_bytes += bytes;
+			m_budget -= bytes;
+		}
+	}
+	reply->deleteLater();
+	fetchNext();
+}
+
+// Each tick gives back one tick of bandwidth, never more than one tick ahead
+void TSTilePrefetcher::refill()
+{
+	m_budget = qMin(m_budget + m_bytesPerTick, (qint64)m_bytesPerTick);
+	fetchNext();
+}
+
+void TSTilePrefetcher::noteRequest(const QNetworkRequest& request)
+{
+	if( request.attribute(PrefetchAttribute).toBool() )
+		return;
+
+	QString layer;
+	int zoom, x, y;
+	if( !m_store->tileOf(request.url(), &layer, &zoom, &x, &y) || layer != m_layer )
+		return;
+
+	m_requests++;
+	QString tile = QString("%1/%2/%3").arg(zoom).arg(x).arg(y);
+	if( m_fetched.contains(tile) )
+		m_hits++;
+	else if( m_waiting.contains(tile) )
+	{
+		// The page fetches it now, no need to fetch it again
+		m_late++;
+		if( m_queue.removeOne(tile) )
+			m_waiting.remove(tile);
+	}
+}
+
+// %1 x, %2 y, %3 zoom and %4 one of four servers, spread by tile
+QString TSTilePrefetcher::tileUrl(const QString& tile) const
+{
+	QStringList zxy = tile.split(QLatin1Char('/'));
+	int x = zxy[1].toInt(), y = zxy[2].toInt();
+	return m_urlTemplate.arg(x).arg(y).arg(zxy[0]).arg((x + y) % 4);
+}
+
+void TSTilePrefetcher::report() const
+{
+	QLOG_INFO() << QString("Tile prefetch: %1 tiles fetched (%2 KB), %3 waiting; the page asked for %4 tiles, %5% prefetched, %6% still waiting.")
+		.arg(m_fetched.count()).arg(m_bytes / 1024).arg(m_queue.count()).arg(m_requests)
+		.arg(m_hits * 100.0 / qMax(1, m_requests), 0, 'f', 1).arg(m_late * 100.0 / qMax(1, m_requests), 0, 'f', 1);
+}
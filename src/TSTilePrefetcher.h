@@ -0,0 +1,115 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSTilePrefetcher.h
+// Author : Zhan
+//
+#ifndef TSTILEPREFETCHER_H
+#define TSTILEPREFETCHER_H
+
+#include "TSWebApp.h"
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QList>
+#include <QSet>
+#include <QHash>
+#include <QPointF>
+#include <QTimer>
+#include <QMetaType>
+#include <QtNetwork/QNetworkRequest>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class QNetworkAccessManager;
+class QNetworkReply;
+class TSTileStore;
+
+// Fetches the map tiles along a new walk before the walker pans to them.
+//
+// The tiles covering a corridor around the walk are listed for the few zooms
+// the map is likely to show, in the order of the walk, and requested through
+// the network access manager so they land in its disk cache. Only a few are
+// in flight at a time and a bandwidth budget refilled every tick holds the
+// next ones back, so the page's own requests keep the line. The tiles of a new
+// walk go before those still waiting from the previous one; tiles of the
+// offline store are never fetched.
+//
+// The manager reports the tiles the page asks for, which gives the hit rate:
+// tiles already fetched, still waiting, or never listed.
+//
+// Configured by the [prefetch] group of app_config.ini.
+class TSWEBAPP_EXPORTS TSTilePrefetcher : public QObject
+{
+	Q_OBJECT
+
+public:
+	TSTilePrefetcher(QNetworkAccessManager* manager, const TSTileStore* store, QObject *parent = 0);
+
+	void						loadSettings();
+
+	// Counts a tile request of the page against the prefetched tiles
+	void						noteRequest(const QNetworkRequest& request);
+
+	// Tiles of a corridor around a walk at a zoom, as "zoom/x/y" in the order of the walk
+	static QStringList			corridorTiles(const QVector<QPointF>& shape, int zoom, double corridorMeters);
+
+	int							queued() const { return m_queue.count(); }
+	int							fetched() const { return m_fetched.count(); }
+	qint64						fetchedBytes() const { return m_bytes; }
+	int							pageRequests() const { return m_requests; }
+	int							hits() const { return m_hits; }
+	int							lateHits() const { return m_late; }
+
+	// Marks the requests of the prefetcher, which the page statistics leave out
+	static const QNetworkRequest::Attribute PrefetchAttribute;
+
+public slots:
+	// Queues the tiles along a walk, x = lng and y = lat; from another thread the call is posted to the prefetcher's
+	void						prefetch(const QVector<QPointF>& shape);
+
+private slots:
+	void						fetchNext();
+	void						onFinished();
+	void						refill();
+
+private:
+	QString						tileUrl(const QString& tile) const;
+	void						report() const;
+
+	QNetworkAccessManager		*m_manager;
+	const TSTileStore			*m_store;
+	QTimer						m_tick;
+	QList<QString>				m_queue;			// "zoom/x/y", next first
+	QSet<QString>				m_waiting;			// queued or in flight
+	QSet<QString>				m_fetched;
+	QHash<QNetworkReply*, QString> m_inFlight;
+	qint64						m_budget;			// bytes that may still be fetched in this tick
+	qint64						m_bytes;
+	int							m_errors;			// in a row
+	int							m_requests;
+	int							m_hits;
+	int							m_late;
+
+	bool						m_enabled;
+	QList<int>					m_zooms;			// most likely first
+	double						m_corridorMeters;
+	int							m_maxConcurrent;
+	int							m_bytesPerTick;		// 0 for no limit
+	int							m_maxQueued;
+	QString						m_layer;
+	QString						m_urlTemplate;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+Q_DECLARE_METATYPE(QVector<QPointF>)
+
+#endif // TSTILEPREFETCHER_H
@@ -0,0 +1,414 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSTileStore.cpp
+// Author : Zhan
+//
+
+#include "TSTileStore.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QSettings>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QFileInfo>
+#include <QtCore/QTimer>
+#include <QtCore/QtEndian>
+#include <QtCore/QtAlgorithms>
+#include <QtNetwork/QNetworkAccessManager>
+
+#include <stdio.h>
+#include <string.h>
+
+#define TILE_MAGIC			"TSTL"
+#define TILE_VERSION		1
+#define HEADER_SIZE			16			// magic, version, count, reserved
+#define ENTRY_SIZE			32			// layer, zoom, x, y, offset (64 bits), size, type
+
+// Index entry, in memory; on disk the same fields in that order, little endian
+struct TSTileEntry
+{
+	quint32						layer;			// first four characters of the name
+	quint32						zoom;
+	quint32						x;
+	quint32						y;
+	quint64						offset;
+	quint32						size;
+	quint32						type;
+	QString						path;			// source file while packing
+	QByteArray					data;			// or the tile itself
+
+	bool operator<(const TSTileEntry& other) const
+	{
+		if( layer != other.layer )
+			return layer < other.layer;
+		if( zoom != other.zoom )
+			return zoom < other.zoom;
+		if( x != other.x )
+			return x < other.x;
+		return y < other.y;
+	}
+};
+
+static quint32 layerCode(const QString& layer)
+{
+	QByteArray name = layer.toLatin1().left(4);
+	quint32 code = 0;
+	for( int i = 0; i < name.size(); i++ )
+		code |= (quint32)(uchar)name[i] << (8 * i);
+	return code;
+}
+
+// -1, 0 or 1 as the entry at p sorts before, with or after the key
+static int compareEntry(const uchar* p, quint32 layer, quint32 zoom, quint32 x, quint32 y)
+{
+	const quint32 key[4] = { layer, zoom, x, y };
+	for( int i = 0; i < 4; i++ )
+	{
+		quint32 v = qFromLittleEndian<quint32>(p + 4 * i);
+		if( v != key[i] )
+			return v < key[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+/*!
+  \brief Store configured by a group of app_config.ini, opened at once when its file exists.
+*/
+TSTileStore::TSTileStore(const QString& group, const QString& hosts)
+: m_data(0)
+, m_size(0)
+, m_count(0)
+, m_group(group)
+, m_defaultHosts(hosts)
+{
+	loadSettings();
+}
+
+TSTileStore::~TSTileStore()
+{
+	close();
+}
+
+void TSTileStore::loadSettings()
+{
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	settings.beginGroup(m_group);
+	m_fileName = settings.value(QLatin1String("File"), QString("tiles/campus.%1").arg(m_group)).toString();
+	m_hosts = settings.value(QLatin1String("Hosts"), m_defaultHosts.split(QLatin1Char(','))).toStringList();		// comma separated
+	settings.endGroup();
+
+	if( !m_fileName.isEmpty() && QFile::exists(m_fileName) )
+		open(m_fileName);
+}
+
+/*!
+  \brief Map a store file and check its header and index bounds.
+*/
+bool TSTileStore::open(const QString& fileName)
+{
+	close();
+	m_file.setFileName(fileName);
+	if( !m_file.open(QIODevice::ReadOnly) || m_file.size() < HEADER_SIZE )
+	{
+		QLOG_WARN() << QString("Tile store: cannot open %1.").arg(fileName);
+		m_file.close();
+		return false;
+	}
+
+	m_size = m_file.size();
+	m_data = m_file.map(0, m_size);
+	if( !m_data )
+	{
+		QLOG_WARN() << QString("Tile store: cannot map %1.").arg(fileName);
+		m_file.close();
+		return false;
+	}
+
+	quint32 version = qFromLittleEndian<quint32>(m_data + 4);
+	quint32 count = qFromLittleEndian<quint32>(m_data + 8);
+	if( memcmp(m_data, TILE_MAGIC, 4) != 0 || version != TILE_VERSION || HEADER_SIZE + (qint64)count * ENTRY_SIZE > m_size )
+	{
+		QLOG_WARN() << QString("Tile store: %1 is not a tile store of version %2.").arg(fileName).arg(TILE_VERSION);
+		close();
+		return false;
+	}
+
+	m_count = (int)count;
+	QLOG_INFO() << QString("Tile store: %1 tiles mapped from %2.").arg(m_count).arg(fileName);
+	return true;
+}
+
+void TSTileStore::close()
+{
+	if( m_data )
+		m_file.unmap(const_cast<uchar*>(m_data));
+	m_file.close();
+	m_data = 0;
+	m_size = 0;
+	m_count = 0;
+}
+
+bool TSTileStore::find(const QString& layer, int zoom, int x, int y, const uchar** data, qint64* size, Type* type) const
+{
+	if( !m_data || zoom < 0 || x < 0 || y < 0 )
+		return false;
+
+	quint32 code = layerCode(layer);
+	const uchar* index = m_data + HEADER_SIZE;
+	int lo = 0, hi = m_count;
+	while( lo < hi )
+	{
+		int mid = (lo + hi) / 2;
+		int c = compareEntry(index + (qint64)mid * ENTRY_SIZE, code, zoom, x, y);
+		if( c == 0 )
+		{
+			const uchar* entry = index + (qint64)mid * ENTRY_SIZE;
+			quint64 offset = qFromLittleEndian<quint64>(entry + 16);
+			quint32 bytes = qFromLittleEndian<quint32>(entry + 24);
+			if( offset + bytes > (quint64)m_size )
+				return false;		// truncated file
+			*data = m_data + offset;
+			*size = bytes;
+			if( type )
+				*type = (Type)qFromLittleEndian<quint32>(entry + 28);
+			return true;
+		}
+		if( c < 0 )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return false;
+}
+
+bool TSTileStore::find(const QUrl& url, const uchar** data, qint64* size, Type* type) const
+{
+	QString layer;
+	int zoom, x, y;
+	return m_data && tileOf(url, &layer, &zoom, &x, &y) && find(layer, zoom, x, y, data, size, type);
+}
+
+bool TSTileStore::tileOf(const QUrl& url, QString* layer, int* zoom, int* x, int* y) const
+{
+	QString host = url.host();
+	bool served = false;
+	for( int i = 0; i < m_hosts.count() && !served; i++ )
+		served = host.endsWith(m_hosts[i].trimmed());
+	if( !served || !url.hasQueryItem(QLatin1String("x")) || !url.hasQueryItem(QLatin1String("y")) || !url.hasQueryItem(QLatin1String("z")) )
+		return false;
+
+	*layer = url.queryItemValue(QLatin1String("lyrs")).section(QLatin1Char('@'), 0, 0);
+	if( layer->isEmpty() )
+		*layer = url.path().section(QLatin1Char('/'), -1);
+
+	bool okX = false, okY = false, okZ = false;
+	*x = url.queryItemValue(QLatin1String("x")).toInt(&okX);
+	*y = url.queryItemValue(QLatin1String("y")).toInt(&okY);
+	*zoom = url.queryItemValue(QLatin1String("z")).toInt(&okZ);
+	return okX && okY && okZ;
+}
+
+// Every layer/zoom/x/y.png or .jpg of a directory
+int TSTileStore::pack(const QString& directory, const QString& fileName)
+{
+	QDir root(directory);
+	QList<TSTileEntry> entries;
+	QDirIterator it(directory, QStringList() << QLatin1String("*.png") << QLatin1String("*.jpg") << QLatin1String("*.jpeg"),
+					QDir::Files, QDirIterator::Subdirectories);
+	while( it.hasNext() )
+	{
+		QString path = it.next();
+		QStringList parts = root.relativeFilePath(path).split(QLatin1Char('/'));
+		if( parts.count() != 4 )
+			continue;
+
+		bool okZ = false, okX = false, okY = false;
+		TSTileEntry entry;
+		entry.layer = layerCode(parts[0]);
+		entry.zoom = parts[1].toUInt(&okZ);
+		entry.x = parts[2].toUInt(&okX);
+		entry.y = QFileInfo(parts[3]).baseName().toUInt(&okY);
+		entry.size = (quint32)QFileInfo(path).size();
+		entry.type = parts[3].endsWith(QLatin1String(".png"), Qt::CaseInsensitive) ? Png : Jpeg;
+		entry.offset = 0;
+		entry.path = path;
+		if( okZ && okX && okY )
+			entries.append(entry);
+	}
+	return writeEntries(fileName, entries) ? entries.count() : -1;
+}
+
+int TSTileStore::write(const QString& fileName, const QList<TSStoredTile>& tiles)
+{
+	QList<TSTileEntry> entries;
+	for( int i = 0; i < tiles.count(); i++ )
+	{
+		TSTileEntry entry;
+		entry.layer = layerCode(tiles[i].layer);
+		entry.zoom = tiles[i].zoom;
+		entry.x = tiles[i].x;
+		entry.y = tiles[i].y;
+		entry.size = tiles[i].data.size();
+		entry.type = tiles[i].type;
+		entry.offset = 0;
+		entry.data = tiles[i].data;
+		entries.append(entry);
+	}
+	return writeEntries(fileName, entries) ? entries.count() : -1;
+}
+
+/*!
+  \brief Write the header, the sorted index and the tiles.
+
+  The index is written first with the offsets the tiles will have, then the
+  tiles are copied one at a time, so packing a directory never holds more
+  than one image in memory.
+*/
+bool TSTileStore::writeEntries(const QString& fileName, QList<TSTileEntry>& entries)
+{
+	qSort(entries);
+
+	QDir().mkpath(QFileInfo(fileName).absolutePath());
+	QFile file(fileName);
+	if( !file.open(QIODevice::WriteOnly | QIODevice::Truncate) )
+	{
+		QLOG_ERROR() << QString("Tile store: cannot write %1.").arg(fileName);
+		return false;
+	}
+
+	uchar header[HEADER_SIZE];
+	memcpy(header, TILE_MAGIC, 4);
+	qToLittleEndian<quint32>(TILE_VERSION, header + 4);
+	qToLittleEndian<quint32>(entries.count(), header + 8);
+	qToLittleEndian<quint32>(0, header + 12);
+	file.write((const char*)header, HEADER_SIZE);
+
+	quint64 offset = HEADER_SIZE + (quint64)entries.count() * ENTRY_SIZE;
+	for( int i = 0; i < entries.count(); i++ )
+	{
+		uchar raw[ENTRY_SIZE];
+		qToLittleEndian<quint32>(entries[i].layer, raw);
+		qToLittleEndian<quint32>(entries[i].zoom, raw + 4);
+		qToLittleEndian<quint32>(entries[i].x, raw + 8);
+		qToLittleEndian<quint32>(entries[i].y, raw + 12);
+		qToLittleEndian<quint64>(offset, raw + 16);
+		qToLittleEndian<quint32>(entries[i].size, raw + 24);
+		qToLittleEndian<quint32>(entries[i].type, raw + 28);
+		file.write((const char*)raw, ENTRY_SIZE);
+		offset += entries[i].size;
+	}
+
+	for( int i = 0; i < entries.count(); i++ )
+	{
+		if( entries[i].path.isEmpty() )
+		{
+			file.write(entries[i].data);
+			continue;
+		}
+		QFile image(entries[i].path);
+		QByteArray bytes;
+		if( image.open(QIODevice::ReadOnly) )
+			bytes = image.readAll();
+		if( bytes.size() != (int)entries[i].size )
+		{
+			QLOG_ERROR() << QString("Tile store: %1 changed while packing.").arg(entries[i].path);
+			file.remove();
+			return false;
+		}
+		file.write(bytes);
+	}
+	return true;
+}
+
+bool TSTileStore::run(const QStringList& args, int* exitCode)
+{
+	int pos = args.indexOf(QLatin1String("--pack-tiles"));
+	if( pos < 0 )
+		return false;
+
+	if( pos + 1 >= args.count() )
+	{
+		fprintf(stderr, "Usage: --pack-tiles directory [file]\n");
+		*exitCode = 1;
+		return true;
+	}
+	QString fileName = pos + 2 < args.count() ? args[pos + 2]
+		: QSettings("app_config.ini", QSettings::IniFormat).value(QLatin1String("tiles/File"), QLatin1String("tiles/campus.tiles")).toString();
+	int count = pack(args[pos + 1], fileName);
+	if( count < 0 )
+	{
+		fprintf(stderr, "Cannot pack the tiles of %s into %s\n", qPrintable(args[pos + 1]), qPrintable(fileName));
+		*exitCode = 1;
+		return true;
+	}
+	printf("%d tiles packed into %s\n", count, qPrintable(fileName));
+	fflush(stdout);
+	*exitCode = 0;
+	return true;
+}
+
+const char* TSTileStore::mimeType(Type type)
+{
+	switch( type )
+	{
+	case Png:		return "image/png";
+	case Jpeg:		return "image/jpeg";
+	default:		return "application/x-speechnav-vector";
+	}
+}
+
+TSTileReply::TSTileReply(const QNetworkRequest& request, const uchar* data, qint64 size, TSTileStore::Type type, QObject *parent)
+: QNetworkReply(parent)
+, m_data(data)
+, m_size(size)
+, m_pos(0)
+{
+	setRequest(request);
+	setUrl(request.url());
+	setOperation(QNetworkAccessManager::GetOperation);
+	setHeader(QNetworkRequest::ContentTypeHeader, QByteArray(TSTileStore::mimeType(type)));
+	setHeader(QNetworkRequest::ContentLengthHeader, m_size);
+	setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+	setAttribute(QNetworkRequest::HttpReasonPhraseAttribute, QByteArray("OK"));
+	setRawHeader("Access-Control-Allow-Origin", "*");
+	open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+
+	// The page connects to the reply once it is returned
+	QTimer::singleShot(0, this, SLOT(deliver()));
+}
+
+void TSTileReply::deliver()
+{
+	emit metaDataChanged();
+	if( m_size > 0 )
+	{
+		emit downloadProgress(m_size, m_size);
+		emit readyRead();
+	}
+	emit finished();
+}
+
+void TSTileReply::abort()
+{
+	m_pos = m_size;
+	close();
+}
+
+qint64 TSTileReply::bytesAvailable() const
+{
+	return m_size - m_pos + QNetworkReply::bytesAvailable();
+}
+
+// Straight from the mapped file into the buffer of the reader
+qint64 TSTileReply::readData(char *data, qint64 maxSize)
+{
+	if( m_pos >= m_size )
+		return -1;
+	qint64 count = qMin(maxSize, m_size - m_pos);
+	memcpy(data, m_data + m_pos, count);
+	m_pos += count;
+	return count;
+}
@@ -0,0 +1,132 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSTileStore.h
+// Author : Zhan
+//
+#ifndef TSTILESTORE_H
+#define TSTILESTORE_H
+
+#include "TSWebApp.h"
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QFile>
+#include <QUrl>
+#include <QtNetwork/QNetworkReply>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+struct TSStoredTile;
+struct TSTileEntry;
+
+// Map tiles kept for offline use in one memory-mapped file.
+//
+// The file is a header, an index of fixed size entries sorted by layer, zoom,
+// x and y, then the images one after the other. Opening it only maps it: a tile
+// is found by a binary search in the mapped index and its bytes are read where
+// they lie, nothing is parsed or copied up front. All numbers are little endian.
+//
+// Tiles are asked for with the URLs of the map, e.g.
+// http://mt0.googleapis.com/vt?lyrs=m@207000000&x=2287&y=3089&z=13: the layer
+// is lyrs up to the '@', or the last part of the path without it (kh for
+// satellite images). pack() builds the file from a directory laid out as
+// layer/zoom/x/y.png or .jpg, write() from tiles made in memory such as the
+// vector tiles of TSVectorTileBuilder.
+//
+// Configured by the [tiles] group of app_config.ini, or the group given; hosts
+// are the suffixes served when the group lists none.
+class TSWEBAPP_EXPORTS TSTileStore
+{
+public:
+	enum Type
+	{
+		Png,
+		Jpeg,
+		Vector			// see TSVectorTileBuilder
+	};
+
+	explicit TSTileStore(const QString& group = QLatin1String("tiles"), const QString& hosts = QLatin1String(".googleapis.com,.google.com"));
+	~TSTileStore();
+
+	void						loadSettings();
+	bool						open(const QString& fileName);
+	void						close();
+	bool						isOpen() const { return m_data != 0; }
+	int							count() const { return m_count; }
+
+	// Mapped bytes of a tile, valid until the store is closed
+	bool						find(const QString& layer, int zoom, int x, int y, const uchar** data, qint64* size, Type* type = 0) const;
+	// Same for a tile URL of the map, false for any other URL
+	bool						find(const QUrl& url, const uchar** data, qint64* size, Type* type = 0) const;
+	// Layer and coordinates of a tile URL of the map, false for any other URL
+	bool						tileOf(const QUrl& url, QString* layer, int* zoom, int* x, int* y) const;
+
+	// Writes the tiles of a directory to a store file, returns how many or -1 on error
+	static int					pack(const QString& directory, const QString& fileName);
+	// Writes tiles to a store file, returns how many or -1 on error
+	static int					write(const QString& fileName, const QList<TSStoredTile>& tiles);
+	// Packs tiles when the arguments hold --pack-tiles directory [file]; false otherwise
+	static bool					run(const QStringList& args, int* exitCode);
+
+	static const char*			mimeType(Type type);
+
+private:
+	static bool					writeEntries(const QString& fileName, QList<TSTileEntry>& entries);
+
+	QFile						m_file;
+	const uchar					*m_data;		// whole file, mapped
+	qint64						m_size;
+	int							m_count;
+	QStringList					m_hosts;		// suffixes of the hosts serving tiles
+	QString						m_fileName;
+	QString						m_group;
+	QString						m_defaultHosts;
+};
+
+// Tile handed to TSTileStore::write()
+struct TSStoredTile
+{
+	QString						layer;
+	int							zoom;
+	int							x;
+	int							y;
+	TSTileStore::Type			type;
+	QByteArray					data;
+};
+
+// Reply of the network access manager for a tile of the store, read straight
+// from the mapped file. Finishes from the event loop like a network reply; any
+// page may read it, whatever its origin.
+class TSWEBAPP_EXPORTS TSTileReply : public QNetworkReply
+{
+	Q_OBJECT
+
+public:
+	TSTileReply(const QNetworkRequest& request, const uchar* data, qint64 size, TSTileStore::Type type, QObject *parent = 0);
+
+	virtual void				abort();
+	virtual qint64				bytesAvailable() const;
+	virtual bool				isSequential() const { return true; }
+
+protected:
+	virtual qint64				readData(char *data, qint64 maxSize);
+
+private slots:
+	void						deliver();
+
+private:
+	const uchar					*m_data;
+	qint64						m_size;
+	qint64						m_pos;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSTILESTORE_H
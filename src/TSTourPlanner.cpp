@@ -0,0 +1,406 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSTourPlanner.cpp
+// Author : Zhan
+//
+
+#include "TSTourPlanner.h"
+#include "TSRouteEngine.h"
+#include "TSRouteSearch.h"
+
+#include <QtCore/QSettings>
+#include <QtCore/QtConcurrentMap>
+
+const float TSTourPlanner::UNREACHABLE = 1e7f;
+
+#define MIN_GAIN			0.001f			// seconds, smaller changes are rounding
+
+// Cost of a move on a tour of the matrix, both ways may differ
+struct TSTourCost
+{
+	const float					*cost;
+	int							n;
+
+	float operator()(int a, int b) const { return cost[a * n + b]; }
+};
+
+// Park-Miller generator, one per restart as rand() is shared between threads
+struct TSTourRandom
+{
+	quint32						state;
+
+	int next(int bound)
+	{
+		state = (quint32)(((quint64)state * 48271) % 2147483647);
+		return (int)(state % (quint32)bound);
+	}
+};
+
+/*!
+  \brief First tour by insertion.
+
+  Without a generator, the stop closest to the tour is inserted next (nearest
+  insertion); with one, stops are inserted in random order. Either way a stop
+  goes where it lengthens the tour the least.
+*/
+static QVector<int> insertionTour(const TSTourCost& c, TSTourRandom* random)
+{
+	const int n = c.n;
+	QVector<int> tour;
+	tour.append(0);
+
+	QVector<int> pending;
+	QVector<float> toTour(n, 0);
+	for( int k = 1; k < n; k++ )
+	{
+		pending.append(k);
+		toTour[k] = qMin(c(0, k), c(k, 0));
+	}
+
+	while( !pending.isEmpty() )
+	{
+		int pick = 0;
+		if( random )
+			pick = random->next(pending.count());
+		else
+		{
+			for( int i = 1; i < pending.count(); i++ )
+			{
+				if( toTour[pending[i]] < toTour[pending[pick]] )
+					pick = i;
+			}
+		}
+		int k = pending[pick];
+		pending.remove(pick);
+
+		int bestPos = 1;
+		float bestAdd = TSTourPlanner::UNREACHABLE * 4;
+		for( int i = 0; i < tour.count(); i++ )
+		{
+			int a = tour[i], b = tour[(i + 1) % tour.count()];
+			float add = c(a, k) + c(k, b) - c(a, b);
+			if( add < bestAdd )
+			{
+				bestAdd = add;
+				bestPos = i + 1;
+			}
+		}
+		tour.insert(bestPos, k);
+
+		for( int i = 0; i < pending.count(); i++ )
+			toTour[pending[i]] = qMin(toTour[pending[i]], qMin(c(k, pending[i]), c(pending[i], k)));
+	}
+	return tour;
+}
+
+/*!
+  \brief Reverse one stretch of the tour if it shortens it.
+
+  Prefix sums of the tour walked forward and backward give the cost of the
+  reversed stretch at once. The first stop never moves.
+*/
+static bool twoOpt(const TSTourCost& c, QVector<int>& t)
+{
+	const int n = t.count();
+	QVector<double> forward(n, 0), backward(n, 0);
+	for( int k = 1; k < n; k++ )
+	{
+		forward[k] = forward[k - 1] + c(t[k - 1], t[k]);
+		backward[k] = backward[k - 1] + c(t[k], t[k - 1]);
+	}
+
+	for( int i = 0; i < n - 2; i++ )
+	{
+		int a = t[i], first = t[i + 1];
+		for( int j = i + 2; j < n; j++ )
+		{
+			int last = t[j], b = t[(j + 1) % n];
+			double before = c(a, first) + (forward[j] - forward[i + 1]) + c(last, b);
+			double after = c(a, last) + (backward[j] - backward[i + 1]) + c(first, b);
+			if( after < before - MIN_GAIN )
+			{
+				for( int l = i + 1, r = j; l < r; l++, r-- )
+					qSwap(t[l], t[r]);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Move a stretch of one to three stops elsewhere, in the same direction
+static bool orOpt(const TSTourCost& c, QVector<int>& t)
+{
+	const int n = t.count();
+	for( int len = 1; len <= 3 && len < n - 1; len++ )
+	{
+		for( int i = 1; i + len <= n; i++ )
+		{
+			int first = t[i], last = t[i + len - 1];
+			int prev = t[i - 1], next = t[(i + len) % n];
+			float gain = c(prev, first) + c(last, next) - c(prev, next);
+			if( gain <= MIN_GAIN )
+				continue;
+
+			for( int k = 0; k < n; k++ )
+			{
+				if( k >= i - 1 && k < i + len )
+					continue;
+				int p = t[k], q = t[(k + 1) % n];
+				if( c(p, first) + c(last, q) - c(p, q) < gain - MIN_GAIN )
+				{
+					QVector<int> moved = t.mid(i, len);
+					t.remove(i, len);
+					int at = (k < i ? k : k - len) + 1;
+					for( int m = 0; m < len; m++ )
+						t.insert(at + m, moved[m]);
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+// One restart, run by QtConcurrent on every restart
+struct TSTourJob
+{
+	typedef void result_type;
+
+	TSTourCost					cost;
+	QVector<int>				*results;
+
+	void operator()(const int& restart) const
+	{
+		TSTourRandom random;
+		random.state = (quint32)(restart * 7919 + 1);
+		QVector<int> t = insertionTour(cost, restart == 0 ? 0 : &random);
+		while( twoOpt(cost, t) || orOpt(cost, t) )
+			;
+		results[restart] = t;
+	}
+};
+
+// Leg of the tour, run by QtConcurrent on every leg
+struct TSTourLegJob
+{
+	typedef void result_type;
+
+	const TSRouteEngine			*engine;
+	const QList<int>			*stops;
+	TSRoute						*legs;
+
+	void operator()(const int& i) const
+	{
+		int next = (i + 1) % stops->count();
+		legs[i] = engine->route((*stops)[i], (*stops)[next]);
+	}
+};
+
+// Row of the matrix when the route table misses a stop or paths are closed
+struct TSTourRowJob
+{
+	typedef void result_type;
+
+	const TSRouteGraph			*graph;
+	const QVector<quint32>		*nodes;
+	QVector<float>				weights;		// default profile with the closures
+	float						*seconds;
+	float						*meters;
+
+	void operator()(const int& i) const
+	{
+		const int n = nodes->count();
+		TSRouteSearch search(graph);
+		search.setWeights(weights);
+		search.run((*nodes)[i], *nodes);
+		for( int j = 0; j < n; j++ )
+		{
+			quint32 node = (*nodes)[j];
+			seconds[i * n + j] = search.reached(node) ? search.seconds(node) : TSTourPlanner::UNREACHABLE;
+			meters[i * n + j] = search.reached(node) ? search.meters(node) : TSTourPlanner::UNREACHABLE;
+		}
+	}
+};
+
+TSTourPlanner::TSTourPlanner(const TSRouteEngine* engine)
+: m_engine(engine)
+, m_restarts(8)
+, m_maxStops(50)
+{
+	loadSettings();
+}
+
+void TSTourPlanner::loadSettings()
+{
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	settings.beginGroup(QLatin1String("tour"));
+	m_restarts = qMax(1, settings.value(QLatin1String("Restarts"), 8).toInt());
+	m_maxStops = qMax(2, settings.value(QLatin1String("MaxStops"), 50).toInt());
+	settings.endGroup();
+}
+
+float TSTourPlanner::length(const QVector<float>& cost, int n, const QVector<int>& order)
+{
+	float total = 0;
+	for( int i = 0; i < order.count(); i++ )
+		total += cost[order[i] * n + order[(i + 1) % order.count()]];
+	return total;
+}
+
+QVector<int> TSTourPlanner::solve(const QVector<float>& cost, int n, int restarts)
+{
+	if( n <= 3 )
+	{
+		QVector<int> order;
+		for( int i = 0; i < n; i++ )
+			order.append(i);
+		if( n == 3 && length(cost, n, order) > cost[0 * n + 2] + cost[2 * n + 1] + cost[1 * n + 0] )
+			qSwap(order[1], order[2]);
+		return order;
+	}
+
+	QVector< QVector<int> > results(qMax(1, restarts));
+	QList<int> indexes;
+	for( int r = 0; r < results.count(); r++ )
+		indexes.append(r);
+
+	TSTourJob job;
+	job.cost.cost = cost.constData();
+	job.cost.n = n;
+	job.results = results.data();
+	QtConcurrent::blockingMap(indexes, job);
+
+	int best = 0;
+	for( int r = 1; r < results.count(); r++ )
+	{
+		if( length(cost, n, results[r]) < length(cost, n, results[best]) )
+			best = r;
+	}
+	return results[best];
+}
+
+/*!
+  \brief Walking times and distances between every pair of stops.
+
+  \return false when a stop is outside the graph
+*/
+bool TSTourPlanner::matrix(const QList<int>& poiIds, QVector<float>* seconds, QVector<float>* meters) const
+{
+	const int n = poiIds.count();
+	seconds->fill(0, n * n);
+	meters->fill(0, n * n);
+
+	QVector<quint32> nodes;
+	bool inTable = true;
+	for( int i = 0; i < n; i++ )
+	{
+		quint32 node = m_engine->poiNode(poiIds[i]);
+		if( node == TS_INVALID )
+			return false;
+		nodes.append(node);
+		inTable = inTable && m_engine->table().contains(poiIds[i]);
+	}
+
+	if( inTable && !m_engine->hasClosures() )
+	{
+		for( int i = 0; i < n; i++ )
+		{
+			for( int j = 0; j < n; j++ )
+			{
+				if( i == j )
+					continue;
+				const TSRouteTable::Cell* cell = m_engine->table().lookup(poiIds[i], poiIds[j]);
+				(*seconds)[i * n + j] = cell->meters < 0 ? UNREACHABLE : cell->seconds;
+				(*meters)[i * n + j] = cell->meters < 0 ? UNREACHABLE : cell->meters;
+			}
+		}
+		return true;
+	}
+
+	QList<int> rows;
+	for( int i = 0; i < n; i++ )
+		rows.append(i);
+
+	TSTourRowJob job;
+	job.graph = &m_engine->graph();
+	job.nodes = &nodes;
+	job.weights = m_engine->weights(TSRouteProfile::DEFAULT);
+	job.seconds = seconds->data();
+	job.meters = meters->data();
+	QtConcurrent::blockingMap(rows, job);
+	return true;
+}
+
+/*!
+  \brief Shortest walk through the stops, starting at the first one.
+
+  A one way tour is solved as a round trip through an extra stop that costs
+  nothing to reach and only leads back to the first stop, so it always comes
+  last and is then dropped.
+*/
+TSTour TSTourPlanner::plan(const QList<int>& poiIds, bool roundTrip) const
+{
+	TSTour tour;
+	tour.roundTrip = roundTrip;
+	tour.seconds = 0;
+	tour.meters = 0;
+
+	QList<int> stops;
+	for( int i = 0; i < poiIds.count(); i++ )
+	{
+		if( !stops.contains(poiIds[i]) )
+			stops.append(poiIds[i]);
+	}
+	if( stops.count() < 2 || stops.count() > m_maxStops )
+		return tour;
+
+	QVector<float> seconds, meters;
+	if( !matrix(stops, &seconds, &meters) )
+		return tour;
+
+	const int n = stops.count();
+	int m = n;
+	QVector<float> cost = seconds;
+	if( !roundTrip )
+	{
+		m = n + 1;
+		cost.fill(0, m * m);
+		for( int i = 0; i < n; i++ )
+		{
+			for( int j = 0; j < n; j++ )
+				cost[i * m + j] = seconds[i * n + j];
+			cost[n * m + i] = i == 0 ? 0 : UNREACHABLE;
+		}
+	}
+
+	QVector<int> order = solve(cost, m, m_restarts);
+	if( length(cost, m, order) >= UNREACHABLE )
+		return tour;
+	if( !roundTrip )
+		order.remove(order.indexOf(n));
+
+	for( int i = 0; i < order.count(); i++ )
+		tour.stops.append(stops[order[i]]);
+
+	int legCount = roundTrip ? n : n - 1;
+	QVector<TSRoute> legs(legCount);
+	QList<int> indexes;
+	for( int i = 0; i < legCount; i++ )
+	{
+		indexes.append(i);
+		tour.seconds += seconds[order[i] * n + order[(i + 1) % n]];
+		tour.meters += meters[order[i] * n + order[(i + 1) % n]];
+	}
+
+	TSTourLegJob job;
+	job.engine = m_engine;
+	job.stops = &tour.stops;
+	job.legs = legs.data();
+	QtConcurrent::blockingMap(indexes, job);
+	for( int i = 0; i < legs.count(); i++ )
+		tour.legs.append(legs[i]);
+	return tour;
+}
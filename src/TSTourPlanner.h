@@ -0,0 +1,74 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSTourPlanner.h
+// Author : Zhan
+//
+#ifndef TSTOURPLANNER_H
+#define TSTOURPLANNER_H
+
+#include "TSWebApp.h"
+#include "TSManeuver.h"
+
+#include <QList>
+#include <QVector>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class TSRouteEngine;
+
+// A walk through several buildings
+struct TSTour
+{
+	QList<int>					stops;			// poi ids in visiting order, starting with the first one asked
+	bool						roundTrip;		// the last leg goes back to the first stop
+	float						seconds;
+	float						meters;
+	QList<TSRoute>				legs;			// stop to stop, one less than the stops unless round trip
+
+	bool						isEmpty() const { return stops.isEmpty(); }
+};
+
+// Visiting order of a few buildings.
+//
+// The walking times between the stops come from the route table when it holds
+// them all, otherwise from one search per stop. The order is built by nearest
+// insertion, then improved by 2-opt and Or-opt moves until none shortens the
+// walk. Further restarts build the first order by random insertion instead;
+// they run in parallel and the shortest tour wins. Times may differ each way,
+// stairs being slower up than down, so every move is costed in both directions.
+//
+// Configured by the [tour] group of app_config.ini.
+class TSWEBAPP_EXPORTS TSTourPlanner
+{
+public:
+	explicit TSTourPlanner(const TSRouteEngine* engine);
+
+	void						loadSettings();
+	void						setRestarts(int restarts) { m_restarts = restarts; }
+
+	// Empty when a stop is outside the graph or cannot be walked to
+	TSTour						plan(const QList<int>& poiIds, bool roundTrip = true) const;
+
+	// Order of the n nodes of a row-major cost matrix, closed back to node 0 which comes first
+	static QVector<int>			solve(const QVector<float>& cost, int n, int restarts);
+	static float				length(const QVector<float>& cost, int n, const QVector<int>& order);
+
+	static const float			UNREACHABLE;
+
+private:
+	bool						matrix(const QList<int>& poiIds, QVector<float>* seconds, QVector<float>* meters) const;
+
+	const TSRouteEngine			*m_engine;
+	int							m_restarts;
+	int							m_maxStops;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSTOURPLANNER_H
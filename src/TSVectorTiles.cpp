@@ -0,0 +1,635 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSVectorTiles.cpp
+// Author : Zhan
+//
+
+#include "TSVectorTiles.h"
+#include "TSRouteEngine.h"
+#include "TSTileStore.h"
+
+#include "QsLog.h"
+
+#include <QtCore/QSettings>
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QPoint>
+#include <QtCore/QTime>
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QtConcurrentMap>
+
+#include <math.h>
+#include <stdio.h>
+
+#define DEG_TO_RAD			0.017453292519943295
+#define PI					3.14159265358979
+#define TILE_VERSION		1
+#define TILE_LAYER			"v"
+#define WAY_FLAGS			(TSRouteGraph::EDGE_STEPS | TSRouteGraph::EDGE_COVERED | TSRouteGraph::EDGE_INDOOR)
+#define MIN_BUILDING_PIXELS	4			// side of the smallest building drawn below the detail zoom
+
+// One tile, cut by QtConcurrent on the thread pool
+struct TSVectorTileJob
+{
+	typedef QByteArray result_type;
+
+	const TSVectorTileBuilder	*builder;
+
+	QByteArray operator()(const TSTileCoord& tile) const
+	{
+		return builder->tile(tile.zoom, tile.x, tile.y);
+	}
+};
+
+static QPointF mercator(const QPointF& lngLat)
+{
+	double phi = qBound(-85.05, lngLat.y(), 85.05) * DEG_TO_RAD;
+	return QPointF((lngLat.x() + 180.0) / 360.0, (1.0 - log(tan(phi) + 1.0 / cos(phi)) / PI) / 2.0);
+}
+
+// Touching counts, unlike QRectF::intersects() which misses lines along an axis
+static bool overlaps(const QRectF& a, const QRectF& b)
+{
+	return a.left() <= b.right() && b.left() <= a.right() && a.top() <= b.bottom() && b.top() <= a.bottom();
+}
+
+static void appendVarint(QByteArray* out, quint32 value)
+{
+	while( value >= 0x80 )
+	{
+		out->append((char)(0x80 | (value & 0x7f)));
+		value >>= 7;
+	}
+	out->append((char)value);
+}
+
+static quint32 zigzag(int value)
+{
+	return value < 0 ? ~((quint32)value << 1) : ((quint32)value << 1);
+}
+
+/*!
+  \brief Parts of a line inside the square lo..hi, by Liang-Barsky on each segment.
+
+  A part ends where the line leaves the square and a new one starts where it
+  comes back in.
+*/
+static void clipLine(const QVector<QPointF>& points, double lo, double hi, QList< QVector<QPointF> >* parts)
+{
+	QVector<QPointF> part;
+	for( int i = 0; i + 1 < points.count(); i++ )
+	{
+		const QPointF& a = points[i];
+		QPointF d = points[i + 1] - a;
+		double p[4] = { -d.x(), d.x(), -d.y(), d.y() };
+		double q[4] = { a.x() - lo, hi - a.x(), a.y() - lo, hi - a.y() };
+		double t0 = 0, t1 = 1;
+		bool visible = true;
+		for( int k = 0; k < 4 && visible; k++ )
+		{
+			if( p[k] == 0 )
+			{
+				if( q[k] < 0 )
+					visible = false;		// parallel to the edge and outside
+				continue;
+			}
+			double r = q[k] / p[k];
+			if( p[k] < 0 )
+			{
+				if( r > t1 )
+					visible = false;
+				else if( r > t0 )
+					t0 = r;
+			}
+			else
+			{
+				if( r < t0 )
+					visible = false;
+				else if( r < t1 )
+					t1 = r;
+			}
+		}
+
+		if( !visible || t0 > 0 )
+		{
+			if( part.count() >= 2 )
+				parts->append(part);
+			part.clear();
+			if( !visible )
+				continue;
+		}
+		if( part.isEmpty() )
+			part.append(a + d * t0);
+		part.append(a + d * t1);
+	}
+	if( part.count() >= 2 )
+		parts->append(part);
+}
+
+// Ring clipped to one side of the square by Sutherland-Hodgman: side 0 left, 1 right, 2 top, 3 bottom
+static QVector<QPointF> clipRingSide(const QVector<QPointF>& ring, int side, double bound)
+{
+	QVector<QPointF> result;
+	for( int i = 0; i < ring.count(); i++ )
+	{
+		const QPointF& a = ring[i];
+		const QPointF& b = ring[(i + 1) % ring.count()];
+		double va = side < 2 ? a.x() : a.y();
+		double vb = side < 2 ? b.x() : b.y();
+		bool insideA = (side % 2 == 0) ? va >= bound : va <= bound;
+		bool insideB = (side % 2 == 0) ? vb >= bound : vb <= bound;
+		if( insideA )
+			result.append(a);
+		if( insideA != insideB )
+			result.append(a + (b - a) * ((bound - va) / (vb - va)));
+	}
+	return result;
+}
+
+static QVector<QPointF> clipRing(const QVector<QPointF>& ring, double lo, double hi)
+{
+	QVector<QPointF> result = clipRingSide(ring, 0, lo);
+	result = clipRingSide(result, 1, hi);
+	result = clipRingSide(result, 2, lo);
+	return clipRingSide(result, 3, hi);
+}
+
+// Rounded to whole tile coordinates, repeated points dropped
+static QVector<QPoint> quantized(const QVector<QPointF>& points)
+{
+	QVector<QPoint> result;
+	result.reserve(points.count());
+	for( int i = 0; i < points.count(); i++ )
+	{
+		QPoint p(qRound(points[i].x()), qRound(points[i].y()));
+		if( result.isEmpty() || result.last() != p )
+			result.append(p);
+	}
+	return result;
+}
+
+static double segmentDistance(const QPoint& p, const QPoint& a, const QPoint& b)
+{
+	double bx = b.x() - a.x(), by = b.y() - a.y();
+	double px = p.x() - a.x(), py = p.y() - a.y();
+	double length2 = bx * bx + by * by;
+	double t = length2 > 0 ? qBound(0.0, (px * bx + py * by) / length2, 1.0) : 0;
+	double dx = px - t * bx, dy = py - t * by;
+	return sqrt(dx * dx + dy * dy);
+}
+
+// Douglas-Peucker in tile coordinates
+static QVector<QPoint> simplified(const QVector<QPoint>& points, double tolerance)
+{
+	const int n = points.count();
+	if( n < 3 )
+		return points;
+
+	QVector<bool> keep(n, false);
+	keep[0] = keep[n - 1] = true;
+	QVector< QPair<int, int> > stack;
+	stack.append(qMakePair(0, n - 1));
+	while( !stack.isEmpty() )
+	{
+		QPair<int, int> span = stack.last();
+		stack.pop_back();
+
+		int farthest = -1;
+		double distance = tolerance;
+		for( int i = span.first + 1; i < span.second; i++ )
+		{
+			double d = segmentDistance(points[i], points[span.first], points[span.second]);
+			if( d > distance )
+			{
+				distance = d;
+				farthest = i;
+			}
+		}
+		if( farthest < 0 )
+			continue;
+		keep[farthest] = true;
+		stack.append(qMakePair(span.first, farthest));
+		stack.append(qMakePair(farthest, span.second));
+	}
+
+	QVector<QPoint> result;
+	for( int i = 0; i < n; i++ )
+	{
+		if( keep[i] )
+			result.append(points[i]);
+	}
+	return result;
+}
+
+static double ringArea(const QVector<QPoint>& ring)
+{
+	double area = 0;
+	for( int i = 0; i < ring.count(); i++ )
+	{
+		const QPoint& a = ring[i];
+		const QPoint& b = ring[(i + 1) % ring.count()];
+		area += (double)a.x() * b.y() - (double)b.x() * a.y();
+	}
+	return fabs(area) / 2;
+}
+
+static void appendFeature(QByteArray* out, int kind, int flags, int name, const QVector<QPoint>& points)
+{
+	out->append((char)kind);
+	appendVarint(out, flags);
+	appendVarint(out, name + 1);
+	appendVarint(out, points.count());
+	QPoint last(0, 0);
+	for( int i = 0; i < points.count(); i++ )
+	{
+		appendVarint(out, zigzag(points[i].x() - last.x()));
+		appendVarint(out, zigzag(points[i].y() - last.y()));
+		last = points[i];
+	}
+}
+
+TSVectorTileBuilder::TSVectorTileBuilder()
+: m_cellZoom(16)
+, m_minZoom(14)
+, m_maxZoom(18)
+, m_detailZoom(16)
+, m_extent(4096)
+, m_tolerancePixels(0.5)
+, m_bufferPixels(8)
+{
+	loadSettings();
+}
+
+void TSVectorTileBuilder::loadSettings()
+{
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	settings.beginGroup(QLatin1String("vectortiles"));
+	m_fileName = settings.value(QLatin1String("File"), QLatin1String("tiles/campus.vectortiles")).toString();
+	m_minZoom = qBound(0, settings.value(QLatin1String("MinZoom"), 14).toInt(), 22);
+	m_maxZoom = qBound(m_minZoom, settings.value(QLatin1String("MaxZoom"), 18).toInt(), 22);
+	m_detailZoom = settings.value(QLatin1String("DetailZoom"), 16).toInt();
+	m_extent = qBound(256, settings.value(QLatin1String("Extent"), 4096).toInt(), 1 << 16);
+	m_tolerancePixels = qMax(0.0, settings.value(QLatin1String("TolerancePixels"), 0.5).toDouble());
+	m_bufferPixels = qBound(0.0, settings.value(QLatin1String("BufferPixels"), 8).toDouble(), 128.0);
+	settings.endGroup();
+}
+
+void TSVectorTileBuilder::addFeature(int kind, int flags, const QString& name, const QVector<QPointF>& lngLat)
+{
+	Feature feature;
+	feature.kind = kind;
+	feature.flags = flags;
+	feature.name = -1;
+	if( !name.isEmpty() )
+	{
+		feature.name = m_names.indexOf(name);
+		if( feature.name < 0 )
+		{
+			feature.name = m_names.count();
+			m_names.append(name);
+		}
+	}
+
+	double left = 1, top = 1, right = 0, bottom = 0;
+	feature.points.reserve(lngLat.count());
+	for( int i = 0; i < lngLat.count(); i++ )
+	{
+		QPointF p = mercator(lngLat[i]);
+		feature.points.append(p);
+		left = qMin(left, p.x());
+		right = qMax(right, p.x());
+		top = qMin(top, p.y());
+		bottom = qMax(bottom, p.y());
+	}
+	feature.bounds = QRectF(QPointF(left, top), QPointF(right, bottom));
+
+	if( m_features.isEmpty() )
+		m_bounds = feature.bounds;
+	else
+		m_bounds = QRectF(QPointF(qMin(m_bounds.left(), left), qMin(m_bounds.top(), top)),
+						  QPointF(qMax(m_bounds.right(), right), qMax(m_bounds.bottom(), bottom)));
+	m_features.append(feature);
+}
+
+/*!
+  \brief Buildings, then the ways of the graph, then the building labels.
+
+  Every street is kept once: each edge and its twin are taken together, and a
+  way grows from an edge in both directions for as long as it goes through
+  nodes with exactly two neighbours and the next edge has the same name and
+  the same steps, covered and indoor flags.
+*/
+void TSVectorTileBuilder::setSource(const TSRouteGraph& graph, const TSPoiCatalog& catalog)
+{
+	m_features.clear();
+	m_names.clear();
+	m_bounds = QRectF();
+	m_cells.clear();
+	m_cellFeatures.clear();
+
+	const QList<TSPoi>& pois = catalog.pois();
+	for( int i = 0; i < pois.count(); i++ )
+	{
+		if( pois[i].footprint.count() >= 3 )
+			addFeature(Building, 0, pois[i].name, pois[i].footprint);
+	}
+
+	const int edges = graph.edgeCount();
+	QVector<bool> used(edges, false);
+	for( int e = 0; e < edges; e++ )
+	{
+		if( used[e] )
+			continue;
+		const TSRouteGraph::Edge& first = graph.edge(e);
+		used[e] = used[first.reverse] = true;
+
+		// Forward from the target of the edge, then backward from its source
+		QVector<quint32> ahead, behind;
+		for( int pass = 0; pass < 2; pass++ )
+		{
+			QVector<quint32>& nodes = pass == 0 ? ahead : behind;
+			quint32 current = pass == 0 ? (quint32)e : first.reverse;
+			quint32 node = graph.edge(current).target;
+			while( graph.lastEdge(node) - graph.firstEdge(node) == 2 )
+			{
+				quint32 next = graph.firstEdge(node);
+				if( next == graph.edge(current).reverse )
+					next++;
+				const TSRouteGraph::Edge& edge = graph.edge(next);
+				if( used[next] || edge.name != first.name || (edge.flags & WAY_FLAGS) != (first.flags & WAY_FLAGS) )
+					break;
+				used[next] = used[edge.reverse] = true;
+				nodes.append(edge.target);
+				current = next;
+				node = edge.target;
+			}
+		}
+
+		QVector<QPointF> line;
+		line.reserve(behind.count() + ahead.count() + 2);
+		for( int i = behind.count() - 1; i >= 0; i-- )
+			line.append(QPointF(graph.lng(behind[i]), graph.lat(behind[i])));
+		quint32 source = graph.edgeSource(e);
+		line.append(QPointF(graph.lng(source), graph.lat(source)));
+		line.append(QPointF(graph.lng(first.target), graph.lat(first.target)));
+		for( int i = 0; i < ahead.count(); i++ )
+			line.append(QPointF(graph.lng(ahead[i]), graph.lat(ahead[i])));
+		addFeature(Way, first.flags & WAY_FLAGS, graph.edgeName(e), line);
+	}
+
+	for( int i = 0; i < pois.count(); i++ )
+		addFeature(Label, 0, pois[i].name, QVector<QPointF>() << QPointF(pois[i].lng, pois[i].lat));
+	index();
+
+	QLOG_INFO() << QString("Vector tiles: %1 features with %2 names in %3 cells.").arg(m_features.count()).arg(m_names.count()).arg(m_cells.count());
+}
+
+/*!
+  \brief List the features by the cells their bounds overlap.
+
+  Cells are the tiles of the detail zoom, or of the highest zoom if lower: a
+  tile then looks at a handful of cells at most, while a way or a building
+  only spans a few of them.
+*/
+void TSVectorTileBuilder::index()
+{
+	m_cellZoom = qBound(m_minZoom, m_detailZoom, m_maxZoom);
+	const int n = 1 << m_cellZoom;
+
+	QVector< QPair<quint64, int> > entries;
+	for( int f = 0; f < m_features.count(); f++ )
+	{
+		const QRectF& b = m_features[f].bounds;
+		int col0 = qBound(0, (int)floor(b.left() * n), n - 1), col1 = qBound(0, (int)floor(b.right() * n), n - 1);
+		int row0 = qBound(0, (int)floor(b.top() * n), n - 1), row1 = qBound(0, (int)floor(b.bottom() * n), n - 1);
+		for( int row = row0; row <= row1; row++ )
+		{
+			for( int col = col0; col <= col1; col++ )
+				entries.append(qMakePair(cellKey(row, col), f));
+		}
+	}
+	qSort(entries);
+
+	m_cellFeatures.resize(entries.count());
+	for( int i = 0; i < entries.count(); i++ )
+	{
+		m_cellFeatures[i] = entries[i].second;
+		if( i == 0 || entries[i].first != entries[i - 1].first )
+			m_cells.insert(entries[i].first, qMakePair(i, 0));
+		m_cells[entries[i].first].second++;
+	}
+}
+
+QList<TSTileCoord> TSVectorTileBuilder::coverage() const
+{
+	QList<TSTileCoord> tiles;
+	if( m_features.isEmpty() )
+		return tiles;
+
+	for( int zoom = m_minZoom; zoom <= m_maxZoom; zoom++ )
+	{
+		const int n = 1 << zoom;
+		int x0 = qBound(0, (int)floor(m_bounds.left() * n), n - 1);
+		int x1 = qBound(0, (int)floor(m_bounds.right() * n), n - 1);
+		int y0 = qBound(0, (int)floor(m_bounds.top() * n), n - 1);
+		int y1 = qBound(0, (int)floor(m_bounds.bottom() * n), n - 1);
+		for( int x = x0; x <= x1; x++ )
+		{
+			for( int y = y0; y <= y1; y++ )
+			{
+				TSTileCoord tile = { zoom, x, y };
+				tiles.append(tile);
+			}
+		}
+	}
+	return tiles;
+}
+
+/*!
+  \brief Features of one tile, clipped, rounded and simplified.
+
+  Lines and rings are clipped to the tile and a buffer around it, so strokes
+  and fills join seamlessly with the neighbouring tiles, then rounded to the
+  extent and simplified with the configured tolerance in pixels. Only the
+  names used by the tile are written with it.
+*/
+QByteArray TSVectorTileBuilder::tile(int zoom, int x, int y) const
+{
+	const double n = (double)(1 << zoom);
+	const double scale = m_extent * n;						// Web Mercator to tile coordinates
+	const double buffer = m_bufferPixels * m_extent / 256;
+	const double tolerance = m_tolerancePixels * m_extent / 256;
+	const double minArea = pow(MIN_BUILDING_PIXELS * m_extent / 256.0, 2);
+	const bool detail = zoom >= m_detailZoom;
+	QRectF area(QPointF((x - buffer / m_extent) / n, (y - buffer / m_extent) / n),
+				QPointF((x + 1 + buffer / m_extent) / n, (y + 1 + buffer / m_extent) / n));
+
+	// Features of the cells under the tile and its buffer, once each and in drawing order
+	const int cells = 1 << m_cellZoom;
+	int col0 = qBound(0, (int)floor(area.left() * cells), cells - 1), col1 = qBound(0, (int)floor(area.right() * cells), cells - 1);
+	int row0 = qBound(0, (int)floor(area.top() * cells), cells - 1), row1 = qBound(0, (int)floor(area.bottom() * cells), cells - 1);
+	QVector<int> candidates;
+	for( int row = row0; row <= row1; row++ )
+	{
+		for( int col = col0; col <= col1; col++ )
+		{
+			QHash<quint64, QPair<int, int> >::const_iterator it = m_cells.find(cellKey(row, col));
+			if( it == m_cells.end() )
+				continue;
+			for( int i = it.value().first; i < it.value().first + it.value().second; i++ )
+				candidates.append(m_cellFeatures[i]);
+		}
+	}
+	qSort(candidates);
+
+	QHash<int, int> localNames;		// index into m_names -> index in the tile
+	QStringList names;
+	QByteArray features;
+	int count = 0;
+	for( int c = 0; c < candidates.count(); c++ )
+	{
+		if( c > 0 && candidates[c] == candidates[c - 1] )
+			continue;
+		const Feature& feature = m_features[candidates[c]];
+		if( !overlaps(feature.bounds, area) )
+			continue;
+		if( !detail && (feature.kind == Label || (feature.kind == Way && (feature.name < 0 || (feature.flags & TSRouteGraph::EDGE_INDOOR)))) )
+			continue;
+
+		QVector<QPointF> points(feature.points.count());
+		for( int i = 0; i < points.count(); i++ )
+			points[i] = QPointF(feature.points[i].x() * scale - x * m_extent, feature.points[i].y() * scale - y * m_extent);
+
+		QList< QVector<QPoint> > parts;
+		if( feature.kind == Way )
+		{
+			QList< QVector<QPointF> > clipped;
+			clipLine(points, -buffer, m_extent + buffer, &clipped);
+			for( int i = 0; i < clipped.count(); i++ )
+			{
+				QVector<QPoint> part = simplified(quantized(clipped[i]), tolerance);
+				if( part.count() >= 2 )
+					parts.append(part);
+			}
+		}
+		else if( feature.kind == Building )
+		{
+			QVector<QPoint> ring = quantized(clipRing(points, -buffer, m_extent + buffer));
+			if( ring.count() > 1 && ring.first() == ring.last() )
+				ring.pop_back();
+			if( ring.count() >= 3 )
+			{
+				ring.append(ring.first());		// simplified as a line back to its start
+				ring = simplified(ring, tolerance);
+				ring.pop_back();
+			}
+			if( ring.count() >= 3 && (detail || ringArea(ring) >= minArea) )
+				parts.append(ring);
+		}
+		else
+		{
+			const QPointF& p = points[0];
+			if( p.x() >= 0 && p.x() < m_extent && p.y() >= 0 && p.y() < m_extent )
+				parts.append(QVector<QPoint>() << QPoint((int)p.x(), (int)p.y()));
+		}
+		if( parts.isEmpty() )
+			continue;
+
+		int name = -1;
+		if( feature.name >= 0 )
+		{
+			if( !localNames.contains(feature.name) )
+			{
+				localNames.insert(feature.name, names.count());
+				names.append(m_names[feature.name]);
+			}
+			name = localNames.value(feature.name);
+		}
+		for( int i = 0; i < parts.count(); i++ )
+			appendFeature(&features, feature.kind, feature.flags, name, parts[i]);
+		count += parts.count();
+	}
+	if( count == 0 )
+		return QByteArray();
+
+	QByteArray data;
+	data.append((char)TILE_VERSION);
+	appendVarint(&data, m_extent);
+	appendVarint(&data, names.count());
+	for( int i = 0; i < names.count(); i++ )
+	{
+		QByteArray utf8 = names[i].toUtf8();
+		appendVarint(&data, utf8.size());
+		data.append(utf8);
+	}
+	appendVarint(&data, count);
+	data.append(features);
+	return data;
+}
+
+int TSVectorTileBuilder::build(const QString& fileName) const
+{
+	QList<TSTileCoord> tiles = coverage();
+	TSVectorTileJob job;
+	job.builder = this;
+	QList<QByteArray> data = QtConcurrent::blockingMapped(tiles, job);
+
+	QList<TSStoredTile> stored;
+	qint64 bytes = 0;
+	for( int i = 0; i < tiles.count(); i++ )
+	{
+		if( data[i].isEmpty() )
+			continue;
+		TSStoredTile tile;
+		tile.layer = QLatin1String(TILE_LAYER);
+		tile.zoom = tiles[i].zoom;
+		tile.x = tiles[i].x;
+		tile.y = tiles[i].y;
+		tile.type = TSTileStore::Vector;
+		tile.data = data[i];
+		stored.append(tile);
+		bytes += data[i].size();
+	}
+
+	int count = TSTileStore::write(fileName, stored);
+	if( count >= 0 )
+		QLOG_INFO() << QString("Vector tiles: %1 of %2 tiles hold features, %3 KB written to %4.")
+			.arg(count).arg(tiles.count()).arg(bytes / 1024).arg(fileName);
+	return count;
+}
+
+bool TSVectorTileBuilder::run(const QStringList& args, int* exitCode)
+{
+	int pos = args.indexOf(QLatin1String("--build-vector-tiles"));
+	if( pos < 0 )
+		return false;
+
+	TSVectorTileBuilder builder;
+	QString fileName = pos + 1 < args.count() ? args[pos + 1] : builder.fileName();
+	TSRouteEngine engine;
+	engine.init();
+	if( !engine.isReady() )
+	{
+		fprintf(stderr, "No walking graph to cut into vector tiles\n");
+		*exitCode = 1;
+		return true;
+	}
+
+	QTime timer;
+	timer.start();
+	builder.setSource(engine.graph(), engine.catalog());
+	int count = builder.build(fileName);
+	if( count < 0 )
+	{
+		fprintf(stderr, "Cannot write the vector tiles to %s\n", qPrintable(fileName));
+		*exitCode = 1;
+		return true;
+	}
+	printf("%d vector tiles, zooms %d to %d, written to %s in %d ms\n",
+		   count, builder.minZoom(), builder.maxZoom(), qPrintable(fileName), timer.elapsed());
+	fflush(stdout);
+	*exitCode = 0;
+	return true;
+}
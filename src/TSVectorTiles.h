@@ -0,0 +1,126 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSVectorTiles.h
+// Author : Zhan
+//
+#ifndef TSVECTORTILES_H
+#define TSVECTORTILES_H
+
+#include "TSWebApp.h"
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QList>
+#include <QHash>
+#include <QPair>
+#include <QPointF>
+#include <QRectF>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class TSRouteGraph;
+class TSPoiCatalog;
+
+// Tile of the vector tile pyramid
+struct TSTileCoord
+{
+	int							zoom;
+	int							x;
+	int							y;
+};
+
+// Cuts the walking graph and the building footprints into vector tiles the
+// map page draws itself, so the campus shows without any tile server.
+//
+// The graph is first chained into ways: runs of edges through nodes of degree
+// two that keep the same name and kind. Ways, footprints and building labels
+// are then projected once to Web Mercator. Each tile clips them to its square
+// plus a small buffer, rounds them to the tile extent and simplifies them with
+// a tolerance of a fraction of a pixel; below the detail zoom unnamed and
+// indoor paths, small buildings and labels are left out. The features are
+// listed by the tiles of the detail zoom they overlap, so a tile only looks at
+// those of the cells under it. Tiles are independent and are cut on the thread
+// pool.
+//
+// A tile is a version byte, the extent, its names and its features, drawn in
+// order: kind (1 way, 2 building, 3 label), flags of the way, name + 1 (0 if
+// unnamed), point count, then the points as zigzag deltas from the previous
+// one. All numbers but the version are varints, names are UTF-8.
+//
+// The tiles are written to a TSTileStore file as layer "v", which the network
+// access manager serves to the map page at http://vectortiles.speechnav/v.
+// Configured by the [vectortiles] group of app_config.ini.
+class TSWEBAPP_EXPORTS TSVectorTileBuilder
+{
+public:
+	enum Kind
+	{
+		Way = 1,
+		Building = 2,
+		Label = 3
+	};
+
+	TSVectorTileBuilder();
+
+	void						loadSettings();
+
+	// Ways of the graph and buildings of the catalog, replacing any earlier source
+	void						setSource(const TSRouteGraph& graph, const TSPoiCatalog& catalog);
+	int							featureCount() const { return m_features.count(); }
+
+	// Tiles over the source from the lowest to the highest zoom
+	QList<TSTileCoord>			coverage() const;
+	// Encoded tile, empty if nothing falls in it; thread safe
+	QByteArray					tile(int zoom, int x, int y) const;
+	// Cuts every tile on the thread pool and writes them to a store file, returns how many or -1 on error
+	int							build(const QString& fileName) const;
+
+	int							extent() const { return m_extent; }
+	int							minZoom() const { return m_minZoom; }
+	int							maxZoom() const { return m_maxZoom; }
+	QString						fileName() const { return m_fileName; }
+
+	// Builds the tiles when the arguments hold --build-vector-tiles [file]; false otherwise
+	static bool					run(const QStringList& args, int* exitCode);
+
+private:
+	struct Feature
+	{
+		int						kind;
+		int						flags;
+		int						name;			// index into m_names, -1 if unnamed
+		QVector<QPointF>		points;			// Web Mercator, 0..1 from the top left of the world
+		QRectF					bounds;
+	};
+
+	void						addFeature(int kind, int flags, const QString& name, const QVector<QPointF>& lngLat);
+	void						index();
+	quint64						cellKey(int row, int col) const { return ((quint64)(quint32)row << 32) | (quint32)col; }
+
+	QList<Feature>				m_features;		// in drawing order
+	QStringList					m_names;
+	QRectF						m_bounds;
+	QHash<quint64, QPair<int, int> > m_cells;	// cell -> first position and count in m_cellFeatures
+	QVector<int>				m_cellFeatures;	// in drawing order within a cell
+	int							m_cellZoom;		// cells are the tiles of this zoom
+
+	QString						m_fileName;
+	int							m_minZoom;
+	int							m_maxZoom;
+	int							m_detailZoom;	// first zoom with every feature
+	int							m_extent;		// tile coordinates per side
+	double						m_tolerancePixels;
+	double						m_bufferPixels;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSVECTORTILES_H
@@ -0,0 +1,104 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSVocabulary.cpp
+// Author : Zhan
+//
+
+#include "TSVocabulary.h"
+#include "TSGeocoder.h"
+#include "TSRouteGraph.h"
+
+#include <QtCore/QSettings>
+#include <QtCore/QStringList>
+#include <QtAlgorithms>
+
+TSVocabulary::TSVocabulary(const TSGeocoder* geocoder)
+: m_geocoder(geocoder)
+, m_nearestCount(20)
+, m_refreshMeters(50)
+, m_hasCenter(false)
+, m_centerLat(0)
+, m_centerLng(0)
+{
+	loadSettings();
+}
+
+void TSVocabulary::loadSettings()
+{
+	QSettings settings("app_config.ini", QSettings::IniFormat);
+	settings.beginGroup(QLatin1String("grammar"));
+	m_nearestCount = qMax(1, settings.value(QLatin1String("NearestBuildings"), 20).toInt());
+	m_refreshMeters = settings.value(QLatin1String("RefreshMeters"), 50.0).toDouble();
+
+	m_favourites.clear();
+	QStringList ids = settings.value(QLatin1String("Favourites")).toString().split(QLatin1Char(';'), QString::SkipEmptyParts);
+	for( int i = 0; i < ids.count(); i++ )
+	{
+		bool ok = false;
+		int id = ids[i].trimmed().toInt(&ok);
+		if( ok )
+			m_favourites.append(id);
+	}
+	settings.endGroup();
+}
+
+bool TSVocabulary::update(double lat, double lng)
+{
+	if( m_hasCenter && TSRouteGraph::distance(m_centerLat, m_centerLng, lat, lng) < m_refreshMeters )
+		return false;
+	return select(lat, lng);
+}
+
+void TSVocabulary::reset()
+{
+	m_hasCenter = false;
+	m_active.clear();
+	m_added.clear();
+	m_removed.clear();
+}
+
+/*!
+  \brief Compute the active set at a position and its difference with the previous one.
+
+  Both sets are sorted, so one merge yields the buildings added and removed.
+*/
+bool TSVocabulary::select(double lat, double lng)
+{
+	m_hasCenter = true;
+	m_centerLat = lat;
+	m_centerLng = lng;
+
+	QList<int> ids = m_favourites;
+	QList<TSNearbyPoi> near = m_geocoder->nearby(lat, lng, m_nearestCount);
+	for( int i = 0; i < near.count(); i++ )
+		ids.append(near[i].poiId);
+	qSort(ids);
+
+	// A favourite may also be close
+	QList<int> next;
+	for( int i = 0; i < ids.count(); i++ )
+	{
+		if( next.isEmpty() || next.last() != ids[i] )
+			next.append(ids[i]);
+	}
+
+	m_added.clear();
+	m_removed.clear();
+	int i = 0, j = 0;
+	while( i < m_active.count() || j < next.count() )
+	{
+		if( j >= next.count() || (i < m_active.count() && m_active[i] < next[j]) )
+			m_removed.append(m_active[i++]);
+		else if( i >= m_active.count() || next[j] < m_active[i] )
+			m_added.append(next[j++]);
+		else
+		{
+			i++;
+			j++;
+		}
+	}
+	m_active = next;
+	return !m_added.isEmpty() || !m_removed.isEmpty();
+}
@@ -0,0 +1,69 @@
+// Copyright (C) T-Solution
+//
+
+//
+// File   : TSVocabulary.h
+// Author : Zhan
+//
+#ifndef TSVOCABULARY_H
+#define TSVOCABULARY_H
+
+#include "TSWebApp.h"
+
+#include <QList>
+
+#ifdef WIN32
+#pragma warning( disable:4251 )
+#endif
+
+class TSGeocoder;
+
+// Buildings the recognizer listens for around a position.
+//
+// The nearest buildings of the catalog and the configured favourites form the
+// active set. It is only computed again once the walker has moved refreshMeters away
+// from where it was last computed, and the difference with the previous set is
+// kept so that the grammar is only touched when the set really changes.
+//
+// Configured by the [grammar] group of app_config.ini.
+class TSWEBAPP_EXPORTS TSVocabulary
+{
+public:
+	explicit TSVocabulary(const TSGeocoder* geocoder);
+
+	void						loadSettings();
+	void						setNearestCount(int count) { m_nearestCount = count; }
+	void						setRefreshMeters(double meters) { m_refreshMeters = meters; }
+	void						setFavourites(const QList<int>& poiIds) { m_favourites = poiIds; }
+
+	// True when the active set changed
+	bool						update(double lat, double lng);
+	// Back to the whole catalog, no position known
+	void						reset();
+
+	// False until the first position, the whole catalog is then active
+	bool						isBiased() const { return m_hasCenter; }
+	const QList<int>&			active() const { return m_active; }		// sorted poi ids
+	const QList<int>&			added() const { return m_added; }		// by the last change
+	const QList<int>&			removed() const { return m_removed; }
+
+private:
+	bool						select(double lat, double lng);
+
+	const TSGeocoder			*m_geocoder;
+	int							m_nearestCount;
+	double						m_refreshMeters;
+	QList<int>					m_favourites;
+	bool						m_hasCenter;
+	double						m_centerLat;	// where the set was last computed
+	double						m_centerLng;
+	QList<int>					m_active;
+	QList<int>					m_added;
+	QList<int>					m_removed;
+};
+
+#ifdef WIN32
+#pragma warning( default:4251 )
+#endif
+
+#endif // TSVOCABULARY_H
@@ -8,14 +8,28 @@ var currentDirections = null;
 var gGreenIcon, gRedIcon;
 var srcMarker, dstMarker, srcPos, dstPos;
 var routeSteps = [];
+var hereMarker = null, positionWatch = null;
+var isochronePolygons = [];
+var tourOverlays = [];
+var alternativeLine = null;
+var nativeLines = [];		// {line, points} of the native walks drawn, redrawn at each zoom
+var zoomWatchedMap = null;
+var CAMPUS_MAP_TYPE = 'campus';	// drawn from the vector tiles of the application, also offline
+var CAMPUS_TILE_URL = 'http://vectortiles.speechnav/v';	// answered by the application from its tile file, never by the network
+var campusTiles = {};		// 'zoom/x/y' -> {loaded, tile, waiting callbacks}
 
 function initGMap() {
   var myOptions = {
     zoom: 15,
     center: new google.maps.LatLng(40.4445,-79.957155),
-    mapTypeId: google.maps.MapTypeId.ROADMAP
+    mapTypeId: google.maps.MapTypeId.ROADMAP,
+    mapTypeControlOptions: {
+      mapTypeIds: [google.maps.MapTypeId.ROADMAP, google.maps.MapTypeId.SATELLITE, CAMPUS_MAP_TYPE]
+    }
   }
   map = new google.maps.Map(document.getElementById("map_canvas"), myOptions);
+  addCampusMap(map);
+  window.addEventListener('offline', function() { map.setMapTypeId(CAMPUS_MAP_TYPE); }, false);
   
   // Check for geolocation support
 	if(navigator.geolocation) {
@@ -23,11 +37,13 @@ function initGMap() {
 		navigator.geolocation.getCurrentPosition(function(position) {
 				myOptions.center = new google.maps.LatLng(position.coords.latitude, position.coords.longitude);
 				map = new google.maps.Map(document.getElementById("map_canvas"), myOptions);
+				addCampusMap(map);
 			}, function(){});			
 	}
 	else
 	{
 		map = new google.maps.Map(document.getElementById("map_canvas"), myOptions);
+		addCampusMap(map);
 	}
 	
 	geocoder = new google.maps.Geocoder(); 
@@ -61,59 +77,10 @@ function initGMap() {
   // Source auto complete
   $(function() {
        $("#route_source").autocomplete({
-       
-         source: function(request, response) {
-
-		         if (geocoder == null){
-		           geocoder = new google.maps.Geocoder();
-		         }
-             geocoder.geocode( {'address': request.term }, function(results, status) {
-               if (status == google.maps.GeocoderStatus.OK) {
-
-                  var searchLoc = results[0].geometry.location;
-               		var lat = results[0].geometry.location.lat();
-                  var lng = results[0].geometry.location.lng();
-                  var latlng = new google.maps.LatLng(lat, lng);
-                  var bounds = results[0].geometry.bounds;
-
-                  geocoder.geocode({'latLng': latlng}, function(results1, status1) {
-                      if (status1 == google.maps.GeocoderStatus.OK) {
-                        if (results1[1]) {
-                         response($.map(results1, function(loc) {
-                        return {
-                            label  : loc.formatted_address,
-                            value  : loc.formatted_address,
-                            bounds : loc.geometry.bounds,
-                            position	: new google.maps.LatLng(loc.geometry.location.lat(), 																					loc.geometry.location.lng()) 
-                          }
-                        }));
-                        }
-                      }
-                    });
-            }
-            });
-         },
+         source: addressSource,
+         close: cancelAutocomplete,
          select: function(event,ui){
-			      var position = ui.item.position;
-			      var label = ui.item.label;
-			      var bounds = ui.item.bounds;
-			
-						srcPos =  position;
-
-						if (bounds){
-							if(dstPos) bounds.extend(dstPos);
-			       	map.fitBounds(bounds);
-			      }
-			      map.panTo(position);
-			      
-			      if(srcMarker)
-			      {
-			      	srcMarker.setMap(null);
-			      	srcMarker = null;
-			      }
-			      srcMarker = new google.maps.Marker({
-			        position: position,
-			        icon: gGreenAIcon, shadow: null, map: map});				      
+			      placeEndpoint(ui.item.position, ui.item.bounds, true);
          }
        });
    });
@@ -122,58 +89,10 @@ function initGMap() {
    // Destination auto complete
    $(function() {
        $("#route_destination").autocomplete({
-       
-         source: function(request, response) {
-
-		         if (geocoder == null){
-		           geocoder = new google.maps.Geocoder();
-		         }
-             geocoder.geocode( {'address': request.term }, function(results, status) {
-               if (status == google.maps.GeocoderStatus.OK) {
-
-                  var searchLoc = results[0].geometry.location;
-               var lat = results[0].geometry.location.lat();
-                  var lng = results[0].geometry.location.lng();
-                  var latlng = new google.maps.LatLng(lat, lng);
-                  var bounds = results[0].geometry.bounds;
-
-                  geocoder.geocode({'latLng': latlng}, function(results1, status1) {
-                      if (status1 == google.maps.GeocoderStatus.OK) {
-                        if (results1[1]) {
-                         response($.map(results1, function(loc) {
-                        return {
-                            label  : loc.formatted_address,
-                            value  : loc.formatted_address,
-                            bounds   : loc.geometry.bounds,
-                            position	: new google.maps.LatLng(loc.geometry.location.lat(), 																					loc.geometry.location.lng())
-                          }
-                        }));
-                        }
-                      }
-                    });
-            }
-            });
-         },
+         source: addressSource,
+         close: cancelAutocomplete,
          select: function(event,ui){
-			      var position = ui.item.position;
-			      var label = ui.item.label;
-			      var bounds = ui.item.bounds;
-			
-						dstPos = position;
-						if (bounds){
-							if(srcPos) bounds.extend(srcPos);
-			       	map.fitBounds(bounds);
-			      }
-			      map.panTo(position);
-			      
-			      if(dstMarker)
-			      {
-			      	dstMarker.setMap(null);
-			      	dstMarker = null;
-			      }
-			      dstMarker = new google.maps.Marker({
-			        position: position,
-			        icon: gGreenBIcon, shadow: null, map: map});	
+			      placeEndpoint(ui.item.position, ui.item.bounds, false);
          }
        });
    });
@@ -203,10 +122,27 @@ function calcRoute() {
       	dstMarker = null;
       }
       
+      clearAlternative();
+      directionsDisplay.setMap(map);
       directionsDisplay.setDirections(response);
       
       routeSteps = [];
-      if(response.routes.length > 0 
+      
+      // Walks between catalog buildings are described by the application, ready to be spoken
+      var nativeSteps = [];
+      try {
+      	if( window.tsWebProxyObject )
+      		nativeSteps = tsWebProxyObject.routeSteps(start, end);
+      }
+      catch(e) {
+      }
+      
+      if( nativeSteps.length > 0 )
+      {
+      	for( var k = 0; k < nativeSteps.length; k++ )
+      		routeSteps.push(nativeSteps[k].speech || nativeSteps[k].text);
+      }
+      else if(response.routes.length > 0 
       		&& response.routes[0].legs.length > 0)
       {
       	for( var i = 0; i < response.routes[0].legs.length; i++ )
@@ -264,57 +200,155 @@ function clearRoute() {
     $("#directions_panel").slideUp("fast");
 }
 
+// Address box completion: the application answers from its building catalog,
+// Google geocoding is only used when the page runs outside of it
+var pendingAutocomplete = null;
+
+function addressSource(request, response)
+{
+	try {
+		if( window.tsWebProxyObject )
+		{
+			// A newer keystroke supersedes the request still waiting for its answer
+			if( pendingAutocomplete )
+				pendingAutocomplete.response([]);
+			pendingAutocomplete = { id: tsWebProxyObject.autocomplete(request.term, 8), response: response };
+			return;
+		}
+	}
+	catch(e) {
+	}
+	googleAddressSource(request, response);
+}
+
+function onAutocompleteReady(id, items)
+{
+	if( !pendingAutocomplete || pendingAutocomplete.id != id )
+		return;
+		
+	var response = pendingAutocomplete.response;
+	pendingAutocomplete = null;
+	response($.map(items, function(item) {
+		return {
+			label    : item.label,
+			value    : item.value,
+			bounds   : null,
+			position : new google.maps.LatLng(item.lat, item.lng)
+		}
+	}));
+}
+
+function cancelAutocomplete()
+{
+	if( pendingAutocomplete )
+	{
+		pendingAutocomplete.response([]);
+		pendingAutocomplete = null;
+	}
+	try {
+		if( window.tsWebProxyObject )
+			tsWebProxyObject.cancelAutocomplete();
+	}
+	catch(e) {
+	}
+}
+
+function googleAddressSource(request, response)
+{
+   if (geocoder == null){
+     geocoder = new google.maps.Geocoder();
+   }
+   geocoder.geocode( {'address': request.term }, function(results, status) {
+     if (status == google.maps.GeocoderStatus.OK) {
+        var lat = results[0].geometry.location.lat();
+        var lng = results[0].geometry.location.lng();
+        var latlng = new google.maps.LatLng(lat, lng);
+
+        geocoder.geocode({'latLng': latlng}, function(results1, status1) {
+            if (status1 == google.maps.GeocoderStatus.OK) {
+              if (results1[1]) {
+               response($.map(results1, function(loc) {
+              return {
+                  label  : loc.formatted_address,
+                  value  : loc.formatted_address,
+                  bounds : loc.geometry.bounds,
+                  position	: new google.maps.LatLng(loc.geometry.location.lat(), loc.geometry.location.lng()) 
+                }
+              }));
+              }
+            }
+          });
+      }
+   });
+}
+
+// Show a resolved source or destination on the map
+function placeEndpoint(latlng, bounds, is_src)
+{
+	if(is_src)
+		srcPos = latlng;
+	else
+		dstPos = latlng;
+		
+	if (bounds){
+			if(srcPos) bounds.extend(srcPos);
+			if(dstPos) bounds.extend(dstPos);
+     	map.fitBounds(bounds);
+  }
+  map.panTo(latlng);
+  
+  if(is_src)
+  {
+  	if(srcMarker)
+  	{
+    	srcMarker.setMap(null);
+    	srcMarker = null;
+  	}
+  	srcMarker = new google.maps.Marker({
+					        position: latlng,
+					        icon: gGreenAIcon, shadow: null, map: map});
+  }
+     
+  if(!is_src)
+  {
+  	if(dstMarker)
+  	{
+    	dstMarker.setMap(null);
+    	dstMarker = null;
+  	}
+  	dstMarker = new google.maps.Marker({
+					        position: latlng,
+					        icon: gGreenBIcon, shadow: null, map: map});	
+  }
+}
+
 function geoCode(addr, is_src)
 {
+	// Catalog addresses are resolved by the application, no network round trip
+	try {
+		if( window.tsWebProxyObject )
+		{
+			var found = tsWebProxyObject.geocode(addr);
+			// A building on the same street is only a guess, Google knows the address
+			if( found && found.lat !== undefined && found.match != 'street' )
+			{
+				placeEndpoint(new google.maps.LatLng(found.lat, found.lng), null, is_src);
+				return;
+			}
+		}
+	}
+	catch(e) {
+	}
+	
 	 if (geocoder == null){
      geocoder = new google.maps.Geocoder();
    }
    
    geocoder.geocode( {'address': addr }, function(results, status) {
      if (status == google.maps.GeocoderStatus.OK) {
-
-        var searchLoc = results[0].geometry.location;
      		var lat = results[0].geometry.location.lat();
         var lng = results[0].geometry.location.lng();
-        var latlng = new google.maps.LatLng(lat, lng);
-        var bounds = results[0].geometry.bounds;
-				
-				if(is_src)
-					srcPos = latlng;
-				else
-					dstPos = latlng;
-					
-				if (bounds){
-						if(srcPos) bounds.extend(srcPos);
-						if(dstPos) bounds.extend(dstPos);
-		       	map.fitBounds(bounds);
-		    }
-		    map.panTo(latlng);
-		    
-		    if(is_src)
-	      {
-	      	if(srcMarker)
-	      	{
-		      	srcMarker.setMap(null);
-		      	srcMarker = null;
-	      	}
-	      	srcMarker = new google.maps.Marker({
-								        position: latlng,
-								        icon: gGreenAIcon, shadow: null, map: map});
-	      }
-	         
-	      if(!is_src)
-	      {
-	      	if(dstMarker)
-	      	{
-		      	dstMarker.setMap(null);
-		      	dstMarker = null;
-	      	}
-	      	dstMarker = new google.maps.Marker({
-								        position: latlng,
-								        icon: gGreenBIcon, shadow: null, map: map});	
-	      }
-	      
+        placeEndpoint(new google.maps.LatLng(lat, lng), results[0].geometry.bounds, is_src);
       }
    });     
 }
@@ -350,6 +384,8 @@ $(document).ready(function(){
 	
 	$("#get_direction").bind('click', calcRoute);
 	$("#clear_addr").bind('click', clearRoute);
+	$("#plan_tour").bind('click', planTour);
+	$("#route_profile").bind('change', changeProfile);
 	
 	// Help info
 	$("#help_info_panel").html('<br><span style="color:green;"><h5>Say "Set Destination" Command.</h4></span>');
@@ -363,6 +399,19 @@ $(document).ready(function(){
 			tsWebProxyObject.RouteStart.connect(startRoute);
 			tsWebProxyObject.RouteStop.connect(stopRoute);
 			tsWebProxyObject.UNRECOGNIZED.connect(onError);
+			tsWebProxyObject.AutocompleteReady.connect(onAutocompleteReady);
+			tsWebProxyObject.StepReached.connect(onStepReached);
+			tsWebProxyObject.PositionUpdated.connect(onPositionUpdated);
+			tsWebProxyObject.Arrived.connect(onArrived);
+			tsWebProxyObject.Rerouted.connect(onRerouted);
+			tsWebProxyObject.GeofenceEntered.connect(onGeofenceEntered);
+			tsWebProxyObject.WhereAmI.connect(whereAmI);
+			tsWebProxyObject.ReachRequested.connect(whatCanIReach);
+			tsWebProxyObject.ReachableReady.connect(drawIsochrone);
+			tsWebProxyObject.FacilityRequested.connect(findFacility);
+			tsWebProxyObject.FacilityFound.connect(onFacilityFound);
+			tsWebProxyObject.AlternativeRoute.connect(onAlternativeRoute);
+			tsWebProxyObject.ProfileChanged.connect(onProfileChanged);
 		}
 	}
 	catch(e) {
@@ -370,11 +419,14 @@ $(document).ready(function(){
 	
 });
 
-function setSource(bldg, src)
+function setSource(bldg, src, lat, lng)
 {
 	 $("#route_source").val(src);
    //$("#route_source").autocomplete('search', src);
-   geoCode(src, true);
+   if( isFinite(lat) && isFinite(lng) )
+   	placeEndpoint(new google.maps.LatLng(lat, lng), null, true);
+   else
+   	geoCode(src, true);
    $("#src_bldg_name").text(bldg);
    
    // Help info
@@ -382,11 +434,14 @@ function setSource(bldg, src)
 
 }
 
-function setDestination(bldg, dst)
+function setDestination(bldg, dst, lat, lng)
 {
 	$("#route_destination").val(dst);
 	//$("#route_destination").autocomplete('search', dst);
-	geoCode(dst, false);
+	if( isFinite(lat) && isFinite(lng) )
+		placeEndpoint(new google.maps.LatLng(lat, lng), null, false);
+	else
+		geoCode(dst, false);
 	$("#dst_bldg_name").text(bldg);
 	
 	// Help info
@@ -396,9 +451,29 @@ function setDestination(bldg, dst)
 
 function startRoute()
 {
-	for( var i = 0; i < routeSteps.length; i++)
+	// The native tracker speaks each step when the walker reaches it
+	var guided = false;
+	try {
+		guided = tsWebProxyObject.startGuidance($("#route_source").val(), $("#route_destination").val());
+	}
+	catch(e) {
+	}
+	
+	if( guided )
+	{
+		if( navigator.geolocation && positionWatch == null )
+		{
+			positionWatch = navigator.geolocation.watchPosition(function(position) {
+					tsWebProxyObject.updatePosition(position.coords.latitude, position.coords.longitude, position.coords.accuracy);
+				}, function(){}, { enableHighAccuracy: true });
+		}
+	}
+	else
 	{
-		tsWebProxyObject.speak(routeSteps[i]);
+		for( var i = 0; i < routeSteps.length; i++)
+		{
+			tsWebProxyObject.speak(routeSteps[i]);
+		}
 	}
 	
 	// Help info
@@ -406,8 +481,591 @@ function startRoute()
 
 }
 
+function stopGuidance()
+{
+	try {
+		tsWebProxyObject.stopGuidance();
+	}
+	catch(e) {
+	}
+	
+	if( positionWatch != null )
+	{
+		navigator.geolocation.clearWatch(positionWatch);
+		positionWatch = null;
+	}
+	
+	if( hereMarker )
+	{
+		hereMarker.setMap(null);
+		hereMarker = null;
+	}
+}
+
+function onStepReached(index, text)
+{
+	$("#help_info_panel").html('<br><span style="color:green;"><h5>' + text + '</h4></span>');
+}
+
+function onPositionUpdated(lat, lng)
+{
+	var pos = new google.maps.LatLng(lat, lng);
+	if( !hereMarker )
+	{
+		hereMarker = new google.maps.Marker({
+			position: pos,
+			map: map,
+			title: "You are here"
+		});
+	}
+	else
+		hereMarker.setPosition(pos);
+}
+
+// The Google directions on the map no longer match the walk
+function onRerouted()
+{
+	if( directionsDisplay )
+	{
+		directionsDisplay.setMap(null);
+	}
+	$("#directions_panel").slideUp("fast");
+}
+
+function onGeofenceEntered(poiId, kind, name)
+{
+	if( kind == "approach" )
+		$("#help_info_panel").html('<br><span style="color:green;"><h5>Approaching ' + name + '</h4></span>');
+	else if( kind == "entrance" )
+		$("#help_info_panel").html('<br><span style="color:green;"><h5>Entrance of ' + name + '</h4></span>');
+	else
+		$("#help_info_panel").html('<br><span style="color:green;"><h5>At ' + name + '</h4></span>');
+}
+
+// Asked by the voice command when no recent position is known natively
+function whereAmI()
+{
+	if( !navigator.geolocation )
+	{
+		tsWebProxyObject.speak("Your position is unknown.");
+		return;
+	}
+	
+	navigator.geolocation.getCurrentPosition(function(position) {
+			var text = tsWebProxyObject.describePosition(position.coords.latitude, position.coords.longitude);
+			$("#help_info_panel").html('<br><span style="color:green;"><h5>' + text + '</h4></span>');
+			onPositionUpdated(position.coords.latitude, position.coords.longitude);
+		}, function() {
+			tsWebProxyObject.speak("Your position is unknown.");
+		});
+}
+
+// Asked by the voice command as well, the bands come back through ReachableReady
+function whatCanIReach()
+{
+	if( !navigator.geolocation )
+	{
+		tsWebProxyObject.speak("Your position is unknown.");
+		return;
+	}
+	
+	navigator.geolocation.getCurrentPosition(function(position) {
+			tsWebProxyObject.announceReach(position.coords.latitude, position.coords.longitude);
+			onPositionUpdated(position.coords.latitude, position.coords.longitude);
+		}, function() {
+			tsWebProxyObject.speak("Your position is unknown.");
+		});
+}
+
+// Asked by the voice command, the answer comes back through SetDestination and FacilityFound
+function findFacility(category)
+{
+	if( !navigator.geolocation )
+	{
+		tsWebProxyObject.speak("Your position is unknown.");
+		return;
+	}
+	
+	navigator.geolocation.getCurrentPosition(function(position) {
+			onPositionUpdated(position.coords.latitude, position.coords.longitude);
+			tsWebProxyObject.announceFacility(position.coords.latitude, position.coords.longitude, category);
+		}, function() {
+			tsWebProxyObject.speak("Your position is unknown.");
+		});
+}
+
+// The walk starts where the walker stands
+function onFacilityFound(facilities)
+{
+	if( hereMarker )
+	{
+		var here = hereMarker.getPosition();
+		setSource("Your position", here.lat() + "," + here.lng(), here.lat(), here.lng());
+	}
+	
+	var names = [];
+	for( var i = 0; i < facilities.length; i++ )
+		names.push(facilities[i].name + " (" + Math.max(1, Math.round(facilities[i].seconds / 60)) + " min)");
+	$("#help_info_panel").html('<br><span style="color:green;"><h5>' + names.join(", ") + '. Say <strong>"Get Path"</strong> Command.</h4></span>');
+}
+
+function clearAlternative()
+{
+	if( alternativeLine )
+	{
+		alternativeLine.setMap(null);
+		alternativeLine = null;
+	}
+}
+
+// {points, levels} of a native walk -> [{position, level}], both strings read in one pass
+function decodePath(path)
+{
+	var text = path.points, levels = path.levels;
+	var points = [];
+	var pos = 0, lat = 0, lng = 0;
+	function nextValue()
+	{
+		var value = 0, shift = 0, chunk;
+		do
+		{
+			chunk = text.charCodeAt(pos++) - 63;
+			value |= (chunk & 0x1f) << shift;
+			shift += 5;
+		} while( chunk >= 0x20 );
+		return (value & 1) ? ~(value >> 1) : (value >> 1);
+	}
+	while( pos < text.length )
+	{
+		lat += nextValue();
+		lng += nextValue();
+		points.push({ position: new google.maps.LatLng(lat * 1e-5, lng * 1e-5), level: levels.charCodeAt(points.length) - 63 });
+	}
+	return points;
+}
+
+// Points of a decoded walk shown at a zoom, the simplification was done by the application
+function visiblePath(points, zoom)
+{
+	var path = [];
+	for( var i = 0; i < points.length; i++ )
+	{
+		if( points[i].level <= zoom )
+			path.push(points[i].position);
+	}
+	return path;
+}
+
+function onZoomChanged()
+{
+	var zoom = map.getZoom();
+	var drawn = [];
+	for( var i = 0; i < nativeLines.length; i++ )
+	{
+		if( nativeLines[i].line.getMap() )
+		{
+			nativeLines[i].line.setPath(visiblePath(nativeLines[i].points, zoom));
+			drawn.push(nativeLines[i]);
+		}
+	}
+	nativeLines = drawn;
+}
+
+// Polyline of a native walk, its bounds are added to bounds
+function nativeLine(path, options, bounds)
+{
+	if( zoomWatchedMap != map )
+	{
+		google.maps.event.addListener(map, 'zoom_changed', onZoomChanged);
+		zoomWatchedMap = map;
+	}
+	var points = decodePath(path);
+	for( var i = 0; i < points.length; i++ )
+		bounds.extend(points[i].position);
+	options.path = visiblePath(points, map.getZoom());
+	options.map = map;
+	var line = new google.maps.Polyline(options);
+	nativeLines.push({ line: line, points: points });
+	return line;
+}
+
+// Map type of the campus: each tile is drawn on a canvas from the vector tile the application cut
+function CampusMapType()
+{
+	this.tileSize = new google.maps.Size(256, 256);
+	this.minZoom = 0;
+	this.maxZoom = 21;
+	this.name = 'Campus';
+	this.alt = 'Campus paths and buildings, available offline';
+}
+
+CampusMapType.prototype.getTile = function(coord, zoom, ownerDocument)
+{
+	var canvas = ownerDocument.createElement('canvas');
+	canvas.width = 256;
+	canvas.height = 256;
+	var ctx = canvas.getContext('2d');
+	ctx.fillStyle = '#f2efe9';
+	ctx.fillRect(0, 0, 256, 256);
+	findCampusTile(zoom, coord.x, coord.y, 0, function(tile, up) {
+		drawCampusTile(ctx, coord, zoom, tile, up);
+	});
+	return canvas;
+};
+
+function addCampusMap(m)
+{
+	m.mapTypes.set(CAMPUS_MAP_TYPE, new CampusMapType());
+	if( !navigator.onLine )
+		m.setMapTypeId(CAMPUS_MAP_TYPE);
+}
+
+// Past the deepest tiles cut, or where a tile is missing, the closest parent tile up levels above is scaled up
+function findCampusTile(zoom, x, y, up, done)
+{
+	fetchVectorTile(zoom - up, x >> up, y >> up, function(tile) {
+		if( tile )
+			done(tile, up);
+		else if( up < Math.min(zoom, 6) )
+			findCampusTile(zoom, x, y, up + 1, done);
+	});
+}
+
+// Vector tile of the application handed to done once fetched, null if there is none; each tile is fetched once
+function fetchVectorTile(zoom, x, y, done)
+{
+	var key = zoom + '/' + x + '/' + y;
+	var entry = campusTiles[key];
+	if( entry && entry.loaded )
+	{
+		done(entry.tile);
+		return;
+	}
+	if( entry )
+	{
+		entry.waiting.push(done);
+		return;
+	}
+	entry = campusTiles[key] = { loaded: false, tile: null, waiting: [done] };
+	
+	var request = new XMLHttpRequest();
+	request.open('GET', CAMPUS_TILE_URL + '?z=' + zoom + '&x=' + x + '&y=' + y, true);
+	var binary = 'responseType' in request;
+	if( binary )
+		request.responseType = 'arraybuffer';
+	else
+		request.overrideMimeType('text/plain; charset=x-user-defined');		// each byte in the low half of a character
+	request.onreadystatechange = function() {
+		if( request.readyState != 4 )
+			return;
+		entry.loaded = true;
+		try {
+			if( request.status == 200 )
+				entry.tile = readVectorTile(binary ? new Uint8Array(request.response) : textBytes(request.responseText));
+		}
+		catch(e) {
+			entry.tile = null;
+		}
+		for( var i = 0; i < entry.waiting.length; i++ )
+			entry.waiting[i](entry.tile);
+		entry.waiting = [];
+	};
+	request.send(null);
+}
+
+function textBytes(text)
+{
+	var bytes = [];
+	for( var i = 0; i < text.length; i++ )
+		bytes.push(text.charCodeAt(i) & 0xff);
+	return bytes;
+}
+
+// UTF-8 bytes from start to end
+function utf8Text(bytes, start, end)
+{
+	var escaped = '';
+	for( var i = start; i < end; i++ )
+		escaped += (bytes[i] < 16 ? '%0' : '%') + bytes[i].toString(16);
+	try {
+		return decodeURIComponent(escaped);
+	}
+	catch(e) {
+		return '';
+	}
+}
+
+// Bytes of a vector tile -> {extent, features: [{kind, flags, name, points}]}, null if empty
+function readVectorTile(bytes)
+{
+	if( !bytes.length || bytes[0] != 1 )
+		return null;
+	
+	var pos = 1;
+	function varint()
+	{
+		var value = 0, scale = 1, b;
+		do
+		{
+			b = bytes[pos++];
+			value += (b & 0x7f) * scale;
+			scale *= 128;
+		} while( b & 0x80 );
+		return value;
+	}
+	function delta()
+	{
+		var v = varint();
+		return (v % 2) ? -(v + 1) / 2 : v / 2;
+	}
+	
+	var tile = { extent: varint(), features: [] };
+	var names = [];
+	var count = varint();
+	for( var i = 0; i < count; i++ )
+	{
+		var length = varint();
+		names.push(utf8Text(bytes, pos, pos + length));
+		pos += length;
+	}
+	count = varint();
+	for( var f = 0; f < count; f++ )
+	{
+		var feature = { kind: bytes[pos++], flags: varint(), points: [] };
+		var nameIndex = varint();
+		feature.name = nameIndex > 0 ? names[nameIndex - 1] : '';
+		var n = varint(), px = 0, py = 0;
+		for( var k = 0; k < n; k++ )
+		{
+			px += delta();
+			py += delta();
+			feature.points.push([px, py]);
+		}
+		tile.features.push(feature);
+	}
+	return tile;
+}
+
+// Tile up levels above the zoom drawn over its part of the canvas
+function drawCampusTile(ctx, coord, zoom, tile, up)
+{
+	var span = 1 << up;
+	var scale = 256 * span / tile.extent;
+	var left = (coord.x % span) * 256, top = (coord.y % span) * 256;
+	function trace(points)
+	{
+		ctx.beginPath();
+		for( var i = 0; i < points.length; i++ )
+		{
+			var x = points[i][0] * scale - left, y = points[i][1] * scale - top;
+			if( i == 0 )
+				ctx.moveTo(x, y);
+			else
+				ctx.lineTo(x, y);
+		}
+	}
+	
+	var width = zoom >= 17 ? 4 : (zoom >= 15 ? 2.5 : 1.5);
+	ctx.lineCap = 'round';
+	ctx.lineJoin = 'round';
+	ctx.font = '11px sans-serif';
+	ctx.textAlign = 'center';
+	for( var i = 0; i < tile.features.length; i++ )
+	{
+		var feature = tile.features[i];
+		if( feature.kind == 2 )				// building
+		{
+			trace(feature.points);
+			ctx.closePath();
+			ctx.fillStyle = '#d9d0c9';
+			ctx.fill();
+			ctx.strokeStyle = '#bfb3a8';
+			ctx.lineWidth = 1;
+			ctx.stroke();
+		}
+		else if( feature.kind == 1 )		// way: 1 steps, 2 covered, 4 indoor
+		{
+			trace(feature.points);
+			if( feature.flags & 4 )
+			{
+				ctx.strokeStyle = '#b0bec5';
+				ctx.lineWidth = width / 2;
+			}
+			else if( feature.flags & 1 )
+			{
+				ctx.strokeStyle = '#e07b39';
+				ctx.lineWidth = width / 2;
+			}
+			else
+			{
+				ctx.strokeStyle = (feature.flags & 2) ? '#c9b8e8' : '#ffffff';
+				ctx.lineWidth = feature.name ? width * 1.5 : width;
+			}
+			ctx.stroke();
+		}
+		else if( feature.kind == 3 && feature.name )	// label
+		{
+			ctx.fillStyle = '#333333';
+			ctx.fillText(feature.name, feature.points[0][0] * scale - left, feature.points[0][1] * scale - top);
+		}
+	}
+}
+
+// "Next route": the native walk replaces the Google one until the next "Get Path"
+function onAlternativeRoute(route)
+{
+	clearAlternative();
+	if( directionsDisplay )
+		directionsDisplay.setMap(null);
+	
+	var bounds = new google.maps.LatLngBounds();
+	alternativeLine = nativeLine(route.path, {
+		strokeColor: "#6a1b9a",
+		strokeOpacity: 0.8,
+		strokeWeight: 5
+	}, bounds);
+	if( !bounds.isEmpty() )
+		map.fitBounds(bounds);
+	
+	routeSteps = route.steps;
+	var html = '<h5>Route ' + (route.index + 1) + ' of ' + route.count + '</h5><ol>';
+	for( var i = 0; i < route.steps.length; i++ )
+		html += '<li>' + route.steps[i] + '</li>';
+	html += '</ol>';
+	$("#directions_panel").html(html).slideDown("fast");
+	$("#help_info_panel").html('<br><span style="color:green;"><h5>Say <strong>"Start Route"</strong> or "Next Route" Command.</h4></span>');
+}
+
+function clearTour()
+{
+	for( var i = 0; i < tourOverlays.length; i++ )
+		tourOverlays[i].setMap(null);
+	tourOverlays = [];
+}
+
+// Picked on the page, the application speaks the profile and answers with ProfileChanged
+function changeProfile()
+{
+	if( window.tsWebProxyObject )
+		tsWebProxyObject.setProfile($("#route_profile").val());
+}
+
+// Spoken or picked profile: the steps of the current walk are read again
+function onProfileChanged(name)
+{
+	$("#route_profile").val(name);
+	if( $("#route_source").val().length > 0 && $("#route_destination").val().length > 0 )
+		calcRoute();
+}
+
+// Stops of the tour box in the order the application found, the first one typed starts the tour
+function planTour()
+{
+	var names = $("#tour_stops").val().split(";");
+	var stops = [];
+	for( var i = 0; i < names.length; i++ )
+	{
+		var name = $.trim(names[i]);
+		if( name.length > 0 )
+			stops.push(name);
+	}
+	if( stops.length < 2 )
+		return;
+	
+	var tour = tsWebProxyObject.planTour(stops, $("#tour_return").is(":checked"));
+	clearTour();
+	if( !tour.stops )
+	{
+		$("#help_info_panel").html('<br><span style="color:red;"><h5>These buildings cannot be visited on foot.</h4></span>');
+		return;
+	}
+	
+	var bounds = new google.maps.LatLngBounds();
+	for( var k = 0; k < tour.legs.length; k++ )
+	{
+		tourOverlays.push(nativeLine(tour.legs[k].path, {
+			strokeColor: "#1565c0",
+			strokeOpacity: 0.8,
+			strokeWeight: 4
+		}, bounds));
+	}
+	
+	var html = '<ol>';
+	for( var i = 0; i < tour.stops.length; i++ )
+	{
+		tourOverlays.push(new google.maps.Marker({
+			position: new google.maps.LatLng(tour.stops[i].lat, tour.stops[i].lng),
+			map: map,
+			title: (i + 1) + ". " + tour.stops[i].name
+		}));
+		html += '<li>' + tour.stops[i].name + '</li>';
+	}
+	html += '</ol>';
+	$("#directions_panel").html(html + Math.max(1, Math.round(tour.seconds / 60)) + " minutes, " + Math.round(tour.meters) + " meters").slideDown("fast");
+	if( !bounds.isEmpty() )
+		map.fitBounds(bounds);
+}
+
+function clearIsochrone()
+{
+	for( var i = 0; i < isochronePolygons.length; i++ )
+		isochronePolygons[i].setMap(null);
+	isochronePolygons = [];
+}
+
+// Widest band first so that the narrower ones are drawn on top of it
+function drawIsochrone(bands)
+{
+	var colors = ["#2e7d32", "#f9a825", "#c62828"];
+	clearIsochrone();
+	for( var b = bands.length - 1; b >= 0; b-- )
+	{
+		var paths = [];
+		for( var k = 0; k < bands[b].outlines.length; k++ )
+		{
+			var path = [];
+			for( var i = 0; i < bands[b].outlines[k].length; i++ )
+				path.push(new google.maps.LatLng(bands[b].outlines[k][i][0], bands[b].outlines[k][i][1]));
+			paths.push(path);
+		}
+		if( paths.length == 0 )
+			continue;
+		
+		var color = colors[Math.min(b, colors.length - 1)];
+		isochronePolygons.push(new google.maps.Polygon({
+			paths: paths,
+			strokeColor: color,
+			strokeOpacity: 0.8,
+			strokeWeight: 1,
+			fillColor: color,
+			fillOpacity: 0.2,
+			clickable: false,
+			map: map
+		}));
+	}
+	
+	if( bands.length > 0 )
+	{
+		var text = bands[0].pois.length + " buildings within " + Math.round(bands[0].seconds / 60) + " minutes";
+		$("#help_info_panel").html('<br><span style="color:green;"><h5>' + text + '</h4></span>');
+	}
+}
+
+function onArrived()
+{
+	stopGuidance();
+	
+	// Help info
+	$("#help_info_panel").html('<br><span style="color:green;"><h5>Arrived. Say "Set Destination" or "End Route" Command.</h4></span>');
+}
+
 function stopRoute()
 {
+	stopGuidance();
+	clearIsochrone();
+	clearTour();
+	clearAlternative();
+	
 	$("#route_source").val("");
 	$("#route_destination").val("");
 	